@@ -0,0 +1,684 @@
+#include "CollisionWorld.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <numeric>
+#include <utility>
+
+namespace gps {
+
+    // deeper than any hierarchy the binned build makes out of a few million triangles
+    static const int MAX_DEPTH = 128;
+
+    static float surfaceArea(glm::vec3 boundsMin, glm::vec3 boundsMax) {
+
+        glm::vec3 size = glm::max(boundsMax - boundsMin, glm::vec3(0.0f));
+        return 2.0f * (size.x * size.y + size.y * size.z + size.z * size.x);
+    }
+
+    // entry of the segment from + t * motion (t in [0, tMax]) into the box, false if it misses
+    static bool segmentBox(glm::vec3 from, glm::vec3 motion, glm::vec3 boundsMin, glm::vec3 boundsMax, float tMax, float& tEnter) {
+
+        float t0 = 0.0f;
+        float t1 = tMax;
+        for (int axis = 0; axis < 3; axis++) {
+
+            if (std::fabs(motion[axis]) < 1e-12f) {
+                // parallel to the slab, inside it or never
+                if (from[axis] < boundsMin[axis] || from[axis] > boundsMax[axis]) {
+                    return false;
+                }
+                continue;
+            }
+
+            float inverse = 1.0f / motion[axis];
+            float near = (boundsMin[axis] - from[axis]) * inverse;
+            float far = (boundsMax[axis] - from[axis]) * inverse;
+            if (near > far) {
+                std::swap(near, far);
+            }
+            t0 = std::max(t0, near);
+            t1 = std::min(t1, far);
+            if (t0 > t1) {
+                return false;
+            }
+        }
+
+        tEnter = t0;
+        return true;
+    }
+
+    static bool sphereBox(glm::vec3 center, float radius, glm::vec3 boundsMin, glm::vec3 boundsMax) {
+
+        glm::vec3 d = center - glm::clamp(center, boundsMin, boundsMax);
+        return glm::dot(d, d) <= radius * radius;
+    }
+
+    // Ericson, Real-Time Collision Detection 5.1.5
+    static glm::vec3 closestPointTriangle(glm::vec3 p, glm::vec3 a, glm::vec3 b, glm::vec3 c) {
+
+        glm::vec3 ab = b - a;
+        glm::vec3 ac = c - a;
+        glm::vec3 ap = p - a;
+        float d1 = glm::dot(ab, ap);
+        float d2 = glm::dot(ac, ap);
+        if (d1 <= 0.0f && d2 <= 0.0f) {
+            return a;
+        }
+
+        glm::vec3 bp = p - b;
+        float d3 = glm::dot(ab, bp);
+        float d4 = glm::dot(ac, bp);
+        if (d3 >= 0.0f && d4 <= d3) {
+            return b;
+        }
+
+        float vc = d1 * d4 - d3 * d2;
+        if (vc <= 0.0f && d1 >= 0.0f && d3 <= 0.0f) {
+            return a + ab * (d1 / (d1 - d3));
+        }
+
+        glm::vec3 cp = p - c;
+        float d5 = glm::dot(ab, cp);
+        float d6 = glm::dot(ac, cp);
+        if (d6 >= 0.0f && d5 <= d6) {
+            return c;
+        }
+
+        float vb = d5 * d2 - d1 * d6;
+        if (vb <= 0.0f && d2 >= 0.0f && d6 <= 0.0f) {
+            return a + ac * (d2 / (d2 - d6));
+        }
+
+        float va = d3 * d6 - d5 * d4;
+        if (va <= 0.0f && (d4 - d3) >= 0.0f && (d5 - d6) >= 0.0f) {
+            return b + (c - b) * ((d4 - d3) / ((d4 - d3) + (d5 - d6)));
+        }
+
+        float denominator = 1.0f / (va + vb + vc);
+        return a + ab * (vb * denominator) + ac * (vc * denominator);
+    }
+
+    static bool insideTriangle(glm::vec3 p, glm::vec3 a, glm::vec3 b, glm::vec3 c, glm::vec3 normal) {
+
+        const float tolerance = -1e-6f;
+        return glm::dot(glm::cross(b - a, p - a), normal) >= tolerance
+            && glm::dot(glm::cross(c - b, p - b), normal) >= tolerance
+            && glm::dot(glm::cross(a - c, p - c), normal) >= tolerance;
+    }
+
+    // a sphere of the given radius centered on from + t * motion against a point;
+    // a sphere already touching it only stops if it moves closer
+    static bool sweepPoint(glm::vec3 from, glm::vec3 motion, float radius, glm::vec3 point, SweepHit& hit) {
+
+        glm::vec3 m = from - point;
+        float a = glm::dot(motion, motion);
+        float b = 2.0f * glm::dot(motion, m);
+        float c = glm::dot(m, m) - radius * radius;
+
+        if (c < 0.0f) {
+            if (b < -1e-6f * std::sqrt(a) * radius && hit.t > 0.0f) {
+                hit.t = 0.0f;
+                hit.normal = glm::normalize(m);
+                return true;
+            }
+            return false;
+        }
+
+        float discriminant = b * b - 4.0f * a * c;
+        if (a < 1e-12f || discriminant < 0.0f) {
+            return false;
+        }
+
+        float t = (-b - std::sqrt(discriminant)) / (2.0f * a);
+        if (t < 0.0f || t >= hit.t) {
+            return false;
+        }
+        hit.t = t;
+        hit.normal = glm::normalize(from + motion * t - point);
+        return true;
+    }
+
+    // against the edge p0 - p1 (an infinite cylinder, kept where it is between the ends)
+    static bool sweepEdge(glm::vec3 from, glm::vec3 motion, float radius, glm::vec3 p0, glm::vec3 p1, SweepHit& hit) {
+
+        glm::vec3 e = p1 - p0;
+        glm::vec3 m = from - p0;
+        float ee = glm::dot(e, e);
+        float ed = glm::dot(e, motion);
+        float em = glm::dot(e, m);
+
+        float a = ee * glm::dot(motion, motion) - ed * ed;
+        float b = 2.0f * (ee * glm::dot(motion, m) - ed * em);
+        float c = ee * (glm::dot(m, m) - radius * radius) - em * em;
+
+        if (c < 0.0f) {
+            float s = em / ee;
+            if (s >= 0.0f && s <= 1.0f && b < -1e-6f * std::sqrt(std::max(a, 0.0f)) * radius && hit.t > 0.0f) {
+                hit.t = 0.0f;
+                hit.normal = glm::normalize(from - (p0 + e * s));
+                return true;
+            }
+            return false;
+        }
+
+        // moving along the edge, the vertices take care of it
+        float discriminant = b * b - 4.0f * a * c;
+        if (a < 1e-12f * ee || discriminant < 0.0f) {
+            return false;
+        }
+
+        float t = (-b - std::sqrt(discriminant)) / (2.0f * a);
+        if (t < 0.0f || t >= hit.t) {
+            return false;
+        }
+        float s = (em + t * ed) / ee;
+        if (s < 0.0f || s > 1.0f) {
+            return false;
+        }
+        hit.t = t;
+        hit.normal = glm::normalize(from + motion * t - (p0 + e * s));
+        return true;
+    }
+
+    // Fauerby, Improved Collision detection and Response: the face first,
+    // the edges and vertices only if the sphere touches the plane outside the triangle
+    static bool sweepTriangle(glm::vec3 a, glm::vec3 b, glm::vec3 c, glm::vec3 triangleNormal, glm::vec3 from, glm::vec3 motion, float radius, SweepHit& hit) {
+
+        // two sided, the plane faces the sphere
+        glm::vec3 normal = triangleNormal;
+        float distance = glm::dot(normal, from - a);
+        if (distance < 0.0f) {
+            normal = -normal;
+            distance = -distance;
+        }
+        float approach = glm::dot(normal, motion);
+
+        if (distance >= radius) {
+            if (approach >= 0.0f) {
+                return false;
+            }
+            // nothing of the triangle can be touched before its plane is
+            float t = (distance - radius) / -approach;
+            if (t >= hit.t) {
+                return false;
+            }
+            if (insideTriangle(from + motion * t - normal * radius, a, b, c, triangleNormal)) {
+                hit.t = t;
+                hit.normal = normal;
+                return true;
+            }
+        }
+        else if (insideTriangle(from - normal * distance, a, b, c, triangleNormal)) {
+            // already on the face: only the motion into it is stopped
+            if (approach < -1e-6f * glm::length(motion) && hit.t > 0.0f) {
+                hit.t = 0.0f;
+                hit.normal = normal;
+                return true;
+            }
+            return false;
+        }
+
+        bool found = false;
+        found |= sweepEdge(from, motion, radius, a, b, hit);
+        found |= sweepEdge(from, motion, radius, b, c, hit);
+        found |= sweepEdge(from, motion, radius, c, a, hit);
+        found |= sweepPoint(from, motion, radius, a, hit);
+        found |= sweepPoint(from, motion, radius, b, hit);
+        found |= sweepPoint(from, motion, radius, c, hit);
+        return found;
+    }
+
+    void CollisionWorld::addModel(gps::Model3D& model, const glm::mat4& transform) {
+
+        for (gps::Mesh& mesh : model.getMeshes()) {
+            for (size_t i = 0; i + 2 < mesh.indices.size(); i += 3) {
+
+                Triangle triangle;
+                triangle.a = glm::vec3(transform * glm::vec4(mesh.vertices[mesh.indices[i]].Position, 1.0f));
+                triangle.b = glm::vec3(transform * glm::vec4(mesh.vertices[mesh.indices[i + 1]].Position, 1.0f));
+                triangle.c = glm::vec3(transform * glm::vec4(mesh.vertices[mesh.indices[i + 2]].Position, 1.0f));
+
+                glm::vec3 n = glm::cross(triangle.b - triangle.a, triangle.c - triangle.a);
+                float length = glm::length(n);
+                if (length < 1e-8f) {
+                    continue; // degenerate, no face to stand on
+                }
+                triangle.normal = n / length;
+                triangles.push_back(triangle);
+            }
+        }
+    }
+
+    void CollisionWorld::build() {
+
+        nodes.clear();
+        int n = (int)triangles.size();
+        if (n == 0) {
+            return;
+        }
+
+        std::vector<int> order(n);
+        std::iota(order.begin(), order.end(), 0);
+        std::vector<glm::vec3> centroids(n);
+        std::vector<glm::vec3> boxMin(n);
+        std::vector<glm::vec3> boxMax(n);
+        for (int i = 0; i < n; i++) {
+            const Triangle& triangle = triangles[i];
+            centroids[i] = (triangle.a + triangle.b + triangle.c) / 3.0f;
+            boxMin[i] = glm::min(triangle.a, glm::min(triangle.b, triangle.c));
+            boxMax[i] = glm::max(triangle.a, glm::max(triangle.b, triangle.c));
+        }
+
+        nodes.reserve(2 * n / LEAF_TRIANGLES + 1);
+        nodes.push_back({ glm::vec3(0.0f), 0, glm::vec3(0.0f), n });
+
+        std::vector<int> stack;
+        stack.push_back(0);
+        while (!stack.empty()) {
+
+            int index = stack.back();
+            stack.pop_back();
+            int first = nodes[index].first;
+            int count = nodes[index].count;
+
+            glm::vec3 boundsMin = glm::vec3(1e30f);
+            glm::vec3 boundsMax = glm::vec3(-1e30f);
+            glm::vec3 centroidMin = glm::vec3(1e30f);
+            glm::vec3 centroidMax = glm::vec3(-1e30f);
+            for (int i = first; i < first + count; i++) {
+                boundsMin = glm::min(boundsMin, boxMin[order[i]]);
+                boundsMax = glm::max(boundsMax, boxMax[order[i]]);
+                centroidMin = glm::min(centroidMin, centroids[order[i]]);
+                centroidMax = glm::max(centroidMax, centroids[order[i]]);
+            }
+            nodes[index].boundsMin = boundsMin;
+            nodes[index].boundsMax = boundsMax;
+
+            if (count <= LEAF_TRIANGLES) {
+                continue;
+            }
+
+            // ===== BINNED SAH =====
+            // the triangles go in bins by centroid, every bin boundary of every axis is a candidate
+            float bestCost = 1e30f;
+            int bestAxis = -1;
+            int bestSplit = 0;
+            for (int axis = 0; axis < 3; axis++) {
+
+                float extent = centroidMax[axis] - centroidMin[axis];
+                if (extent < 1e-6f) {
+                    continue;
+                }
+                float scale = SAH_BINS / extent;
+
+                int binCount[SAH_BINS] = {};
+                glm::vec3 binMin[SAH_BINS];
+                glm::vec3 binMax[SAH_BINS];
+                for (int b = 0; b < SAH_BINS; b++) {
+                    binMin[b] = glm::vec3(1e30f);
+                    binMax[b] = glm::vec3(-1e30f);
+                }
+                for (int i = first; i < first + count; i++) {
+                    int t = order[i];
+                    int b = std::min(SAH_BINS - 1, (int)((centroids[t][axis] - centroidMin[axis]) * scale));
+                    binCount[b]++;
+                    binMin[b] = glm::min(binMin[b], boxMin[t]);
+                    binMax[b] = glm::max(binMax[b], boxMax[t]);
+                }
+
+                // areas and counts left of every boundary, then right of it
+                float leftArea[SAH_BINS - 1];
+                int leftCount[SAH_BINS - 1];
+                glm::vec3 growMin = glm::vec3(1e30f);
+                glm::vec3 growMax = glm::vec3(-1e30f);
+                int sum = 0;
+                for (int b = 0; b < SAH_BINS - 1; b++) {
+                    sum += binCount[b];
+                    growMin = glm::min(growMin, binMin[b]);
+                    growMax = glm::max(growMax, binMax[b]);
+                    leftCount[b] = sum;
+                    leftArea[b] = sum > 0 ? surfaceArea(growMin, growMax) : 0.0f;
+                }
+
+                growMin = glm::vec3(1e30f);
+                growMax = glm::vec3(-1e30f);
+                sum = 0;
+                for (int b = SAH_BINS - 1; b > 0; b--) {
+                    sum += binCount[b];
+                    growMin = glm::min(growMin, binMin[b]);
+                    growMax = glm::max(growMax, binMax[b]);
+                    float rightArea = sum > 0 ? surfaceArea(growMin, growMax) : 0.0f;
+
+                    float cost = leftArea[b - 1] * leftCount[b - 1] + rightArea * sum;
+                    if (cost < bestCost) {
+                        bestCost = cost;
+                        bestAxis = axis;
+                        bestSplit = b;
+                    }
+                }
+            }
+
+            int middle;
+            if (bestAxis < 0) {
+                // every centroid at the same place, any half will do
+                middle = first + count / 2;
+            }
+            else {
+                float extent = centroidMax[bestAxis] - centroidMin[bestAxis];
+                float scale = SAH_BINS / extent;
+                int* split = std::partition(&order[first], &order[first] + count, [&](int t) {
+                    return std::min(SAH_BINS - 1, (int)((centroids[t][bestAxis] - centroidMin[bestAxis]) * scale)) < bestSplit;
+                });
+                middle = (int)(split - &order[0]);
+                if (middle == first || middle == first + count) {
+                    middle = first + count / 2;
+                }
+            }
+
+            int children = (int)nodes.size();
+            nodes.push_back({ glm::vec3(0.0f), first, glm::vec3(0.0f), middle - first });
+            nodes.push_back({ glm::vec3(0.0f), middle, glm::vec3(0.0f), first + count - middle });
+            nodes[index].first = children;
+            nodes[index].count = 0;
+            stack.push_back(children);
+            stack.push_back(children + 1);
+        }
+
+        // the triangles of a leaf next to each other
+        std::vector<Triangle> sorted(n);
+        for (int i = 0; i < n; i++) {
+            sorted[i] = triangles[order[i]];
+        }
+        triangles.swap(sorted);
+    }
+
+    void CollisionWorld::clear() {
+
+        triangles.clear();
+        nodes.clear();
+        clearDynamic();
+    }
+
+    int CollisionWorld::getTriangleCount() {
+        return (int)triangles.size();
+    }
+
+    int CollisionWorld::getNodeCount() {
+        return (int)nodes.size();
+    }
+
+    void CollisionWorld::clearDynamic() {
+
+        spheres.clear();
+        cellStart.clear();
+        tableSize = 0;
+        maxDynamicRadius = 0.0f;
+    }
+
+    void CollisionWorld::addDynamic(glm::vec3 center, float radius) {
+
+        spheres.push_back({ center, radius });
+        maxDynamicRadius = std::max(maxDynamicRadius, radius);
+    }
+
+    int CollisionWorld::getDynamicCount() {
+        return (int)spheres.size();
+    }
+
+    uint32_t CollisionWorld::bucketOf(int32_t cellX, int32_t cellZ) {
+        return (((uint32_t)cellX * 73856093u) ^ ((uint32_t)cellZ * 19349663u)) & (uint32_t)(tableSize - 1);
+    }
+
+    void CollisionWorld::buildDynamic() {
+
+        int n = (int)spheres.size();
+        if (n == 0) {
+            return;
+        }
+
+        // a sphere spans at most two cells per axis
+        cellSize = std::max(2.0f * maxDynamicRadius, 1.0f);
+        tableSize = 1;
+        while (tableSize < 2 * n) {
+            tableSize <<= 1;
+        }
+
+        // ===== COUNTING SORT by bucket =====
+        cellStart.assign(tableSize + 1, 0);
+        sphereCells.resize(n);
+        for (int i = 0; i < n; i++) {
+            sphereCells[i] = bucketOf((int32_t)std::floor(spheres[i].center.x / cellSize), (int32_t)std::floor(spheres[i].center.z / cellSize));
+            cellStart[sphereCells[i] + 1]++;
+        }
+        for (int b = 0; b < tableSize; b++) {
+            cellStart[b + 1] += cellStart[b];
+        }
+
+        sphereScratch.resize(n);
+        std::vector<int> cursor(cellStart.begin(), cellStart.end() - 1);
+        for (int i = 0; i < n; i++) {
+            sphereScratch[cursor[sphereCells[i]]++] = spheres[i];
+        }
+        spheres.swap(sphereScratch);
+    }
+
+    void CollisionWorld::sweepStatic(glm::vec3 from, glm::vec3 motion, float radius, SweepHit& hit, bool& found) {
+
+        if (nodes.empty()) {
+            return;
+        }
+
+        glm::vec3 grow = glm::vec3(radius);
+        int stack[MAX_DEPTH];
+        int top = 0;
+        stack[top++] = 0;
+
+        while (top > 0) {
+
+            const Node& node = nodes[stack[--top]];
+            float tEnter;
+            if (!segmentBox(from, motion, node.boundsMin - grow, node.boundsMax + grow, hit.t, tEnter)) {
+                continue;
+            }
+
+            if (node.count > 0) {
+                for (int i = node.first; i < node.first + node.count; i++) {
+                    const Triangle& triangle = triangles[i];
+                    found |= sweepTriangle(triangle.a, triangle.b, triangle.c, triangle.normal, from, motion, radius, hit);
+                }
+                continue;
+            }
+
+            // the nearer child on top, its hit cuts the farther one short
+            const Node& left = nodes[node.first];
+            const Node& right = nodes[node.first + 1];
+            float tLeft, tRight;
+            bool hitLeft = segmentBox(from, motion, left.boundsMin - grow, left.boundsMax + grow, hit.t, tLeft);
+            bool hitRight = segmentBox(from, motion, right.boundsMin - grow, right.boundsMax + grow, hit.t, tRight);
+            if (top + 2 > MAX_DEPTH) {
+                continue;
+            }
+            if (hitLeft && hitRight) {
+                if (tLeft <= tRight) {
+                    stack[top++] = node.first + 1;
+                    stack[top++] = node.first;
+                }
+                else {
+                    stack[top++] = node.first;
+                    stack[top++] = node.first + 1;
+                }
+            }
+            else if (hitLeft) {
+                stack[top++] = node.first;
+            }
+            else if (hitRight) {
+                stack[top++] = node.first + 1;
+            }
+        }
+    }
+
+    void CollisionWorld::sweepDynamic(glm::vec3 from, glm::vec3 motion, float radius, SweepHit& hit, bool& found) {
+
+        if (tableSize == 0) {
+            return;
+        }
+
+        float reach = radius + maxDynamicRadius;
+        glm::vec3 to = from + motion;
+        int32_t x0 = (int32_t)std::floor((std::min(from.x, to.x) - reach) / cellSize);
+        int32_t x1 = (int32_t)std::floor((std::max(from.x, to.x) + reach) / cellSize);
+        int32_t z0 = (int32_t)std::floor((std::min(from.z, to.z) - reach) / cellSize);
+        int32_t z1 = (int32_t)std::floor((std::max(from.z, to.z) + reach) / cellSize);
+
+        auto sweepRange = [&](int begin, int end) {
+            for (int i = begin; i < end; i++) {
+                found |= sweepPoint(from, motion, radius + spheres[i].radius, spheres[i].center, hit);
+            }
+        };
+
+        // a long move covers more cells than there are buckets
+        if ((int64_t)(x1 - x0 + 1) * (z1 - z0 + 1) > tableSize) {
+            sweepRange(0, (int)spheres.size());
+            return;
+        }
+
+        std::vector<uint32_t> visited;
+        for (int32_t z = z0; z <= z1; z++) {
+            for (int32_t x = x0; x <= x1; x++) {
+                uint32_t bucket = bucketOf(x, z);
+                if (std::find(visited.begin(), visited.end(), bucket) != visited.end()) {
+                    continue;
+                }
+                visited.push_back(bucket);
+                sweepRange(cellStart[bucket], cellStart[bucket + 1]);
+            }
+        }
+    }
+
+    bool CollisionWorld::sweepSphere(glm::vec3 from, glm::vec3 to, float radius, SweepHit& hit) {
+
+        hit.t = 1.0f;
+        hit.normal = glm::vec3(0.0f, 1.0f, 0.0f);
+        bool found = false;
+
+        glm::vec3 motion = to - from;
+        sweepStatic(from, motion, radius, hit, found);
+        sweepDynamic(from, motion, radius, hit, found);
+        return found;
+    }
+
+    glm::vec3 CollisionWorld::pushOut(glm::vec3 center, float radius) {
+
+        for (int iteration = 0; iteration < MAX_SLIDES; iteration++) {
+
+            bool moved = false;
+
+            if (!nodes.empty()) {
+                int stack[MAX_DEPTH];
+                int top = 0;
+                stack[top++] = 0;
+                while (top > 0) {
+
+                    const Node& node = nodes[stack[--top]];
+                    if (!sphereBox(center, radius, node.boundsMin, node.boundsMax)) {
+                        continue;
+                    }
+                    if (node.count == 0) {
+                        if (top + 2 <= MAX_DEPTH) {
+                            stack[top++] = node.first;
+                            stack[top++] = node.first + 1;
+                        }
+                        continue;
+                    }
+
+                    for (int i = node.first; i < node.first + node.count; i++) {
+                        const Triangle& triangle = triangles[i];
+                        glm::vec3 closest = closestPointTriangle(center, triangle.a, triangle.b, triangle.c);
+                        glm::vec3 d = center - closest;
+                        float distance = glm::length(d);
+                        if (distance >= radius) {
+                            continue;
+                        }
+                        // exactly on the surface: out along the face, on the side it came from
+                        glm::vec3 direction = distance > 1e-6f ? d / distance : triangle.normal;
+                        center += direction * (radius - distance + SKIN_WIDTH);
+                        moved = true;
+                    }
+                }
+            }
+
+            if (tableSize > 0) {
+                int32_t cellX = (int32_t)std::floor(center.x / cellSize);
+                int32_t cellZ = (int32_t)std::floor(center.z / cellSize);
+                int reach = (int)std::ceil((radius + maxDynamicRadius) / cellSize);
+                std::vector<uint32_t> visited;
+                for (int32_t z = cellZ - reach; z <= cellZ + reach; z++) {
+                    for (int32_t x = cellX - reach; x <= cellX + reach; x++) {
+                        uint32_t bucket = bucketOf(x, z);
+                        if (std::find(visited.begin(), visited.end(), bucket) != visited.end()) {
+                            continue;
+                        }
+                        visited.push_back(bucket);
+
+                        for (int i = cellStart[bucket]; i < cellStart[bucket + 1]; i++) {
+                            glm::vec3 d = center - spheres[i].center;
+                            float distance = glm::length(d);
+                            float overlap = radius + spheres[i].radius - distance;
+                            if (overlap <= 0.0f) {
+                                continue;
+                            }
+                            glm::vec3 direction = distance > 1e-6f ? d / distance : glm::vec3(0.0f, 1.0f, 0.0f);
+                            center += direction * (overlap + SKIN_WIDTH);
+                            moved = true;
+                        }
+                    }
+                }
+            }
+
+            if (!moved) {
+                break;
+            }
+        }
+
+        return center;
+    }
+
+    glm::vec3 CollisionWorld::moveSphere(glm::vec3 from, glm::vec3 to, float radius) {
+
+        auto start = std::chrono::high_resolution_clock::now();
+
+        // whatever walked into the sphere since the last move pushes it first
+        glm::vec3 position = pushOut(from, radius);
+        glm::vec3 motion = to - from;
+
+        for (int slide = 0; slide < MAX_SLIDES; slide++) {
+
+            float length = glm::length(motion);
+            if (length < 1e-6f) {
+                break;
+            }
+
+            SweepHit hit;
+            if (!sweepSphere(position, position + motion, radius, hit)) {
+                position += motion;
+                break;
+            }
+
+            // up to the contact, minus the skin, then along the surface with what is left
+            position += motion * std::max(hit.t - SKIN_WIDTH / length, 0.0f);
+            glm::vec3 remaining = motion * (1.0f - hit.t);
+            motion = remaining - hit.normal * glm::dot(remaining, hit.normal);
+        }
+
+        auto end = std::chrono::high_resolution_clock::now();
+        lastQueryTime = std::chrono::duration<float, std::micro>(end - start).count();
+
+        return position;
+    }
+
+    float CollisionWorld::getLastQueryTime() {
+        return lastQueryTime;
+    }
+}
@@ -0,0 +1,112 @@
+#ifndef CollisionWorld_hpp
+#define CollisionWorld_hpp
+
+#include <glm/glm.hpp>
+
+#include "Model3D.hpp"
+
+#include <cstdint>
+#include <vector>
+
+namespace gps {
+
+    // First contact of a moving sphere
+    struct SweepHit {
+        float t;            // fraction of the motion, 0..1
+        glm::vec3 normal;   // away from the surface, towards the sphere
+    };
+
+    // Everything the camera can bump into.
+    //
+    // Static: the triangles of the scene meshes (world space) in a bounding
+    // volume hierarchy built once with a binned surface area heuristic. The
+    // nodes are a flat array, a leaf holds a few triangles stored contiguously
+    // in the leaf order, so a query touches the few branches along its path
+    // instead of every triangle of the terrain.
+    //
+    // Dynamic: spheres (the walking penguins) given again every frame, bucketed
+    // by a hashed uniform grid rebuilt with a counting sort.
+    //
+    // A moving sphere is swept (a capsule from start to end) against the
+    // triangles' faces, edges and vertices, and against the dynamic spheres;
+    // moveSphere then slides along what it hits.
+    class CollisionWorld {
+
+    public:
+        static const int LEAF_TRIANGLES = 4;
+        static const int SAH_BINS = 12;
+        // contacts resolved per move, the leftover motion is dropped
+        static const int MAX_SLIDES = 4;
+        // kept between the sphere and what it touches
+        static constexpr float SKIN_WIDTH = 0.01f;
+
+        // ===== STATIC =====
+        // all the meshes of the model, through transform
+        void addModel(gps::Model3D& model, const glm::mat4& transform);
+        void build();
+        void clear();
+
+        int getTriangleCount();
+        int getNodeCount();
+
+        // ===== DYNAMIC =====
+        // the dynamic spheres are given again every frame: clear, add, then build
+        void clearDynamic();
+        void addDynamic(glm::vec3 center, float radius);
+        void buildDynamic();
+        int getDynamicCount();
+
+        // ===== QUERIES =====
+        // earliest contact of a sphere moving from -> to, false if it gets there freely
+        bool sweepSphere(glm::vec3 from, glm::vec3 to, float radius, SweepHit& hit);
+
+        // from -> to, sliding along the contacts; returns where the sphere ends up
+        glm::vec3 moveSphere(glm::vec3 from, glm::vec3 to, float radius);
+
+        // moves an overlapping sphere out of the geometry; returns the new center
+        glm::vec3 pushOut(glm::vec3 center, float radius);
+
+        // microseconds taken by the last moveSphere
+        float getLastQueryTime();
+
+    private:
+        struct Triangle {
+            glm::vec3 a, b, c;
+            glm::vec3 normal;
+        };
+
+        // inner node: count == 0, children at first and first + 1
+        // leaf: triangles first .. first + count - 1
+        struct Node {
+            glm::vec3 boundsMin;
+            int first;
+            glm::vec3 boundsMax;
+            int count;
+        };
+
+        struct Sphere {
+            glm::vec3 center;
+            float radius;
+        };
+
+        std::vector<Triangle> triangles;
+        std::vector<Node> nodes;
+
+        // dynamic spheres, in the order of the grid after buildDynamic
+        std::vector<Sphere> spheres;
+        std::vector<Sphere> sphereScratch;
+        std::vector<uint32_t> sphereCells;
+        std::vector<int> cellStart;
+        int tableSize = 0;
+        float cellSize = 1.0f;
+        float maxDynamicRadius = 0.0f;
+
+        float lastQueryTime = 0.0f;
+
+        uint32_t bucketOf(int32_t cellX, int32_t cellZ);
+        void sweepStatic(glm::vec3 from, glm::vec3 motion, float radius, SweepHit& hit, bool& found);
+        void sweepDynamic(glm::vec3 from, glm::vec3 motion, float radius, SweepHit& hit, bool& found);
+    };
+}
+
+#endif /* CollisionWorld_hpp */
@@ -0,0 +1,51 @@
+#ifndef Frustum_hpp
+#define Frustum_hpp
+
+#include <glm/glm.hpp>
+
+namespace gps {
+
+    // The six planes of a view projection (Gribb & Hartmann: left, right,
+    // bottom, top, near, far), inside when dot(plane, point) + w >= 0. The
+    // planes are in the space the matrix starts from, so projection * view *
+    // model culls in the model's space.
+    struct Frustum {
+
+        glm::vec4 planes[6];
+
+        explicit Frustum(const glm::mat4& viewProjection) {
+            glm::mat4 m = glm::transpose(viewProjection);
+            planes[0] = m[3] + m[0];
+            planes[1] = m[3] - m[0];
+            planes[2] = m[3] + m[1];
+            planes[3] = m[3] - m[1];
+            planes[4] = m[3] + m[2];
+            planes[5] = m[3] - m[2];
+        }
+
+        // conservative: only false when the box is wholly outside one plane
+        bool intersectsBox(const glm::vec3& boundsMin, const glm::vec3& boundsMax) const {
+            for (const glm::vec4& plane : planes) {
+                // the corner furthest along the plane's normal
+                glm::vec3 corner = glm::vec3(plane.x > 0.0f ? boundsMax.x : boundsMin.x,
+                    plane.y > 0.0f ? boundsMax.y : boundsMin.y,
+                    plane.z > 0.0f ? boundsMax.z : boundsMin.z);
+                if (glm::dot(glm::vec3(plane), corner) + plane.w < 0.0f) {
+                    return false;
+                }
+            }
+            return true;
+        }
+
+        bool intersectsSphere(const glm::vec3& center, float radius) const {
+            for (const glm::vec4& plane : planes) {
+                if (glm::dot(glm::vec3(plane), center) + plane.w < -radius * glm::length(glm::vec3(plane))) {
+                    return false;
+                }
+            }
+            return true;
+        }
+    };
+}
+
+#endif /* Frustum_hpp */
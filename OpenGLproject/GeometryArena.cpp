@@ -0,0 +1,184 @@
+#include "GeometryArena.hpp"
+
+#include <algorithm>
+
+namespace gps {
+
+    // ===== FREE LIST =====
+    void GeometryArena::FreeList::init(GLuint size) {
+
+        ranges.clear();
+        ranges[0] = size;
+    }
+
+    bool GeometryArena::FreeList::allocate(GLuint size, GLuint& offset) {
+
+        for (auto it = ranges.begin(); it != ranges.end(); ++it) {
+            if (it->second < size) {
+                continue;
+            }
+            offset = it->first;
+            GLuint left = it->second - size;
+            ranges.erase(it);
+            if (left > 0) {
+                ranges[offset + size] = left;
+            }
+            return true;
+        }
+        return false;
+    }
+
+    void GeometryArena::FreeList::free(GLuint offset, GLuint size) {
+
+        auto next = ranges.lower_bound(offset);
+        if (next != ranges.end() && offset + size == next->first) {
+            size += next->second;
+            next = ranges.erase(next);
+        }
+        if (next != ranges.begin()) {
+            auto previous = std::prev(next);
+            if (previous->first + previous->second == offset) {
+                previous->second += size;
+                return;
+            }
+        }
+        ranges[offset] = size;
+    }
+
+    // ===== ARENA =====
+    GeometryArena::GeometryArena(GLsizei vertexSize, std::function<void()> setAttributes)
+        : vertexSize(vertexSize), setAttributes(setAttributes) {
+    }
+
+    void GeometryArena::Delete() {
+
+        for (Block& block : blocks) {
+            glDeleteVertexArrays(1, &block.VAO);
+            glDeleteBuffers(1, &block.VBO);
+            glDeleteBuffers(1, &block.EBO);
+        }
+        blocks.clear();
+        usedVertices = 0;
+        usedIndices = 0;
+    }
+
+    void GeometryArena::addBlock(GLuint vertexCapacity, GLuint indexCapacity) {
+
+        Block block;
+        block.vertexCapacity = vertexCapacity;
+        block.indexCapacity = indexCapacity;
+        block.freeVertices.init(vertexCapacity);
+        block.freeIndices.init(indexCapacity);
+
+        glGenVertexArrays(1, &block.VAO);
+        glGenBuffers(1, &block.VBO);
+        glGenBuffers(1, &block.EBO);
+
+        glBindVertexArray(block.VAO);
+        glBindBuffer(GL_ARRAY_BUFFER, block.VBO);
+        glBufferData(GL_ARRAY_BUFFER, (GLsizeiptr)vertexCapacity * vertexSize, nullptr, GL_STATIC_DRAW);
+        setAttributes();
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, block.EBO);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, (GLsizeiptr)indexCapacity * sizeof(GLuint), nullptr, GL_STATIC_DRAW);
+        glBindVertexArray(0);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+        blocks.push_back(block);
+    }
+
+    GeometryArena::Range GeometryArena::allocate(const void* vertices, GLuint vertexCount, const GLuint* indices, GLuint indexCount) {
+
+        Range range;
+        range.vertexCount = vertexCount;
+        range.indexCount = indexCount;
+
+        GLuint vertexOffset = 0;
+        GLuint indexOffset = 0;
+        for (int i = 0; i < (int)blocks.size() && range.block < 0; i++) {
+            if (!blocks[i].freeVertices.allocate(vertexCount, vertexOffset)) {
+                continue;
+            }
+            if (!blocks[i].freeIndices.allocate(indexCount, indexOffset)) {
+                blocks[i].freeVertices.free(vertexOffset, vertexCount);
+                continue;
+            }
+            range.block = i;
+        }
+        if (range.block < 0) {
+            addBlock(vertexCount > BLOCK_VERTICES ? vertexCount : BLOCK_VERTICES, indexCount > BLOCK_INDICES ? indexCount : BLOCK_INDICES);
+            range.block = (int)blocks.size() - 1;
+            blocks[range.block].freeVertices.allocate(vertexCount, vertexOffset);
+            blocks[range.block].freeIndices.allocate(indexCount, indexOffset);
+        }
+        range.baseVertex = (GLint)vertexOffset;
+        range.firstIndex = indexOffset;
+
+        // through the copy target, so no VAO's index buffer binding changes
+        Block& block = blocks[range.block];
+        glBindBuffer(GL_COPY_WRITE_BUFFER, block.VBO);
+        glBufferSubData(GL_COPY_WRITE_BUFFER, (GLintptr)vertexOffset * vertexSize, (GLsizeiptr)vertexCount * vertexSize, vertices);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, block.EBO);
+        glBufferSubData(GL_COPY_WRITE_BUFFER, (GLintptr)indexOffset * sizeof(GLuint), (GLsizeiptr)indexCount * sizeof(GLuint), indices);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+        usedVertices += vertexCount;
+        usedIndices += indexCount;
+        return range;
+    }
+
+    void GeometryArena::free(Range& range) {
+
+        if (range.block < 0) {
+            return;
+        }
+        blocks[range.block].freeVertices.free((GLuint)range.baseVertex, range.vertexCount);
+        blocks[range.block].freeIndices.free(range.firstIndex, range.indexCount);
+        usedVertices -= range.vertexCount;
+        usedIndices -= range.indexCount;
+        range = Range();
+    }
+
+    void GeometryArena::updateIndices(const Range& range, const GLuint* indices) {
+
+        glBindBuffer(GL_COPY_WRITE_BUFFER, blocks[range.block].EBO);
+        glBufferSubData(GL_COPY_WRITE_BUFFER, (GLintptr)range.firstIndex * sizeof(GLuint), (GLsizeiptr)range.indexCount * sizeof(GLuint), indices);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+    }
+
+    GLuint GeometryArena::getVertexArray(int block) {
+        return blocks[block].VAO;
+    }
+
+    GLuint GeometryArena::getVertexBuffer(int block) {
+        return blocks[block].VBO;
+    }
+
+    GLuint GeometryArena::getIndexBuffer(int block) {
+        return blocks[block].EBO;
+    }
+
+    const GLvoid* GeometryArena::indexOffset(const Range& range) {
+        return (const GLvoid*)((size_t)range.firstIndex * sizeof(GLuint));
+    }
+
+    int GeometryArena::getBlockCount() {
+        return (int)blocks.size();
+    }
+
+    size_t GeometryArena::getUsedVertexCount() {
+        return usedVertices;
+    }
+
+    size_t GeometryArena::getUsedIndexCount() {
+        return usedIndices;
+    }
+
+    size_t GeometryArena::getMemorySize() {
+
+        size_t size = 0;
+        for (Block& block : blocks) {
+            size += (size_t)block.vertexCapacity * vertexSize + (size_t)block.indexCapacity * sizeof(GLuint);
+        }
+        return size;
+    }
+}
@@ -0,0 +1,96 @@
+#ifndef GeometryArena_hpp
+#define GeometryArena_hpp
+
+#if defined (__APPLE__)
+    #define GL_SILENCE_DEPRECATION
+    #include <OpenGL/gl3.h>
+#else
+    #define GLEW_STATIC
+    #include <GL/glew.h>
+#endif
+
+#include <cstddef>
+#include <functional>
+#include <map>
+#include <vector>
+
+namespace gps {
+
+    // The vertices and indices of every mesh of one vertex format, in a few
+    // large buffers instead of a pair per mesh. A block is a vertex buffer,
+    // an index buffer and the VAO reading them; a mesh is a range of both,
+    // drawn with glDrawElementsBaseVertex (its indices start at 0), so all
+    // the meshes of a block draw with one VAO bound. The free space of every
+    // buffer is a first fit free list; freed ranges merge with their
+    // neighbours. A new block is only made when none has room (a mesh bigger
+    // than a block gets a block of its own size).
+    class GeometryArena {
+
+    public:
+        static const GLuint BLOCK_VERTICES = 1 << 20;
+        static const GLuint BLOCK_INDICES = 1 << 20;
+
+        struct Range {
+            int block = -1;
+            GLint baseVertex = 0;
+            GLuint vertexCount = 0;
+            GLuint firstIndex = 0;
+            GLuint indexCount = 0;
+        };
+
+        // setAttributes: the format's attribute pointers, called with the
+        // block's VAO and vertex buffer bound (offsets from 0)
+        GeometryArena(GLsizei vertexSize, std::function<void()> setAttributes);
+        void Delete();
+
+        Range allocate(const void* vertices, GLuint vertexCount, const GLuint* indices, GLuint indexCount);
+        void free(Range& range);
+        // new indices for the range, as many as it has
+        void updateIndices(const Range& range, const GLuint* indices);
+
+        GLuint getVertexArray(int block);
+        GLuint getVertexBuffer(int block);
+        GLuint getIndexBuffer(int block);
+        // the byte offset glDrawElements* take for the range's first index
+        static const GLvoid* indexOffset(const Range& range);
+
+        int getBlockCount();
+        size_t getUsedVertexCount();
+        size_t getUsedIndexCount();
+        // bytes of video memory, used or not
+        size_t getMemorySize();
+
+    private:
+        // offset -> size, of the free ranges of one buffer
+        class FreeList {
+
+        public:
+            void init(GLuint size);
+            bool allocate(GLuint size, GLuint& offset);
+            void free(GLuint offset, GLuint size);
+
+        private:
+            std::map<GLuint, GLuint> ranges;
+        };
+
+        struct Block {
+            GLuint VAO = 0;
+            GLuint VBO = 0;
+            GLuint EBO = 0;
+            GLuint vertexCapacity = 0;
+            GLuint indexCapacity = 0;
+            FreeList freeVertices;
+            FreeList freeIndices;
+        };
+
+        GLsizei vertexSize;
+        std::function<void()> setAttributes;
+        std::vector<Block> blocks;
+        size_t usedVertices = 0;
+        size_t usedIndices = 0;
+
+        void addBlock(GLuint vertexCapacity, GLuint indexCapacity);
+    };
+}
+
+#endif /* GeometryArena_hpp */
@@ -0,0 +1,218 @@
+#include "GpuInstanceCuller.hpp"
+
+#include "Frustum.hpp"
+
+#include <glm/gtc/type_ptr.hpp>
+
+#include <algorithm>
+#include <cstddef>
+#include <iostream>
+
+namespace gps {
+
+    std::vector<std::string> GpuInstanceCuller::feedbackVaryings() {
+
+        return { "outColumn0", "outColumn1", "outColumn2", "outColumn3", "outExtra" };
+    }
+
+    void GpuInstanceCuller::init(int maxInstances, int maxKept) {
+
+        this->maxInstances = maxInstances;
+        if (maxKept <= 0) {
+            maxKept = maxInstances;
+        }
+#if !defined (__APPLE__)
+        queryBuffer = GLEW_VERSION_4_4 || GLEW_ARB_query_buffer_object;
+#endif
+
+        glGenVertexArrays(1, &VAO);
+        glGenBuffers(BUFFERS, buffers);
+        glGenTextures(BUFFERS, textures);
+        glGenQueries(BUFFERS, queries);
+        for (int i = 0; i < BUFFERS; i++) {
+            glBindBuffer(GL_TEXTURE_BUFFER, buffers[i]);
+            glBufferData(GL_TEXTURE_BUFFER, (GLsizeiptr)maxKept * TEXELS_PER_INSTANCE * sizeof(glm::vec4), nullptr, GL_DYNAMIC_COPY);
+            glBindTexture(GL_TEXTURE_BUFFER, textures[i]);
+            glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, buffers[i]);
+        }
+        glBindTexture(GL_TEXTURE_BUFFER, 0);
+        glBindBuffer(GL_TEXTURE_BUFFER, 0);
+
+        if (queryBuffer) {
+            glGenBuffers(1, &indirectBuffer);
+            glBindBuffer(GL_DRAW_INDIRECT_BUFFER, indirectBuffer);
+            glBufferData(GL_DRAW_INDIRECT_BUFFER, MAX_DRAWS * sizeof(DrawElementsIndirectCommand), nullptr, GL_STREAM_DRAW);
+            glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+        }
+
+        // the same for every culler, told once
+        static bool told = false;
+        if (!told) {
+            std::cout << "GPU instance culling: count through " << (queryBuffer ? "a query buffer" : "last frame's query") << std::endl;
+            told = true;
+        }
+    }
+
+    void GpuInstanceCuller::Delete() {
+
+        glDeleteVertexArrays(1, &VAO);
+        glDeleteBuffers(BUFFERS, buffers);
+        glDeleteTextures(BUFFERS, textures);
+        glDeleteQueries(BUFFERS, queries);
+        glDeleteBuffers(1, &indirectBuffer);
+        VAO = indirectBuffer = 0;
+        for (int i = 0; i < BUFFERS; i++) {
+            buffers[i] = textures[i] = queries[i] = counts[i] = 0;
+            pending[i] = false;
+            serials[i] = 0;
+        }
+        culls = 0;
+        current = 0;
+        drawn = -1;
+    }
+
+    void GpuInstanceCuller::setDistanceRange(const glm::vec3& camera, float nearDistance, float farDistance) {
+
+        rangeCamera = camera;
+        distanceRange = glm::vec2(nearDistance, farDistance);
+    }
+
+    void GpuInstanceCuller::cull(gps::Shader& cullShader, GLuint source, int count, const glm::vec3& center, float radius, const glm::mat4& viewProjection, GLintptr sourceOffset) {
+
+        count = std::max(0, std::min(count, maxInstances));
+        lastCount = count;
+        draws = 0;
+
+        int next = (current + 1) % BUFFERS;
+        if (!queryBuffer) {
+            // draw the newest output that has its count, never cull into it
+            collectCounts();
+            drawn = newestArrived();
+            if (next == drawn) {
+                next = (next + 1) % BUFFERS;
+            }
+        }
+
+        gps::Frustum frustum(viewProjection);
+        cullShader.useShaderProgram();
+        GLuint program = cullShader.shaderProgram;
+        glUniform4fv(glGetUniformLocation(program, "frustumPlanes"), 6, glm::value_ptr(frustum.planes[0]));
+        glUniform4fv(glGetUniformLocation(program, "bounds"), 1, glm::value_ptr(glm::vec4(center, queryBuffer ? radius : radius * LATE_FRAME_MARGIN)));
+        glUniform3fv(glGetUniformLocation(program, "cullCamera"), 1, glm::value_ptr(rangeCamera));
+        glUniform2fv(glGetUniformLocation(program, "distanceRange"), 1, glm::value_ptr(distanceRange));
+
+        // one point per instance
+        const GLsizei stride = TEXELS_PER_INSTANCE * sizeof(glm::vec4);
+        glBindVertexArray(VAO);
+        glBindBuffer(GL_ARRAY_BUFFER, source);
+        for (GLuint texel = 0; texel < TEXELS_PER_INSTANCE; texel++) {
+            glEnableVertexAttribArray(texel);
+            glVertexAttribPointer(texel, 4, GL_FLOAT, GL_FALSE, stride, (GLvoid*)(sourceOffset + texel * sizeof(glm::vec4)));
+        }
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+        // culling only, nothing is rasterized
+        glEnable(GL_RASTERIZER_DISCARD);
+        glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, buffers[next]);
+
+        glBeginQuery(GL_TRANSFORM_FEEDBACK_PRIMITIVES_WRITTEN, queries[next]);
+        glBeginTransformFeedback(GL_POINTS);
+        glDrawArrays(GL_POINTS, 0, count);
+        glEndTransformFeedback();
+        glEndQuery(GL_TRANSFORM_FEEDBACK_PRIMITIVES_WRITTEN);
+
+        glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, 0);
+        glBindVertexArray(0);
+        glDisable(GL_RASTERIZER_DISCARD);
+
+        pending[next] = true;
+        serials[next] = ++culls;
+        current = next;
+
+        if (queryBuffer) {
+            // orphaned, the previous frame's draws may still read it
+            glBindBuffer(GL_DRAW_INDIRECT_BUFFER, indirectBuffer);
+            glBufferData(GL_DRAW_INDIRECT_BUFFER, MAX_DRAWS * sizeof(DrawElementsIndirectCommand), nullptr, GL_STREAM_DRAW);
+            glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+        }
+    }
+
+    void GpuInstanceCuller::collectCounts() {
+
+        for (int i = 0; i < BUFFERS; i++) {
+            if (pending[i]) {
+                GLuint available = 0;
+                glGetQueryObjectuiv(queries[i], GL_QUERY_RESULT_AVAILABLE, &available);
+                if (available) {
+                    glGetQueryObjectuiv(queries[i], GL_QUERY_RESULT, &counts[i]);
+                    pending[i] = false;
+                }
+            }
+        }
+    }
+
+    int GpuInstanceCuller::newestArrived() {
+
+        int newest = -1;
+        for (int i = 0; i < BUFFERS; i++) {
+            if (serials[i] != 0 && !pending[i] && (newest == -1 || serials[i] > serials[newest])) {
+                newest = i;
+            }
+        }
+        return newest;
+    }
+
+    GLuint GpuInstanceCuller::getBuffer() {
+        return buffers[queryBuffer || drawn == -1 ? current : drawn];
+    }
+
+    GLuint GpuInstanceCuller::getTexture() {
+        return textures[queryBuffer || drawn == -1 ? current : drawn];
+    }
+
+    void GpuInstanceCuller::drawElements(GLsizei indexCount, GLuint firstIndex, GLint baseVertex) {
+
+        if (!queryBuffer) {
+            // the output and the count of the same cull
+            if (drawn != -1 && counts[drawn] > 0) {
+                glDrawElementsInstancedBaseVertex(GL_TRIANGLES, indexCount, GL_UNSIGNED_INT, (const GLvoid*)((size_t)firstIndex * sizeof(GLuint)),
+                    (GLsizei)counts[drawn], baseVertex);
+            }
+            return;
+        }
+
+#if !defined (__APPLE__)
+        if (draws == MAX_DRAWS) {
+            return;
+        }
+        // the command with no instances, then the query result copied in
+        GLintptr offset = draws * sizeof(DrawElementsIndirectCommand);
+        DrawElementsIndirectCommand command = { (GLuint)indexCount, 0, firstIndex, baseVertex, 0 };
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, indirectBuffer);
+        glBufferSubData(GL_DRAW_INDIRECT_BUFFER, offset, sizeof(command), &command);
+        glBindBuffer(GL_QUERY_BUFFER, indirectBuffer);
+        glGetQueryObjectuiv(queries[current], GL_QUERY_RESULT, (GLuint*)(offset + offsetof(DrawElementsIndirectCommand, instanceCount)));
+        glBindBuffer(GL_QUERY_BUFFER, 0);
+
+        glDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, (const GLvoid*)offset);
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+        draws++;
+#endif
+    }
+
+    bool GpuInstanceCuller::isQueryBuffer() {
+        return queryBuffer;
+    }
+
+    int GpuInstanceCuller::getVisibleCount() {
+
+        // reads the counts only: what is drawn changes at the next cull
+        collectCounts();
+        int newest = newestArrived();
+        return newest != -1 ? (int)counts[newest] : 0;
+    }
+
+    int GpuInstanceCuller::getInstanceCount() {
+        return lastCount;
+    }
+}
@@ -0,0 +1,121 @@
+#ifndef GpuInstanceCuller_hpp
+#define GpuInstanceCuller_hpp
+
+#if defined (__APPLE__)
+    #define GL_SILENCE_DEPRECATION
+    #include <OpenGL/gl3.h>
+#else
+    #define GLEW_STATIC
+    #include <GL/glew.h>
+#endif
+
+#include <glm/glm.hpp>
+
+#include "Shader.hpp"
+
+#include <string>
+#include <vector>
+
+namespace gps {
+
+    // Frustum culling of a large instance set on the GPU. The instances are
+    // TEXELS_PER_INSTANCE vec4s each: the 4 model matrix columns, then one
+    // the drawing shader reads (RigidPartModel's instanceData layout).
+    //
+    // cull draws one point per instance with the rasterizer off: the vertex
+    // shader tests the instance's bounding sphere against the frustum planes
+    // (and, when set, its center's distance to the camera: one LOD's ring),
+    // the geometry shader emits the survivors, which transform feedback packs
+    // into the output buffer; a GL_TRANSFORM_FEEDBACK_PRIMITIVES_WRITTEN query
+    // counts them. An instance whose matrix is all zeros is a hole in the
+    // set, never kept.
+    //
+    // drawElements draws once per survivor, the count never leaving the GPU:
+    //  - with GL 4.4 or ARB_query_buffer_object the query result is written
+    //    into the instance count of a DrawElementsIndirectCommand, then
+    //    glDrawElementsIndirect;
+    //  - on 4.1 each of the BUFFERS outputs keeps the count of the cull that
+    //    wrote it, read back when it has arrived (nothing waits). The draw
+    //    takes the newest output whose count has arrived, with that count,
+    //    and no cull writes into it until a newer one has arrived: with three
+    //    outputs there is always one that is neither drawn nor the newest
+    //    cull. What is drawn lags a frame or more, the bounds have a margin
+    //    for it. The matrices drawn are as old, so a culled draw of instances
+    //    that move (the crowd's colour pass) is behind an unculled one of the
+    //    same frame (the sun's depth pass): moving penguins lag their shadows.
+    class GpuInstanceCuller {
+
+    public:
+        static const int TEXELS_PER_INSTANCE = 5;
+        static const int BUFFERS = 3;
+        // drawElements calls between two culls
+        static const int MAX_DRAWS = 16;
+        // the bounding sphere grows by this much on the 4.1 path
+        static constexpr float LATE_FRAME_MARGIN = 1.25f;
+
+        static std::vector<std::string> feedbackVaryings();
+
+        // room for maxKept survivors of a cull (0: maxInstances), transform
+        // feedback drops the ones past it
+        void init(int maxInstances, int maxKept = 0);
+        void Delete();
+
+        // the next culls keep the instances whose center is nearDistance to
+        // farDistance from camera (in the instances' space); farDistance 0: any
+        void setDistanceRange(const glm::vec3& camera, float nearDistance, float farDistance);
+
+        // the first count instances of source (from byte sourceOffset) whose
+        // sphere (model space center, radius) is inside the frustum of
+        // viewProjection; the cull shader (instanceCull.vert / .geom) is used
+        // and left in use
+        void cull(gps::Shader& cullShader, GLuint source, int count, const glm::vec3& center, float radius, const glm::mat4& viewProjection, GLintptr sourceOffset = 0);
+
+        // the instances to draw, packed (TEXELS_PER_INSTANCE texels each);
+        // on 4.1 the output drawElements draws, until the next cull
+        GLuint getBuffer();
+        GLuint getTexture();
+        // with the VAO bound: indexCount indices from firstIndex, once per instance kept
+        void drawElements(GLsizei indexCount, GLuint firstIndex = 0, GLint baseVertex = 0);
+
+        bool isQueryBuffer();
+        // the instances kept by the last cull whose count has arrived (never waits)
+        int getVisibleCount();
+        int getInstanceCount();
+
+    private:
+        struct DrawElementsIndirectCommand {
+            GLuint count;
+            GLuint instanceCount;
+            GLuint firstIndex;
+            GLint baseVertex;
+            GLuint baseInstance;
+        };
+
+        bool queryBuffer = false;
+        int maxInstances = 0;
+        int lastCount = 0;
+        int draws = 0; // since the last cull
+        unsigned int culls = 0;
+        glm::vec3 rangeCamera = glm::vec3(0.0f);
+        glm::vec2 distanceRange = glm::vec2(0.0f);
+
+        GLuint VAO = 0;
+        GLuint buffers[BUFFERS] = { 0, 0, 0 };
+        GLuint textures[BUFFERS] = { 0, 0, 0 };
+        GLuint queries[BUFFERS] = { 0, 0, 0 };
+        // per output: the survivors of the cull that wrote it, once arrived
+        GLuint counts[BUFFERS] = { 0, 0, 0 };
+        bool pending[BUFFERS] = { false, false, false };
+        unsigned int serials[BUFFERS] = { 0, 0, 0 }; // which cull wrote it, 0: none
+        int current = 0; // the output of the last cull
+        int drawn = -1;  // 4.1: the newest output whose count has arrived
+        GLuint indirectBuffer = 0;
+
+        // reads back the counts that have arrived, never waits
+        void collectCounts();
+        // the newest output whose count has arrived, -1: none yet
+        int newestArrived();
+    };
+}
+
+#endif /* GpuInstanceCuller_hpp */
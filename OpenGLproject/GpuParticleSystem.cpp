@@ -0,0 +1,135 @@
+#include "GpuParticleSystem.hpp"
+
+#include <glm/gtc/type_ptr.hpp>
+
+#include <cmath>
+
+namespace gps {
+
+    // particle count the fire was tuned for, used to keep the same brightness
+    static const float REFERENCE_PARTICLES = 250.0f;
+
+    std::vector<std::string> GpuParticleSystem::feedbackVaryings() {
+
+        return { "outPosition", "outColor", "outSize", "outLifeRatio",
+            "outVelocity", "outLife", "outMaxLife", "outType" };
+    }
+
+    void GpuParticleSystem::init(int particleCount, GLuint quadVBO, GLuint quadEBO) {
+
+        this->particleCount = particleCount;
+
+        // every particle starts dead with a random spawn delay (negative life),
+        // so the emission is spread in time instead of one burst
+        std::vector<float> initialData(particleCount * FLOATS_PER_PARTICLE, 0.0f);
+        unsigned int seed = 12345u;
+        for (int i = 0; i < particleCount; i++) {
+            seed = seed * 1664525u + 1013904223u;
+            float delay = (float)(seed >> 8) / 16777216.0f * 4.0f;
+            initialData[i * FLOATS_PER_PARTICLE + 12] = -delay; // life
+            initialData[i * FLOATS_PER_PARTICLE + 13] = 1.0f;   // maxLife
+        }
+
+        glGenBuffers(2, buffers);
+        glGenVertexArrays(2, updateVAO);
+        glGenVertexArrays(2, renderVAO);
+
+        const GLsizei stride = FLOATS_PER_PARTICLE * sizeof(float);
+
+        for (int i = 0; i < 2; i++) {
+
+            glBindBuffer(GL_ARRAY_BUFFER, buffers[i]);
+            glBufferData(GL_ARRAY_BUFFER, initialData.size() * sizeof(float), initialData.data(), GL_DYNAMIC_COPY);
+
+            // ===== UPDATE VAO - the whole particle state, one vertex per particle =====
+            glBindVertexArray(updateVAO[i]);
+            glBindBuffer(GL_ARRAY_BUFFER, buffers[i]);
+            const GLint sizes[8] = { 3, 4, 1, 1, 3, 1, 1, 1 };
+            size_t offset = 0;
+            for (GLuint attrib = 0; attrib < 8; attrib++) {
+                glEnableVertexAttribArray(attrib);
+                glVertexAttribPointer(attrib, sizes[attrib], GL_FLOAT, GL_FALSE, stride, (void*)(offset * sizeof(float)));
+                offset += sizes[attrib];
+            }
+
+            // ===== RENDER VAO - quad corners + particle state as instance data =====
+            glBindVertexArray(renderVAO[i]);
+
+            glBindBuffer(GL_ARRAY_BUFFER, quadVBO);
+            glEnableVertexAttribArray(0);
+            glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void*)0);
+
+            glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, quadEBO);
+
+            // same locations as the CPU particles: pos, color, size, life
+            glBindBuffer(GL_ARRAY_BUFFER, buffers[i]);
+            glEnableVertexAttribArray(1);
+            glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, stride, (void*)0);
+            glVertexAttribDivisor(1, 1);
+            glEnableVertexAttribArray(2);
+            glVertexAttribPointer(2, 4, GL_FLOAT, GL_FALSE, stride, (void*)(3 * sizeof(float)));
+            glVertexAttribDivisor(2, 1);
+            glEnableVertexAttribArray(3);
+            glVertexAttribPointer(3, 1, GL_FLOAT, GL_FALSE, stride, (void*)(7 * sizeof(float)));
+            glVertexAttribDivisor(3, 1);
+            glEnableVertexAttribArray(4);
+            glVertexAttribPointer(4, 1, GL_FLOAT, GL_FALSE, stride, (void*)(8 * sizeof(float)));
+            glVertexAttribDivisor(4, 1);
+        }
+
+        glBindVertexArray(0);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+
+    void GpuParticleSystem::Delete() {
+
+        glDeleteVertexArrays(2, updateVAO);
+        glDeleteVertexArrays(2, renderVAO);
+        glDeleteBuffers(2, buffers);
+    }
+
+    void GpuParticleSystem::update(gps::Shader& updateShader, float deltaTime, glm::vec3 emitterPos) {
+
+        time += deltaTime;
+        frameIndex++;
+
+        updateShader.useShaderProgram();
+        glUniform1f(glGetUniformLocation(updateShader.shaderProgram, "deltaTime"), deltaTime);
+        glUniform1f(glGetUniformLocation(updateShader.shaderProgram, "time"), time);
+        glUniform1ui(glGetUniformLocation(updateShader.shaderProgram, "frameIndex"), frameIndex);
+        glUniform3fv(glGetUniformLocation(updateShader.shaderProgram, "emitterPos"), 1, glm::value_ptr(emitterPos));
+        // many more overlapping particles: dim each one so the fire keeps its brightness
+        float densityScale = glm::clamp(std::sqrt(REFERENCE_PARTICLES / (float)particleCount), 0.05f, 1.0f);
+        glUniform1f(glGetUniformLocation(updateShader.shaderProgram, "densityScale"), densityScale);
+
+        int next = 1 - current;
+
+        // simulation only, nothing is rasterized
+        glEnable(GL_RASTERIZER_DISCARD);
+
+        glBindVertexArray(updateVAO[current]);
+        glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, buffers[next]);
+
+        glBeginTransformFeedback(GL_POINTS);
+        glDrawArrays(GL_POINTS, 0, particleCount);
+        glEndTransformFeedback();
+
+        glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, 0);
+        glBindVertexArray(0);
+
+        glDisable(GL_RASTERIZER_DISCARD);
+
+        current = next;
+    }
+
+    void GpuParticleSystem::draw() {
+
+        glBindVertexArray(renderVAO[current]);
+        glDrawElementsInstanced(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0, particleCount);
+        glBindVertexArray(0);
+    }
+
+    int GpuParticleSystem::getParticleCount() {
+        return particleCount;
+    }
+}
@@ -0,0 +1,57 @@
+#ifndef GpuParticleSystem_hpp
+#define GpuParticleSystem_hpp
+
+#if defined (__APPLE__)
+    #define GL_SILENCE_DEPRECATION
+    #include <OpenGL/gl3.h>
+#else
+    #define GLEW_STATIC
+    #include <GL/glew.h>
+#endif
+
+#include <glm/glm.hpp>
+
+#include "Shader.hpp"
+
+#include <string>
+#include <vector>
+
+namespace gps {
+
+    // Fire and smoke simulated entirely on the GPU.
+    // The update pass is a vertex shader whose outputs are captured with
+    // transform feedback into the second of two ping-pong buffers; the render
+    // pass reads the freshly written buffer as per-instance attributes, so the
+    // particle data never goes through the CPU.
+    class GpuParticleSystem {
+
+    public:
+        // floats per particle: pos(3) color(4) size(1) lifeRatio(1) velocity(3) life(1) maxLife(1) type(1)
+        static const int FLOATS_PER_PARTICLE = 15;
+
+        // outputs of the update shader, in buffer order
+        static std::vector<std::string> feedbackVaryings();
+
+        // quadVBO / quadEBO hold the billboard corners, shared with the CPU particles
+        void init(int particleCount, GLuint quadVBO, GLuint quadEBO);
+        void Delete();
+
+        void update(gps::Shader& updateShader, float deltaTime, glm::vec3 emitterPos);
+        // draws every particle as an instanced billboard with the currently bound shader
+        void draw();
+
+        int getParticleCount();
+
+    private:
+        int particleCount = 0;
+        int current = 0; // buffer holding the latest state
+        unsigned int frameIndex = 0;
+        float time = 0.0f;
+
+        GLuint buffers[2] = { 0, 0 };
+        GLuint updateVAO[2] = { 0, 0 };
+        GLuint renderVAO[2] = { 0, 0 };
+    };
+}
+
+#endif /* GpuParticleSystem_hpp */
@@ -0,0 +1,445 @@
+#include "Heightfield.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <deque>
+#include <limits>
+#include <utility>
+
+namespace gps {
+
+    // not written by any tile yet
+    static const float HOLE = -std::numeric_limits<float>::max();
+
+    // entry of the ray into the box within [0, tMax], false if it misses
+    static bool rayBox(glm::vec3 origin, glm::vec3 direction, glm::vec3 boundsMin, glm::vec3 boundsMax, float tMax, float& tEnter) {
+
+        float t0 = 0.0f;
+        float t1 = tMax;
+        for (int axis = 0; axis < 3; axis++) {
+
+            if (std::fabs(direction[axis]) < 1e-12f) {
+                if (origin[axis] < boundsMin[axis] || origin[axis] > boundsMax[axis]) {
+                    return false;
+                }
+                continue;
+            }
+
+            float inverse = 1.0f / direction[axis];
+            float near = (boundsMin[axis] - origin[axis]) * inverse;
+            float far = (boundsMax[axis] - origin[axis]) * inverse;
+            if (near > far) {
+                std::swap(near, far);
+            }
+            t0 = std::max(t0, near);
+            t1 = std::min(t1, far);
+            if (t0 > t1) {
+                return false;
+            }
+        }
+
+        tEnter = t0;
+        return true;
+    }
+
+    // Moller - Trumbore, two sided
+    static bool rayTriangle(glm::vec3 origin, glm::vec3 direction, glm::vec3 a, glm::vec3 b, glm::vec3 c, float& best) {
+
+        glm::vec3 ab = b - a;
+        glm::vec3 ac = c - a;
+        glm::vec3 p = glm::cross(direction, ac);
+        float determinant = glm::dot(ab, p);
+        if (std::fabs(determinant) < 1e-12f) {
+            return false;
+        }
+
+        float inverse = 1.0f / determinant;
+        glm::vec3 s = origin - a;
+        float u = glm::dot(s, p) * inverse;
+        if (u < 0.0f || u > 1.0f) {
+            return false;
+        }
+        glm::vec3 q = glm::cross(s, ab);
+        float v = glm::dot(direction, q) * inverse;
+        if (v < 0.0f || u + v > 1.0f) {
+            return false;
+        }
+
+        float t = glm::dot(ac, q) * inverse;
+        if (t < 0.0f || t >= best) {
+            return false;
+        }
+        best = t;
+        return true;
+    }
+
+    void Heightfield::bake(const std::vector<gps::Model3D*>& tiles) {
+
+        Delete();
+        if (tiles.empty()) {
+            return;
+        }
+
+        // ===== GRID =====
+        // the finest tile sets the spacing, the union of the tiles the extent
+        std::vector<std::pair<float, int>> bySpacing;
+        glm::vec3 boundsMin = glm::vec3(std::numeric_limits<float>::max());
+        glm::vec3 boundsMax = glm::vec3(-std::numeric_limits<float>::max());
+        for (int i = 0; i < (int)tiles.size(); i++) {
+            glm::vec3 tileMin = tiles[i]->getBoundsMin();
+            glm::vec3 tileMax = tiles[i]->getBoundsMax();
+            float tileSpacing = std::min(tileMax.x - tileMin.x, tileMax.z - tileMin.z) / (TILE_VERTICES - 1);
+            bySpacing.push_back({ tileSpacing, i });
+            boundsMin = glm::min(boundsMin, tileMin);
+            boundsMax = glm::max(boundsMax, tileMax);
+        }
+
+        // coarsest first, the finer tiles overwrite them
+        std::stable_sort(bySpacing.begin(), bySpacing.end(), [](const std::pair<float, int>& a, const std::pair<float, int>& b) {
+            return a.first > b.first;
+        });
+
+        spacing = bySpacing.back().first;
+        origin = glm::vec2(boundsMin.x, boundsMin.z);
+        width = (int)std::ceil((boundsMax.x - boundsMin.x) / spacing) + 1;
+        depth = (int)std::ceil((boundsMax.z - boundsMin.z) / spacing) + 1;
+        heights.assign((size_t)width * depth, HOLE);
+        owners.assign((size_t)width * depth, 0);
+
+        // ===== RASTERIZATION =====
+        for (auto& entry : bySpacing) {
+            uint8_t owner = (uint8_t)entry.second;
+            for (gps::Mesh& mesh : tiles[entry.second]->getMeshes()) {
+                for (size_t t = 0; t + 2 < mesh.indices.size(); t += 3) {
+                    glm::vec3 a = mesh.vertices[mesh.indices[t]].Position;
+                    glm::vec3 b = mesh.vertices[mesh.indices[t + 1]].Position;
+                    glm::vec3 c = mesh.vertices[mesh.indices[t + 2]].Position;
+
+                    float area = (b.x - a.x) * (c.z - a.z) - (c.x - a.x) * (b.z - a.z);
+                    if (std::fabs(area) < 1e-6f) {
+                        continue;
+                    }
+
+                    int x0 = std::max(0, (int)std::ceil((std::min(a.x, std::min(b.x, c.x)) - origin.x) / spacing));
+                    int x1 = std::min(width - 1, (int)std::floor((std::max(a.x, std::max(b.x, c.x)) - origin.x) / spacing));
+                    int z0 = std::max(0, (int)std::ceil((std::min(a.z, std::min(b.z, c.z)) - origin.y) / spacing));
+                    int z1 = std::min(depth - 1, (int)std::floor((std::max(a.z, std::max(b.z, c.z)) - origin.y) / spacing));
+
+                    for (int z = z0; z <= z1; z++) {
+                        for (int x = x0; x <= x1; x++) {
+                            float px = origin.x + x * spacing;
+                            float pz = origin.y + z * spacing;
+
+                            // barycentric coordinates on the xz plane
+                            float u = ((b.x - px) * (c.z - pz) - (c.x - px) * (b.z - pz)) / area;
+                            float v = ((c.x - px) * (a.z - pz) - (a.x - px) * (c.z - pz)) / area;
+                            float w = 1.0f - u - v;
+                            if (u < -1e-4f || v < -1e-4f || w < -1e-4f) {
+                                continue;
+                            }
+                            heights[(size_t)z * width + x] = u * a.y + v * b.y + w * c.y;
+                            owners[(size_t)z * width + x] = owner;
+                        }
+                    }
+                }
+            }
+        }
+
+        // ===== HOLES =====
+        // the samples no tile covers take the height (and the tile) of the nearest covered one (breadth first)
+        std::deque<int> queue;
+        for (int i = 0; i < width * depth; i++) {
+            if (heights[i] != HOLE) {
+                queue.push_back(i);
+            }
+        }
+        while (!queue.empty()) {
+            int i = queue.front();
+            queue.pop_front();
+            int x = i % width;
+            int z = i / width;
+            int neighbours[4] = { x > 0 ? i - 1 : -1, x < width - 1 ? i + 1 : -1, z > 0 ? i - width : -1, z < depth - 1 ? i + width : -1 };
+            for (int n : neighbours) {
+                if (n >= 0 && heights[n] == HOLE) {
+                    heights[n] = heights[i];
+                    owners[n] = owners[i];
+                    queue.push_back(n);
+                }
+            }
+        }
+
+        buildPyramid();
+    }
+
+    glm::vec2 Heightfield::getRange(int level, int x, int z) {
+
+        if (level > 0) {
+            return levels[level][(size_t)z * levelWidth[level] + x];
+        }
+        float h00 = height(x, z);
+        float h10 = height(x + 1, z);
+        float h01 = height(x, z + 1);
+        float h11 = height(x + 1, z + 1);
+        return glm::vec2(std::min(std::min(h00, h10), std::min(h01, h11)), std::max(std::max(h00, h10), std::max(h01, h11)));
+    }
+
+    void Heightfield::buildPyramid() {
+
+        levels.clear();
+        levelWidth.clear();
+        levelDepth.clear();
+
+        // level 0 (one node per cell) is read from the heights, not stored
+        int w = std::max(width - 1, 1);
+        int d = std::max(depth - 1, 1);
+        levels.emplace_back();
+        levelWidth.push_back(w);
+        levelDepth.push_back(d);
+
+        while (w > 1 || d > 1) {
+            int level = (int)levels.size() - 1;
+            int parentWidth = (w + 1) / 2;
+            int parentDepth = (d + 1) / 2;
+            std::vector<glm::vec2> parents((size_t)parentWidth * parentDepth, glm::vec2(std::numeric_limits<float>::max(), -std::numeric_limits<float>::max()));
+
+            for (int z = 0; z < d; z++) {
+                for (int x = 0; x < w; x++) {
+                    glm::vec2& parent = parents[(size_t)(z / 2) * parentWidth + x / 2];
+                    glm::vec2 child = getRange(level, x, z);
+                    parent.x = std::min(parent.x, child.x);
+                    parent.y = std::max(parent.y, child.y);
+                }
+            }
+
+            levels.push_back(std::move(parents));
+            levelWidth.push_back(w = parentWidth);
+            levelDepth.push_back(d = parentDepth);
+        }
+    }
+
+    void Heightfield::Delete() {
+
+        heights.clear();
+        heights.shrink_to_fit();
+        owners.clear();
+        owners.shrink_to_fit();
+        levels.clear();
+        levelWidth.clear();
+        levelDepth.clear();
+        width = depth = 0;
+    }
+
+    float Heightfield::height(int x, int z) {
+
+        x = std::min(std::max(x, 0), width - 1);
+        z = std::min(std::max(z, 0), depth - 1);
+        return heights[(size_t)z * width + x];
+    }
+
+    float Heightfield::heightAt(float x, float z) {
+
+        if (heights.empty()) {
+            return 0.0f;
+        }
+
+        float gx = glm::clamp((x - origin.x) / spacing, 0.0f, (float)(width - 1));
+        float gz = glm::clamp((z - origin.y) / spacing, 0.0f, (float)(depth - 1));
+        int ix = std::min((int)gx, std::max(width - 2, 0));
+        int iz = std::min((int)gz, std::max(depth - 2, 0));
+        float fx = gx - ix;
+        float fz = gz - iz;
+
+        float h00 = height(ix, iz);
+        float h11 = height(ix + 1, iz + 1);
+        if (fx >= fz) {
+            float h10 = height(ix + 1, iz);
+            return h00 + fx * (h10 - h00) + fz * (h11 - h10);
+        }
+        float h01 = height(ix, iz + 1);
+        return h00 + fz * (h01 - h00) + fx * (h11 - h01);
+    }
+
+    glm::vec3 Heightfield::normalAt(float x, float z) {
+
+        // central differences one sample apart, smooth across the cell edges
+        float left = heightAt(x - spacing, z);
+        float right = heightAt(x + spacing, z);
+        float back = heightAt(x, z - spacing);
+        float front = heightAt(x, z + spacing);
+        return glm::normalize(glm::vec3(left - right, 2.0f * spacing, back - front));
+    }
+
+    bool Heightfield::raycastCell(int x, int z, glm::vec3 origin, glm::vec3 direction, float& best) {
+
+        glm::vec3 corner = glm::vec3(this->origin.x + x * spacing, 0.0f, this->origin.y + z * spacing);
+        glm::vec3 v00 = corner + glm::vec3(0.0f, height(x, z), 0.0f);
+        glm::vec3 v10 = corner + glm::vec3(spacing, height(x + 1, z), 0.0f);
+        glm::vec3 v01 = corner + glm::vec3(0.0f, height(x, z + 1), spacing);
+        glm::vec3 v11 = corner + glm::vec3(spacing, height(x + 1, z + 1), spacing);
+
+        bool found = rayTriangle(origin, direction, v00, v10, v11, best);
+        found |= rayTriangle(origin, direction, v00, v11, v01, best);
+        return found;
+    }
+
+    bool Heightfield::raycast(glm::vec3 origin, glm::vec3 direction, float maxDistance, float& t) {
+
+        if (levels.empty()) {
+            return false;
+        }
+
+        struct Item {
+            int level;
+            int x;
+            int z;
+            float tEnter;
+        };
+
+        // the box of a node: its cells on xz, its min / max in y
+        auto nodeBox = [&](int level, int x, int z, glm::vec3& boxMin, glm::vec3& boxMax) {
+            int x0 = x << level;
+            int z0 = z << level;
+            int x1 = std::min((x + 1) << level, levelWidth[0]);
+            int z1 = std::min((z + 1) << level, levelDepth[0]);
+            glm::vec2 range = getRange(level, x, z);
+            boxMin = glm::vec3(this->origin.x + x0 * spacing, range.x, this->origin.y + z0 * spacing);
+            boxMax = glm::vec3(this->origin.x + x1 * spacing, range.y, this->origin.y + z1 * spacing);
+        };
+
+        float best = maxDistance;
+        bool found = false;
+
+        int top = (int)levels.size() - 1;
+        glm::vec3 boxMin, boxMax;
+        float tEnter;
+        nodeBox(top, 0, 0, boxMin, boxMax);
+        if (!rayBox(origin, direction, boxMin, boxMax, best, tEnter)) {
+            return false;
+        }
+
+        std::vector<Item> stack;
+        stack.reserve(4 * levels.size());
+        stack.push_back({ top, 0, 0, tEnter });
+
+        while (!stack.empty()) {
+
+            Item item = stack.back();
+            stack.pop_back();
+            // a nearer hit was found since it was pushed
+            if (item.tEnter > best) {
+                continue;
+            }
+
+            if (item.level == 0) {
+                found |= raycastCell(item.x, item.z, origin, direction, best);
+                continue;
+            }
+
+            // the children the ray goes through, the farthest pushed first
+            Item children[4];
+            int count = 0;
+            int level = item.level - 1;
+            for (int cz = 0; cz < 2; cz++) {
+                for (int cx = 0; cx < 2; cx++) {
+                    int x = item.x * 2 + cx;
+                    int z = item.z * 2 + cz;
+                    if (x >= levelWidth[level] || z >= levelDepth[level]) {
+                        continue;
+                    }
+                    nodeBox(level, x, z, boxMin, boxMax);
+                    if (rayBox(origin, direction, boxMin, boxMax, best, tEnter)) {
+                        children[count++] = { level, x, z, tEnter };
+                    }
+                }
+            }
+            std::sort(children, children + count, [](const Item& a, const Item& b) {
+                return a.tEnter > b.tEnter;
+            });
+            stack.insert(stack.end(), children, children + count);
+        }
+
+        if (found) {
+            t = best;
+        }
+        return found;
+    }
+
+    glm::vec3 Heightfield::moveSphere(glm::vec3 from, glm::vec3 to, float radius) {
+
+        glm::vec3 position = from;
+        glm::vec3 motion = to - from;
+
+        for (int slide = 0; slide < MAX_SLIDES; slide++) {
+
+            float length = glm::length(motion);
+            if (length < 1e-6f) {
+                break;
+            }
+            glm::vec3 direction = motion / length;
+
+            // a radius further, so the front of the sphere is covered too
+            float t;
+            if (!raycast(position, direction, length + radius, t)) {
+                position += motion;
+                break;
+            }
+
+            // up to the contact with the ground's plane there, then along it with what is left
+            glm::vec3 hit = position + direction * t;
+            glm::vec3 normal = normalAt(hit.x, hit.z);
+            float approach = -glm::dot(direction, normal);
+            if (approach < 1e-6f) {
+                position += motion;
+                break;
+            }
+            float travel = glm::clamp((glm::dot(position - hit, normal) - radius - SKIN_WIDTH) / approach, 0.0f, length);
+            position += direction * travel;
+            glm::vec3 remaining = motion * (1.0f - travel / length);
+            motion = remaining - normal * glm::dot(remaining, normal);
+        }
+
+        // what the center's path missed (a ridge under the side of the sphere)
+        position.y = std::max(position.y, heightAt(position.x, position.z) + radius);
+        return position;
+    }
+
+    std::vector<float>& Heightfield::getHeights() {
+        return heights;
+    }
+
+    std::vector<uint8_t>& Heightfield::getOwners() {
+        return owners;
+    }
+
+    glm::vec2 Heightfield::getOrigin() {
+        return origin;
+    }
+
+    float Heightfield::getSpacing() {
+        return spacing;
+    }
+
+    int Heightfield::getWidth() {
+        return width;
+    }
+
+    int Heightfield::getDepth() {
+        return depth;
+    }
+
+    int Heightfield::getLevelCount() {
+        return (int)levels.size();
+    }
+
+    glm::vec3 Heightfield::getBoundsMin() {
+
+        float lowest = levels.empty() ? 0.0f : getRange((int)levels.size() - 1, 0, 0).x;
+        return glm::vec3(origin.x, lowest, origin.y);
+    }
+
+    glm::vec3 Heightfield::getBoundsMax() {
+
+        float highest = levels.empty() ? 0.0f : getRange((int)levels.size() - 1, 0, 0).y;
+        return glm::vec3(origin.x + (width - 1) * spacing, highest, origin.y + (depth - 1) * spacing);
+    }
+}
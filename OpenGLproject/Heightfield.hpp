@@ -0,0 +1,86 @@
+#ifndef Heightfield_hpp
+#define Heightfield_hpp
+
+#include <glm/glm.hpp>
+
+#include "Model3D.hpp"
+
+#include <cstdint>
+#include <vector>
+
+namespace gps {
+
+    // The Matterhorn tiles baked into one regular height grid, at the spacing
+    // of the finest tile. Every tile is a 65 x 65 vertex grid; they are
+    // rasterized coarsest first, so where two overlap the finer one wins.
+    // A cell is split in two triangles along its (x0, z0) - (x1, z1) diagonal,
+    // heightAt interpolates over them like the meshes do.
+    //
+    // On top of the grid, a min / max pyramid: level 0 is the lowest and
+    // highest corner of every cell (read from the grid), level k the range of
+    // every 2^k x 2^k cells. A ray walks it as a quadtree, front to back,
+    // skipping every node whose box it passes over, down to the two triangles
+    // of the cells it may hit.
+    //
+    // Every sample also remembers the tile it was taken from (its index in
+    // the tiles given to bake), so the renderer knows which texture covers it.
+    class Heightfield {
+
+    public:
+        static const int TILE_VERTICES = 65;
+        static const int MAX_SLIDES = 4;
+        // kept between the sphere and the ground
+        static constexpr float SKIN_WIDTH = 0.01f;
+
+        // tiles: the models of the terrain, world space
+        void bake(const std::vector<gps::Model3D*>& tiles);
+        void Delete();
+
+        // ===== QUERIES, O(1) =====
+        // outside the baked area the border is extended
+        float heightAt(float x, float z);
+        glm::vec3 normalAt(float x, float z);
+
+        // first hit of origin + t * direction with t <= maxDistance (direction normalized),
+        // inside the baked area only
+        bool raycast(glm::vec3 origin, glm::vec3 direction, float maxDistance, float& t);
+
+        // a sphere moved from -> to, stopped by the ground and slid along it
+        // (the center's path against the ground's plane where it meets it);
+        // it always ends above the ground
+        glm::vec3 moveSphere(glm::vec3 from, glm::vec3 to, float radius);
+
+        // (min, max) height of the 2^level x 2^level cells from (x, z) * 2^level
+        glm::vec2 getRange(int level, int x, int z);
+
+        // width x depth samples, row by row (z), from getOrigin every getSpacing
+        std::vector<float>& getHeights();
+        std::vector<uint8_t>& getOwners();
+        glm::vec2 getOrigin();
+        float getSpacing();
+        int getWidth();
+        int getDepth();
+        int getLevelCount();
+        glm::vec3 getBoundsMin();
+        glm::vec3 getBoundsMax();
+
+    private:
+        int width = 0;  // vertices along x
+        int depth = 0;  // vertices along z
+        float spacing = 1.0f;
+        glm::vec2 origin = glm::vec2(0.0f);
+        std::vector<float> heights;
+        std::vector<uint8_t> owners;
+
+        // levels[k][z * levelWidth + x] = (min, max) of the node, k > 0
+        std::vector<std::vector<glm::vec2>> levels;
+        std::vector<int> levelWidth;
+        std::vector<int> levelDepth;
+
+        float height(int x, int z);
+        void buildPyramid();
+        bool raycastCell(int x, int z, glm::vec3 origin, glm::vec3 direction, float& best);
+    };
+}
+
+#endif /* Heightfield_hpp */
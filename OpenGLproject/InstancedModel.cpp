@@ -0,0 +1,600 @@
+#include "InstancedModel.hpp"
+
+#include <glm/gtc/type_ptr.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+
+namespace gps {
+
+    // normals are written with 4 decimals in the .obj files
+    static const double NORMAL_TOLERANCE = 1e-2;
+    static const double TEXCOORD_TOLERANCE = 1e-4;
+
+    // Eigen decomposition of a symmetric n x n matrix (n <= 4), cyclic Jacobi.
+    // a is destroyed, vectors[i * n + k] is the k-th component of the i-th eigenvector.
+    static void jacobiEigen(double* a, int n, double* values, double* vectors) {
+
+        for (int i = 0; i < n; i++) {
+            for (int j = 0; j < n; j++) {
+                vectors[i * n + j] = i == j ? 1.0 : 0.0;
+            }
+        }
+
+        for (int sweep = 0; sweep < 50; sweep++) {
+
+            double offDiagonal = 0.0;
+            for (int p = 0; p < n; p++) {
+                for (int q = p + 1; q < n; q++) {
+                    offDiagonal += a[p * n + q] * a[p * n + q];
+                }
+            }
+            if (offDiagonal < 1e-30) {
+                break;
+            }
+
+            for (int p = 0; p < n; p++) {
+                for (int q = p + 1; q < n; q++) {
+
+                    double apq = a[p * n + q];
+                    if (std::fabs(apq) < 1e-300) {
+                        continue;
+                    }
+
+                    // rotation that zeroes a[p][q]
+                    double theta = (a[q * n + q] - a[p * n + p]) / (2.0 * apq);
+                    double t = (theta >= 0.0 ? 1.0 : -1.0) / (std::fabs(theta) + std::sqrt(theta * theta + 1.0));
+                    double c = 1.0 / std::sqrt(t * t + 1.0);
+                    double s = t * c;
+
+                    for (int k = 0; k < n; k++) {
+                        double akp = a[k * n + p];
+                        double akq = a[k * n + q];
+                        a[k * n + p] = c * akp - s * akq;
+                        a[k * n + q] = s * akp + c * akq;
+                    }
+                    for (int k = 0; k < n; k++) {
+                        double apk = a[p * n + k];
+                        double aqk = a[q * n + k];
+                        a[p * n + k] = c * apk - s * aqk;
+                        a[q * n + k] = s * apk + c * aqk;
+                    }
+                    for (int k = 0; k < n; k++) {
+                        double vpk = vectors[p * n + k];
+                        double vqk = vectors[q * n + k];
+                        vectors[p * n + k] = c * vpk - s * vqk;
+                        vectors[q * n + k] = s * vpk + c * vqk;
+                    }
+                }
+            }
+        }
+
+        for (int i = 0; i < n; i++) {
+            values[i] = a[i * n + i];
+        }
+    }
+
+    // FNV-1a
+    static void hashValue(uint64_t& hash, uint64_t value) {
+
+        for (int i = 0; i < 8; i++) {
+            hash ^= (value >> (8 * i)) & 0xFF;
+            hash *= 1099511628211ull;
+        }
+    }
+
+    // all the vertices of the model, the meshes one after the other
+    static void gatherVertices(gps::Model3D& model, std::vector<gps::Vertex>& out) {
+
+        out.clear();
+        for (gps::Mesh& mesh : model.getMeshes()) {
+            out.insert(out.end(), mesh.vertices.begin(), mesh.vertices.end());
+        }
+    }
+
+    // Centroid, principal axes (columns, largest spread first), spread along them
+    // and rms distance to the centroid
+    static void canonicalFrame(const std::vector<gps::Vertex>& vertices, double center[3], double axes[3][3], double spread[3], double& radius) {
+
+        center[0] = center[1] = center[2] = 0.0;
+        for (const gps::Vertex& vertex : vertices) {
+            for (int k = 0; k < 3; k++) {
+                center[k] += vertex.Position[k];
+            }
+        }
+        for (int k = 0; k < 3; k++) {
+            center[k] /= (double)vertices.size();
+        }
+
+        double covariance[9] = { 0.0 };
+        for (const gps::Vertex& vertex : vertices) {
+            double d[3] = { vertex.Position.x - center[0], vertex.Position.y - center[1], vertex.Position.z - center[2] };
+            for (int r = 0; r < 3; r++) {
+                for (int c = 0; c < 3; c++) {
+                    covariance[r * 3 + c] += d[r] * d[c];
+                }
+            }
+        }
+        radius = std::sqrt((covariance[0] + covariance[4] + covariance[8]) / (double)vertices.size());
+
+        double values[3];
+        double vectors[9];
+        jacobiEigen(covariance, 3, values, vectors);
+
+        int order[3] = { 0, 1, 2 };
+        std::sort(order, order + 3, [&values](int a, int b) { return values[a] > values[b]; });
+        for (int i = 0; i < 3; i++) {
+            spread[i] = values[order[i]];
+            for (int k = 0; k < 3; k++) {
+                axes[k][i] = vectors[order[i] * 3 + k];
+            }
+        }
+    }
+
+    // Rotation, scale and translation taking the points from onto the points to (Horn),
+    // xyz packed. The scale is solved for when fixedScale <= 0.
+    static void hornFit(const std::vector<double>& from, const std::vector<double>& to, double fixedScale, double R[3][3], double& scale, double translation[3]) {
+
+        size_t count = from.size() / 3;
+
+        // ===== CENTROIDS =====
+        double fromCenter[3] = { 0.0, 0.0, 0.0 };
+        double toCenter[3] = { 0.0, 0.0, 0.0 };
+        for (size_t i = 0; i < count; i++) {
+            for (int k = 0; k < 3; k++) {
+                fromCenter[k] += from[3 * i + k];
+                toCenter[k] += to[3 * i + k];
+            }
+        }
+        for (int k = 0; k < 3; k++) {
+            fromCenter[k] /= (double)count;
+            toCenter[k] /= (double)count;
+        }
+
+        // ===== CROSS COVARIANCE and spreads =====
+        double S[3][3] = { { 0.0 } };
+        double fromSpread = 0.0;
+        double toSpread = 0.0;
+        for (size_t i = 0; i < count; i++) {
+
+            double a[3], b[3];
+            for (int k = 0; k < 3; k++) {
+                a[k] = from[3 * i + k] - fromCenter[k];
+                b[k] = to[3 * i + k] - toCenter[k];
+            }
+            for (int r = 0; r < 3; r++) {
+                for (int c = 0; c < 3; c++) {
+                    S[r][c] += a[r] * b[c];
+                }
+                fromSpread += a[r] * a[r];
+                toSpread += b[r] * b[r];
+            }
+        }
+
+        // ===== ROTATION: the quaternion is the top eigenvector of N =====
+        double N[16] = {
+            S[0][0] + S[1][1] + S[2][2], S[1][2] - S[2][1],            S[2][0] - S[0][2],            S[0][1] - S[1][0],
+            S[1][2] - S[2][1],            S[0][0] - S[1][1] - S[2][2], S[0][1] + S[1][0],            S[2][0] + S[0][2],
+            S[2][0] - S[0][2],            S[0][1] + S[1][0],           -S[0][0] + S[1][1] - S[2][2], S[1][2] + S[2][1],
+            S[0][1] - S[1][0],            S[2][0] + S[0][2],           S[1][2] + S[2][1],            -S[0][0] - S[1][1] + S[2][2]
+        };
+        double values[4];
+        double vectors[16];
+        jacobiEigen(N, 4, values, vectors);
+
+        int best = 0;
+        for (int i = 1; i < 4; i++) {
+            if (values[i] > values[best]) {
+                best = i;
+            }
+        }
+        double w = vectors[best * 4 + 0];
+        double x = vectors[best * 4 + 1];
+        double y = vectors[best * 4 + 2];
+        double z = vectors[best * 4 + 3];
+
+        R[0][0] = 1.0 - 2.0 * (y * y + z * z); R[0][1] = 2.0 * (x * y - w * z);       R[0][2] = 2.0 * (x * z + w * y);
+        R[1][0] = 2.0 * (x * y + w * z);       R[1][1] = 1.0 - 2.0 * (x * x + z * z); R[1][2] = 2.0 * (y * z - w * x);
+        R[2][0] = 2.0 * (x * z - w * y);       R[2][1] = 2.0 * (y * z + w * x);       R[2][2] = 1.0 - 2.0 * (x * x + y * y);
+
+        // ===== SCALE and TRANSLATION =====
+        scale = fixedScale > 0.0 ? fixedScale : (fromSpread > 0.0 ? std::sqrt(toSpread / fromSpread) : 1.0);
+        for (int r = 0; r < 3; r++) {
+            translation[r] = toCenter[r] - scale * (R[r][0] * fromCenter[0] + R[r][1] * fromCenter[1] + R[r][2] * fromCenter[2]);
+        }
+    }
+
+    static glm::mat4 toMatrix(const double R[3][3], double scale, const double translation[3]) {
+
+        glm::mat4 transform = glm::mat4(1.0f);
+        for (int r = 0; r < 3; r++) {
+            for (int c = 0; c < 3; c++) {
+                transform[c][r] = (float)(scale * R[r][c]);
+            }
+            transform[3][r] = (float)translation[r];
+        }
+        return transform;
+    }
+
+    void InstancedModel::init(gps::Model3D& reference, const std::vector<glm::mat4>& instanceMatrices) {
+
+        this->reference = &reference;
+        this->instanceMatrices = instanceMatrices;
+
+        glGenBuffers(1, &instanceVBO);
+        glBindBuffer(GL_ARRAY_BUFFER, instanceVBO);
+        glBufferData(GL_ARRAY_BUFFER, instanceMatrices.size() * sizeof(glm::mat4), instanceMatrices.data(), GL_STATIC_DRAW);
+
+        std::vector<gps::Mesh>& meshes = reference.getMeshes();
+        vaos.resize(meshes.size());
+        glGenVertexArrays((GLsizei)vaos.size(), vaos.data());
+
+        for (size_t i = 0; i < meshes.size(); i++) {
+
+            gps::Buffers buffers = meshes[i].getBuffers();
+            glBindVertexArray(vaos[i]);
+
+            // the arena block holding the reference's vertices and indices, same layout as Mesh
+            glBindBuffer(GL_ARRAY_BUFFER, buffers.VBO);
+            glEnableVertexAttribArray(0);
+            glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (GLvoid*)0);
+            glEnableVertexAttribArray(1);
+            glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (GLvoid*)offsetof(Vertex, Normal));
+            glEnableVertexAttribArray(2);
+            glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (GLvoid*)offsetof(Vertex, TexCoords));
+            glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, buffers.EBO);
+
+            // model matrix, one column per attribute
+            glBindBuffer(GL_ARRAY_BUFFER, instanceVBO);
+            for (int column = 0; column < 4; column++) {
+                glEnableVertexAttribArray(3 + column);
+                glVertexAttribPointer(3 + column, 4, GL_FLOAT, GL_FALSE, sizeof(glm::mat4), (GLvoid*)(column * sizeof(glm::vec4)));
+                glVertexAttribDivisor(3 + column, 1);
+            }
+        }
+
+        glBindVertexArray(0);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+
+    void InstancedModel::Delete() {
+
+        // the vertex and index buffers belong to the reference model
+        if (!vaos.empty()) {
+            glDeleteVertexArrays((GLsizei)vaos.size(), vaos.data());
+        }
+        glDeleteBuffers(1, &instanceVBO);
+        vaos.clear();
+        instanceVBO = 0;
+        reference = nullptr;
+    }
+
+    void InstancedModel::Draw(gps::Shader shader) {
+
+        shader.useShaderProgram();
+
+        std::vector<gps::Mesh>& meshes = reference->getMeshes();
+        for (size_t i = 0; i < meshes.size(); i++) {
+
+            std::vector<gps::Texture>& textures = meshes[i].textures;
+            for (GLuint t = 0; t < textures.size(); t++) {
+
+                glActiveTexture(GL_TEXTURE0 + t);
+                glUniform1i(glGetUniformLocation(shader.shaderProgram, textures[t].type.c_str()), t);
+                glBindTexture(GL_TEXTURE_2D, textures[t].id);
+            }
+
+            glBindVertexArray(vaos[i]);
+            gps::GeometryArena::Range range = meshes[i].getRange();
+            glDrawElementsInstancedBaseVertex(GL_TRIANGLES, (GLsizei)range.indexCount, GL_UNSIGNED_INT, gps::GeometryArena::indexOffset(range),
+                (GLsizei)instanceMatrices.size(), range.baseVertex);
+            glBindVertexArray(0);
+
+            for (GLuint t = 0; t < textures.size(); t++) {
+
+                glActiveTexture(GL_TEXTURE0 + t);
+                glBindTexture(GL_TEXTURE_2D, 0);
+            }
+        }
+    }
+
+    int InstancedModel::getInstanceCount() {
+        return (int)instanceMatrices.size();
+    }
+
+    glm::mat4 InstancedModel::getInstanceMatrix(int index) {
+        return instanceMatrices[index];
+    }
+
+    uint64_t InstancedModel::canonicalHash(gps::Model3D& model) {
+
+        uint64_t hash = 14695981039346656037ull;
+
+        // topology and texture coordinates do not move with the model
+        std::vector<gps::Mesh>& meshes = model.getMeshes();
+        hashValue(hash, meshes.size());
+        for (gps::Mesh& mesh : meshes) {
+
+            hashValue(hash, mesh.vertices.size());
+            hashValue(hash, mesh.indices.size());
+            for (GLuint index : mesh.indices) {
+                hashValue(hash, index);
+            }
+            for (const gps::Vertex& vertex : mesh.vertices) {
+                hashValue(hash, (uint64_t)(int64_t)std::lround(vertex.TexCoords.x * 4096.0f));
+                hashValue(hash, (uint64_t)(int64_t)std::lround(vertex.TexCoords.y * 4096.0f));
+            }
+        }
+
+        // canonical pose: the spread along the principal axes, relative to the total
+        // (the size cancels out), coarse enough for the rounding of the files
+        std::vector<gps::Vertex> vertices;
+        gatherVertices(model, vertices);
+        if (vertices.empty()) {
+            return hash;
+        }
+
+        double center[3];
+        double axes[3][3];
+        double spread[3];
+        double radius;
+        canonicalFrame(vertices, center, axes, spread, radius);
+
+        double total = spread[0] + spread[1] + spread[2];
+        for (int k = 0; k < 3; k++) {
+            hashValue(hash, (uint64_t)std::lround(total > 0.0 ? spread[k] / total * 256.0 : 0.0));
+        }
+
+        return hash;
+    }
+
+    bool InstancedModel::fitTransform(const std::vector<gps::Vertex>& from, const std::vector<gps::Vertex>& to, glm::mat4& transform) {
+
+        size_t count = from.size();
+        if (count == 0 || count != to.size()) {
+            return false;
+        }
+
+        std::vector<double> fromPoints(3 * count);
+        std::vector<double> toPoints(3 * count);
+        double toCenter[3] = { 0.0, 0.0, 0.0 };
+        for (size_t i = 0; i < count; i++) {
+            for (int k = 0; k < 3; k++) {
+                fromPoints[3 * i + k] = from[i].Position[k];
+                toPoints[3 * i + k] = to[i].Position[k];
+                toCenter[k] += to[i].Position[k];
+            }
+        }
+
+        for (int k = 0; k < 3; k++) {
+            toCenter[k] /= (double)count;
+        }
+
+        double toSpread = 0.0;
+        for (size_t i = 0; i < count; i++) {
+            for (int k = 0; k < 3; k++) {
+                double d = to[i].Position[k] - toCenter[k];
+                toSpread += d * d;
+            }
+        }
+
+        double R[3][3];
+        double scale;
+        double translation[3];
+        hornFit(fromPoints, toPoints, 0.0, R, scale, translation);
+
+        // ===== VERIFY every vertex =====
+        double tolerance = FIT_TOLERANCE * std::sqrt(toSpread / (double)count) + 1e-3;
+        for (size_t i = 0; i < count; i++) {
+
+            const gps::Vertex& a = from[i];
+            const gps::Vertex& b = to[i];
+
+            for (int r = 0; r < 3; r++) {
+
+                double position = scale * (R[r][0] * a.Position[0] + R[r][1] * a.Position[1] + R[r][2] * a.Position[2]) + translation[r];
+                double normal = R[r][0] * a.Normal[0] + R[r][1] * a.Normal[1] + R[r][2] * a.Normal[2];
+
+                if (std::fabs(position - b.Position[r]) > tolerance || std::fabs(normal - b.Normal[r]) > NORMAL_TOLERANCE) {
+                    return false;
+                }
+            }
+            if (std::fabs(a.TexCoords.x - b.TexCoords.x) > TEXCOORD_TOLERANCE || std::fabs(a.TexCoords.y - b.TexCoords.y) > TEXCOORD_TOLERANCE) {
+                return false;
+            }
+        }
+
+        transform = toMatrix(R, scale, translation);
+        return true;
+    }
+
+    // mean distance from the transformed samples to the closest point of to
+    static double meanClosestDistance(const std::vector<double>& samples, const std::vector<double>& to, const double R[3][3], double scale, const double translation[3], std::vector<double>* closest) {
+
+        double total = 0.0;
+        size_t count = samples.size() / 3;
+        for (size_t i = 0; i < count; i++) {
+
+            double p[3];
+            for (int r = 0; r < 3; r++) {
+                p[r] = scale * (R[r][0] * samples[3 * i] + R[r][1] * samples[3 * i + 1] + R[r][2] * samples[3 * i + 2]) + translation[r];
+            }
+
+            size_t bestIndex = 0;
+            double best = 1e300;
+            for (size_t j = 0; j < to.size(); j += 3) {
+                double dx = p[0] - to[j], dy = p[1] - to[j + 1], dz = p[2] - to[j + 2];
+                double d = dx * dx + dy * dy + dz * dz;
+                if (d < best) {
+                    best = d;
+                    bestIndex = j;
+                }
+            }
+
+            total += std::sqrt(best);
+            if (closest != nullptr) {
+                for (int k = 0; k < 3; k++) {
+                    (*closest)[3 * i + k] = to[bestIndex + k];
+                }
+            }
+        }
+        return total / (double)count;
+    }
+
+    float InstancedModel::alignShapes(const std::vector<gps::Vertex>& from, const std::vector<gps::Vertex>& to, glm::mat4& transform) {
+
+        if (from.empty() || to.empty()) {
+            return 1e30f;
+        }
+
+        double fromCenter[3], toCenter[3];
+        double fromAxes[3][3], toAxes[3][3];
+        double fromSpread[3], toSpread[3];
+        double fromRadius, toRadius;
+        canonicalFrame(from, fromCenter, fromAxes, fromSpread, fromRadius);
+        canonicalFrame(to, toCenter, toAxes, toSpread, toRadius);
+        if (fromRadius <= 0.0) {
+            return 1e30f;
+        }
+
+        // a few hundred samples of from, all of to
+        size_t stride = std::max<size_t>(1, from.size() / ALIGN_SAMPLES);
+        std::vector<double> samples;
+        for (size_t i = 0; i < from.size(); i += stride) {
+            for (int k = 0; k < 3; k++) {
+                samples.push_back(from[i].Position[k]);
+            }
+        }
+        std::vector<double> toPoints(3 * to.size());
+        for (size_t i = 0; i < to.size(); i++) {
+            for (int k = 0; k < 3; k++) {
+                toPoints[3 * i + k] = to[i].Position[k];
+            }
+        }
+
+        double scale = toRadius / fromRadius;
+
+        // ===== CANONICAL POSES: the principal axes only give directions up to sign =====
+        double R[3][3];
+        double translation[3];
+        double error = 1e300;
+        for (int signs = 0; signs < 8; signs++) {
+
+            double flip[3] = { (signs & 1) ? -1.0 : 1.0, (signs & 2) ? -1.0 : 1.0, (signs & 4) ? -1.0 : 1.0 };
+            if (flip[0] * flip[1] * flip[2] < 0.0) {
+                // the axes are both right or both left handed, one flip would mirror
+                continue;
+            }
+
+            double candidate[3][3];
+            for (int r = 0; r < 3; r++) {
+                for (int c = 0; c < 3; c++) {
+                    candidate[r][c] = 0.0;
+                    for (int k = 0; k < 3; k++) {
+                        candidate[r][c] += toAxes[r][k] * flip[k] * fromAxes[c][k];
+                    }
+                }
+            }
+
+            double determinant =
+                candidate[0][0] * (candidate[1][1] * candidate[2][2] - candidate[1][2] * candidate[2][1]) -
+                candidate[0][1] * (candidate[1][0] * candidate[2][2] - candidate[1][2] * candidate[2][0]) +
+                candidate[0][2] * (candidate[1][0] * candidate[2][1] - candidate[1][1] * candidate[2][0]);
+            if (determinant < 0.0) {
+                for (int r = 0; r < 3; r++) {
+                    candidate[r][2] = -candidate[r][2];
+                }
+            }
+
+            double candidateTranslation[3];
+            for (int r = 0; r < 3; r++) {
+                candidateTranslation[r] = toCenter[r] - scale * (candidate[r][0] * fromCenter[0] + candidate[r][1] * fromCenter[1] + candidate[r][2] * fromCenter[2]);
+            }
+
+            double candidateError = meanClosestDistance(samples, toPoints, candidate, scale, candidateTranslation, nullptr);
+            if (candidateError < error) {
+                error = candidateError;
+                std::copy(&candidate[0][0], &candidate[0][0] + 9, &R[0][0]);
+                std::copy(candidateTranslation, candidateTranslation + 3, translation);
+            }
+        }
+
+        // ===== REFINE (ICP): pair with the closest points, refit =====
+        std::vector<double> closest(samples.size());
+        for (int iteration = 0; iteration < ALIGN_ITERATIONS; iteration++) {
+
+            meanClosestDistance(samples, toPoints, R, scale, translation, &closest);
+
+            double refinedR[3][3];
+            double refinedScale;
+            double refinedTranslation[3];
+            hornFit(samples, closest, scale, refinedR, refinedScale, refinedTranslation);
+
+            double refinedError = meanClosestDistance(samples, toPoints, refinedR, scale, refinedTranslation, nullptr);
+            if (refinedError >= error) {
+                break;
+            }
+            error = refinedError;
+            std::copy(&refinedR[0][0], &refinedR[0][0] + 9, &R[0][0]);
+            std::copy(refinedTranslation, refinedTranslation + 3, translation);
+        }
+
+        transform = toMatrix(R, scale, translation);
+        return (float)(error / toRadius);
+    }
+
+    bool InstancedModel::fitModel(gps::Model3D& from, gps::Model3D& to, glm::mat4& transform) {
+
+        std::vector<gps::Mesh>& fromMeshes = from.getMeshes();
+        std::vector<gps::Mesh>& toMeshes = to.getMeshes();
+        if (fromMeshes.size() != toMeshes.size()) {
+            return false;
+        }
+        for (size_t i = 0; i < fromMeshes.size(); i++) {
+            if (fromMeshes[i].vertices.size() != toMeshes[i].vertices.size() || fromMeshes[i].indices != toMeshes[i].indices) {
+                return false;
+            }
+        }
+
+        // one transform for the whole model, not one per mesh
+        std::vector<gps::Vertex> fromVertices;
+        std::vector<gps::Vertex> toVertices;
+        gatherVertices(from, fromVertices);
+        gatherVertices(to, toVertices);
+
+        return fitTransform(fromVertices, toVertices, transform);
+    }
+
+    void InstancedModel::findInstanceGroups(std::vector<gps::Model3D*>& models, std::vector<InstanceGroup>& groups) {
+
+        groups.clear();
+        std::vector<uint64_t> groupHashes;
+
+        for (int i = 0; i < (int)models.size(); i++) {
+
+            uint64_t hash = canonicalHash(*models[i]);
+
+            // only the groups in the same bucket are worth a fit
+            bool matched = false;
+            for (size_t g = 0; g < groups.size() && !matched; g++) {
+
+                glm::mat4 transform;
+                if (groupHashes[g] == hash && fitModel(*models[groups[g].reference], *models[i], transform)) {
+                    groups[g].members.push_back(i);
+                    groups[g].transforms.push_back(transform);
+                    matched = true;
+                }
+            }
+
+            if (!matched) {
+                InstanceGroup group;
+                group.reference = i;
+                group.members.push_back(i);
+                group.transforms.push_back(glm::mat4(1.0f));
+                groups.push_back(group);
+                groupHashes.push_back(hash);
+            }
+        }
+    }
+}
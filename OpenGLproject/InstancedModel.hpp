@@ -0,0 +1,85 @@
+#ifndef InstancedModel_hpp
+#define InstancedModel_hpp
+
+#if defined (__APPLE__)
+    #define GL_SILENCE_DEPRECATION
+    #include <OpenGL/gl3.h>
+#else
+    #define GLEW_STATIC
+    #include <GL/glew.h>
+#endif
+
+#include <glm/glm.hpp>
+
+#include "Shader.hpp"
+#include "Model3D.hpp"
+
+#include <cstdint>
+#include <vector>
+
+namespace gps {
+
+    // Models that turned out to be copies of the same geometry
+    struct InstanceGroup {
+        int reference;                      // index of the model whose geometry is kept
+        std::vector<int> members;           // every model of the group, the reference included
+        std::vector<glm::mat4> transforms;  // reference model space -> member, one per member
+    };
+
+    // One copy of a model's geometry drawn many times: every mesh gets a
+    // second VAO over the reference's vertex / index buffers plus a per
+    // instance model matrix (attributes 3-6), one glDrawElementsInstanced per mesh.
+    //
+    // The deduplication finds the models that are the same mesh baked at
+    // different places. Candidates are bucketed by a hash of their canonical
+    // pose (counts, texture coordinates and the principal axes spread, none of
+    // which move with the model), then the transform between two candidates is
+    // fitted (Horn's closed form, rotation + uniform scale + translation) and
+    // accepted only if it maps every vertex onto its counterpart.
+    class InstancedModel {
+
+    public:
+        // relative to the size of the model
+        static constexpr float FIT_TOLERANCE = 1e-4f;
+        // samples and refinement steps of alignShapes
+        static const int ALIGN_SAMPLES = 512;
+        static const int ALIGN_ITERATIONS = 8;
+
+        void init(gps::Model3D& reference, const std::vector<glm::mat4>& instanceMatrices);
+        void Delete();
+
+        // the shader reads the matrix from attributes 3-6 instead of the model uniform
+        void Draw(gps::Shader shader);
+
+        int getInstanceCount();
+        glm::mat4 getInstanceMatrix(int index);
+
+        // ===== DEDUPLICATION =====
+        // Groups the models that are transforms of each other, every model ends
+        // up in exactly one group (alone if nothing matches it).
+        static void findInstanceGroups(std::vector<gps::Model3D*>& models, std::vector<InstanceGroup>& groups);
+
+        // Invariant to rotation, uniform scale and translation
+        static uint64_t canonicalHash(gps::Model3D& model);
+
+        // Fits from -> to, vertex i onto vertex i. Returns false when no such
+        // transform maps the positions and normals within the tolerance.
+        static bool fitTransform(const std::vector<gps::Vertex>& from, const std::vector<gps::Vertex>& to, glm::mat4& transform);
+
+        // Fits from -> to without a vertex correspondence, for shapes that are only
+        // alike (a re-exported or re-posed copy): canonical poses first, then a few
+        // closest point iterations. The scale is the ratio of the sizes.
+        // Returns the mean distance left, relative to the size of to.
+        static float alignShapes(const std::vector<gps::Vertex>& from, const std::vector<gps::Vertex>& to, glm::mat4& transform);
+
+    private:
+        gps::Model3D* reference = nullptr;
+        std::vector<GLuint> vaos; // one per mesh of the reference
+        GLuint instanceVBO = 0;
+        std::vector<glm::mat4> instanceMatrices;
+
+        static bool fitModel(gps::Model3D& from, gps::Model3D& to, glm::mat4& transform);
+    };
+}
+
+#endif /* InstancedModel_hpp */
@@ -12,7 +12,39 @@ namespace gps {
 	}
 
 	Buffers Mesh::getBuffers() {
-	    return this->buffers;
+
+		Buffers buffers = { 0, 0, 0 };
+		if (this->range.block >= 0) {
+			buffers.VAO = getArena().getVertexArray(this->range.block);
+			buffers.VBO = getArena().getVertexBuffer(this->range.block);
+			buffers.EBO = getArena().getIndexBuffer(this->range.block);
+		}
+		return buffers;
+	}
+
+	GeometryArena::Range Mesh::getRange() {
+	    return this->range;
+	}
+
+	void Mesh::Delete() {
+		getArena().free(this->range);
+	}
+
+	// Never destroyed: models freeing their meshes at exit may outlive it otherwise
+	gps::GeometryArena& Mesh::getArena() {
+
+		static gps::GeometryArena* arena = new gps::GeometryArena(sizeof(Vertex), [] {
+			// Vertex Positions
+			glEnableVertexAttribArray(0);
+			glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (GLvoid*)0);
+			// Vertex Normals
+			glEnableVertexAttribArray(1);
+			glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (GLvoid*)offsetof(Vertex, Normal));
+			// Vertex Texture Coords
+			glEnableVertexAttribArray(2);
+			glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (GLvoid*)offsetof(Vertex, TexCoords));
+		});
+		return *arena;
 	}
 
 	/* Mesh drawing function - also applies associated textures */
@@ -28,8 +60,8 @@ namespace gps {
 			glBindTexture(GL_TEXTURE_2D, this->textures[i].id);
 		}
 
-		glBindVertexArray(this->buffers.VAO);
-		glDrawElements(GL_TRIANGLES, (GLsizei)this->indices.size(), GL_UNSIGNED_INT, 0);
+		glBindVertexArray(getArena().getVertexArray(this->range.block));
+		glDrawElementsBaseVertex(GL_TRIANGLES, (GLsizei)this->range.indexCount, GL_UNSIGNED_INT, GeometryArena::indexOffset(this->range), this->range.baseVertex);
 		glBindVertexArray(0);
 
         for(GLuint i = 0; i < this->textures.size(); i++) {
@@ -40,33 +72,9 @@ namespace gps {
 
     }
 
-	// Initializes all the buffer objects/arrays
+	// Copies the vertices and indices into the shared arena
 	void Mesh::setupMesh() {
 
-		// Create buffers/arrays
-		glGenVertexArrays(1, &this->buffers.VAO);
-		glGenBuffers(1, &this->buffers.VBO);
-		glGenBuffers(1, &this->buffers.EBO);
-
-		glBindVertexArray(this->buffers.VAO);
-		// Load data into vertex buffers
-		glBindBuffer(GL_ARRAY_BUFFER, this->buffers.VBO);
-		glBufferData(GL_ARRAY_BUFFER, this->vertices.size() * sizeof(Vertex), &this->vertices[0], GL_STATIC_DRAW);
-
-		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, this->buffers.EBO);
-		glBufferData(GL_ELEMENT_ARRAY_BUFFER, this->indices.size() * sizeof(GLuint), &this->indices[0], GL_STATIC_DRAW);
-
-		// Set the vertex attribute pointers
-		// Vertex Positions
-		glEnableVertexAttribArray(0);
-		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (GLvoid*)0);
-		// Vertex Normals
-		glEnableVertexAttribArray(1);
-		glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (GLvoid*)offsetof(Vertex, Normal));
-		// Vertex Texture Coords
-		glEnableVertexAttribArray(2);
-		glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (GLvoid*)offsetof(Vertex, TexCoords));
-
-		glBindVertexArray(0);
+		this->range = getArena().allocate(this->vertices.data(), (GLuint)this->vertices.size(), this->indices.data(), (GLuint)this->indices.size());
 	}
 }
@@ -11,6 +11,7 @@
 
 #include <glm/glm.hpp>
 
+#include "GeometryArena.hpp"
 #include "Shader.hpp"
 
 #include <string>
@@ -56,15 +57,24 @@ namespace gps {
 
 	    Mesh(std::vector<Vertex> vertices, std::vector<GLuint> indices, std::vector<Texture> textures);
 
+	    // The buffers of the mesh's arena block, shared with the other meshes in it
 	    Buffers getBuffers();
+	    // Where the mesh is in them
+	    GeometryArena::Range getRange();
 
 	    void Draw(gps::Shader shader);
 
+	    // Gives the mesh's vertices and indices back to the arena (video memory only)
+	    void Delete();
+
+	    // The arena of every mesh, the Vertex format
+	    static gps::GeometryArena& getArena();
+
     private:
         /*  Render data  */
-        Buffers buffers;
+        GeometryArena::Range range;
 
-	    // Initializes all the buffer objects/arrays
+	    // Copies the vertices and indices into the shared arena
 	    void setupMesh();
 
     };
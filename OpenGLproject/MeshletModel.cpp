@@ -0,0 +1,310 @@
+#include "MeshletModel.hpp"
+
+#include "Frustum.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+namespace gps {
+
+    static GLuint diffuseTextureOf(gps::Mesh& mesh, GLuint fallback) {
+
+        for (const gps::Texture& texture : mesh.textures) {
+            if (texture.type == "diffuseTexture") {
+                return texture.id;
+            }
+        }
+        return fallback;
+    }
+
+    void MeshletModel::build(gps::Model3D& model) {
+
+        parts.clear();
+        for (gps::Mesh& mesh : model.getMeshes()) {
+            Part part;
+            part.mesh = &mesh;
+            buildMeshlets(mesh, part.meshlets);
+            gps::Mesh::getArena().updateIndices(mesh.getRange(), mesh.indices.data());
+            parts.push_back(part);
+        }
+
+        // the meshes of a block and texture follow each other, one call for them all
+        std::stable_sort(parts.begin(), parts.end(), [](const Part& a, const Part& b) {
+            if (a.mesh->getRange().block != b.mesh->getRange().block) {
+                return a.mesh->getRange().block < b.mesh->getRange().block;
+            }
+            return diffuseTextureOf(*a.mesh, 0) < diffuseTextureOf(*b.mesh, 0);
+        });
+    }
+
+    // ===== BUILD =====
+    void MeshletModel::buildMeshlets(gps::Mesh& mesh, std::vector<Meshlet>& meshlets) {
+
+        const std::vector<GLuint>& indices = mesh.indices;
+        const std::vector<gps::Vertex>& vertices = mesh.vertices;
+        GLuint triangleCount = (GLuint)(indices.size() / 3);
+
+        // the loader gives every corner a vertex of its own: the meshlets are
+        // grown and counted over the positions, the vertices welded by position
+        std::vector<GLuint> sorted(vertices.size());
+        for (GLuint v = 0; v < (GLuint)vertices.size(); v++) {
+            sorted[v] = v;
+        }
+        auto lexicographic = [&vertices](GLuint a, GLuint b) {
+            const glm::vec3& p = vertices[a].Position;
+            const glm::vec3& q = vertices[b].Position;
+            return p.x != q.x ? p.x < q.x : (p.y != q.y ? p.y < q.y : p.z < q.z);
+        };
+        std::sort(sorted.begin(), sorted.end(), lexicographic);
+        std::vector<GLuint> welded(vertices.size());
+        std::vector<GLuint> positionVertex; // a vertex at every position
+        for (size_t i = 0; i < sorted.size(); i++) {
+            if (i == 0 || vertices[sorted[i]].Position != vertices[sorted[i - 1]].Position) {
+                positionVertex.push_back(sorted[i]);
+            }
+            welded[sorted[i]] = (GLuint)positionVertex.size() - 1;
+        }
+
+        // the triangles of every position
+        std::vector<GLuint> firstTriangle(positionVertex.size() + 1, 0);
+        for (GLuint index : indices) {
+            firstTriangle[welded[index] + 1]++;
+        }
+        for (size_t v = 0; v < positionVertex.size(); v++) {
+            firstTriangle[v + 1] += firstTriangle[v];
+        }
+        std::vector<GLuint> vertexTriangles(triangleCount * 3);
+        std::vector<GLuint> filled(firstTriangle.begin(), firstTriangle.end() - 1);
+        for (GLuint t = 0; t < triangleCount; t++) {
+            for (int k = 0; k < 3; k++) {
+                vertexTriangles[filled[welded[indices[3 * t + k]]]++] = t;
+            }
+        }
+
+        std::vector<bool> used(triangleCount, false);
+        std::vector<int> inMeshlet(positionVertex.size(), -1);
+        std::vector<GLuint> meshletVertices;
+        std::vector<GLuint> candidates;
+        std::vector<GLuint> ordered;
+        ordered.reserve(triangleCount * 3);
+
+        GLuint seed = 0;
+        while (true) {
+            while (seed < triangleCount && used[seed]) {
+                seed++;
+            }
+            if (seed == triangleCount) {
+                break;
+            }
+
+            int id = (int)meshlets.size();
+            Meshlet meshlet;
+            meshlet.firstIndex = (GLuint)ordered.size();
+            meshletVertices.clear();
+            candidates.clear();
+
+            GLuint next = seed;
+            for (int triangles = 1; ; triangles++) {
+                used[next] = true;
+                for (int k = 0; k < 3; k++) {
+                    ordered.push_back(indices[3 * next + k]);
+                    GLuint v = welded[indices[3 * next + k]];
+                    if (inMeshlet[v] == id) {
+                        continue;
+                    }
+                    inMeshlet[v] = id;
+                    meshletVertices.push_back(v);
+                    for (GLuint i = firstTriangle[v]; i < firstTriangle[v + 1]; i++) {
+                        if (!used[vertexTriangles[i]]) {
+                            candidates.push_back(vertexTriangles[i]);
+                        }
+                    }
+                }
+                if (triangles == MAX_TRIANGLES) {
+                    break;
+                }
+
+                // the neighbour adding the fewest vertices, the earliest of those
+                int bestNew = 4;
+                GLuint best = 0;
+                for (size_t c = 0; c < candidates.size(); ) {
+                    GLuint t = candidates[c];
+                    if (used[t]) {
+                        candidates[c] = candidates.back();
+                        candidates.pop_back();
+                        continue;
+                    }
+                    int added = 0;
+                    for (int k = 0; k < 3; k++) {
+                        added += inMeshlet[welded[indices[3 * t + k]]] != id;
+                    }
+                    if (meshletVertices.size() + added <= (size_t)MAX_VERTICES && (added < bestNew || (added == bestNew && t < best))) {
+                        bestNew = added;
+                        best = t;
+                    }
+                    c++;
+                }
+                if (bestNew == 4) {
+                    break;
+                }
+                next = best;
+            }
+            meshlet.indexCount = (GLuint)ordered.size() - meshlet.firstIndex;
+
+            // ===== BOUNDS =====
+            glm::vec3 low = vertices[positionVertex[meshletVertices[0]]].Position;
+            glm::vec3 high = low;
+            for (GLuint v : meshletVertices) {
+                low = glm::min(low, vertices[positionVertex[v]].Position);
+                high = glm::max(high, vertices[positionVertex[v]].Position);
+            }
+            meshlet.center = 0.5f * (low + high);
+            meshlet.radius = 0.0f;
+            for (GLuint v : meshletVertices) {
+                meshlet.radius = std::max(meshlet.radius, glm::length(vertices[positionVertex[v]].Position - meshlet.center));
+            }
+
+            std::vector<glm::vec3> normals;
+            glm::vec3 sum = glm::vec3(0.0f);
+            for (GLuint i = meshlet.firstIndex; i < meshlet.firstIndex + meshlet.indexCount; i += 3) {
+                glm::vec3 a = vertices[ordered[i]].Position;
+                glm::vec3 normal = glm::cross(vertices[ordered[i + 1]].Position - a, vertices[ordered[i + 2]].Position - a);
+                float length = glm::length(normal);
+                if (length > 0.0f) {
+                    normals.push_back(normal / length);
+                    sum += normals.back();
+                }
+            }
+            meshlet.coneAxis = glm::vec3(0.0f, 0.0f, 1.0f);
+            meshlet.coneCutoff = 1.0f;
+            if (glm::length(sum) > 1e-6f) {
+                meshlet.coneAxis = glm::normalize(sum);
+                float minDot = 1.0f;
+                for (const glm::vec3& normal : normals) {
+                    minDot = std::min(minDot, glm::dot(normal, meshlet.coneAxis));
+                }
+                if (minDot > 0.0f) {
+                    meshlet.coneCutoff = std::sqrt(1.0f - minDot * minDot);
+                }
+            }
+            meshlets.push_back(meshlet);
+        }
+
+        mesh.indices = ordered;
+    }
+
+    void MeshletModel::Delete() {
+        parts.clear();
+    }
+
+    // ===== DRAW =====
+    void MeshletModel::Draw(gps::Shader& shader, const glm::mat4& viewProjection, const glm::vec3& camera, const glm::vec3& material, GLuint texture) {
+
+        gps::Frustum frustum(viewProjection);
+        GLuint program = shader.shaderProgram;
+        glUniform1f(glGetUniformLocation(program, "objectLightMultiplier"), material.x);
+        glUniform1f(glGetUniformLocation(program, "shininess"), material.y);
+        glUniform1f(glGetUniformLocation(program, "specularStrength"), material.z);
+        glActiveTexture(GL_TEXTURE0);
+        glUniform1i(glGetUniformLocation(program, "diffuseTexture"), 0);
+
+        lastVisible = 0;
+        lastFrustumCulled = 0;
+        lastBackfaceCulled = 0;
+        lastRanges = 0;
+        std::vector<GLsizei> counts;
+        std::vector<const GLvoid*> offsets;
+        std::vector<GLint> baseVertices;
+        int callBlock = -1;
+        GLuint callTexture = 0;
+
+        auto flush = [&]() {
+            if (counts.empty()) {
+                return;
+            }
+            glBindVertexArray(gps::Mesh::getArena().getVertexArray(callBlock));
+            glBindTexture(GL_TEXTURE_2D, callTexture);
+            glMultiDrawElementsBaseVertex(GL_TRIANGLES, counts.data(), GL_UNSIGNED_INT, offsets.data(), (GLsizei)counts.size(), baseVertices.data());
+            lastRanges += (int)counts.size();
+            counts.clear();
+            offsets.clear();
+            baseVertices.clear();
+        };
+
+        for (Part& part : parts) {
+            GeometryArena::Range range = part.mesh->getRange();
+            GLuint partTexture = diffuseTextureOf(*part.mesh, texture);
+            if (range.block != callBlock || partTexture != callTexture) {
+                flush();
+                callBlock = range.block;
+                callTexture = partTexture;
+            }
+
+            GLuint rangeEnd = 0;
+            bool open = false; // the last range is this mesh's, it can grow
+            for (const Meshlet& meshlet : part.meshlets) {
+                if (culling) {
+                    if (!frustum.intersectsSphere(meshlet.center, meshlet.radius)) {
+                        lastFrustumCulled++;
+                        continue;
+                    }
+                    // every point of the sphere sees the back of every normal in the cone
+                    glm::vec3 toCenter = meshlet.center - camera;
+                    if (meshlet.coneCutoff < 1.0f &&
+                        glm::dot(toCenter, meshlet.coneAxis) >= meshlet.coneCutoff * glm::length(toCenter) + meshlet.radius * (1.0f + meshlet.coneCutoff)) {
+                        lastBackfaceCulled++;
+                        continue;
+                    }
+                }
+                lastVisible++;
+                if (open && meshlet.firstIndex == rangeEnd) {
+                    counts.back() += (GLsizei)meshlet.indexCount;
+                }
+                else {
+                    counts.push_back((GLsizei)meshlet.indexCount);
+                    offsets.push_back((const GLvoid*)((size_t)(range.firstIndex + meshlet.firstIndex) * sizeof(GLuint)));
+                    baseVertices.push_back(range.baseVertex);
+                    open = true;
+                }
+                rangeEnd = meshlet.firstIndex + meshlet.indexCount;
+            }
+        }
+        flush();
+
+        glBindVertexArray(0);
+        glBindTexture(GL_TEXTURE_2D, 0);
+    }
+
+    void MeshletModel::setCulling(bool enabled) {
+        culling = enabled;
+    }
+
+    bool MeshletModel::getCulling() {
+        return culling;
+    }
+
+    int MeshletModel::getMeshletCount() {
+
+        int count = 0;
+        for (Part& part : parts) {
+            count += (int)part.meshlets.size();
+        }
+        return count;
+    }
+
+    int MeshletModel::getVisibleCount() {
+        return lastVisible;
+    }
+
+    int MeshletModel::getFrustumCulledCount() {
+        return lastFrustumCulled;
+    }
+
+    int MeshletModel::getBackfaceCulledCount() {
+        return lastBackfaceCulled;
+    }
+
+    int MeshletModel::getRangeCount() {
+        return lastRanges;
+    }
+}
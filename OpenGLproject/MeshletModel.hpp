@@ -0,0 +1,90 @@
+#ifndef MeshletModel_hpp
+#define MeshletModel_hpp
+
+#if defined (__APPLE__)
+    #define GL_SILENCE_DEPRECATION
+    #include <OpenGL/gl3.h>
+#else
+    #define GLEW_STATIC
+    #include <GL/glew.h>
+#endif
+
+#include <glm/glm.hpp>
+
+#include "Model3D.hpp"
+#include "Shader.hpp"
+
+#include <vector>
+
+namespace gps {
+
+    // A big model drawn as meshlets: runs of at most MAX_TRIANGLES triangles
+    // over at most MAX_VERTICES vertices, grown across shared edges from a
+    // seed so they stay compact. Each has a bounding sphere and a cone
+    // holding its normals.
+    //
+    // build reorders the indices of every mesh (in the model and in its arena
+    // range) so each meshlet is a run of them; the model itself still draws
+    // the same. Draw leaves out the meshlets outside the frustum and those
+    // whose cone faces away from the camera, merges neighbouring visible ones
+    // into one range and draws the ranges of every arena block and texture
+    // with one glMultiDrawElementsBaseVertex.
+    //
+    // The cone test holds for the model's space under a rotation, a
+    // translation and a uniform scale.
+    class MeshletModel {
+
+    public:
+        static const int MAX_VERTICES = 64;
+        static const int MAX_TRIANGLES = 124;
+
+        // the model must stay loaded while this draws it
+        void build(gps::Model3D& model);
+        void Delete();
+
+        // the shader (already in use) draws the visible meshlets;
+        // viewProjection: maps the model's space (model included);
+        // camera: in the model's space;
+        // material: light multiplier, shininess, specular strength;
+        // texture: for the meshes without a diffuse texture of their own
+        void Draw(gps::Shader& shader, const glm::mat4& viewProjection, const glm::vec3& camera, const glm::vec3& material, GLuint texture = 0);
+
+        // off: every meshlet drawn, to compare
+        void setCulling(bool enabled);
+        bool getCulling();
+
+        int getMeshletCount();
+        // of the last Draw
+        int getVisibleCount();
+        int getFrustumCulledCount();
+        int getBackfaceCulledCount();
+        int getRangeCount();
+
+    private:
+        struct Meshlet {
+            GLuint firstIndex; // in the mesh's indices
+            GLuint indexCount;
+            glm::vec3 center;
+            float radius;
+            glm::vec3 coneAxis;
+            // sine of the cone's half angle, 1 when the normals span a half space or more
+            float coneCutoff;
+        };
+
+        struct Part {
+            gps::Mesh* mesh;
+            std::vector<Meshlet> meshlets;
+        };
+
+        std::vector<Part> parts; // by arena block
+        bool culling = true;
+        int lastVisible = 0;
+        int lastFrustumCulled = 0;
+        int lastBackfaceCulled = 0;
+        int lastRanges = 0;
+
+        static void buildMeshlets(gps::Mesh& mesh, std::vector<Meshlet>& meshlets);
+    };
+}
+
+#endif /* MeshletModel_hpp */
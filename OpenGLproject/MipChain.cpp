@@ -0,0 +1,156 @@
+#include "MipChain.hpp"
+
+#include "stb_image.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+
+namespace gps {
+
+    static const char MIP_FILE_MAGIC[4] = { 'M', 'I', 'P', '1' };
+
+    static int levelSize(int size, int level) {
+        return std::max(1, size >> level);
+    }
+
+    bool MipChain::open(const std::string& imagePath) {
+
+        path = imagePath + ".mips";
+        if (readHeader()) {
+            return true;
+        }
+        build(imagePath, path);
+        return readHeader();
+    }
+
+    void MipChain::build(const std::string& imagePath, const std::string& mipPath) {
+
+        int width, height, n;
+        unsigned char* pixels = stbi_load(imagePath.c_str(), &width, &height, &n, 4);
+        if (!pixels) {
+            fprintf(stderr, "ERROR: could not load %s\n", imagePath.c_str());
+            return;
+        }
+
+        std::vector<unsigned char> level((size_t)width * height * 4);
+        for (int y = 0; y < height; y++) {
+            std::memcpy(&level[(size_t)y * width * 4], pixels + (size_t)(height - y - 1) * width * 4, (size_t)width * 4);
+        }
+        stbi_image_free(pixels);
+
+        writeLevels(mipPath, width, height, std::move(level));
+    }
+
+    void MipChain::write(const std::string& imagePath, int width, int height, const std::vector<unsigned char>& pixels) {
+        writeLevels(imagePath + ".mips", width, height, pixels);
+    }
+
+    void MipChain::writeLevels(const std::string& mipPath, int width, int height, std::vector<unsigned char> level) {
+
+        int levels = 1;
+        while (std::max(levelSize(width, levels - 1), levelSize(height, levels - 1)) > 1) {
+            levels++;
+        }
+
+        std::ofstream file(mipPath, std::ios::binary);
+        file.write(MIP_FILE_MAGIC, 4);
+        int header[3] = { width, height, levels };
+        file.write((const char*)header, sizeof(header));
+
+        float toLinear[256];
+        for (int i = 0; i < 256; i++) {
+            float c = i / 255.0f;
+            toLinear[i] = c <= 0.04045f ? c / 12.92f : std::pow((c + 0.055f) / 1.055f, 2.4f);
+        }
+
+        int w = width;
+        int h = height;
+        for (int l = 0; l < levels; l++) {
+            file.write((const char*)level.data(), (std::streamsize)level.size());
+            if (l + 1 == levels) {
+                break;
+            }
+
+            int nextW = levelSize(width, l + 1);
+            int nextH = levelSize(height, l + 1);
+            std::vector<unsigned char> next((size_t)nextW * nextH * 4);
+            for (int y = 0; y < nextH; y++) {
+                for (int x = 0; x < nextW; x++) {
+                    int x0 = std::min(2 * x, w - 1), x1 = std::min(2 * x + 1, w - 1);
+                    int y0 = std::min(2 * y, h - 1), y1 = std::min(2 * y + 1, h - 1);
+                    const unsigned char* p[4] = { &level[((size_t)y0 * w + x0) * 4], &level[((size_t)y0 * w + x1) * 4],
+                        &level[((size_t)y1 * w + x0) * 4], &level[((size_t)y1 * w + x1) * 4] };
+                    unsigned char* out = &next[((size_t)y * nextW + x) * 4];
+                    for (int c = 0; c < 3; c++) {
+                        float linear = 0.25f * (toLinear[p[0][c]] + toLinear[p[1][c]] + toLinear[p[2][c]] + toLinear[p[3][c]]);
+                        float srgb = linear <= 0.0031308f ? linear * 12.92f : 1.055f * std::pow(linear, 1.0f / 2.4f) - 0.055f;
+                        out[c] = (unsigned char)std::min(255.0f, srgb * 255.0f + 0.5f);
+                    }
+                    out[3] = (unsigned char)((p[0][3] + p[1][3] + p[2][3] + p[3][3] + 2) / 4);
+                }
+            }
+            level.swap(next);
+            w = nextW;
+            h = nextH;
+        }
+    }
+
+    bool MipChain::readHeader() {
+
+        std::ifstream file(path, std::ios::binary);
+        char magic[4];
+        int header[3];
+        if (!file.read(magic, 4) || std::memcmp(magic, MIP_FILE_MAGIC, 4) != 0 || !file.read((char*)header, sizeof(header))) {
+            return false;
+        }
+
+        width = header[0];
+        height = header[1];
+        levels = header[2];
+        levelOffsets.clear();
+        size_t offset = 4 + sizeof(header);
+        for (int l = 0; l < levels; l++) {
+            levelOffsets.push_back(offset);
+            offset += (size_t)levelSize(width, l) * levelSize(height, l) * 4;
+        }
+
+        // a file cut short (a run stopped while writing it) is made again
+        file.seekg(0, std::ios::end);
+        return (size_t)file.tellg() == offset;
+    }
+
+    const std::string& MipChain::getPath() {
+        return path;
+    }
+
+    int MipChain::getWidth() {
+        return width;
+    }
+
+    int MipChain::getHeight() {
+        return height;
+    }
+
+    int MipChain::getLevelCount() {
+        return levels;
+    }
+
+    int MipChain::getLevelWidth(int level) {
+        return levelSize(width, level);
+    }
+
+    int MipChain::getLevelHeight(int level) {
+        return levelSize(height, level);
+    }
+
+    size_t MipChain::getLevelOffset(int level) {
+        return levelOffsets[level];
+    }
+
+    size_t MipChain::getLevelSize(int level) {
+        return (size_t)levelSize(width, level) * levelSize(height, level) * 4;
+    }
+}
@@ -0,0 +1,48 @@
+#ifndef MipChain_hpp
+#define MipChain_hpp
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+namespace gps {
+
+    // An image and all its mip levels (down to 1 x 1) in one file next to it
+    // (path + ".mips"): a header, then every level, rows bottom first like
+    // OpenGL reads them. It is written from the image the first time, so a
+    // level, or a part of one, is read later without decoding the image.
+    // The levels are averaged in linear space, like the sRGB mipmaps OpenGL
+    // makes.
+    class MipChain {
+
+    public:
+        // builds the file when it is missing or cut short; false when neither loads
+        bool open(const std::string& imagePath);
+        // the file of an image made in memory (RGBA8, rows bottom first), where
+        // open(imagePath) finds it; written over every time
+        static void write(const std::string& imagePath, int width, int height, const std::vector<unsigned char>& pixels);
+
+        const std::string& getPath();
+        int getWidth();
+        int getHeight();
+        int getLevelCount();
+        int getLevelWidth(int level);
+        int getLevelHeight(int level);
+        // where the level starts in the file, and its size, in bytes (RGBA8)
+        size_t getLevelOffset(int level);
+        size_t getLevelSize(int level);
+
+    private:
+        std::string path;
+        int width = 0;
+        int height = 0;
+        int levels = 0;
+        std::vector<size_t> levelOffsets;
+
+        static void build(const std::string& imagePath, const std::string& mipPath);
+        static void writeLevels(const std::string& mipPath, int width, int height, std::vector<unsigned char> level);
+        bool readHeader();
+    };
+}
+
+#endif /* MipChain_hpp */
@@ -1,4 +1,5 @@
 #include "Model3D.hpp"
+#include "TextureStreamer.hpp"
 
 namespace gps {
 
@@ -20,6 +21,35 @@ namespace gps {
 			meshes[i].Draw(shaderProgram);
 	}
 
+	glm::vec3 Model3D::getBoundsMin() {
+
+		return boundsMin;
+	}
+
+	glm::vec3 Model3D::getBoundsMax() {
+
+		return boundsMax;
+	}
+
+	void Model3D::setTextureStreamer(gps::TextureStreamer* streamer) {
+
+		textureStreamer = streamer;
+	}
+
+	std::vector<gps::Mesh>& Model3D::getMeshes() {
+
+		return meshes;
+	}
+
+	void Model3D::releaseMeshes() {
+
+		for (size_t i = 0; i < meshes.size(); i++) {
+
+			meshes.at(i).Delete();
+		}
+		meshes.clear();
+	}
+
 	// Does the parsing of the .obj file and fills in the data structure
 	void Model3D::ReadOBJ(std::string fileName, std::string basePath) {
 
@@ -94,6 +124,14 @@ namespace gps {
 
 					vertices.push_back(currentVertex);
 
+					if (!hasBounds) {
+
+						boundsMin = boundsMax = vertexPosition;
+						hasBounds = true;
+					}
+					boundsMin = glm::min(boundsMin, vertexPosition);
+					boundsMax = glm::max(boundsMax, vertexPosition);
+
 					indices.push_back((GLuint)(index_offset + v));
 				}
 
@@ -163,7 +201,7 @@ namespace gps {
 			}
 
 			gps::Texture currentTexture;
-			currentTexture.id = ReadTextureFromFile(path.c_str());
+			currentTexture.id = textureStreamer ? textureStreamer->load(path) : ReadTextureFromFile(path.c_str());
 			currentTexture.type = std::string(type);
 			currentTexture.path = path;
 
@@ -238,19 +276,14 @@ namespace gps {
 
 	Model3D::~Model3D() {
 
-        for (size_t i = 0; i < loadedTextures.size(); i++) {
+        for (size_t i = 0; i < loadedTextures.size() && !textureStreamer; i++) {
 
             glDeleteTextures(1, &loadedTextures.at(i).id);
         }
 
         for (size_t i = 0; i < meshes.size(); i++) {
 
-            GLuint VBO = meshes.at(i).getBuffers().VBO;
-            GLuint EBO = meshes.at(i).getBuffers().EBO;
-            GLuint VAO = meshes.at(i).getBuffers().VAO;
-            glDeleteBuffers(1, &VBO);
-            glDeleteBuffers(1, &EBO);
-            glDeleteVertexArrays(1, &VAO);
+            meshes.at(i).Delete();
         }
 	}
 }
@@ -12,6 +12,8 @@
 
 namespace gps {
 
+    class TextureStreamer;
+
     class Model3D {
 
     public:
@@ -26,11 +28,30 @@ namespace gps {
 		// Reads the pixel data from an image file and loads it into the video memory
 		GLuint ReadTextureFromFile(const char* file_name);
 
+		// Material textures come from the streamer (which owns them) instead, set before LoadModel
+		void setTextureStreamer(gps::TextureStreamer* streamer);
+
+		// Axis aligned bounding box of all the loaded meshes (model space)
+		glm::vec3 getBoundsMin();
+		glm::vec3 getBoundsMax();
+
+		// Component meshes, for the code that shares their buffers
+		std::vector<gps::Mesh>& getMeshes();
+
+		// Frees the meshes (video memory included), once another model draws this geometry.
+		// The bounds are kept.
+		void releaseMeshes();
+
     private:
 		// Component meshes - group of objects
         std::vector<gps::Mesh> meshes;
 		// Associated textures
         std::vector<gps::Texture> loadedTextures;
+		// Bounding box, grown while parsing
+		glm::vec3 boundsMin = glm::vec3(0.0f);
+		glm::vec3 boundsMax = glm::vec3(0.0f);
+		bool hasBounds = false;
+		gps::TextureStreamer* textureStreamer = nullptr;
 
 		// Does the parsing of the .obj file and fills in the data structure
 		void ReadOBJ(std::string fileName, std::string basePath);
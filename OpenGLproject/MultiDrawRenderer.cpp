@@ -0,0 +1,243 @@
+#include "MultiDrawRenderer.hpp"
+
+#include <algorithm>
+#include <iostream>
+
+namespace gps {
+
+    void MultiDrawRenderer::init() {
+
+#if !defined (__APPLE__)
+        indirect = GLEW_VERSION_4_3 || (GLEW_ARB_multi_draw_indirect && GLEW_ARB_base_instance);
+#endif
+
+        // 0 .. MAX_DRAWS - 1, read at the base instance
+        std::vector<GLfloat> drawIndices(MAX_DRAWS);
+        for (int i = 0; i < MAX_DRAWS; i++) {
+            drawIndices[i] = (GLfloat)i;
+        }
+        glGenBuffers(1, &drawIndexBuffer);
+        glBindBuffer(GL_ARRAY_BUFFER, drawIndexBuffer);
+        glBufferData(GL_ARRAY_BUFFER, drawIndices.size() * sizeof(GLfloat), drawIndices.data(), GL_STATIC_DRAW);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+        glGenBuffers(1, &drawDataBuffer);
+        glBindBuffer(GL_TEXTURE_BUFFER, drawDataBuffer);
+        glBufferData(GL_TEXTURE_BUFFER, (GLsizeiptr)MAX_DRAWS * TEXELS_PER_DRAW * sizeof(glm::vec4), nullptr, GL_STREAM_DRAW);
+        glGenTextures(1, &drawDataTexture);
+        glBindTexture(GL_TEXTURE_BUFFER, drawDataTexture);
+        glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, drawDataBuffer);
+        glBindTexture(GL_TEXTURE_BUFFER, 0);
+        glBindBuffer(GL_TEXTURE_BUFFER, 0);
+
+        if (indirect) {
+            glGenBuffers(1, &indirectBuffer);
+            glBindBuffer(GL_DRAW_INDIRECT_BUFFER, indirectBuffer);
+            glBufferData(GL_DRAW_INDIRECT_BUFFER, MAX_DRAWS * sizeof(DrawElementsIndirectCommand), nullptr, GL_STREAM_DRAW);
+            glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+        }
+
+        std::cout << "Multi-draw: " << (indirect ? "glMultiDrawElementsIndirect" : "glMultiDrawElementsBaseVertex") << std::endl;
+    }
+
+    void MultiDrawRenderer::Delete() {
+
+        if (!vaos.empty()) {
+            glDeleteVertexArrays((GLsizei)vaos.size(), vaos.data());
+        }
+        glDeleteBuffers(1, &drawIndexBuffer);
+        glDeleteBuffers(1, &drawDataBuffer);
+        glDeleteTextures(1, &drawDataTexture);
+        glDeleteBuffers(1, &indirectBuffer);
+        vaos.clear();
+        drawIndexBuffer = drawDataBuffer = drawDataTexture = indirectBuffer = 0;
+        draws.clear();
+    }
+
+    // the block's buffers, same layout as Mesh, and the draw index
+    GLuint MultiDrawRenderer::vertexArray(int block) {
+
+        if (block >= (int)vaos.size()) {
+            size_t first = vaos.size();
+            vaos.resize(block + 1, 0);
+            glGenVertexArrays((GLsizei)(vaos.size() - first), &vaos[first]);
+
+            gps::GeometryArena& arena = gps::Mesh::getArena();
+            for (size_t b = first; b < vaos.size(); b++) {
+                glBindVertexArray(vaos[b]);
+                glBindBuffer(GL_ARRAY_BUFFER, arena.getVertexBuffer((int)b));
+                glEnableVertexAttribArray(0);
+                glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (GLvoid*)0);
+                glEnableVertexAttribArray(1);
+                glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (GLvoid*)offsetof(Vertex, Normal));
+                glEnableVertexAttribArray(2);
+                glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (GLvoid*)offsetof(Vertex, TexCoords));
+                glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, arena.getIndexBuffer((int)b));
+
+                glBindBuffer(GL_ARRAY_BUFFER, drawIndexBuffer);
+                glEnableVertexAttribArray(DRAW_INDEX_ATTRIBUTE);
+                glVertexAttribPointer(DRAW_INDEX_ATTRIBUTE, 1, GL_FLOAT, GL_FALSE, sizeof(GLfloat), (GLvoid*)0);
+                glVertexAttribDivisor(DRAW_INDEX_ATTRIBUTE, 1);
+            }
+            glBindVertexArray(0);
+            glBindBuffer(GL_ARRAY_BUFFER, 0);
+        }
+        return vaos[block];
+    }
+
+    void MultiDrawRenderer::begin() {
+        draws.clear();
+    }
+
+    void MultiDrawRenderer::add(gps::Model3D& model, const glm::mat4& transform, const glm::vec3& material, GLuint texture) {
+
+        for (gps::Mesh& mesh : model.getMeshes()) {
+            if ((int)draws.size() == MAX_DRAWS) {
+                return;
+            }
+            Draw draw;
+            draw.range = mesh.getRange();
+            draw.texture = texture;
+            for (const gps::Texture& meshTexture : mesh.textures) {
+                if (meshTexture.type == "diffuseTexture") {
+                    draw.texture = meshTexture.id;
+                }
+            }
+            draw.transform = transform;
+            draw.material = material;
+            draws.push_back(draw);
+        }
+    }
+
+    void MultiDrawRenderer::submit(gps::Shader& shader, bool textured) {
+
+        lastCalls = 0;
+        if (draws.empty()) {
+            return;
+        }
+
+        // ===== BUCKETS =====
+        std::vector<Draw> sorted = draws;
+        std::sort(sorted.begin(), sorted.end(), [textured](const Draw& a, const Draw& b) {
+            if (a.range.block != b.range.block) {
+                return a.range.block < b.range.block;
+            }
+            if (textured && a.texture != b.texture) {
+                return a.texture < b.texture;
+            }
+            return a.range.baseVertex < b.range.baseVertex;
+        });
+
+        // call i is draws callFirst[i] .. callFirst[i + 1] - 1
+        std::vector<int> callFirst;
+        for (int i = 0; i < (int)sorted.size(); i++) {
+            const Draw& draw = sorted[i];
+            bool newCall = i == 0 || draw.range.block != sorted[i - 1].range.block || (textured && draw.texture != sorted[i - 1].texture);
+            if (!indirect && !newCall) {
+                const GeometryArena::Range& previous = sorted[i - 1].range;
+                newCall = draw.range.baseVertex < previous.baseVertex + (GLint)previous.vertexCount;
+            }
+            if (newCall) {
+                callFirst.push_back(i);
+            }
+        }
+        callFirst.push_back((int)sorted.size());
+
+        // ===== DRAW DATA =====
+        std::vector<glm::vec4> texels;
+        texels.reserve(sorted.size() * TEXELS_PER_DRAW);
+        for (const Draw& draw : sorted) {
+            for (int column = 0; column < 4; column++) {
+                texels.push_back(draw.transform[column]);
+            }
+            texels.push_back(glm::vec4(draw.material, (float)draw.range.baseVertex));
+        }
+        // orphaned, the previous pass may still read it
+        glBindBuffer(GL_TEXTURE_BUFFER, drawDataBuffer);
+        glBufferData(GL_TEXTURE_BUFFER, (GLsizeiptr)MAX_DRAWS * TEXELS_PER_DRAW * sizeof(glm::vec4), nullptr, GL_STREAM_DRAW);
+        glBufferSubData(GL_TEXTURE_BUFFER, 0, texels.size() * sizeof(glm::vec4), texels.data());
+        glBindBuffer(GL_TEXTURE_BUFFER, 0);
+
+        GLuint program = shader.shaderProgram;
+        glUniform1i(glGetUniformLocation(program, "multiDraw"), 1);
+        glUniform1i(glGetUniformLocation(program, "drawIndirect"), indirect);
+        glActiveTexture(GL_TEXTURE0 + DRAW_DATA_UNIT);
+        glBindTexture(GL_TEXTURE_BUFFER, drawDataTexture);
+        glUniform1i(glGetUniformLocation(program, "drawData"), DRAW_DATA_UNIT);
+        glActiveTexture(GL_TEXTURE0);
+        if (textured) {
+            glUniform1i(glGetUniformLocation(program, "diffuseTexture"), 0);
+        }
+
+        // ===== CALLS =====
+        if (indirect) {
+            std::vector<DrawElementsIndirectCommand> commands;
+            commands.reserve(sorted.size());
+            for (int i = 0; i < (int)sorted.size(); i++) {
+                const GeometryArena::Range& range = sorted[i].range;
+                commands.push_back({ range.indexCount, 1, range.firstIndex, range.baseVertex, (GLuint)i });
+            }
+            glBindBuffer(GL_DRAW_INDIRECT_BUFFER, indirectBuffer);
+            glBufferData(GL_DRAW_INDIRECT_BUFFER, MAX_DRAWS * sizeof(DrawElementsIndirectCommand), nullptr, GL_STREAM_DRAW);
+            glBufferSubData(GL_DRAW_INDIRECT_BUFFER, 0, commands.size() * sizeof(DrawElementsIndirectCommand), commands.data());
+        }
+
+        GLint drawFirstLoc = glGetUniformLocation(program, "drawFirst");
+        GLint drawCountLoc = glGetUniformLocation(program, "drawCount");
+        std::vector<GLsizei> counts;
+        std::vector<const GLvoid*> offsets;
+        std::vector<GLint> baseVertices;
+
+        for (size_t c = 0; c + 1 < callFirst.size(); c++) {
+            int first = callFirst[c];
+            int count = callFirst[c + 1] - first;
+            const Draw& head = sorted[first];
+
+            glBindVertexArray(vertexArray(head.range.block));
+            if (textured) {
+                glBindTexture(GL_TEXTURE_2D, head.texture);
+            }
+
+            if (indirect) {
+#if !defined (__APPLE__)
+                glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, (const GLvoid*)(first * sizeof(DrawElementsIndirectCommand)), count, 0);
+#endif
+            }
+            else {
+                counts.clear();
+                offsets.clear();
+                baseVertices.clear();
+                for (int i = first; i < first + count; i++) {
+                    counts.push_back((GLsizei)sorted[i].range.indexCount);
+                    offsets.push_back(GeometryArena::indexOffset(sorted[i].range));
+                    baseVertices.push_back(sorted[i].range.baseVertex);
+                }
+                glUniform1i(drawFirstLoc, first);
+                glUniform1i(drawCountLoc, count);
+                glMultiDrawElementsBaseVertex(GL_TRIANGLES, counts.data(), GL_UNSIGNED_INT, offsets.data(), count, baseVertices.data());
+            }
+            lastCalls++;
+        }
+
+        glBindVertexArray(0);
+        if (indirect) {
+            glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+        }
+        if (textured) {
+            glBindTexture(GL_TEXTURE_2D, 0);
+        }
+        glUniform1i(glGetUniformLocation(program, "multiDraw"), 0);
+    }
+
+    bool MultiDrawRenderer::isIndirect() {
+        return indirect;
+    }
+
+    int MultiDrawRenderer::getDrawCount() {
+        return (int)draws.size();
+    }
+
+    int MultiDrawRenderer::getCallCount() {
+        return lastCalls;
+    }
+}
@@ -0,0 +1,92 @@
+#ifndef MultiDrawRenderer_hpp
+#define MultiDrawRenderer_hpp
+
+#if defined (__APPLE__)
+    #define GL_SILENCE_DEPRECATION
+    #include <OpenGL/gl3.h>
+#else
+    #define GLEW_STATIC
+    #include <GL/glew.h>
+#endif
+
+#include <glm/glm.hpp>
+
+#include "GeometryArena.hpp"
+#include "Model3D.hpp"
+#include "Shader.hpp"
+
+#include <vector>
+
+namespace gps {
+
+    // Draws the meshes added in a frame with one call per state bucket (the
+    // arena block and, in colour passes, the diffuse texture).
+    //
+    // The transform and material of every draw go in a texture buffer, read
+    // by the vertex shader at the draw's index (multiDraw = true):
+    //  - with GL 4.3 or ARB_multi_draw_indirect, a DrawElementsIndirectCommand
+    //    per draw and glMultiDrawElementsIndirect per bucket; the base instance
+    //    is the draw index, which attribute 9 (divisor 1) hands to the shader;
+    //  - on 4.1, glMultiDrawElementsBaseVertex per bucket; gl_VertexID counts
+    //    from the draw's base vertex, so the shader finds the draw among the
+    //    call's (drawFirst, drawCount), sorted by first vertex. A mesh drawn
+    //    twice in a bucket starts another call, the ranges must not overlap.
+    //
+    // drawData (RGBA32F), TEXELS_PER_DRAW texels per draw: the 4 transform
+    // columns, (light multiplier, shininess, specular strength, first vertex)
+    class MultiDrawRenderer {
+
+    public:
+        static const int MAX_DRAWS = 1024;
+        static const int TEXELS_PER_DRAW = 5;
+        // texture unit of the draw data while drawing
+        static const int DRAW_DATA_UNIT = 9;
+        static const GLuint DRAW_INDEX_ATTRIBUTE = 9;
+
+        void init();
+        void Delete();
+
+        void begin();
+        // every mesh of the model; material: light multiplier, shininess, specular strength;
+        // texture: for the meshes without a diffuse texture of their own
+        void add(gps::Model3D& model, const glm::mat4& transform, const glm::vec3& material, GLuint texture = 0);
+        // the shader (already in use) draws everything added since begin;
+        // textured: bucket by texture and bind it, off for the depth passes
+        void submit(gps::Shader& shader, bool textured);
+
+        bool isIndirect();
+        int getDrawCount();
+        // calls of the last submit
+        int getCallCount();
+
+    private:
+        struct Draw {
+            GeometryArena::Range range;
+            GLuint texture;
+            glm::mat4 transform;
+            glm::vec3 material;
+        };
+
+        struct DrawElementsIndirectCommand {
+            GLuint count;
+            GLuint instanceCount;
+            GLuint firstIndex;
+            GLint baseVertex;
+            GLuint baseInstance;
+        };
+
+        bool indirect = false;
+        std::vector<Draw> draws;
+        int lastCalls = 0;
+
+        std::vector<GLuint> vaos; // per arena block
+        GLuint drawIndexBuffer = 0;
+        GLuint drawDataBuffer = 0;
+        GLuint drawDataTexture = 0;
+        GLuint indirectBuffer = 0;
+
+        GLuint vertexArray(int block);
+    };
+}
+
+#endif /* MultiDrawRenderer_hpp */
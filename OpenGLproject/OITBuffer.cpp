@@ -0,0 +1,229 @@
+#include "OITBuffer.hpp"
+
+#include <iostream>
+
+namespace gps {
+
+    static GLuint createTarget(GLint internalFormat, int width, int height, GLenum format, GLenum type, GLint filter) {
+
+        GLuint texture;
+        glGenTextures(1, &texture);
+        glBindTexture(GL_TEXTURE_2D, texture);
+        glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, width, height, 0, format, type, nullptr);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, filter);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, filter);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+        return texture;
+    }
+
+    void OITBuffer::init(int width, int height, int divisor) {
+
+        this->width = width;
+        this->height = height;
+        this->divisor = divisor;
+
+        glGenVertexArrays(1, &emptyVAO);
+        createTargets();
+    }
+
+    void OITBuffer::Delete() {
+
+        deleteTargets();
+        glDeleteVertexArrays(1, &emptyVAO);
+        emptyVAO = 0;
+    }
+
+    void OITBuffer::resize(int width, int height, int divisor) {
+
+        if (width == this->width && height == this->height && divisor == this->divisor) {
+            return;
+        }
+
+        this->width = width;
+        this->height = height;
+        this->divisor = divisor;
+
+        deleteTargets();
+        createTargets();
+    }
+
+    void OITBuffer::setDepthRange(float nearPlane, float farPlane) {
+
+        this->nearPlane = nearPlane;
+        this->farPlane = farPlane;
+    }
+
+    void OITBuffer::createTargets() {
+
+        targetWidth = (width + divisor - 1) / divisor;
+        targetHeight = (height + divisor - 1) / divisor;
+
+        // ===== FULL RESOLUTION SCENE DEPTH =====
+        // same format as the default framebuffer, the depth blit needs it
+        glGenFramebuffers(1, &sceneDepthFBO);
+        glBindFramebuffer(GL_FRAMEBUFFER, sceneDepthFBO);
+        sceneDepthTexture = createTarget(GL_DEPTH24_STENCIL8, width, height, GL_DEPTH_STENCIL, GL_UNSIGNED_INT_24_8, GL_NEAREST);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_TEXTURE_2D, sceneDepthTexture, 0);
+        glDrawBuffer(GL_NONE);
+        glReadBuffer(GL_NONE);
+
+        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+            std::cerr << "OIT scene depth framebuffer is not complete" << std::endl;
+        }
+
+        // ===== TARGET RESOLUTION =====
+        // filtered, the composite upsamples them
+        accumTexture = createTarget(GL_RGBA16F, targetWidth, targetHeight, GL_RGBA, GL_HALF_FLOAT, GL_LINEAR); // the weighted sums go well over 1
+        revealageTexture = createTarget(GL_R8, targetWidth, targetHeight, GL_RED, GL_UNSIGNED_BYTE, GL_LINEAR);
+        linearDepthTexture = createTarget(GL_R32F, targetWidth, targetHeight, GL_RED, GL_FLOAT, GL_NEAREST);
+        depthTexture = createTarget(GL_DEPTH_COMPONENT24, targetWidth, targetHeight, GL_DEPTH_COMPONENT, GL_FLOAT, GL_NEAREST);
+
+        glGenFramebuffers(1, &depthFBO);
+        glBindFramebuffer(GL_FRAMEBUFFER, depthFBO);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, linearDepthTexture, 0);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, depthTexture, 0);
+
+        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+            std::cerr << "OIT depth framebuffer is not complete" << std::endl;
+        }
+
+        glGenFramebuffers(1, &fbo);
+        glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, accumTexture, 0);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D, revealageTexture, 0);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, depthTexture, 0);
+
+        const GLenum drawBuffers[2] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1 };
+        glDrawBuffers(2, drawBuffers);
+
+        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+            std::cerr << "OIT framebuffer is not complete" << std::endl;
+        }
+
+        glBindTexture(GL_TEXTURE_2D, 0);
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    }
+
+    void OITBuffer::deleteTargets() {
+
+        glDeleteFramebuffers(1, &sceneDepthFBO);
+        glDeleteFramebuffers(1, &depthFBO);
+        glDeleteFramebuffers(1, &fbo);
+        glDeleteTextures(1, &sceneDepthTexture);
+        glDeleteTextures(1, &accumTexture);
+        glDeleteTextures(1, &revealageTexture);
+        glDeleteTextures(1, &linearDepthTexture);
+        glDeleteTextures(1, &depthTexture);
+        sceneDepthFBO = depthFBO = fbo = 0;
+        sceneDepthTexture = accumTexture = revealageTexture = linearDepthTexture = depthTexture = 0;
+    }
+
+    void OITBuffer::begin(gps::Shader& depthDownsampleShader) {
+
+        // ===== SCENE DEPTH, resolved from the (multisampled) default framebuffer =====
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+        glBindFramebuffer(GL_DRAW_FRAMEBUFFER, sceneDepthFBO);
+        glBlitFramebuffer(0, 0, width, height, 0, 0, width, height, GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+
+        // ===== DOWNSAMPLE to the target resolution =====
+        glBindFramebuffer(GL_FRAMEBUFFER, depthFBO);
+        glViewport(0, 0, targetWidth, targetHeight);
+
+        // every pixel is written, the depth test must not reject any
+        glDisable(GL_BLEND);
+        glEnable(GL_DEPTH_TEST);
+        glDepthFunc(GL_ALWAYS);
+        glDepthMask(GL_TRUE);
+
+        depthDownsampleShader.useShaderProgram();
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_2D, sceneDepthTexture);
+        glUniform1i(glGetUniformLocation(depthDownsampleShader.shaderProgram, "sceneDepth"), 0);
+        glUniform1i(glGetUniformLocation(depthDownsampleShader.shaderProgram, "divisor"), divisor);
+        glUniform1f(glGetUniformLocation(depthDownsampleShader.shaderProgram, "nearPlane"), nearPlane);
+        glUniform1f(glGetUniformLocation(depthDownsampleShader.shaderProgram, "farPlane"), farPlane);
+
+        glBindVertexArray(emptyVAO);
+        glDrawArrays(GL_TRIANGLES, 0, 3);
+        glBindVertexArray(0);
+
+        glDepthFunc(GL_LESS);
+
+        // ===== TRANSPARENT TARGETS =====
+        glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+
+        const GLfloat clearAccum[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+        const GLfloat clearRevealage[4] = { 1.0f, 1.0f, 1.0f, 1.0f };
+        glClearBufferfv(GL_COLOR, 0, clearAccum);
+        glClearBufferfv(GL_COLOR, 1, clearRevealage);
+
+        // tested against the scene, never written: the surfaces do not hide each other
+        glDepthMask(GL_FALSE);
+        glDisable(GL_CULL_FACE);
+
+        glEnable(GL_BLEND);
+        glBlendEquation(GL_FUNC_ADD);
+        glBlendFunci(0, GL_ONE, GL_ONE);                  // sums
+        glBlendFunci(1, GL_ZERO, GL_ONE_MINUS_SRC_COLOR); // product of (1 - alpha)
+    }
+
+    void OITBuffer::composite(gps::Shader& compositeShader) {
+
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        glViewport(0, 0, width, height);
+
+        // average color over the background, weighted by the total coverage:
+        // dst = avg * (1 - revealage) + dst * revealage
+        glDisable(GL_DEPTH_TEST);
+        glEnable(GL_BLEND);
+        glBlendFunc(GL_ONE_MINUS_SRC_ALPHA, GL_SRC_ALPHA);
+
+        compositeShader.useShaderProgram();
+
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_2D, accumTexture);
+        glUniform1i(glGetUniformLocation(compositeShader.shaderProgram, "accumTexture"), 0);
+
+        glActiveTexture(GL_TEXTURE1);
+        glBindTexture(GL_TEXTURE_2D, revealageTexture);
+        glUniform1i(glGetUniformLocation(compositeShader.shaderProgram, "revealageTexture"), 1);
+
+        glActiveTexture(GL_TEXTURE2);
+        glBindTexture(GL_TEXTURE_2D, linearDepthTexture);
+        glUniform1i(glGetUniformLocation(compositeShader.shaderProgram, "lowResDepth"), 2);
+
+        glActiveTexture(GL_TEXTURE3);
+        glBindTexture(GL_TEXTURE_2D, sceneDepthTexture);
+        glUniform1i(glGetUniformLocation(compositeShader.shaderProgram, "sceneDepth"), 3);
+
+        glUniform1i(glGetUniformLocation(compositeShader.shaderProgram, "divisor"), divisor);
+        glUniform1f(glGetUniformLocation(compositeShader.shaderProgram, "nearPlane"), nearPlane);
+        glUniform1f(glGetUniformLocation(compositeShader.shaderProgram, "farPlane"), farPlane);
+
+        glBindVertexArray(emptyVAO);
+        glDrawArrays(GL_TRIANGLES, 0, 3);
+        glBindVertexArray(0);
+
+        glActiveTexture(GL_TEXTURE0);
+        glEnable(GL_DEPTH_TEST);
+        glDisable(GL_BLEND);
+    }
+
+    GLuint OITBuffer::getLinearDepthTexture() {
+        return linearDepthTexture;
+    }
+
+    int OITBuffer::getWidth() {
+        return width;
+    }
+
+    int OITBuffer::getHeight() {
+        return height;
+    }
+
+    int OITBuffer::getDivisor() {
+        return divisor;
+    }
+}
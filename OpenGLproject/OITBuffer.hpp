@@ -0,0 +1,81 @@
+#ifndef OITBuffer_hpp
+#define OITBuffer_hpp
+
+#if defined (__APPLE__)
+    #define GL_SILENCE_DEPRECATION
+    #include <OpenGL/gl3.h>
+#else
+    #define GLEW_STATIC
+    #include <GL/glew.h>
+#endif
+
+#include "Shader.hpp"
+
+namespace gps {
+
+    // Weighted blended order-independent transparency (McGuire & Bavoil),
+    // rendered off-screen at full, half or quarter resolution.
+    // Transparent surfaces are drawn in any order into two targets:
+    //  - accumulation (RGBA16F): sum of premultiplied color * weight, alpha * weight
+    //  - revealage (R8): product of (1 - alpha), how much of the background shows
+    // and a full screen composite blends their average over the opaque scene.
+    //
+    // The opaque depth is copied, then reduced to the target resolution
+    // (farthest depth of each block) into the depth buffer the transparent
+    // draws are tested against, plus a linear depth texture they can sample
+    // for soft edges. The composite upsamples with the nearest-depth filter:
+    // bilinear where the 4 low resolution depths agree with the full
+    // resolution pixel, the closest one in depth across silhouettes.
+    class OITBuffer {
+
+    public:
+        // divisor = 1, 2 or 4, the transparent targets are (width, height) / divisor
+        void init(int width, int height, int divisor);
+        void Delete();
+        void resize(int width, int height, int divisor);
+
+        // near / far of the scene projection, used to linearize the depth
+        void setDepthRange(float nearPlane, float farPlane);
+
+        // copies and downsamples the depth of the default framebuffer, clears the
+        // targets and sets up the blending; the transparent draws follow (their
+        // fragment shader writes the accumulation to location 0 and the alpha to location 1)
+        void begin(gps::Shader& depthDownsampleShader);
+        // back to the default framebuffer, upsamples and composites the transparent layer over it
+        void composite(gps::Shader& compositeShader);
+
+        // linear view depth of the scene at the target resolution, for soft particles
+        GLuint getLinearDepthTexture();
+
+        int getWidth();
+        int getHeight();
+        int getDivisor();
+
+    private:
+        // full resolution copy of the scene depth
+        GLuint sceneDepthFBO = 0;
+        GLuint sceneDepthTexture = 0;
+
+        // target resolution
+        GLuint depthFBO = 0;  // linear depth + depth buffer, written by the downsample
+        GLuint fbo = 0;       // accumulation + revealage + depth buffer
+        GLuint accumTexture = 0;
+        GLuint revealageTexture = 0;
+        GLuint linearDepthTexture = 0;
+        GLuint depthTexture = 0;
+
+        GLuint emptyVAO = 0; // the full screen triangles are generated from gl_VertexID
+        int width = 0;
+        int height = 0;
+        int divisor = 1;
+        int targetWidth = 0;
+        int targetHeight = 0;
+        float nearPlane = 0.1f;
+        float farPlane = 1000.0f;
+
+        void createTargets();
+        void deleteTargets();
+    };
+}
+
+#endif /* OITBuffer_hpp */
@@ -0,0 +1,266 @@
+#include "ParticleEmitterSystem.hpp"
+
+#include "Frustum.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+namespace gps {
+
+    ParticleEmitterSystem::~ParticleEmitterSystem() {
+        Delete();
+    }
+
+    void ParticleEmitterSystem::init(int arenaCapacity, int globalBudget) {
+
+        Delete();
+
+        // room for the lane rounding and the alignment of a few dozen pools
+        arenaFloats = ParticlePool::storageFloats(arenaCapacity) + 64 * ParticlePool::storageFloats(ParticleRandom::LANES);
+        arena = new float[arenaFloats]();
+        arenaUsed = 0;
+
+        this->globalBudget = globalBudget;
+    }
+
+    void ParticleEmitterSystem::Delete() {
+
+        for (ParticlePool* pool : pools) {
+            delete pool;
+        }
+        pools.clear();
+        emitters.clear();
+
+        delete[] arena;
+        arena = nullptr;
+        arenaFloats = 0;
+        arenaUsed = 0;
+    }
+
+    int ParticleEmitterSystem::addEmitter(EmitterType type, glm::vec3 position, int maxParticles) {
+
+        ParticleEmitter emitter = {};
+        emitter.type = type;
+        emitter.position = position;
+        emitter.maxParticles = maxParticles;
+        emitter.lod = EMITTER_FROZEN;
+        emitter.firstPool = (int)pools.size();
+
+        ParticleKind kinds[2];
+        int capacities[2];
+        float lifetimes[2]; // average
+
+        if (type == EMITTER_CAMPFIRE) {
+            // 80% fire, 20% smoke, like the original fire
+            emitter.poolCount = 2;
+            kinds[0] = PARTICLE_FIRE;
+            kinds[1] = PARTICLE_SMOKE;
+            capacities[0] = maxParticles * 4 / 5;
+            capacities[1] = maxParticles - capacities[0];
+            emitter.spawnRates[0] = 160.0f;
+            emitter.spawnRates[1] = 40.0f;
+            lifetimes[0] = 0.7f;
+            lifetimes[1] = 3.25f;
+            emitter.boundsCenter = position + glm::vec3(0.0f, 700.0f, 0.0f);
+            emitter.boundsRadius = 1000.0f;
+        }
+        else if (type == EMITTER_CHIMNEY) {
+            emitter.poolCount = 1;
+            kinds[0] = PARTICLE_SMOKE;
+            capacities[0] = maxParticles;
+            emitter.spawnRates[0] = 30.0f;
+            lifetimes[0] = 3.25f;
+            emitter.boundsCenter = position + glm::vec3(0.0f, 700.0f, 0.0f);
+            emitter.boundsRadius = 1000.0f;
+        }
+        else {
+            emitter.poolCount = 1;
+            kinds[0] = PARTICLE_SNOW;
+            capacities[0] = maxParticles;
+            emitter.spawnRates[0] = 120.0f;
+            lifetimes[0] = 2.0f;
+            emitter.boundsCenter = position + glm::vec3(100.0f, 50.0f, 0.0f);
+            emitter.boundsRadius = 300.0f;
+        }
+
+        int floatsNeeded = 0;
+        for (int p = 0; p < emitter.poolCount; p++) {
+            floatsNeeded += ParticlePool::storageFloats(capacities[p]);
+        }
+        if (arena == nullptr || arenaUsed + floatsNeeded > arenaFloats) {
+            return -1;
+        }
+
+        emitter.steadyParticles = 0.0f;
+        for (int p = 0; p < emitter.poolCount; p++) {
+
+            ParticlePool* pool = new ParticlePool();
+            pool->init(kinds[p], capacities[p], (uint32_t)(pools.size() * 7919u + 1u), arena + arenaUsed);
+            arenaUsed += ParticlePool::storageFloats(capacities[p]);
+            pools.push_back(pool);
+
+            emitter.steadyParticles += emitter.spawnRates[p] * lifetimes[p];
+        }
+
+        emitters.push_back(emitter);
+        return (int)emitters.size() - 1;
+    }
+
+    void ParticleEmitterSystem::update(float deltaTime, glm::vec3 cameraPos, const glm::mat4& viewProjection) {
+
+        updateVisibility(cameraPos, viewProjection);
+        distributeBudget();
+
+        for (ParticleEmitter& emitter : emitters) {
+
+            if (!emitter.visible || emitter.distance > reducedRateDistance) {
+                emitter.lod = EMITTER_FROZEN;
+            }
+            else if (emitter.distance > fullRateDistance) {
+                emitter.lod = EMITTER_REDUCED;
+            }
+            else {
+                emitter.lod = EMITTER_FULL;
+            }
+
+            emitter.pendingTime = std::min(emitter.pendingTime + deltaTime, MAX_FAST_FORWARD);
+
+            if (emitter.lod == EMITTER_FROZEN) {
+                continue;
+            }
+
+            emitter.framesSinceStep++;
+            if (emitter.lod == EMITTER_FULL || emitter.framesSinceStep >= REDUCED_RATE_FRAMES) {
+                advance(emitter, emitter.pendingTime);
+                emitter.pendingTime = 0.0f;
+                emitter.framesSinceStep = 0;
+            }
+        }
+    }
+
+    void ParticleEmitterSystem::updateVisibility(glm::vec3 cameraPos, const glm::mat4& viewProjection) {
+
+        gps::Frustum frustum(viewProjection);
+
+        for (ParticleEmitter& emitter : emitters) {
+
+            emitter.visible = frustum.intersectsSphere(emitter.boundsCenter, emitter.boundsRadius);
+
+            emitter.distance = glm::length(emitter.boundsCenter - cameraPos);
+            // apparent size, how much of the screen the emitter can cover
+            emitter.importance = emitter.visible ? emitter.boundsRadius / std::max(emitter.distance, emitter.boundsRadius) : 0.0f;
+        }
+    }
+
+    void ParticleEmitterSystem::distributeBudget() {
+
+        budgetOrder.resize(emitters.size());
+        for (int i = 0; i < (int)emitters.size(); i++) {
+            budgetOrder[i] = i;
+        }
+
+        std::sort(budgetOrder.begin(), budgetOrder.end(), [this](int a, int b) {
+            return emitters[a].importance > emitters[b].importance;
+        });
+
+        // the biggest on screen get what they need first; the particles already alive
+        // in an emitter losing its budget are left to die out
+        int remaining = globalBudget;
+        for (int index : budgetOrder) {
+
+            ParticleEmitter& emitter = emitters[index];
+
+            int wanted = 0;
+            if (emitter.importance > 0.0f) {
+                wanted = std::min(emitter.maxParticles, (int)std::ceil(emitter.steadyParticles));
+            }
+
+            emitter.budget = std::min(wanted, remaining);
+            remaining -= emitter.budget;
+
+            // spread over the pools like the emission
+            float share = emitter.steadyParticles > 0.0f ? emitter.budget / emitter.steadyParticles : 0.0f;
+            for (int p = 0; p < emitter.poolCount; p++) {
+                ParticlePool* pool = pools[emitter.firstPool + p];
+                pool->setBudget(emitter.budget == 0 ? 0 : std::max(1, (int)(pool->getCapacity() * std::min(share, 1.0f))));
+            }
+        }
+    }
+
+    void ParticleEmitterSystem::advance(ParticleEmitter& emitter, float time) {
+
+        if (time >= MAX_FAST_FORWARD) {
+            // everything alive has died by now: start over and rebuild the steady state
+            for (int p = 0; p < emitter.poolCount; p++) {
+                pools[emitter.firstPool + p]->clear();
+            }
+        }
+
+        // long gaps in coarse steps, the particles do not need the frame rate to look right
+        while (time > 0.0f) {
+            float deltaTime = std::min(time, FAST_FORWARD_STEP);
+            step(emitter, deltaTime);
+            time -= deltaTime;
+        }
+    }
+
+    void ParticleEmitterSystem::step(ParticleEmitter& emitter, float deltaTime) {
+
+        // a thinner emission instead of bursts clipped by the budget
+        float rateScale = emitter.steadyParticles > 0.0f ? std::min(1.0f, emitter.budget / emitter.steadyParticles) : 0.0f;
+
+        for (int p = 0; p < emitter.poolCount; p++) {
+
+            ParticlePool* pool = pools[emitter.firstPool + p];
+            pool->update(deltaTime);
+
+            // the fraction is carried over to the next step
+            emitter.spawnAccumulators[p] += deltaTime * emitter.spawnRates[p] * rateScale;
+            int spawnCount = (int)emitter.spawnAccumulators[p];
+            emitter.spawnAccumulators[p] -= spawnCount;
+
+            pool->spawn(spawnCount, emitter.position);
+        }
+    }
+
+    void ParticleEmitterSystem::getVisiblePools(std::vector<ParticlePool*>& out) {
+
+        out.clear();
+        for (const ParticleEmitter& emitter : emitters) {
+            if (emitter.visible) {
+                for (int p = 0; p < emitter.poolCount; p++) {
+                    out.push_back(pools[emitter.firstPool + p]);
+                }
+            }
+        }
+    }
+
+    void ParticleEmitterSystem::getPools(std::vector<ParticlePool*>& out) {
+        out = pools;
+    }
+
+    void ParticleEmitterSystem::setGlobalBudget(int budget) {
+        globalBudget = budget;
+    }
+
+    int ParticleEmitterSystem::getGlobalBudget() {
+        return globalBudget;
+    }
+
+    int ParticleEmitterSystem::getAliveCount() {
+
+        int alive = 0;
+        for (ParticlePool* pool : pools) {
+            alive += pool->getCount();
+        }
+        return alive;
+    }
+
+    int ParticleEmitterSystem::getEmitterCount() {
+        return (int)emitters.size();
+    }
+
+    ParticleEmitter& ParticleEmitterSystem::getEmitter(int index) {
+        return emitters[index];
+    }
+}
@@ -0,0 +1,104 @@
+#ifndef ParticleEmitterSystem_hpp
+#define ParticleEmitterSystem_hpp
+
+#include <glm/glm.hpp>
+
+#include "ParticlePool.hpp"
+
+#include <vector>
+
+namespace gps {
+
+    enum EmitterType { EMITTER_CAMPFIRE, EMITTER_CHIMNEY, EMITTER_SNOW_PLUME };
+
+    // simulation level of detail
+    //  FULL: stepped every frame
+    //  REDUCED: stepped every REDUCED_RATE_FRAMES frames with the accumulated time
+    //  FROZEN: not stepped, the skipped time is fast-forwarded when it comes back
+    enum EmitterLOD { EMITTER_FULL, EMITTER_REDUCED, EMITTER_FROZEN };
+
+    struct ParticleEmitter {
+        EmitterType type;
+        glm::vec3 position;
+        glm::vec3 boundsCenter; // sphere around everything the emitter can spawn
+        float boundsRadius;
+
+        int firstPool;
+        int poolCount;
+        float spawnRates[2];        // particles / second, per pool
+        float spawnAccumulators[2];
+        int maxParticles;           // slice of the arena
+        float steadyParticles;      // alive particles at the full spawn rate
+
+        // updated every frame
+        bool visible;
+        float distance;
+        float importance;           // projected size, 0 when not visible
+        int budget;
+        EmitterLOD lod;
+        float pendingTime;          // time not simulated yet
+        int framesSinceStep;
+    };
+
+    // Many particle emitters drawing from one shared arena: every emitter
+    // gets a slice sized for its worst case, but only the global budget is
+    // alive at once. Each frame the budget goes to the visible emitters in
+    // order of projected size (whatever is left reaches the small ones),
+    // and each emitter is simulated at full rate, reduced rate or frozen
+    // depending on distance and visibility.
+    class ParticleEmitterSystem {
+
+    public:
+        static const int REDUCED_RATE_FRAMES = 4;
+        // longer than any particle lives: past it the emitter is simply rebuilt
+        static constexpr float MAX_FAST_FORWARD = 5.0f;
+        static constexpr float FAST_FORWARD_STEP = 0.1f;
+
+        ParticleEmitterSystem() = default;
+        ParticleEmitterSystem(const ParticleEmitterSystem&) = delete;
+        ParticleEmitterSystem& operator=(const ParticleEmitterSystem&) = delete;
+        ~ParticleEmitterSystem();
+
+        // arenaCapacity = particles in the arena, globalBudget = particles alive at once
+        void init(int arenaCapacity, int globalBudget);
+        void Delete();
+
+        // returns the emitter index, -1 when the arena is full
+        int addEmitter(EmitterType type, glm::vec3 position, int maxParticles);
+
+        void update(float deltaTime, glm::vec3 cameraPos, const glm::mat4& viewProjection);
+
+        // pools of the visible emitters, for rendering
+        void getVisiblePools(std::vector<ParticlePool*>& out);
+        // every pool, visible or not
+        void getPools(std::vector<ParticlePool*>& out);
+
+        void setGlobalBudget(int budget);
+        int getGlobalBudget();
+        int getAliveCount();
+
+        int getEmitterCount();
+        ParticleEmitter& getEmitter(int index);
+
+        // ===== LOD DISTANCES =====
+        float fullRateDistance = 6000.0f;
+        float reducedRateDistance = 20000.0f;
+
+    private:
+        float* arena = nullptr;
+        int arenaFloats = 0;
+        int arenaUsed = 0;
+        int globalBudget = 0;
+
+        std::vector<ParticleEmitter> emitters;
+        std::vector<ParticlePool*> pools;
+        std::vector<int> budgetOrder; // scratch
+
+        void updateVisibility(glm::vec3 cameraPos, const glm::mat4& viewProjection);
+        void distributeBudget();
+        void advance(ParticleEmitter& emitter, float time);
+        void step(ParticleEmitter& emitter, float deltaTime);
+    };
+}
+
+#endif /* ParticleEmitterSystem_hpp */
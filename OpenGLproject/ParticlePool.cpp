@@ -0,0 +1,382 @@
+#include "ParticlePool.hpp"
+#include "SimdMath.hpp"
+
+#include <cmath>
+#include <cstring>
+
+namespace gps {
+
+    using namespace simd;
+
+    // ===== RANDOM NUMBERS =====
+
+    void ParticleRandom::seed(uint32_t seed) {
+
+        // splitmix32 to spread the seed over all the lanes
+        uint32_t x = seed;
+        for (int word = 0; word < 4; word++) {
+            for (int lane = 0; lane < LANES; lane++) {
+                x += 0x9E3779B9u;
+                uint32_t z = x;
+                z = (z ^ (z >> 16)) * 0x85EBCA6Bu;
+                z = (z ^ (z >> 13)) * 0xC2B2AE35u;
+                state[word][lane] = (z ^ (z >> 16)) | 1u;
+            }
+        }
+    }
+
+    void ParticleRandom::fill(float* out, int count) {
+
+        for (int base = 0; base < count; base += LANES) {
+
+            for (int h = 0; h < LANES; h += W) {
+
+                vi s0 = viload(&state[0][h]);
+                vi s1 = viload(&state[1][h]);
+                vi s2 = viload(&state[2][h]);
+                vi s3 = viload(&state[3][h]);
+
+                // xoshiro128+
+                vi result = viadd(s0, s3);
+                vi t = vishl<9>(s1);
+                s2 = vixor(s2, s0);
+                s3 = vixor(s3, s1);
+                s1 = vixor(s1, s2);
+                s0 = vixor(s0, s3);
+                s2 = vixor(s2, t);
+                s3 = vior(vishl<11>(s3), vishr<21>(s3));
+
+                vistore(&state[0][h], s0);
+                vistore(&state[1][h], s1);
+                vistore(&state[2][h], s2);
+                vistore(&state[3][h], s3);
+
+                vstore(out + base + h, vunit(result));
+            }
+        }
+    }
+
+    // ===== POOL =====
+
+    static const int STREAMS = 13;
+
+    static int roundUp(int x) {
+        return (x + ParticleRandom::LANES - 1) / ParticleRandom::LANES * ParticleRandom::LANES;
+    }
+
+    ParticlePool::~ParticlePool() {
+        delete[] storage;
+    }
+
+    int ParticlePool::storageFloats(int capacity) {
+
+        // all the streams + 2 random numbers per particle, + room for the 32 byte alignment
+        return (STREAMS + 2) * roundUp(capacity) + 8;
+    }
+
+    void ParticlePool::init(ParticleKind kind, int capacity, uint32_t seed) {
+
+        delete[] storage;
+        storage = new float[storageFloats(capacity)]();
+
+        init(kind, capacity, seed, storage);
+    }
+
+    void ParticlePool::init(ParticleKind kind, int capacity, uint32_t seed, float* externalStorage) {
+
+        if (externalStorage != storage) {
+            delete[] storage;
+            storage = nullptr;
+        }
+
+        this->kind = kind;
+        this->capacity = roundUp(capacity);
+        this->budget = this->capacity;
+        this->count = 0;
+
+        setStreams(externalStorage);
+        random.seed(seed);
+    }
+
+    void ParticlePool::setStreams(float* block) {
+
+        float* aligned = (float*)(((uintptr_t)block + 31) & ~(uintptr_t)31);
+
+        float** streams[STREAMS] = { &posX, &posY, &posZ, &velX, &velY, &velZ,
+            &colR, &colG, &colB, &colA, &size, &life, &invMaxLife };
+        for (int s = 0; s < STREAMS; s++) {
+            *streams[s] = aligned + s * capacity;
+        }
+        randomBuffer = aligned + STREAMS * capacity;
+    }
+
+    void ParticlePool::setBudget(int budget) {
+        this->budget = glm::clamp(budget, 0, capacity);
+    }
+
+    int ParticlePool::getBudget() {
+        return budget;
+    }
+
+    void ParticlePool::clear() {
+        count = 0;
+    }
+
+    int ParticlePool::getCount() {
+        return count;
+    }
+
+    int ParticlePool::getCapacity() {
+        return capacity;
+    }
+
+    ParticleKind ParticlePool::getKind() {
+        return kind;
+    }
+
+    void ParticlePool::spawn(int spawnCount, glm::vec3 emitterPos) {
+
+        alignas(32) float r[16];
+
+        for (int n = 0; n < spawnCount && count < budget; n++) {
+
+            random.fill(r, 16);
+            int i = count++;
+
+            float angle = r[0] * 20.0f * 3.14159f;
+
+            if (kind == PARTICLE_FIRE) {
+
+                float radius = std::sqrt(r[1]) * 85.0f;
+                posX[i] = emitterPos.x + radius * std::cos(angle);
+                posY[i] = emitterPos.y + r[2] * 150.0f;
+                posZ[i] = emitterPos.z + radius * std::sin(angle);
+
+                velX[i] = (r[3] - 0.5f) * 4.0f;
+                velY[i] = 15.0f + r[4] * 10.0f;
+                velZ[i] = (r[5] - 0.5f) * 4.0f;
+
+                // the color ramp of the update kernel takes over from the first frame
+                colR[i] = 1.0f;
+                colG[i] = 1.0f;
+                colB[i] = 0.4f;
+                colA[i] = 1.0f;
+
+                size[i] = 20.0f + r[6] * 30.0f;
+                life[i] = 0.5f + r[7] * 0.4f;
+            }
+            else if (kind == PARTICLE_SNOW) {
+
+                // powder blown off a ridge, mostly along +x
+                float radius = std::sqrt(r[1]) * 120.0f;
+                posX[i] = emitterPos.x + radius * std::cos(angle);
+                posY[i] = emitterPos.y + r[2] * 60.0f;
+                posZ[i] = emitterPos.z + radius * std::sin(angle);
+
+                velX[i] = 40.0f + r[3] * 40.0f;
+                velY[i] = 10.0f + r[4] * 20.0f;
+                velZ[i] = (r[5] - 0.5f) * 20.0f;
+
+                float brightness = 0.9f + r[6] * 0.1f;
+                colR[i] = brightness;
+                colG[i] = brightness;
+                colB[i] = brightness;
+                colA[i] = 0.5f;
+
+                size[i] = 30.0f + r[7] * 30.0f;
+                life[i] = 1.5f + r[8] * 1.0f;
+            }
+            else {
+
+                float radius = std::sqrt(r[1]) * 150.0f;
+                posX[i] = emitterPos.x + radius * std::cos(angle);
+                posY[i] = emitterPos.y + 200.0f + r[2] * 1000.0f;
+                posZ[i] = emitterPos.z + radius * std::sin(angle);
+
+                velX[i] = (r[3] - 0.5f) * 10.0f;
+                velY[i] = 8.0f + r[4] * 25.0f;
+                velZ[i] = (r[5] - 0.5f) * 12.0f;
+
+                float darkness = 0.1f + r[6] * 0.2f;
+                colR[i] = darkness;
+                colG[i] = darkness;
+                colB[i] = darkness;
+                colA[i] = 0.3f;
+
+                size[i] = 70.0f + r[7] * 70.0f;
+                life[i] = 2.5f + r[8] * 1.5f;
+            }
+
+            invMaxLife[i] = 1.0f / life[i];
+        }
+    }
+
+    void ParticlePool::update(float deltaTime) {
+
+        if (count == 0) {
+            return;
+        }
+
+        if (kind == PARTICLE_FIRE) {
+            updateFire(deltaTime);
+        }
+        else if (kind == PARTICLE_SNOW) {
+            updateSnow(deltaTime);
+        }
+        else {
+            updateSmoke(deltaTime);
+        }
+
+        compact();
+    }
+
+    void ParticlePool::updateFire(float deltaTime) {
+
+        // the kernel runs on whole registers, the padding lanes are never read back
+        int padded = roundUp(count);
+        random.fill(randomBuffer, 2 * padded);
+
+        const vf dt = vset(deltaTime);
+        const vf half = vset(0.5f);
+        const vf jitter = vset(10.0f * deltaTime);
+        const vf gravity = vset(3.0f * deltaTime);
+        const vf zero = vset(0.0f);
+        const vf one = vset(1.0f);
+
+        for (int i = 0; i < padded; i += W) {
+
+            vf l = vsub(vload(life + i), dt);
+            vstore(life + i, l);
+
+            vf vx = vload(velX + i);
+            vf vy = vload(velY + i);
+            vf vz = vload(velZ + i);
+
+            vstore(posX + i, vadd(vload(posX + i), vmul(vx, dt)));
+            vstore(posY + i, vadd(vload(posY + i), vmul(vy, dt)));
+            vstore(posZ + i, vadd(vload(posZ + i), vmul(vz, dt)));
+
+            // turbulence and gravity
+            vx = vadd(vx, vmul(vsub(vload(randomBuffer + i), half), jitter));
+            vz = vadd(vz, vmul(vsub(vload(randomBuffer + padded + i), half), jitter));
+            vy = vsub(vy, gravity);
+            vstore(velX + i, vx);
+            vstore(velY + i, vy);
+            vstore(velZ + i, vz);
+
+            // color ramp: yellow -> orange -> fading red
+            vf lifeRatio = vmul(l, vload(invMaxLife + i));
+            vm young = vgt(lifeRatio, vset(0.7f));
+            vm middle = vgt(lifeRatio, vset(0.4f));
+
+            vf g = vselect(young, one,
+                vselect(middle, vadd(half, vmul(vsub(lifeRatio, vset(0.4f)), vset(1.67f))),
+                    vmul(vset(0.5f), lifeRatio)));
+            vf b = vselect(young, vset(0.4f), vselect(middle, vset(0.1f), zero));
+            vf a = vselect(young, one, vselect(middle, vset(0.9f), vmul(lifeRatio, vset(2.0f))));
+
+            vstore(colR + i, one);
+            vstore(colG + i, g);
+            vstore(colB + i, b);
+            vstore(colA + i, a);
+        }
+    }
+
+    void ParticlePool::updateSmoke(float deltaTime) {
+
+        int padded = roundUp(count);
+
+        const vf dt = vset(deltaTime);
+        // 0.97 per frame at 60 fps, whatever the step (the LOD steps are longer)
+        const vf friction = vset(std::pow(0.97f, deltaTime * 60.0f));
+        const vf rise = vset(2.0f * deltaTime);
+        const vf growth = vset(60.0f * deltaTime);
+        const vf one = vset(1.0f);
+
+        for (int i = 0; i < padded; i += W) {
+
+            vf l = vsub(vload(life + i), dt);
+            vstore(life + i, l);
+
+            vf vx = vload(velX + i);
+            vf vy = vload(velY + i);
+            vf vz = vload(velZ + i);
+
+            vstore(posX + i, vadd(vload(posX + i), vmul(vx, dt)));
+            vstore(posY + i, vadd(vload(posY + i), vmul(vy, dt)));
+            vstore(posZ + i, vadd(vload(posZ + i), vmul(vz, dt)));
+
+            // spreads and keeps rising
+            vstore(velX + i, vmul(vx, friction));
+            vstore(velY + i, vadd(vy, rise));
+            vstore(velZ + i, vmul(vz, friction));
+
+            vstore(size + i, vadd(vload(size + i), growth));
+
+            // lighter and more transparent with age
+            vf lifeRatio = vmul(l, vload(invMaxLife + i));
+            vf brightness = vadd(vset(0.4f), vmul(vsub(one, lifeRatio), vset(0.3f)));
+            vstore(colR + i, brightness);
+            vstore(colG + i, brightness);
+            vstore(colB + i, brightness);
+            vstore(colA + i, vmul(lifeRatio, vset(0.3f)));
+        }
+    }
+
+    void ParticlePool::updateSnow(float deltaTime) {
+
+        int padded = roundUp(count);
+
+        const vf dt = vset(deltaTime);
+        const vf friction = vset(std::pow(0.95f, deltaTime * 60.0f));
+        const vf settle = vset(8.0f * deltaTime);
+        const vf growth = vset(25.0f * deltaTime);
+
+        for (int i = 0; i < padded; i += W) {
+
+            vf l = vsub(vload(life + i), dt);
+            vstore(life + i, l);
+
+            vf vx = vload(velX + i);
+            vf vy = vload(velY + i);
+            vf vz = vload(velZ + i);
+
+            vstore(posX + i, vadd(vload(posX + i), vmul(vx, dt)));
+            vstore(posY + i, vadd(vload(posY + i), vmul(vy, dt)));
+            vstore(posZ + i, vadd(vload(posZ + i), vmul(vz, dt)));
+
+            // the gust dies down and the powder settles back
+            vstore(velX + i, vmul(vx, friction));
+            vstore(velY + i, vsub(vy, settle));
+            vstore(velZ + i, vmul(vz, friction));
+
+            vstore(size + i, vadd(vload(size + i), growth));
+
+            vf lifeRatio = vmul(l, vload(invMaxLife + i));
+            vstore(colA + i, vmul(lifeRatio, vset(0.5f)));
+        }
+    }
+
+    void ParticlePool::compact() {
+
+        float* streams[STREAMS] = { posX, posY, posZ, velX, velY, velZ,
+            colR, colG, colB, colA, size, life, invMaxLife };
+
+        // swap the dead particles with the last alive one, only the dead ones are touched
+        int i = 0;
+        while (i < count) {
+
+            if (life[i] > 0.0f) {
+                i++;
+                continue;
+            }
+
+            int last = --count;
+            if (i != last) {
+                for (int s = 0; s < STREAMS; s++) {
+                    streams[s][i] = streams[s][last];
+                }
+            }
+        }
+    }
+}
@@ -0,0 +1,92 @@
+#ifndef ParticlePool_hpp
+#define ParticlePool_hpp
+
+#include <glm/glm.hpp>
+
+#include <cstdint>
+
+namespace gps {
+
+    enum ParticleKind { PARTICLE_FIRE, PARTICLE_SMOKE, PARTICLE_SNOW };
+
+    // xoshiro128+ running in LANES independent lanes, so one step
+    // produces a full register of random numbers instead of one rand() call
+    class ParticleRandom {
+
+    public:
+        static const int LANES = 8;
+
+        void seed(uint32_t seed);
+        // fills out[0, count) with uniform floats in [0, 1), count is rounded up to LANES,
+        // out must be 32 byte aligned
+        void fill(float* out, int count);
+
+    private:
+        alignas(32) uint32_t state[4][LANES];
+    };
+
+    // Structure of arrays particle storage for one particle kind.
+    // Alive particles are always packed in [0, count): the update kernel
+    // runs over full SIMD registers and dead particles are swapped out
+    // with the last alive one.
+    class ParticlePool {
+
+    public:
+        ParticlePool() = default;
+        ParticlePool(const ParticlePool&) = delete;
+        ParticlePool& operator=(const ParticlePool&) = delete;
+        ~ParticlePool();
+
+        void init(ParticleKind kind, int capacity, uint32_t seed);
+        // same, on storageFloats(capacity) floats owned by the caller (a shared arena)
+        void init(ParticleKind kind, int capacity, uint32_t seed, float* externalStorage);
+        static int storageFloats(int capacity);
+
+        // caps the alive particles below the capacity, spawn() stops at it;
+        // lowering it lets the extra particles die out instead of killing them
+        void setBudget(int budget);
+        int getBudget();
+
+        // emits up to count new particles around emitterPos, dropped when the pool is full
+        void spawn(int count, glm::vec3 emitterPos);
+        // moves the particles, updates color and size, then compacts the dead ones away
+        void update(float deltaTime);
+        void clear();
+
+        int getCount();
+        int getCapacity();
+        ParticleKind getKind();
+
+        // SoA streams, valid in [0, getCount())
+        float* posX = nullptr;
+        float* posY = nullptr;
+        float* posZ = nullptr;
+        float* velX = nullptr;
+        float* velY = nullptr;
+        float* velZ = nullptr;
+        float* colR = nullptr;
+        float* colG = nullptr;
+        float* colB = nullptr;
+        float* colA = nullptr;
+        float* size = nullptr;
+        float* life = nullptr;
+        float* invMaxLife = nullptr;
+
+    private:
+        ParticleKind kind = PARTICLE_FIRE;
+        int count = 0;
+        int capacity = 0;  // rounded up to ParticleRandom::LANES
+        int budget = 0;
+        float* storage = nullptr; // owned, null on external storage
+        float* randomBuffer = nullptr; // scratch, 2 random numbers per particle
+        ParticleRandom random;
+
+        void updateFire(float deltaTime);
+        void updateSmoke(float deltaTime);
+        void updateSnow(float deltaTime);
+        void setStreams(float* block);
+        void compact();
+    };
+}
+
+#endif /* ParticlePool_hpp */
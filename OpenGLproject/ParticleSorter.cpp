@@ -0,0 +1,253 @@
+#include "ParticleSorter.hpp"
+
+#include <cstring>
+#include <utility>
+
+namespace gps {
+
+    static const int RADIX_BITS = 11;
+    static const int RADIX_BUCKETS = 1 << RADIX_BITS;
+    static const int RADIX_PASSES = 3; // 11 + 11 + 10 bits
+
+    static inline void packParticle(const ParticlePool* pool, int i, float* out) {
+
+        out[0] = pool->posX[i];
+        out[1] = pool->posY[i];
+        out[2] = pool->posZ[i];
+        out[3] = pool->colR[i];
+        out[4] = pool->colG[i];
+        out[5] = pool->colB[i];
+        out[6] = pool->colA[i];
+        out[7] = pool->size[i];
+        out[8] = pool->life[i] * pool->invMaxLife[i];
+    }
+
+    int ParticleSorter::sort(ParticlePool* const* pools, int poolCount, glm::vec3 cameraPos) {
+
+        // the previous order can only be remapped when the pools are the same
+        bool coherent = temporalCoherence && (int)bases.size() == poolCount + 1;
+
+        std::swap(bases, previousBases);
+        packInstances(pools, poolCount, cameraPos);
+
+        if (coherent) {
+            gatherCoherent();
+        }
+        else {
+            gatherAll();
+        }
+
+        // a few moves per particle are expected from camera and particle motion,
+        // the new particles appended at the end can travel further
+        incremental = coherent && insertionSort(4 * count + 1024);
+        if (!incremental) {
+            radixSort();
+        }
+
+        return count;
+    }
+
+    void ParticleSorter::packInstances(ParticlePool* const* pools, int poolCount, glm::vec3 cameraPos) {
+
+        bases.resize(poolCount + 1);
+        bases[0] = 0;
+        for (int p = 0; p < poolCount; p++) {
+            bases[p + 1] = bases[p] + pools[p]->getCount();
+        }
+        int total = bases[poolCount];
+
+        // the scratch buffers only ever grow
+        if ((int)instanceKeys.size() < total) {
+            instanceKeys.resize(total);
+            instances.resize(total * FLOATS_PER_INSTANCE);
+        }
+
+        for (int p = 0; p < poolCount; p++) {
+
+            ParticlePool* pool = pools[p];
+            int poolParticles = pool->getCount();
+            float* out = &instances[bases[p] * FLOATS_PER_INSTANCE];
+            uint32_t* key = &instanceKeys[bases[p]];
+
+            for (int i = 0; i < poolParticles; i++) {
+
+                float dx = pool->posX[i] - cameraPos.x;
+                float dy = pool->posY[i] - cameraPos.y;
+                float dz = pool->posZ[i] - cameraPos.z;
+                float distance2 = dx * dx + dy * dy + dz * dz;
+
+                // a positive float orders like its bit pattern; inverted so the farthest comes first
+                uint32_t bits;
+                std::memcpy(&bits, &distance2, sizeof(bits));
+                key[i] = ~bits;
+
+                packParticle(pool, i, out);
+                out += FLOATS_PER_INSTANCE;
+            }
+        }
+    }
+
+    static inline uint32_t entryIndex(uint64_t entry) {
+        return (uint32_t)entry;
+    }
+
+    void ParticleSorter::gatherAll() {
+
+        count = bases.back();
+
+        if ((int)entries.size() < count) {
+            entries.resize(count);
+        }
+
+        for (int h = 0; h < count; h++) {
+            entries[h] = ((uint64_t)instanceKeys[h] << 32) | (uint32_t)h;
+        }
+    }
+
+    void ParticleSorter::gatherCoherent() {
+
+        int poolCount = (int)bases.size() - 1;
+        int total = bases[poolCount];
+
+        if ((int)entries.size() < total) {
+            entries.resize(total);
+        }
+
+        // the pools stay packed in [0, count): last frame's particles past the new
+        // count died (their slot was refilled by a swap, so some entries now point
+        // to another particle, which is fine - the old order is only a starting guess)
+        int kept = 0;
+        for (int h = 0; h < count; h++) {
+
+            int previous = (int)entryIndex(entries[h]);
+            int p = 0;
+            while (previous >= previousBases[p + 1]) {
+                p++;
+            }
+
+            int i = previous - previousBases[p];
+            if (i < bases[p + 1] - bases[p]) {
+                uint32_t index = (uint32_t)(bases[p] + i);
+                entries[kept++] = ((uint64_t)instanceKeys[index] << 32) | index;
+            }
+        }
+
+        // particles spawned since the last frame go at the end
+        for (int p = 0; p < poolCount; p++) {
+            int previousParticles = previousBases[p + 1] - previousBases[p];
+            for (int g = bases[p] + previousParticles; g < bases[p + 1]; g++) {
+                entries[kept++] = ((uint64_t)instanceKeys[g] << 32) | (uint32_t)g;
+            }
+        }
+
+        count = kept;
+    }
+
+    bool ParticleSorter::insertionSort(int maxMoves) {
+
+        int moves = 0;
+
+        for (int h = 1; h < count; h++) {
+
+            uint64_t entry = entries[h];
+
+            int j = h - 1;
+            while (j >= 0 && entries[j] > entry) {
+                entries[j + 1] = entries[j];
+                j--;
+
+                if (++moves > maxMoves) {
+                    // the order is scrambled but still a permutation, the radix sort takes over
+                    entries[j + 1] = entry;
+                    return false;
+                }
+            }
+
+            entries[j + 1] = entry;
+        }
+
+        return true;
+    }
+
+    void ParticleSorter::radixSort() {
+
+        if (count < 2) {
+            return;
+        }
+
+        if ((int)entriesTmp.size() < count) {
+            entriesTmp.resize(count);
+        }
+
+        // all the histograms in one read, the digits come from the key half
+        histograms.assign(RADIX_PASSES * RADIX_BUCKETS, 0);
+
+        for (int h = 0; h < count; h++) {
+            uint32_t key = (uint32_t)(entries[h] >> 32);
+            for (int pass = 0; pass < RADIX_PASSES; pass++) {
+                histograms[pass * RADIX_BUCKETS + ((key >> (pass * RADIX_BITS)) & (RADIX_BUCKETS - 1))]++;
+            }
+        }
+
+        for (int pass = 0; pass < RADIX_PASSES; pass++) {
+
+            uint32_t* bucket = &histograms[pass * RADIX_BUCKETS];
+            int shift = 32 + pass * RADIX_BITS;
+
+            // every key has the same digit: nothing to reorder in this pass
+            if (bucket[(entries[0] >> shift) & (RADIX_BUCKETS - 1)] == (uint32_t)count) {
+                continue;
+            }
+
+            uint32_t offset = 0;
+            for (int b = 0; b < RADIX_BUCKETS; b++) {
+                uint32_t n = bucket[b];
+                bucket[b] = offset;
+                offset += n;
+            }
+
+            for (int h = 0; h < count; h++) {
+                uint64_t entry = entries[h];
+                entriesTmp[bucket[(entry >> shift) & (RADIX_BUCKETS - 1)]++] = entry;
+            }
+
+            std::swap(entries, entriesTmp);
+        }
+    }
+
+    void ParticleSorter::pack(float* out) {
+
+        const size_t instanceBytes = FLOATS_PER_INSTANCE * sizeof(float);
+        for (int h = 0; h < count; h++) {
+            std::memcpy(out, &instances[entryIndex(entries[h]) * FLOATS_PER_INSTANCE], instanceBytes);
+            out += FLOATS_PER_INSTANCE;
+        }
+    }
+
+    void ParticleSorter::packUnsorted(ParticlePool* const* pools, int poolCount, float* out) {
+
+        for (int p = 0; p < poolCount; p++) {
+            int poolParticles = pools[p]->getCount();
+            for (int i = 0; i < poolParticles; i++) {
+                packParticle(pools[p], i, out);
+                out += FLOATS_PER_INSTANCE;
+            }
+        }
+    }
+
+    int ParticleSorter::getCount() {
+        return count;
+    }
+
+    void ParticleSorter::setTemporalCoherence(bool enabled) {
+        temporalCoherence = enabled;
+    }
+
+    bool ParticleSorter::getTemporalCoherence() {
+        return temporalCoherence;
+    }
+
+    bool ParticleSorter::lastSortWasIncremental() {
+        return incremental;
+    }
+}
@@ -0,0 +1,66 @@
+#ifndef ParticleSorter_hpp
+#define ParticleSorter_hpp
+
+#include <glm/glm.hpp>
+
+#include "ParticlePool.hpp"
+
+#include <cstdint>
+#include <vector>
+
+namespace gps {
+
+    // Back to front order of the particles of several pools, without any
+    // per-frame allocation. The pools are read once, in storage order, into
+    // packed instances + sort keys; only key + index pairs are moved around
+    // by the sort and pack() gathers whole instances, so the (write
+    // combined) mapped buffer is written sequentially.
+    // The key is the squared view distance as an integer (no sqrt), sorted
+    // with an 11-bit LSD radix sort. With temporal coherence on, last frame's
+    // order is reused and fixed with an insertion sort; too many moves fall
+    // back to the radix sort.
+    class ParticleSorter {
+
+    public:
+        // pos(3) + color(4) + size(1) + life(1), the layout of the particle VAO
+        static const int FLOATS_PER_INSTANCE = 9;
+
+        // sorts the alive particles of pools[0, poolCount), returns how many there are
+        int sort(ParticlePool* const* pools, int poolCount, glm::vec3 cameraPos);
+        // writes the sorted particles as instance data, out must hold getCount() instances
+        void pack(float* out);
+        // writes every alive particle in storage order, for blending that needs no sort
+        static void packUnsorted(ParticlePool* const* pools, int poolCount, float* out);
+
+        int getCount();
+
+        void setTemporalCoherence(bool enabled);
+        bool getTemporalCoherence();
+        // true when the last sort was done by the insertion sort
+        bool lastSortWasIncremental();
+
+    private:
+        int count = 0;
+        bool temporalCoherence = false;
+        bool incremental = false;
+
+        // pool p owns the instances [bases[p], bases[p + 1])
+        std::vector<int> bases;
+        std::vector<int> previousBases;
+        std::vector<float> instances;
+        std::vector<uint32_t> instanceKeys;
+
+        // key << 32 | instance index, in sorted order
+        std::vector<uint64_t> entries;
+        std::vector<uint64_t> entriesTmp;
+        std::vector<uint32_t> histograms;
+
+        void packInstances(ParticlePool* const* pools, int poolCount, glm::vec3 cameraPos);
+        void gatherAll();
+        void gatherCoherent();
+        bool insertionSort(int maxMoves);
+        void radixSort();
+    };
+}
+
+#endif /* ParticleSorter_hpp */
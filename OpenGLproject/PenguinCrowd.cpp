@@ -0,0 +1,419 @@
+#include "PenguinCrowd.hpp"
+#include "SimdMath.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <climits>
+#include <cmath>
+#include <utility>
+
+namespace gps {
+
+    using namespace simd;
+
+    // streams of the storage: 6 double buffered + posY, steerX, steerZ
+    static const int STREAMS = 15;
+
+    static float wrapAngle(float angle) {
+
+        const float pi = 3.14159265f;
+        while (angle > pi) {
+            angle -= 2.0f * pi;
+        }
+        while (angle < -pi) {
+            angle += 2.0f * pi;
+        }
+        return angle;
+    }
+
+    PenguinCrowd::~PenguinCrowd() {
+        Delete();
+    }
+
+    void PenguinCrowd::init(int maxAgents, int threadCount) {
+
+        Delete();
+
+        this->maxAgents = maxAgents;
+        // the kernel reads a register past the last agent of a cell
+        padded = (maxAgents + W + 7) & ~7;
+
+        storage = new float[STREAMS * padded + 8]();
+        float* aligned = (float*)(((uintptr_t)storage + 31) & ~(uintptr_t)31);
+
+        float** streams[STREAMS] = {
+            &posX[0], &posX[1], &posZ[0], &posZ[1], &velX[0], &velX[1], &velZ[0], &velZ[1],
+            &phase[0], &phase[1], &heading[0], &heading[1], &posY, &steerX, &steerZ
+        };
+        for (int s = 0; s < STREAMS; s++) {
+            *streams[s] = aligned + s * padded;
+        }
+
+        // ~2 buckets per agent keeps the collisions rare
+        tableSize = 1;
+        while (tableSize < 2 * maxAgents) {
+            tableSize <<= 1;
+        }
+        agentCells.assign(maxAgents, 0);
+        cellStart.assign(tableSize + 1, 0);
+        cellCursor.assign(tableSize, 0);
+
+        count = 0;
+        workers.init(threadCount);
+    }
+
+    void PenguinCrowd::Delete() {
+
+        workers.Delete();
+        delete[] storage;
+        storage = nullptr;
+        count = 0;
+        maxAgents = 0;
+    }
+
+    void PenguinCrowd::setTerrain(HeightFunction heightAt) {
+        this->heightAt = heightAt;
+    }
+
+    void PenguinCrowd::setHome(glm::vec3 center, float radius) {
+
+        homeCenter = glm::vec2(center.x, center.z);
+        homeHeight = center.y;
+        homeRadius = radius;
+    }
+
+    void PenguinCrowd::spawn(int count, uint32_t seed) {
+
+        // xorshift32, the spawn does not need more
+        uint32_t state = seed * 0x9E3779B9u + 1u;
+        auto next = [&state]() {
+            state ^= state << 13;
+            state ^= state >> 17;
+            state ^= state << 5;
+            return (state >> 8) * (1.0f / 16777216.0f);
+        };
+
+        const float twoPi = 6.2831853f;
+        int end = std::min(this->count + count, maxAgents);
+        for (int i = this->count; i < end; i++) {
+
+            // uniform over the disk
+            float r = homeRadius * std::sqrt(next());
+            float a = twoPi * next();
+            posX[0][i] = homeCenter.x + r * std::cos(a);
+            posZ[0][i] = homeCenter.y + r * std::sin(a);
+
+            float h = twoPi * next();
+            heading[0][i] = h;
+            velX[0][i] = 0.3f * maxSpeed * std::sin(h);
+            velZ[0][i] = 0.3f * maxSpeed * std::cos(h);
+            phase[0][i] = twoPi * next();
+            posY[i] = heightAt ? heightAt(posX[0][i], posZ[0][i]) : homeHeight;
+        }
+        this->count = end;
+    }
+
+    void PenguinCrowd::clear() {
+        // the grid must not hand out agents that are gone
+        count = 0;
+        std::fill(cellStart.begin(), cellStart.end(), 0);
+    }
+
+    int PenguinCrowd::getCount() {
+        return count;
+    }
+
+    int PenguinCrowd::getMaxAgents() {
+        return maxAgents;
+    }
+
+    glm::vec3 PenguinCrowd::getPosition(int agent) {
+        return glm::vec3(posX[0][agent], posY[agent], posZ[0][agent]);
+    }
+
+    float PenguinCrowd::getLastUpdateTime() {
+        return lastUpdateTime;
+    }
+
+    uint32_t PenguinCrowd::cellOf(float x, float z) {
+        return bucketOf((int32_t)std::floor(x / cellSize), (int32_t)std::floor(z / cellSize));
+    }
+
+    uint32_t PenguinCrowd::bucketOf(int32_t cellX, int32_t cellZ) {
+        return (((uint32_t)cellX * 73856093u) ^ ((uint32_t)cellZ * 19349663u)) & (uint32_t)(tableSize - 1);
+    }
+
+    int PenguinCrowd::neighbourBuckets(int32_t cellX, int32_t cellZ, uint32_t* buckets) {
+
+        // two cells can share a bucket, a bucket must be visited once
+        int n = 0;
+        for (int dz = -1; dz <= 1; dz++) {
+            for (int dx = -1; dx <= 1; dx++) {
+
+                uint32_t bucket = bucketOf(cellX + dx, cellZ + dz);
+                bool seen = false;
+                for (int k = 0; k < n; k++) {
+                    seen |= buckets[k] == bucket;
+                }
+                if (!seen) {
+                    buckets[n++] = bucket;
+                }
+            }
+        }
+        return n;
+    }
+
+    void PenguinCrowd::buildGrid() {
+
+        cellSize = neighbourRadius;
+
+        // ===== COUNTING SORT by bucket =====
+        std::fill(cellStart.begin(), cellStart.end(), 0);
+        for (int i = 0; i < count; i++) {
+            agentCells[i] = cellOf(posX[0][i], posZ[0][i]);
+            cellStart[agentCells[i] + 1]++;
+        }
+        for (int b = 0; b < tableSize; b++) {
+            cellStart[b + 1] += cellStart[b];
+        }
+        std::copy(cellStart.begin(), cellStart.end() - 1, cellCursor.begin());
+
+        for (int i = 0; i < count; i++) {
+
+            int slot = cellCursor[agentCells[i]]++;
+            posX[1][slot] = posX[0][i];
+            posZ[1][slot] = posZ[0][i];
+            velX[1][slot] = velX[0][i];
+            velZ[1][slot] = velZ[0][i];
+            phase[1][slot] = phase[0][i];
+            heading[1][slot] = heading[0][i];
+        }
+
+        std::swap(posX[0], posX[1]);
+        std::swap(posZ[0], posZ[1]);
+        std::swap(velX[0], velX[1]);
+        std::swap(velZ[0], velZ[1]);
+        std::swap(phase[0], phase[1]);
+        std::swap(heading[0], heading[1]);
+
+        // the register read past the last agent must not see garbage
+        for (int i = count; i < count + W; i++) {
+            posX[0][i] = posZ[0][i] = 1e30f;
+            velX[0][i] = velZ[0][i] = 0.0f;
+        }
+    }
+
+    void PenguinCrowd::steerBlock(int first, int last) {
+
+        const vf radius2 = vset(neighbourRadius * neighbourRadius);
+        const vf separation2 = vset(separationRadius * separationRadius);
+        const vf epsilon = vset(1e-4f);
+        const vf zero = vset(0.0f);
+        const vf one = vset(1.0f);
+        const vf ramp = vramp();
+        const float inverseCellSize = 1.0f / cellSize;
+
+        // agents of a cell are next to each other, they share the buckets to visit
+        uint32_t buckets[9];
+        int bucketCount = 0;
+        int32_t lastCellX = INT32_MIN;
+        int32_t lastCellZ = INT32_MIN;
+
+        for (int i = first; i < last; i++) {
+
+            float x = posX[0][i];
+            float z = posZ[0][i];
+            const vf xi = vset(x);
+            const vf zi = vset(z);
+
+            vf n = zero, sumX = zero, sumZ = zero, sumVX = zero, sumVZ = zero, sepX = zero, sepZ = zero;
+
+            int32_t cellX = (int32_t)std::floor(x * inverseCellSize);
+            int32_t cellZ = (int32_t)std::floor(z * inverseCellSize);
+            if (cellX != lastCellX || cellZ != lastCellZ) {
+                bucketCount = neighbourBuckets(cellX, cellZ, buckets);
+                lastCellX = cellX;
+                lastCellZ = cellZ;
+            }
+            for (int b = 0; b < bucketCount; b++) {
+
+                int start = cellStart[buckets[b]];
+                int end = cellStart[buckets[b] + 1];
+                const vf endLane = vset((float)end);
+
+                for (int j = start; j < end; j += W) {
+
+                    vf dx = vsub(vloadu(posX[0] + j), xi);
+                    vf dz = vsub(vloadu(posZ[0] + j), zi);
+                    vf d2 = vadd(vmul(dx, dx), vmul(dz, dz));
+
+                    // inside the cell range, in range, not the agent itself
+                    vm valid = vand(vlt(vadd(vset((float)j), ramp), endLane), vand(vlt(d2, radius2), vgt(d2, epsilon)));
+
+                    n = vadd(n, vselect(valid, one, zero));
+                    sumX = vadd(sumX, vselect(valid, dx, zero));
+                    sumZ = vadd(sumZ, vselect(valid, dz, zero));
+                    sumVX = vadd(sumVX, vselect(valid, vloadu(velX[0] + j), zero));
+                    sumVZ = vadd(sumVZ, vselect(valid, vloadu(velZ[0] + j), zero));
+
+                    // pushed away along d / |d|^2, stronger the closer
+                    vm close = vand(valid, vlt(d2, separation2));
+                    vf inverse = vdiv(one, vmax(d2, epsilon));
+                    sepX = vsub(sepX, vselect(close, vmul(dx, inverse), zero));
+                    sepZ = vsub(sepZ, vselect(close, vmul(dz, inverse), zero));
+                }
+            }
+
+            float vx = velX[0][i];
+            float vz = velZ[0][i];
+            float fx = 0.0f;
+            float fz = 0.0f;
+
+            float neighbours = vsum(n);
+            if (neighbours > 0.0f) {
+
+                float inverseCount = 1.0f / neighbours;
+
+                // one neighbour at the separation radius asks for the full speed
+                fx += separationWeight * vsum(sepX) * separationRadius * maxSpeed;
+                fz += separationWeight * vsum(sepZ) * separationRadius * maxSpeed;
+
+                fx += alignmentWeight * (vsum(sumVX) * inverseCount - vx);
+                fz += alignmentWeight * (vsum(sumVZ) * inverseCount - vz);
+
+                fx += cohesionWeight * vsum(sumX) * inverseCount / neighbourRadius * maxSpeed;
+                fz += cohesionWeight * vsum(sumZ) * inverseCount / neighbourRadius * maxSpeed;
+            }
+
+            // wander, a direction turning slowly and differently for each agent
+            float wander = phase[0][i] + 0.3f * (float)time + 0.7f * std::sin(0.11f * (float)time + 3.0f * phase[0][i]);
+            fx += wanderWeight * std::sin(wander) * maxSpeed;
+            fz += wanderWeight * std::cos(wander) * maxSpeed;
+
+            // home, harder the further out
+            float hx = x - homeCenter.x;
+            float hz = z - homeCenter.y;
+            float distance = std::sqrt(hx * hx + hz * hz);
+            if (distance > homeRadius) {
+                float pull = homeWeight * maxSpeed * std::min((distance - homeRadius) / (0.2f * homeRadius), 1.0f) / distance;
+                fx -= hx * pull * 4.0f;
+                fz -= hz * pull * 4.0f;
+            }
+
+            float force = std::sqrt(fx * fx + fz * fz);
+            if (force > maxForce) {
+                fx *= maxForce / force;
+                fz *= maxForce / force;
+            }
+            steerX[i] = fx;
+            steerZ[i] = fz;
+        }
+    }
+
+    void PenguinCrowd::integrateBlock(int first, int last, float deltaTime) {
+
+        float turn = std::min(1.0f, deltaTime * 6.0f);
+
+        for (int i = first; i < last; i++) {
+
+            float vx = velX[0][i] + steerX[i] * deltaTime;
+            float vz = velZ[0][i] + steerZ[i] * deltaTime;
+            float speed = std::sqrt(vx * vx + vz * vz);
+            if (speed > maxSpeed) {
+                vx *= maxSpeed / speed;
+                vz *= maxSpeed / speed;
+            }
+            velX[0][i] = vx;
+            velZ[0][i] = vz;
+
+            posX[0][i] += vx * deltaTime;
+            posZ[0][i] += vz * deltaTime;
+            posY[i] = heightAt ? heightAt(posX[0][i], posZ[0][i]) : homeHeight;
+
+            // turns towards where it walks, standing still keeps the heading
+            if (speed > 0.1f * maxSpeed) {
+                heading[0][i] += wrapAngle(std::atan2(vx, vz) - heading[0][i]) * turn;
+            }
+        }
+    }
+
+    void PenguinCrowd::update(float deltaTime) {
+
+        auto start = std::chrono::high_resolution_clock::now();
+
+        time += deltaTime;
+
+        if (count > 0) {
+            buildGrid();
+
+            int blocks = (count + BLOCK_SIZE - 1) / BLOCK_SIZE;
+
+            // every velocity is read by the neighbours, none is written before all the steering is done
+            workers.run(blocks, [this](int block) {
+                steerBlock(block * BLOCK_SIZE, std::min((block + 1) * BLOCK_SIZE, count));
+            });
+            workers.run(blocks, [this, deltaTime](int block) {
+                integrateBlock(block * BLOCK_SIZE, std::min((block + 1) * BLOCK_SIZE, count), deltaTime);
+            });
+        }
+
+        auto end = std::chrono::high_resolution_clock::now();
+        lastUpdateTime = std::chrono::duration<float, std::milli>(end - start).count();
+    }
+
+    void PenguinCrowd::writeInstances(const glm::mat4& modelFromMesh, glm::mat4* matrices, float* phases) {
+
+        int blocks = (count + BLOCK_SIZE - 1) / BLOCK_SIZE;
+        workers.run(blocks, [&](int block) {
+
+            int last = std::min((block + 1) * BLOCK_SIZE, count);
+            for (int i = block * BLOCK_SIZE; i < last; i++) {
+
+                // rotation about y by the heading, then the position
+                float c = std::cos(heading[0][i]);
+                float s = std::sin(heading[0][i]);
+                glm::mat4 agent(1.0f);
+                agent[0] = glm::vec4(c, 0.0f, -s, 0.0f);
+                agent[2] = glm::vec4(s, 0.0f, c, 0.0f);
+                agent[3] = glm::vec4(posX[0][i], posY[i], posZ[0][i], 1.0f);
+
+                matrices[i] = agent * modelFromMesh;
+                phases[i] = phase[0][i];
+            }
+        });
+    }
+
+    int PenguinCrowd::queryRadius(glm::vec3 position, float radius, std::vector<int>& out) {
+
+        out.clear();
+        if (count == 0) {
+            return 0;
+        }
+
+        // the grid is from the start of the last update, the agents have moved a little since
+        int reach = (int)std::ceil((radius + maxSpeed * 0.1f) / cellSize);
+        int32_t cellX = (int32_t)std::floor(position.x / cellSize);
+        int32_t cellZ = (int32_t)std::floor(position.z / cellSize);
+        std::vector<uint32_t> buckets;
+        for (int dz = -reach; dz <= reach; dz++) {
+            for (int dx = -reach; dx <= reach; dx++) {
+                uint32_t bucket = bucketOf(cellX + dx, cellZ + dz);
+                if (std::find(buckets.begin(), buckets.end(), bucket) == buckets.end()) {
+                    buckets.push_back(bucket);
+                }
+            }
+        }
+
+        float radius2 = radius * radius;
+        for (uint32_t bucket : buckets) {
+            for (int j = cellStart[bucket]; j < cellStart[bucket + 1]; j++) {
+                float dx = posX[0][j] - position.x;
+                float dz = posZ[0][j] - position.z;
+                if (dx * dx + dz * dz < radius2) {
+                    out.push_back(j);
+                }
+            }
+        }
+        return (int)out.size();
+    }
+}
@@ -0,0 +1,119 @@
+#ifndef PenguinCrowd_hpp
+#define PenguinCrowd_hpp
+
+#include <glm/glm.hpp>
+
+#include "WorkerPool.hpp"
+
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+namespace gps {
+
+    // Boids on the ground: every agent steers on the xz plane away from the
+    // ones too close (separation), along with its neighbours (alignment) and
+    // towards their center (cohesion), plus a slow wander and a pull back
+    // inside its home circle. The height comes from the terrain callback.
+    //
+    // Neighbours are found through a uniform grid hashed into a table, rebuilt
+    // every tick with a counting sort. The agents themselves are stored in the
+    // sorted order (structure of arrays), so the agents of a cell are
+    // contiguous and the steering kernel reads its neighbours a register at a
+    // time. The steering is split in blocks over a worker pool.
+    class PenguinCrowd {
+
+    public:
+        typedef std::function<float(float x, float z)> HeightFunction;
+
+        // agents per task of the worker pool
+        static const int BLOCK_SIZE = 256;
+
+        PenguinCrowd() = default;
+        PenguinCrowd(const PenguinCrowd&) = delete;
+        PenguinCrowd& operator=(const PenguinCrowd&) = delete;
+        ~PenguinCrowd();
+
+        // threadCount as WorkerPool::init
+        void init(int maxAgents, int threadCount = 0);
+        void Delete();
+
+        // must be safe to call from several threads at once
+        void setTerrain(HeightFunction heightAt);
+        void setHome(glm::vec3 center, float radius);
+
+        // count agents at random places inside the home, the ones already there are kept
+        void spawn(int count, uint32_t seed);
+        void clear();
+
+        void update(float deltaTime);
+
+        int getCount();
+        int getMaxAgents();
+        glm::vec3 getPosition(int agent);
+
+        // agent i's model matrix (feet at its position, +z along its heading)
+        // times modelFromMesh, and its phase
+        void writeInstances(const glm::mat4& modelFromMesh, glm::mat4* matrices, float* phases);
+
+        // agents closer than radius to position (on the xz plane), returns how many
+        int queryRadius(glm::vec3 position, float radius, std::vector<int>& out);
+
+        // ===== STEERING =====
+        float neighbourRadius = 300.0f;   // also the cell size of the grid
+        float separationRadius = 130.0f;
+        float maxSpeed = 70.0f;           // world units / second
+        float maxForce = 120.0f;
+        float separationWeight = 2.0f;
+        float alignmentWeight = 0.6f;
+        float cohesionWeight = 0.4f;
+        float wanderWeight = 0.5f;
+        float homeWeight = 1.0f;
+
+        // last update, milliseconds
+        float getLastUpdateTime();
+
+    private:
+        int maxAgents = 0;
+        int padded = 0; // maxAgents rounded up to a register
+        int count = 0;
+
+        // agents, in the order of the grid; [0] current, [1] scratch for the sort
+        float* storage = nullptr;
+        float* posX[2];
+        float* posZ[2];
+        float* velX[2];
+        float* velZ[2];
+        float* phase[2];
+        float* heading[2];
+        float* posY;
+        float* steerX; // steering result, applied once all the blocks are done
+        float* steerZ;
+
+        // spatial hash
+        int tableSize = 0;
+        float cellSize = 1.0f;
+        std::vector<uint32_t> agentCells;
+        std::vector<int> cellStart; // tableSize + 1 entries
+        std::vector<int> cellCursor;
+
+        glm::vec2 homeCenter = glm::vec2(0.0f);
+        float homeHeight = 0.0f;
+        float homeRadius = 1000.0f;
+        HeightFunction heightAt;
+        double time = 0.0;
+        float lastUpdateTime = 0.0f;
+
+        WorkerPool workers;
+
+        uint32_t cellOf(float x, float z);
+        uint32_t bucketOf(int32_t cellX, int32_t cellZ);
+        void buildGrid();
+        void steerBlock(int first, int last);
+        void integrateBlock(int first, int last, float deltaTime);
+        // the distinct buckets of the 3 x 3 cells around a cell, returns how many
+        int neighbourBuckets(int32_t cellX, int32_t cellZ, uint32_t* buckets);
+    };
+}
+
+#endif /* PenguinCrowd_hpp */
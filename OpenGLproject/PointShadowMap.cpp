@@ -0,0 +1,282 @@
+#include "PointShadowMap.hpp"
+
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/type_ptr.hpp>
+
+#include <cmath>
+#include <string>
+
+namespace gps {
+
+    void PointShadowMap::init(unsigned int resolution) {
+
+        this->resolution = resolution;
+
+        glGenFramebuffers(1, &layeredFBO);
+        glGenFramebuffers(6, faceFBO);
+        createTextures();
+        computeFaceMatrices();
+    }
+
+    void PointShadowMap::Delete() {
+
+        glDeleteFramebuffers(1, &layeredFBO);
+        glDeleteFramebuffers(6, faceFBO);
+        glDeleteTextures(1, &cubemap);
+    }
+
+    void PointShadowMap::createTextures() {
+
+        if (cubemap != 0) {
+            glDeleteTextures(1, &cubemap);
+        }
+
+        glGenTextures(1, &cubemap);
+        glBindTexture(GL_TEXTURE_CUBE_MAP, cubemap);
+        for (unsigned int i = 0; i < 6; ++i) {
+            glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, 0, GL_DEPTH_COMPONENT24,
+                resolution, resolution, 0, GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
+        }
+        // hardware depth comparison, LINEAR gives a free 2x2 PCF in the lookup
+        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_COMPARE_MODE, GL_COMPARE_REF_TO_TEXTURE);
+        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
+        glBindTexture(GL_TEXTURE_CUBE_MAP, 0);
+
+        // layered attachment, the geometry shader selects the face with gl_Layer
+        glBindFramebuffer(GL_FRAMEBUFFER, layeredFBO);
+        glFramebufferTexture(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, cubemap, 0);
+        glDrawBuffer(GL_NONE);
+        glReadBuffer(GL_NONE);
+
+        for (unsigned int i = 0; i < 6; ++i) {
+            glBindFramebuffer(GL_FRAMEBUFFER, faceFBO[i]);
+            glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT,
+                GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, cubemap, 0);
+            glDrawBuffer(GL_NONE);
+            glReadBuffer(GL_NONE);
+        }
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+        invalidate();
+    }
+
+    void PointShadowMap::setResolution(unsigned int resolution) {
+
+        if (resolution == this->resolution) {
+            return;
+        }
+        this->resolution = resolution;
+        createTextures();
+    }
+
+    unsigned int PointShadowMap::getResolution() {
+        return resolution;
+    }
+
+    void PointShadowMap::setLight(glm::vec3 position, float farPlane) {
+
+        if (position == lightPos && farPlane == this->farPlane) {
+            return;
+        }
+        lightPos = position;
+        this->farPlane = farPlane;
+        computeFaceMatrices();
+        invalidate();
+    }
+
+    glm::vec3 PointShadowMap::getLightPosition() {
+        return lightPos;
+    }
+
+    float PointShadowMap::getFarPlane() {
+        return farPlane;
+    }
+
+    void PointShadowMap::invalidate() {
+        dirtyFaces = 0x3F;
+        // forget the cached caster state so every mask is recomputed
+        lastModelMatrices.clear();
+        lastFaceMasks.clear();
+        lastAnimatedMasks.clear();
+        staticMask = -1;
+    }
+
+    GLuint PointShadowMap::getCubemap() {
+        return cubemap;
+    }
+
+    void PointShadowMap::computeFaceMatrices() {
+
+        glm::mat4 shadowProj = glm::perspective(glm::radians(90.0f), 1.0f, 1.0f, farPlane);
+
+        // +X, -X, +Y, -Y, +Z, -Z (cubemap face order)
+        faceMatrices[0] = shadowProj * glm::lookAt(lightPos, lightPos + glm::vec3( 1, 0, 0), glm::vec3(0, -1, 0));
+        faceMatrices[1] = shadowProj * glm::lookAt(lightPos, lightPos + glm::vec3(-1, 0, 0), glm::vec3(0, -1, 0));
+        faceMatrices[2] = shadowProj * glm::lookAt(lightPos, lightPos + glm::vec3( 0, 1, 0), glm::vec3(0, 0, 1));
+        faceMatrices[3] = shadowProj * glm::lookAt(lightPos, lightPos + glm::vec3( 0,-1, 0), glm::vec3(0, 0, -1));
+        faceMatrices[4] = shadowProj * glm::lookAt(lightPos, lightPos + glm::vec3( 0, 0, 1), glm::vec3(0, -1, 0));
+        faceMatrices[5] = shadowProj * glm::lookAt(lightPos, lightPos + glm::vec3( 0, 0,-1), glm::vec3(0, -1, 0));
+    }
+
+    int PointShadowMap::computeFaceMask(const ShadowCaster& caster) {
+
+        // world space bounding sphere of the transformed bounding box
+        glm::vec3 bmin = caster.model->getBoundsMin();
+        glm::vec3 bmax = caster.model->getBoundsMax();
+        glm::vec3 center = glm::vec3(caster.modelMatrix * glm::vec4((bmin + bmax) * 0.5f, 1.0f));
+        float scale = glm::max(glm::length(glm::vec3(caster.modelMatrix[0])),
+            glm::max(glm::length(glm::vec3(caster.modelMatrix[1])), glm::length(glm::vec3(caster.modelMatrix[2]))));
+        float radius = glm::length(bmax - bmin) * 0.5f * scale;
+
+        return computeFaceMask(center, radius);
+    }
+
+    int PointShadowMap::computeFaceMask(glm::vec3 center, float radius) {
+
+        glm::vec3 p = center - lightPos;
+        if (glm::length(p) - radius > farPlane) {
+            return 0;
+        }
+
+        const float invSqrt2 = 0.70710678f;
+        int mask = 0;
+
+        for (int face = 0; face < 6; face++) {
+
+            int a = face / 2;
+            float s = (face % 2 == 0) ? 1.0f : -1.0f;
+            int b = (a + 1) % 3;
+            int c = (a + 2) % 3;
+
+            // the face frustum is s * p[a] >= |p[b]| and s * p[a] >= |p[c]|
+            float forward = s * p[a];
+            if (forward < -radius) {
+                continue;
+            }
+            if ((forward - p[b]) * invSqrt2 < -radius || (forward + p[b]) * invSqrt2 < -radius ||
+                (forward - p[c]) * invSqrt2 < -radius || (forward + p[c]) * invSqrt2 < -radius) {
+                continue;
+            }
+            mask |= 1 << face;
+        }
+
+        return mask;
+    }
+
+    int PointShadowMap::computeFaceMask(gps::RigidPartModel& model) {
+
+        int mask = 0;
+        for (int i = 0; i < model.getInstanceCount() && mask != 0x3F; i++) {
+            glm::vec4 sphere = model.getInstanceSphere(i);
+            mask |= computeFaceMask(glm::vec3(sphere), sphere.w);
+        }
+        return mask;
+    }
+
+    int PointShadowMap::update(gps::Shader& shader, const std::vector<ShadowCaster>& casters, const std::vector<AnimatedShadowCaster>& animated,
+        gps::StaticBatcher* statics) {
+
+        // a different caster list invalidates everything
+        if (lastModelMatrices.size() != casters.size()) {
+            dirtyFaces = 0x3F;
+            lastModelMatrices.assign(casters.size(), glm::mat4(0.0f));
+            lastFaceMasks.assign(casters.size(), 0);
+        }
+
+        // a caster that moved dirties the faces it used to touch and the faces it touches now
+        for (size_t i = 0; i < casters.size(); i++) {
+
+            if (casters[i].modelMatrix != lastModelMatrices[i]) {
+
+                int mask = computeFaceMask(casters[i]);
+                dirtyFaces |= lastFaceMasks[i] | mask;
+                lastFaceMasks[i] = mask;
+                lastModelMatrices[i] = casters[i].modelMatrix;
+            }
+        }
+
+        // the animated ones dirty the faces they touch every time, and the ones they left
+        lastAnimatedMasks.resize(animated.size(), 0);
+        for (size_t i = 0; i < animated.size(); i++) {
+
+            int mask = computeFaceMask(*animated[i].model);
+            dirtyFaces |= lastAnimatedMasks[i] | mask;
+            lastAnimatedMasks[i] = mask;
+        }
+
+        // they never move: the faces they touch are found once, drawn the first time
+        if (statics && staticMask == -1) {
+            staticMask = 0;
+            for (const glm::vec4& sphere : statics->getPointShadowSpheres()) {
+                staticMask |= computeFaceMask(glm::vec3(sphere), sphere.w);
+            }
+            dirtyFaces |= staticMask;
+        }
+
+        if (dirtyFaces == 0) {
+            return 0;
+        }
+
+        glViewport(0, 0, resolution, resolution);
+
+        int facesDrawn = 0;
+        for (int face = 0; face < 6; face++) {
+
+            if (dirtyFaces & (1 << face)) {
+                glBindFramebuffer(GL_FRAMEBUFFER, faceFBO[face]);
+                glClear(GL_DEPTH_BUFFER_BIT);
+                facesDrawn++;
+            }
+        }
+
+        glBindFramebuffer(GL_FRAMEBUFFER, layeredFBO);
+
+        shader.useShaderProgram();
+        glUniformMatrix4fv(glGetUniformLocation(shader.shaderProgram, "shadowMatrices"), 6, GL_FALSE, glm::value_ptr(faceMatrices[0]));
+        glUniform3fv(glGetUniformLocation(shader.shaderProgram, "lightPos"), 1, glm::value_ptr(lightPos));
+        glUniform1f(glGetUniformLocation(shader.shaderProgram, "farPlane"), farPlane);
+
+        GLint modelLoc = glGetUniformLocation(shader.shaderProgram, "model");
+        GLint faceMaskLoc = glGetUniformLocation(shader.shaderProgram, "faceMask");
+
+        for (size_t i = 0; i < casters.size(); i++) {
+
+            // per face culling - skip the caster when it touches no dirty face
+            int mask = lastFaceMasks[i] & dirtyFaces;
+            if (mask == 0) {
+                continue;
+            }
+
+            glUniform1i(faceMaskLoc, mask);
+            glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(casters[i].modelMatrix));
+            casters[i].model->Draw(shader);
+        }
+
+        if (statics && (staticMask & dirtyFaces) != 0) {
+            glUniform1i(faceMaskLoc, staticMask & dirtyFaces);
+            glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(glm::mat4(1.0f)));
+            statics->DrawPointShadow();
+        }
+
+        for (size_t i = 0; i < animated.size(); i++) {
+
+            int mask = lastAnimatedMasks[i] & dirtyFaces;
+            if (mask == 0) {
+                continue;
+            }
+
+            glUniform1i(faceMaskLoc, mask);
+            animated[i].model->Draw(shader, animated[i].time, animated[i].culled);
+        }
+
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+        dirtyFaces = 0;
+        return facesDrawn;
+    }
+}
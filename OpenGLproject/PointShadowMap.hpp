@@ -0,0 +1,98 @@
+#ifndef PointShadowMap_hpp
+#define PointShadowMap_hpp
+
+#if defined (__APPLE__)
+    #define GL_SILENCE_DEPRECATION
+    #include <OpenGL/gl3.h>
+#else
+    #define GLEW_STATIC
+    #include <GL/glew.h>
+#endif
+
+#include <glm/glm.hpp>
+
+#include "Shader.hpp"
+#include "Model3D.hpp"
+#include "RigidPartModel.hpp"
+#include "StaticBatcher.hpp"
+
+#include <vector>
+
+namespace gps {
+
+    // An object that is drawn into the point light shadow cubemap
+    struct ShadowCaster {
+        gps::Model3D* model;
+        glm::mat4 modelMatrix;
+    };
+
+    // A whole RigidPartModel drawn in one instanced call; its parts swing, so
+    // the faces its instances touch are redrawn on every update
+    struct AnimatedShadowCaster {
+        gps::RigidPartModel* model;
+        gps::GpuInstanceCuller* culled; // draw only what its last cull kept, nullptr: every instance
+        float time;
+    };
+
+    // Omnidirectional shadow map for a point light.
+    // All 6 faces are rendered in a single pass (the geometry shader routes
+    // every triangle to its faces through gl_Layer) and only the faces whose
+    // casters changed since the last update are cleared and redrawn.
+    class PointShadowMap {
+
+    public:
+        void init(unsigned int resolution);
+        void Delete();
+
+        // Reallocates the cubemap, every face is redrawn on the next update
+        void setResolution(unsigned int resolution);
+        unsigned int getResolution();
+
+        void setLight(glm::vec3 position, float farPlane);
+        glm::vec3 getLightPosition();
+        float getFarPlane();
+
+        // Forces all faces to be redrawn on the next update
+        void invalidate();
+
+        // Redraws the dirty faces. The casters must keep the same order between
+        // calls, a caster is identified by its index in the vector; the
+        // animated ones always are dirty (the shader must handle animatedParts).
+        // statics: baked props that never move, drawn in the faces their
+        // point shadow casters touch when something else dirtied them.
+        // Returns the number of faces that were redrawn.
+        int update(gps::Shader& shader, const std::vector<ShadowCaster>& casters,
+            const std::vector<AnimatedShadowCaster>& animated = std::vector<AnimatedShadowCaster>(),
+            gps::StaticBatcher* statics = nullptr);
+
+        GLuint getCubemap();
+
+    private:
+        GLuint layeredFBO = 0;
+        // one FBO per face, used to clear a single face
+        GLuint faceFBO[6] = { 0, 0, 0, 0, 0, 0 };
+        GLuint cubemap = 0;
+        unsigned int resolution = 0;
+
+        glm::vec3 lightPos = glm::vec3(0.0f);
+        float farPlane = 1.0f;
+        glm::mat4 faceMatrices[6];
+
+        int dirtyFaces = 0x3F;
+        // per caster state from the previous update
+        std::vector<glm::mat4> lastModelMatrices;
+        std::vector<int> lastFaceMasks;
+        std::vector<int> lastAnimatedMasks;
+        int staticMask = -1; // -1: not computed since the last invalidate
+
+        void createTextures();
+        void computeFaceMatrices();
+        // bit i is set if the caster's bounding sphere touches face i
+        int computeFaceMask(const ShadowCaster& caster);
+        int computeFaceMask(glm::vec3 center, float radius);
+        // the faces any instance touches
+        int computeFaceMask(gps::RigidPartModel& model);
+    };
+}
+
+#endif /* PointShadowMap_hpp */
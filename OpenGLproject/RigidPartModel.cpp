@@ -0,0 +1,292 @@
+#include "RigidPartModel.hpp"
+
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/type_ptr.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+
+namespace gps {
+
+    int RigidPartModel::addPart(gps::Model3D& model, RigidPart part) {
+
+        if ((int)parts.size() >= MAX_PARTS) {
+            return -1;
+        }
+
+        int partId = (int)parts.size();
+        part.axis = glm::normalize(part.axis);
+        parts.push_back(part);
+
+        for (gps::Mesh& mesh : model.getMeshes()) {
+
+            GLuint baseVertex = (GLuint)vertices.size();
+            for (const gps::Vertex& vertex : mesh.vertices) {
+                vertices.push_back({ vertex, (float)partId });
+            }
+            for (GLuint index : mesh.indices) {
+                indices.push_back(baseVertex + index);
+            }
+        }
+
+        return partId;
+    }
+
+    void RigidPartModel::build(int maxInstances, gps::StreamBuffer* stream) {
+
+        this->maxInstances = maxInstances;
+        this->stream = stream;
+#if !defined (__APPLE__)
+        textureBufferRange = GLEW_VERSION_4_3 || GLEW_ARB_texture_buffer_range;
+        if (textureBufferRange) {
+            glGetIntegerv(GL_TEXTURE_BUFFER_OFFSET_ALIGNMENT, &textureBufferAlignment);
+        }
+#endif
+
+        // ===== BOUNDS =====
+        // a swinging vertex stays as far from its pivot as it is at rest
+        if (!vertices.empty()) {
+            glm::vec3 low = vertices[0].vertex.Position;
+            glm::vec3 high = low;
+            for (const PartVertex& v : vertices) {
+                low = glm::min(low, v.vertex.Position);
+                high = glm::max(high, v.vertex.Position);
+            }
+            boundsCenter = 0.5f * (low + high);
+            boundsRadius = 0.0f;
+            for (const PartVertex& v : vertices) {
+                const RigidPart& part = parts[(int)v.part];
+                float distance = part.amplitude == 0.0f ? glm::length(v.vertex.Position - boundsCenter)
+                    : glm::length(part.pivot - boundsCenter) + glm::length(v.vertex.Position - part.pivot);
+                boundsRadius = std::max(boundsRadius, distance);
+            }
+        }
+
+        // ===== MERGED PARTS =====
+        glGenVertexArrays(1, &VAO);
+        glGenBuffers(1, &VBO);
+        glGenBuffers(1, &EBO);
+
+        glBindVertexArray(VAO);
+        glBindBuffer(GL_ARRAY_BUFFER, VBO);
+        glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(PartVertex), vertices.data(), GL_STATIC_DRAW);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(GLuint), indices.data(), GL_STATIC_DRAW);
+
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(PartVertex), (GLvoid*)offsetof(Vertex, Position));
+        glEnableVertexAttribArray(1);
+        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(PartVertex), (GLvoid*)offsetof(Vertex, Normal));
+        glEnableVertexAttribArray(2);
+        glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(PartVertex), (GLvoid*)offsetof(Vertex, TexCoords));
+        glEnableVertexAttribArray(7);
+        glVertexAttribPointer(7, 1, GL_FLOAT, GL_FALSE, sizeof(PartVertex), (GLvoid*)offsetof(PartVertex, part));
+
+        glBindVertexArray(0);
+
+        // ===== PART DATA, never changes =====
+        std::vector<glm::vec4> partTexels;
+        for (const RigidPart& part : parts) {
+            partTexels.push_back(glm::vec4(part.pivot, part.amplitude));
+            partTexels.push_back(glm::vec4(part.axis, part.frequency));
+        }
+
+        glGenBuffers(1, &partBuffer);
+        glBindBuffer(GL_TEXTURE_BUFFER, partBuffer);
+        glBufferData(GL_TEXTURE_BUFFER, partTexels.size() * sizeof(glm::vec4), partTexels.data(), GL_STATIC_DRAW);
+
+        glGenTextures(1, &partTexture);
+        glBindTexture(GL_TEXTURE_BUFFER, partTexture);
+        glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, partBuffer);
+
+        // ===== INSTANCE DATA, rewritten when an instance changes =====
+        glGenBuffers(1, &instanceBuffer);
+        glBindBuffer(GL_TEXTURE_BUFFER, instanceBuffer);
+        glBufferData(GL_TEXTURE_BUFFER, (GLsizeiptr)maxInstances * TEXELS_PER_INSTANCE * sizeof(glm::vec4), nullptr, GL_DYNAMIC_DRAW);
+
+        glGenTextures(1, &instanceTexture);
+        glBindTexture(GL_TEXTURE_BUFFER, instanceTexture);
+        glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, instanceBuffer);
+
+        glBindTexture(GL_TEXTURE_BUFFER, 0);
+        glBindBuffer(GL_TEXTURE_BUFFER, 0);
+
+        instanceSource = instanceBuffer;
+        instancesDirty = true;
+    }
+
+    void RigidPartModel::Delete() {
+
+        glDeleteVertexArrays(1, &VAO);
+        glDeleteBuffers(1, &VBO);
+        glDeleteBuffers(1, &EBO);
+        glDeleteTextures(1, &partTexture);
+        glDeleteBuffers(1, &partBuffer);
+        glDeleteTextures(1, &instanceTexture);
+        glDeleteBuffers(1, &instanceBuffer);
+        VAO = VBO = EBO = partBuffer = partTexture = instanceBuffer = instanceTexture = instanceSource = 0;
+        streamFrame = -1;
+    }
+
+    int RigidPartModel::addInstance(glm::mat4 modelMatrix, float phase) {
+
+        if ((int)instanceMatrices.size() >= maxInstances) {
+            return -1;
+        }
+
+        instanceMatrices.push_back(modelMatrix);
+        instancePhases.push_back(phase);
+        instancesDirty = true;
+
+        return (int)instanceMatrices.size() - 1;
+    }
+
+    void RigidPartModel::setInstance(int index, glm::mat4 modelMatrix, float phase) {
+
+        instanceMatrices[index] = modelMatrix;
+        instancePhases[index] = phase;
+        instancesDirty = true;
+    }
+
+    int RigidPartModel::setInstances(int first, int count, const glm::mat4* modelMatrices, const float* phases) {
+
+        count = std::max(0, std::min(count, maxInstances - first));
+        instanceMatrices.resize(first + count);
+        instancePhases.resize(first + count);
+        std::copy(modelMatrices, modelMatrices + count, instanceMatrices.begin() + first);
+        std::copy(phases, phases + count, instancePhases.begin() + first);
+        instancesDirty = true;
+
+        return count;
+    }
+
+    int RigidPartModel::getInstanceCount() {
+        return (int)instanceMatrices.size();
+    }
+
+    void RigidPartModel::prepareInstances() {
+
+        // a stream region only lasts its frame
+        if (instancesDirty || (streamFrame != -1 && stream->getFrame() != streamFrame)) {
+            uploadInstances();
+        }
+    }
+
+    void RigidPartModel::uploadInstances() {
+
+        GLsizeiptr bytes = (GLsizeiptr)instanceMatrices.size() * TEXELS_PER_INSTANCE * sizeof(glm::vec4);
+
+        // changed this frame: into the stream, else (or when its region is full) into their own buffer
+        glm::vec4* texels = nullptr;
+        GLintptr offset = 0;
+        if (stream != nullptr && instancesDirty && bytes > 0) {
+            texels = (glm::vec4*)stream->map(bytes, offset, textureBufferAlignment);
+        }
+        bool streamed = texels != nullptr;
+
+        std::vector<glm::vec4> local;
+        if (!streamed) {
+            local.resize(instanceMatrices.size() * TEXELS_PER_INSTANCE);
+            texels = local.data();
+        }
+
+        for (size_t i = 0; i < instanceMatrices.size(); i++) {
+            for (int column = 0; column < 4; column++) {
+                *texels++ = instanceMatrices[i][column];
+            }
+            *texels++ = glm::vec4(instancePhases[i], 0.0f, 0.0f, 0.0f);
+        }
+
+        glBindTexture(GL_TEXTURE_BUFFER, instanceTexture);
+        if (streamed) {
+            stream->unmap();
+            streamFrame = stream->getFrame();
+            instanceSource = stream->getBuffer();
+            instanceOffset = offset;
+#if !defined (__APPLE__)
+            if (textureBufferRange) {
+                glTexBufferRange(GL_TEXTURE_BUFFER, GL_RGBA32F, instanceSource, offset, bytes);
+                instanceFirst = 0;
+            }
+            else
+#endif
+            {
+                glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, instanceSource);
+                instanceFirst = (GLint)(offset / sizeof(glm::vec4));
+            }
+        }
+        else {
+            glBindBuffer(GL_TEXTURE_BUFFER, instanceBuffer);
+            glBufferSubData(GL_TEXTURE_BUFFER, 0, bytes, local.data());
+            glBindBuffer(GL_TEXTURE_BUFFER, 0);
+            if (instanceSource != instanceBuffer) {
+                glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, instanceBuffer);
+            }
+            streamFrame = -1;
+            instanceSource = instanceBuffer;
+            instanceOffset = 0;
+            instanceFirst = 0;
+        }
+        glBindTexture(GL_TEXTURE_BUFFER, 0);
+
+        instancesDirty = false;
+    }
+
+    void RigidPartModel::cull(gps::GpuInstanceCuller& culler, gps::Shader& cullShader, const glm::mat4& viewProjection) {
+
+        prepareInstances();
+        culler.cull(cullShader, instanceSource, (int)instanceMatrices.size(), boundsCenter, boundsRadius, viewProjection, instanceOffset);
+    }
+
+    void RigidPartModel::Draw(gps::Shader& shader, float time, gps::GpuInstanceCuller* culled) {
+
+        if (instanceMatrices.empty()) {
+            return;
+        }
+        prepareInstances();
+
+        GLuint program = shader.shaderProgram;
+        glUniform1i(glGetUniformLocation(program, "animatedParts"), 1);
+        glUniform1f(glGetUniformLocation(program, "partTime"), time);
+
+        glActiveTexture(GL_TEXTURE0 + PART_DATA_UNIT);
+        glBindTexture(GL_TEXTURE_BUFFER, partTexture);
+        glUniform1i(glGetUniformLocation(program, "partData"), PART_DATA_UNIT);
+
+        glActiveTexture(GL_TEXTURE0 + INSTANCE_DATA_UNIT);
+        glBindTexture(GL_TEXTURE_BUFFER, culled ? culled->getTexture() : instanceTexture);
+        glUniform1i(glGetUniformLocation(program, "instanceData"), INSTANCE_DATA_UNIT);
+        glUniform1i(glGetUniformLocation(program, "instanceFirst"), culled ? 0 : instanceFirst);
+
+        glBindVertexArray(VAO);
+        if (culled) {
+            culled->drawElements((GLsizei)indices.size());
+        }
+        else {
+            glDrawElementsInstanced(GL_TRIANGLES, (GLsizei)indices.size(), GL_UNSIGNED_INT, 0, (GLsizei)instanceMatrices.size());
+        }
+        glBindVertexArray(0);
+
+        glActiveTexture(GL_TEXTURE0);
+        glUniform1i(glGetUniformLocation(program, "animatedParts"), 0);
+    }
+
+    glm::mat4 RigidPartModel::getPartMatrix(int instance, int part, float time) {
+
+        const RigidPart& p = parts[part];
+        float angle = p.amplitude * std::sin(p.frequency * time + instancePhases[instance]);
+
+        return instanceMatrices[instance] *
+            glm::translate(glm::mat4(1.0f), p.pivot) *
+            glm::rotate(glm::mat4(1.0f), angle, p.axis) *
+            glm::translate(glm::mat4(1.0f), -p.pivot);
+    }
+
+    glm::vec4 RigidPartModel::getInstanceSphere(int instance) {
+
+        const glm::mat4& m = instanceMatrices[instance];
+        float scale = std::max(glm::length(glm::vec3(m[0])), std::max(glm::length(glm::vec3(m[1])), glm::length(glm::vec3(m[2]))));
+        return glm::vec4(glm::vec3(m * glm::vec4(boundsCenter, 1.0f)), boundsRadius * scale);
+    }
+}
@@ -0,0 +1,128 @@
+#ifndef RigidPartModel_hpp
+#define RigidPartModel_hpp
+
+#if defined (__APPLE__)
+    #define GL_SILENCE_DEPRECATION
+    #include <OpenGL/gl3.h>
+#else
+    #define GLEW_STATIC
+    #include <GL/glew.h>
+#endif
+
+#include <glm/glm.hpp>
+
+#include "GpuInstanceCuller.hpp"
+#include "Shader.hpp"
+#include "Model3D.hpp"
+#include "StreamBuffer.hpp"
+
+#include <vector>
+
+namespace gps {
+
+    // A part swinging around a pivot: angle = amplitude * sin(frequency * time + phase)
+    struct RigidPart {
+        glm::vec3 pivot;    // model space
+        glm::vec3 axis;
+        float amplitude;    // radians, 0 for a part that does not move
+        float frequency;    // radians / second
+    };
+
+    // A model made of rigid parts (a penguin and its two wings) animated in the
+    // vertex shader, every instance with its own model matrix and phase.
+    // The parts are merged in one vertex buffer, each vertex carrying its part
+    // id (attribute 7); the parts and the instances live in two texture buffers,
+    // so the whole set is one glDrawElementsInstanced per pass and nothing is
+    // computed per part on the CPU.
+    //
+    // Texture buffers (RGBA32F):
+    //  partData: 2 texels per part - (pivot, amplitude), (axis, frequency)
+    //  instanceData: 5 texels per instance - the 4 model matrix columns, (phase, 0, 0, 0)
+    //
+    // Instances that changed are written, at the next cull or draw, into the
+    // current region of a StreamBuffer when there is one (the crowd moves every
+    // frame, a glBufferSubData would wait for the GPU to finish reading the
+    // previous frame's); the texture is pointed at them with glTexBufferRange,
+    // or, on 4.1, at the whole stream with the texels before them in the
+    // instanceFirst uniform. Instances that stopped changing go back to a
+    // buffer of their own before the stream region is reused.
+    class RigidPartModel {
+
+    public:
+        static const int MAX_PARTS = 8;
+        static const int TEXELS_PER_INSTANCE = 5;
+        // texture units of the two buffers while drawing
+        static const int PART_DATA_UNIT = 3;
+        static const int INSTANCE_DATA_UNIT = 4;
+
+        // the part's vertices are taken from all the meshes of the model
+        // (textures are not, the caller binds them); returns the part id, -1 when full
+        int addPart(gps::Model3D& model, RigidPart part);
+
+        // uploads the merged parts, room for maxInstances instances; stream:
+        // where the instances changed in a frame are written (nullptr: their own
+        // buffer only), mapped between its beginFrame and endFrame
+        void build(int maxInstances, gps::StreamBuffer* stream = nullptr);
+        void Delete();
+
+        // returns the instance index, -1 when full
+        int addInstance(glm::mat4 modelMatrix, float phase);
+        void setInstance(int index, glm::mat4 modelMatrix, float phase);
+        // instances first .. first + count - 1, the ones after are dropped;
+        // returns how many fit
+        int setInstances(int first, int count, const glm::mat4* modelMatrices, const float* phases);
+        int getInstanceCount();
+
+        // the instances in the frustum of viewProjection, kept by culler on the GPU
+        // (the instance layout is GpuInstanceCuller's); the cull shader is left in use
+        void cull(gps::GpuInstanceCuller& culler, gps::Shader& cullShader, const glm::mat4& viewProjection);
+
+        // the shader (already in use) gets animatedParts = true for the draw,
+        // time and the two buffers; culled: draw only what its last cull kept
+        void Draw(gps::Shader& shader, float time, gps::GpuInstanceCuller* culled = nullptr);
+
+        // the same animation on the CPU, for the passes that draw the parts one by one
+        glm::mat4 getPartMatrix(int instance, int part, float time);
+        // world space sphere holding the instance at any angle of its parts' swing (xyz center, w radius)
+        glm::vec4 getInstanceSphere(int instance);
+
+    private:
+        struct PartVertex {
+            gps::Vertex vertex;
+            float part;
+        };
+
+        std::vector<PartVertex> vertices;
+        std::vector<GLuint> indices;
+        std::vector<RigidPart> parts;
+        std::vector<glm::mat4> instanceMatrices;
+        std::vector<float> instancePhases;
+        int maxInstances = 0;
+        bool instancesDirty = false;
+        // in the model's space, every part at any angle of its swing
+        glm::vec3 boundsCenter = glm::vec3(0.0f);
+        float boundsRadius = 0.0f;
+
+        GLuint VAO = 0;
+        GLuint VBO = 0;
+        GLuint EBO = 0;
+        GLuint partBuffer = 0;
+        GLuint partTexture = 0;
+        GLuint instanceBuffer = 0;
+        GLuint instanceTexture = 0;
+
+        gps::StreamBuffer* stream = nullptr;
+        bool textureBufferRange = false;
+        GLint textureBufferAlignment = 16;
+        long long streamFrame = -1; // the frame the instances were streamed in, -1: in instanceBuffer
+        GLuint instanceSource = 0;  // where the instances are now, and from which byte
+        GLintptr instanceOffset = 0;
+        GLint instanceFirst = 0;    // texels before them in instanceTexture
+
+        // uploads the instances if they changed or their stream region expired
+        void prepareInstances();
+        void uploadInstances();
+    };
+}
+
+#endif /* RigidPartModel_hpp */
@@ -0,0 +1,708 @@
+#include "ScatterSystem.hpp"
+
+#include "Mesh.hpp"
+
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/type_ptr.hpp>
+
+#include <algorithm>
+#include <cmath>
+
+namespace gps {
+
+    static const float TWO_PI = 6.2831853f;
+    // of the altitude and slope windows
+    static const float WINDOW_FADE = 0.05f;
+    static const float SLOPE_FADE = 0.1f;
+    // Bridson's candidates around a point before it is given up
+    static const int TILE_ATTEMPTS = 30;
+
+    // lowbias32: every input bit flips about half of the output bits
+    static uint32_t hash(uint32_t x) {
+
+        x ^= x >> 16;
+        x *= 0x7feb352du;
+        x ^= x >> 15;
+        x *= 0x846ca68bu;
+        x ^= x >> 16;
+        return x;
+    }
+
+    static float hashToUnit(uint32_t x) {
+        return (x >> 8) * (1.0f / 16777216.0f);
+    }
+
+    static float smoothstep(float edge0, float edge1, float x) {
+
+        float t = glm::clamp((x - edge0) / (edge1 - edge0), 0.0f, 1.0f);
+        return t * t * (3.0f - 2.0f * t);
+    }
+
+    void ScatterSystem::init(gps::Heightfield& heightfield, const std::vector<ScatterLayer>& layers) {
+
+        this->heightfield = &heightfield;
+        cellsX = (int)std::ceil((heightfield.getWidth() - 1) * heightfield.getSpacing() / CELL_SIZE);
+        cellsZ = (int)std::ceil((heightfield.getDepth() - 1) * heightfield.getSpacing() / CELL_SIZE);
+        densityWidth = (int)std::ceil((heightfield.getWidth() - 1) * heightfield.getSpacing() / DENSITY_MAP_SPACING) + 1;
+        densityDepth = (int)std::ceil((heightfield.getDepth() - 1) * heightfield.getSpacing() / DENSITY_MAP_SPACING) + 1;
+        lowest = heightfield.getBoundsMin().y;
+        highest = std::max(heightfield.getBoundsMax().y, lowest + 1.0f);
+
+        buildMeshes();
+        buildTexture();
+
+        this->layers.clear();
+        for (const ScatterLayer& settings : layers) {
+
+            this->layers.push_back(Layer());
+            Layer& layer = this->layers.back();
+            layer.settings = settings;
+            buildTile(layer);
+            buildDensityMap(layer);
+
+            // every cell loaded is at most a cell past the last LOD distance
+            float loadedRadius = settings.lodDistances[SCATTER_LOD_COUNT - 1] + CELL_SIZE;
+            int across = (int)std::ceil(2.0f * loadedRadius / CELL_SIZE) + 1;
+            int maxCells = std::min(across * across, cellsX * cellsZ);
+            layer.slotCapacity = (int)layer.tile.size();
+            layer.cellSlots.assign(cellsX * cellsZ, -1);
+            layer.cellCounts.assign(cellsX * cellsZ, 0);
+            layer.slotCells.assign(maxCells, -1);
+
+            // all holes to begin with
+            int maxInstances = maxCells * layer.slotCapacity;
+            std::vector<glm::vec4> zeros((size_t)maxInstances * GpuInstanceCuller::TEXELS_PER_INSTANCE, glm::vec4(0.0f));
+            glGenBuffers(1, &layer.instanceBuffer);
+            glBindBuffer(GL_ARRAY_BUFFER, layer.instanceBuffer);
+            glBufferData(GL_ARRAY_BUFFER, zeros.size() * sizeof(glm::vec4), zeros.data(), GL_DYNAMIC_DRAW);
+            glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+            // a LOD keeps what its disk holds, with a margin for the density's bumps
+            float pointsPerArea = settings.density * layer.slotCapacity / (CELL_SIZE * CELL_SIZE);
+            for (int lod = 0; lod < SCATTER_LOD_COUNT; lod++) {
+                float distance = settings.lodDistances[lod];
+                int kept = (int)(1.25f * 3.14159265f * distance * distance * pointsPerArea) + layer.slotCapacity;
+                layer.keptCapacity[lod] = std::min(kept, maxInstances);
+                layer.cullers[lod].init(maxInstances, layer.keptCapacity[lod]);
+            }
+        }
+    }
+
+    void ScatterSystem::Delete() {
+
+        for (Layer& layer : layers) {
+            glDeleteBuffers(1, &layer.instanceBuffer);
+            for (gps::GpuInstanceCuller& culler : layer.cullers) {
+                culler.Delete();
+            }
+        }
+        layers.clear();
+        glDeleteVertexArrays(1, &VAO);
+        glDeleteBuffers(1, &VBO);
+        glDeleteBuffers(1, &EBO);
+        glDeleteTextures(1, &texture);
+        VAO = VBO = EBO = texture = 0;
+    }
+
+    void ScatterSystem::addClearing(const glm::vec3& center, float radius) {
+
+        clearings.push_back(glm::vec3(center.x, center.z, radius));
+
+        for (Layer& layer : layers) {
+            for (int cell = 0; cell < cellsX * cellsZ; cell++) {
+                if (layer.cellSlots[cell] >= 0 && cellDistance(cell, center) < radius) {
+                    unloadCell(layer, cell);
+                }
+            }
+        }
+    }
+
+    // ===== PLACEMENT =====
+    void ScatterSystem::buildTile(Layer& layer) {
+
+        // xorshift32, from the layer's seed
+        uint32_t state = layer.settings.seed * 0x9E3779B9u + 1u;
+        auto next = [&state]() {
+            state ^= state << 13;
+            state ^= state >> 17;
+            state ^= state << 5;
+            return (state >> 8) * (1.0f / 16777216.0f);
+        };
+
+        // a grid cell spacing / sqrt(2) across or less holds one point at most
+        float radius = layer.settings.spacing;
+        int gridSize = std::max(1, (int)std::ceil(CELL_SIZE * 1.41421356f / radius));
+        float gridCell = CELL_SIZE / gridSize;
+        std::vector<int> grid(gridSize * gridSize, -1);
+
+        auto gridIndex = [&](const glm::vec2& p) {
+            int x = std::min((int)(p.x / gridCell), gridSize - 1);
+            int z = std::min((int)(p.y / gridCell), gridSize - 1);
+            return z * gridSize + x;
+        };
+        // the tile wraps: distances are taken across the edges too
+        auto farEnough = [&](const glm::vec2& p) {
+            int x = std::min((int)(p.x / gridCell), gridSize - 1);
+            int z = std::min((int)(p.y / gridCell), gridSize - 1);
+            for (int dz = -2; dz <= 2; dz++) {
+                for (int dx = -2; dx <= 2; dx++) {
+                    int other = grid[((z + dz + gridSize) % gridSize) * gridSize + (x + dx + gridSize) % gridSize];
+                    if (other < 0) {
+                        continue;
+                    }
+                    glm::vec2 d = glm::abs(layer.tile[other] - p);
+                    d = glm::min(d, glm::vec2(CELL_SIZE) - d);
+                    if (glm::dot(d, d) < radius * radius) {
+                        return false;
+                    }
+                }
+            }
+            return true;
+        };
+
+        layer.tile.clear();
+        layer.tile.push_back(glm::vec2(next(), next()) * CELL_SIZE);
+        grid[gridIndex(layer.tile[0])] = 0;
+        std::vector<int> active = { 0 };
+
+        while (!active.empty()) {
+            int a = std::min((int)(next() * active.size()), (int)active.size() - 1);
+            glm::vec2 around = layer.tile[active[a]];
+
+            bool placed = false;
+            for (int attempt = 0; attempt < TILE_ATTEMPTS && !placed; attempt++) {
+                // uniform over the ring from radius to twice the radius
+                float r = radius * std::sqrt(1.0f + 3.0f * next());
+                float angle = TWO_PI * next();
+                glm::vec2 p = around + r * glm::vec2(std::cos(angle), std::sin(angle));
+                // back into the tile, across the edge it went over
+                p -= CELL_SIZE * glm::floor(p / CELL_SIZE);
+                p = glm::min(p, glm::vec2(std::nextafter(CELL_SIZE, 0.0f)));
+                if (farEnough(p)) {
+                    grid[gridIndex(p)] = (int)layer.tile.size();
+                    active.push_back((int)layer.tile.size());
+                    layer.tile.push_back(p);
+                    placed = true;
+                }
+            }
+            if (!placed) {
+                active[a] = active.back();
+                active.pop_back();
+            }
+        }
+    }
+
+    void ScatterSystem::buildDensityMap(Layer& layer) {
+
+        // value noise: a random value at every node, eased in between by densityAt
+        layer.densityMap.resize(densityWidth * densityDepth);
+        for (int z = 0; z < densityDepth; z++) {
+            for (int x = 0; x < densityWidth; x++) {
+                uint32_t node = (uint32_t)(z * densityWidth + x);
+                layer.densityMap[node] = hashToUnit(hash(layer.settings.seed ^ hash(node + 0x68bc21ebu)));
+            }
+        }
+    }
+
+    float ScatterSystem::densityAt(const Layer& layer, float x, float z) {
+
+        glm::vec2 origin = heightfield->getOrigin();
+        float gx = glm::clamp((x - origin.x) / DENSITY_MAP_SPACING, 0.0f, (float)(densityWidth - 1));
+        float gz = glm::clamp((z - origin.y) / DENSITY_MAP_SPACING, 0.0f, (float)(densityDepth - 1));
+        int ix = std::min((int)gx, std::max(densityWidth - 2, 0));
+        int iz = std::min((int)gz, std::max(densityDepth - 2, 0));
+        int ix1 = std::min(ix + 1, densityWidth - 1);
+        int iz1 = std::min(iz + 1, densityDepth - 1);
+        float fx = smoothstep(0.0f, 1.0f, gx - ix);
+        float fz = smoothstep(0.0f, 1.0f, gz - iz);
+
+        const std::vector<float>& map = layer.densityMap;
+        float top = glm::mix(map[iz * densityWidth + ix], map[iz * densityWidth + ix1], fx);
+        float bottom = glm::mix(map[iz1 * densityWidth + ix], map[iz1 * densityWidth + ix1], fx);
+        // patches and clearings rather than a grey in between
+        return smoothstep(0.3f, 0.7f, glm::mix(top, bottom, fz));
+    }
+
+    float ScatterSystem::cellDistance(int cell, const glm::vec3& camera) {
+
+        glm::vec2 low = heightfield->getOrigin() + glm::vec2((float)(cell % cellsX), (float)(cell / cellsX)) * CELL_SIZE;
+        glm::vec2 high = low + glm::vec2(CELL_SIZE);
+        glm::vec2 outside = glm::max(glm::max(low - glm::vec2(camera.x, camera.z), glm::vec2(camera.x, camera.z) - high), glm::vec2(0.0f));
+        return glm::length(outside);
+    }
+
+    void ScatterSystem::loadCell(Layer& layer, int cell) {
+
+        int slot = -1;
+        for (int s = 0; s < (int)layer.slotCells.size() && slot < 0; s++) {
+            if (layer.slotCells[s] < 0) {
+                slot = s;
+            }
+        }
+        if (slot < 0) {
+            return;
+        }
+
+        const ScatterLayer& settings = layer.settings;
+        glm::vec2 terrainLow = heightfield->getOrigin();
+        glm::vec2 terrainHigh = terrainLow + glm::vec2((float)(heightfield->getWidth() - 1), (float)(heightfield->getDepth() - 1)) * heightfield->getSpacing();
+        glm::vec2 cellLow = terrainLow + glm::vec2((float)(cell % cellsX), (float)(cell / cellsX)) * CELL_SIZE;
+        uint32_t cellSeed = hash(settings.seed + hash((uint32_t)cell));
+
+        std::vector<glm::vec4> texels;
+        texels.reserve((size_t)layer.slotCapacity * GpuInstanceCuller::TEXELS_PER_INSTANCE);
+        for (size_t i = 0; i < layer.tile.size(); i++) {
+
+            glm::vec2 p = cellLow + layer.tile[i];
+            if (p.x > terrainHigh.x || p.y > terrainHigh.y) {
+                continue;
+            }
+            bool cleared = false;
+            for (const glm::vec3& clearing : clearings) {
+                glm::vec2 d = p - glm::vec2(clearing.x, clearing.y);
+                cleared |= glm::dot(d, d) < clearing.z * clearing.z;
+            }
+            if (cleared) {
+                continue;
+            }
+
+            // ===== WINDOWS =====
+            uint32_t h = hash(cellSeed ^ hash((uint32_t)i));
+            float keep = settings.density * densityAt(layer, p.x, p.y);
+            if (hashToUnit(h) >= keep) {
+                continue;
+            }
+            float height = heightfield->heightAt(p.x, p.y);
+            float altitude = (height - lowest) / (highest - lowest);
+            keep *= smoothstep(settings.altitude.x - WINDOW_FADE, settings.altitude.x, altitude) *
+                (1.0f - smoothstep(settings.altitude.y, settings.altitude.y + WINDOW_FADE, altitude));
+            glm::vec3 normal = heightfield->normalAt(p.x, p.y);
+            keep *= smoothstep(settings.minNormalY, settings.minNormalY + SLOPE_FADE, normal.y);
+            if (hashToUnit(h) >= keep) {
+                continue;
+            }
+
+            // ===== TRANSFORM =====
+            uint32_t h1 = hash(h);
+            uint32_t h2 = hash(h1);
+            uint32_t h3 = hash(h2);
+            float size = glm::mix(settings.scale.x, settings.scale.y, hashToUnit(h1));
+            glm::vec3 scale = glm::vec3(size);
+            if (settings.shape == SCATTER_ROCK) {
+                // no two rocks alike
+                scale *= glm::vec3(0.8f + 0.4f * hashToUnit(h3), 0.7f + 0.6f * hashToUnit(hash(h3)), 0.8f + 0.4f * hashToUnit(hash(hash(h3))));
+            }
+
+            glm::vec3 up = glm::normalize(glm::mix(glm::vec3(0.0f, 1.0f, 0.0f), normal, settings.alignToSlope));
+            glm::mat4 tilt = glm::mat4(1.0f);
+            glm::vec3 axis = glm::cross(glm::vec3(0.0f, 1.0f, 0.0f), up);
+            if (glm::length(axis) > 1e-4f) {
+                tilt = glm::rotate(glm::mat4(1.0f), std::acos(glm::clamp(up.y, -1.0f, 1.0f)), glm::normalize(axis));
+            }
+
+            glm::mat4 instance = glm::translate(glm::mat4(1.0f), glm::vec3(p.x, height - settings.sink * size, p.y)) * tilt *
+                glm::rotate(glm::mat4(1.0f), TWO_PI * hashToUnit(h2), glm::vec3(0.0f, 1.0f, 0.0f)) *
+                glm::scale(glm::mat4(1.0f), scale);
+            for (int column = 0; column < 4; column++) {
+                texels.push_back(instance[column]);
+            }
+            texels.push_back(glm::vec4(0.0f));
+        }
+
+        writeSlot(layer, slot, texels);
+        layer.slotCells[slot] = cell;
+        layer.cellSlots[cell] = slot;
+        layer.cellCounts[cell] = (int)(texels.size() / GpuInstanceCuller::TEXELS_PER_INSTANCE);
+        layer.loadedInstances += layer.cellCounts[cell];
+    }
+
+    void ScatterSystem::unloadCell(Layer& layer, int cell) {
+
+        int slot = layer.cellSlots[cell];
+        writeSlot(layer, slot, std::vector<glm::vec4>());
+        layer.slotCells[slot] = -1;
+        layer.cellSlots[cell] = -1;
+        layer.loadedInstances -= layer.cellCounts[cell];
+        layer.cellCounts[cell] = 0;
+    }
+
+    void ScatterSystem::writeSlot(Layer& layer, int slot, const std::vector<glm::vec4>& texels) {
+
+        // the rest of the slot zeroed, whatever the cell before left there
+        std::vector<glm::vec4> slotTexels(texels);
+        slotTexels.resize((size_t)layer.slotCapacity * GpuInstanceCuller::TEXELS_PER_INSTANCE, glm::vec4(0.0f));
+
+        glBindBuffer(GL_ARRAY_BUFFER, layer.instanceBuffer);
+        glBufferSubData(GL_ARRAY_BUFFER, (GLintptr)(slot * slotTexels.size() * sizeof(glm::vec4)), slotTexels.size() * sizeof(glm::vec4), slotTexels.data());
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+
+    void ScatterSystem::update(const glm::vec3& camera) {
+
+        struct Missing {
+            float distance;
+            int layer;
+            int cell;
+        };
+        std::vector<Missing> missing;
+
+        for (int l = 0; l < (int)layers.size(); l++) {
+            Layer& layer = layers[l];
+            float streamDistance = layer.settings.lodDistances[SCATTER_LOD_COUNT - 1];
+            for (int cell = 0; cell < cellsX * cellsZ; cell++) {
+                float distance = cellDistance(cell, camera);
+                if (layer.cellSlots[cell] >= 0 && distance > streamDistance + CELL_SIZE) {
+                    unloadCell(layer, cell);
+                }
+                else if (layer.cellSlots[cell] < 0 && distance <= streamDistance) {
+                    missing.push_back({ distance, l, cell });
+                }
+            }
+        }
+
+        // the nearest first, whatever their layer
+        int count = (int)missing.size() < MAX_CELLS_PER_UPDATE ? (int)missing.size() : MAX_CELLS_PER_UPDATE;
+        std::partial_sort(missing.begin(), missing.begin() + count, missing.end(), [](const Missing& a, const Missing& b) {
+            return a.distance < b.distance;
+        });
+        for (int i = 0; i < count; i++) {
+            loadCell(layers[missing[i].layer], missing[i].cell);
+        }
+    }
+
+    // ===== DRAW =====
+    void ScatterSystem::Draw(gps::Shader& cullShader, gps::Shader& shader, const glm::mat4& viewProjection, const glm::mat4& model, const glm::vec3& camera) {
+
+        if (layers.empty()) {
+            return;
+        }
+
+        // every cull first, then the light shader once
+        glm::mat4 viewProjectionModel = viewProjection * model;
+        std::vector<bool> culled(layers.size(), false);
+        for (size_t l = 0; l < layers.size(); l++) {
+            Layer& layer = layers[l];
+            int usedSlots = 0;
+            for (int s = 0; s < (int)layer.slotCells.size(); s++) {
+                if (layer.slotCells[s] >= 0) {
+                    usedSlots = s + 1;
+                }
+            }
+            if (usedSlots == 0) {
+                continue;
+            }
+
+            const Shape& shape = shapes[layer.settings.shape];
+            for (int lod = 0; lod < SCATTER_LOD_COUNT; lod++) {
+                float nearDistance = lod == 0 ? 0.0f : layer.settings.lodDistances[lod - 1];
+                layer.cullers[lod].setDistanceRange(camera, nearDistance, layer.settings.lodDistances[lod]);
+                layer.cullers[lod].cull(cullShader, layer.instanceBuffer, usedSlots * layer.slotCapacity, shape.boundsCenter, shape.boundsRadius, viewProjectionModel);
+            }
+            culled[l] = true;
+        }
+
+        shader.useShaderProgram();
+        GLuint program = shader.shaderProgram;
+        glUniform1i(glGetUniformLocation(program, "instanced"), 1);
+        glUniformMatrix4fv(glGetUniformLocation(program, "instanceSpace"), 1, GL_FALSE, glm::value_ptr(model));
+        glActiveTexture(GL_TEXTURE0);
+        glUniform1i(glGetUniformLocation(program, "diffuseTexture"), 0);
+        glBindTexture(GL_TEXTURE_2D, texture);
+
+        const GLsizei stride = GpuInstanceCuller::TEXELS_PER_INSTANCE * sizeof(glm::vec4);
+        glBindVertexArray(VAO);
+        for (size_t l = 0; l < layers.size(); l++) {
+            if (!culled[l]) {
+                continue;
+            }
+            Layer& layer = layers[l];
+            glUniform1f(glGetUniformLocation(program, "objectLightMultiplier"), layer.settings.material.x);
+            glUniform1f(glGetUniformLocation(program, "shininess"), layer.settings.material.y);
+            glUniform1f(glGetUniformLocation(program, "specularStrength"), layer.settings.material.z);
+
+            const Shape& shape = shapes[layer.settings.shape];
+            for (int lod = 0; lod < SCATTER_LOD_COUNT; lod++) {
+                // the matrices straight from what the cull kept
+                glBindBuffer(GL_ARRAY_BUFFER, layer.cullers[lod].getBuffer());
+                for (int column = 0; column < 4; column++) {
+                    glVertexAttribPointer(3 + column, 4, GL_FLOAT, GL_FALSE, stride, (GLvoid*)(column * sizeof(glm::vec4)));
+                }
+                const MeshRange& range = shape.lods[lod];
+                layer.cullers[lod].drawElements((GLsizei)range.indexCount, range.firstIndex, range.baseVertex);
+            }
+        }
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        glBindVertexArray(0);
+        glBindTexture(GL_TEXTURE_2D, 0);
+
+        glUniform1i(glGetUniformLocation(program, "instanced"), 0);
+        glUniformMatrix4fv(glGetUniformLocation(program, "instanceSpace"), 1, GL_FALSE, glm::value_ptr(glm::mat4(1.0f)));
+    }
+
+    // ===== MESHES =====
+    // a rock's surface pushed in and out, the same at every LOD so they blend
+    static float rockRadius(const glm::vec3& direction) {
+
+        return 1.0f + 0.22f * std::sin(3.1f * direction.x + 1.7f) * std::sin(2.3f * direction.y + 0.4f) * std::sin(2.9f * direction.z + 2.1f)
+            + 0.12f * std::sin(5.3f * direction.x + 4.1f * direction.z) * std::cos(4.7f * direction.y + 0.9f)
+            + 0.05f * std::sin(11.0f * direction.x + 0.5f) * std::sin(9.0f * direction.z + 1.3f);
+    }
+
+    static void addRockTriangle(std::vector<Vertex>& vertices, std::vector<GLuint>& indices, glm::vec3 a, glm::vec3 b, glm::vec3 c, int depth) {
+
+        if (depth > 0) {
+            glm::vec3 ab = glm::normalize(a + b);
+            glm::vec3 bc = glm::normalize(b + c);
+            glm::vec3 ca = glm::normalize(c + a);
+            addRockTriangle(vertices, indices, a, ab, ca, depth - 1);
+            addRockTriangle(vertices, indices, ab, b, bc, depth - 1);
+            addRockTriangle(vertices, indices, ca, bc, c, depth - 1);
+            addRockTriangle(vertices, indices, ab, bc, ca, depth - 1);
+            return;
+        }
+
+        // flat shaded: a rock has edges; lower than it is wide
+        const glm::vec3 squash = glm::vec3(0.5f, 0.3f, 0.5f);
+        glm::vec3 corners[3] = { a, b, c };
+        glm::vec3 positions[3];
+        for (int k = 0; k < 3; k++) {
+            positions[k] = corners[k] * rockRadius(corners[k]) * squash;
+        }
+        glm::vec3 normal = glm::normalize(glm::cross(positions[1] - positions[0], positions[2] - positions[0]));
+        for (int k = 0; k < 3; k++) {
+            indices.push_back((GLuint)vertices.size());
+            vertices.push_back({ positions[k], normal, glm::vec2(0.1f + 0.3f * (0.5f + 0.5f * corners[k].x), 0.5f + 0.45f * corners[k].z) });
+        }
+    }
+
+    static void buildRock(std::vector<Vertex>& vertices, std::vector<GLuint>& indices, int subdivisions) {
+
+        const float t = 1.6180340f;
+        const glm::vec3 corners[12] = {
+            { -1, t, 0 }, { 1, t, 0 }, { -1, -t, 0 }, { 1, -t, 0 },
+            { 0, -1, t }, { 0, 1, t }, { 0, -1, -t }, { 0, 1, -t },
+            { t, 0, -1 }, { t, 0, 1 }, { -t, 0, -1 }, { -t, 0, 1 }
+        };
+        const int faces[20][3] = {
+            { 0, 11, 5 }, { 0, 5, 1 }, { 0, 1, 7 }, { 0, 7, 10 }, { 0, 10, 11 },
+            { 1, 5, 9 }, { 5, 11, 4 }, { 11, 10, 2 }, { 10, 7, 6 }, { 7, 1, 8 },
+            { 3, 9, 4 }, { 3, 4, 2 }, { 3, 2, 6 }, { 3, 6, 8 }, { 3, 8, 9 },
+            { 4, 9, 5 }, { 2, 4, 11 }, { 6, 2, 10 }, { 8, 6, 7 }, { 9, 8, 1 }
+        };
+        for (const int* face : faces) {
+            glm::vec3 a = glm::normalize(corners[face[0]]);
+            glm::vec3 b = glm::normalize(corners[face[1]]);
+            glm::vec3 c = glm::normalize(corners[face[2]]);
+            // counter-clockwise seen from outside
+            if (glm::dot(glm::cross(b - a, c - a), a + b + c) < 0.0f) {
+                std::swap(b, c);
+            }
+            addRockTriangle(vertices, indices, a, b, c, subdivisions);
+        }
+    }
+
+    static void buildTree(std::vector<Vertex>& vertices, std::vector<GLuint>& indices, int segments, int cones) {
+
+        auto add = [&](const glm::vec3& position, const glm::vec3& normal, const glm::vec2& texCoords) {
+            indices.push_back((GLuint)vertices.size());
+            vertices.push_back({ position, normal, texCoords });
+        };
+        auto ring = [&](float angle, float radius, float y) {
+            return glm::vec3(radius * std::cos(angle), y, radius * std::sin(angle));
+        };
+
+        // ===== TRUNK, from under the ground to inside the branches =====
+        const float trunkRadius = 0.04f;
+        const float trunkBottom = -0.1f;
+        const float trunkTop = 0.35f;
+        for (int s = 0; s < segments; s++) {
+            float a0 = TWO_PI * s / segments;
+            float a1 = TWO_PI * (s + 1) / segments;
+            glm::vec3 n0 = ring(a0, 1.0f, 0.0f);
+            glm::vec3 n1 = ring(a1, 1.0f, 0.0f);
+            glm::vec3 b0 = ring(a0, trunkRadius, trunkBottom);
+            glm::vec3 b1 = ring(a1, trunkRadius, trunkBottom);
+            glm::vec3 t0 = ring(a0, trunkRadius, trunkTop);
+            glm::vec3 t1 = ring(a1, trunkRadius, trunkTop);
+            add(b0, n0, glm::vec2(0.55f, 0.1f));
+            add(t0, n0, glm::vec2(0.55f, 0.9f));
+            add(b1, n1, glm::vec2(0.7f, 0.1f));
+            add(b1, n1, glm::vec2(0.7f, 0.1f));
+            add(t0, n0, glm::vec2(0.55f, 0.9f));
+            add(t1, n1, glm::vec2(0.7f, 0.9f));
+        }
+
+        // ===== BRANCHES, stacked cones narrowing to the top at 1 =====
+        for (int c = 0; c < cones; c++) {
+            float bottom = 0.15f + 0.45f * c / cones;
+            float top = 1.0f - 0.25f * (cones - 1 - c) / cones;
+            float radius = 0.32f * (1.0f - 0.45f * c / cones);
+            float height = top - bottom;
+            glm::vec3 apex = glm::vec3(0.0f, top, 0.0f);
+            glm::vec3 center = glm::vec3(0.0f, bottom, 0.0f);
+
+            for (int s = 0; s < segments; s++) {
+                float a0 = TWO_PI * s / segments;
+                float a1 = TWO_PI * (s + 1) / segments;
+                // smooth around the cone, the apex's normal the side's middle
+                glm::vec3 n0 = glm::normalize(glm::vec3(height * std::cos(a0), radius, height * std::sin(a0)));
+                glm::vec3 n1 = glm::normalize(glm::vec3(height * std::cos(a1), radius, height * std::sin(a1)));
+                float half = 0.5f * (a0 + a1);
+                glm::vec3 nApex = glm::normalize(glm::vec3(height * std::cos(half), radius, height * std::sin(half)));
+                glm::vec3 p0 = ring(a0, radius, bottom);
+                glm::vec3 p1 = ring(a1, radius, bottom);
+                add(p0, n0, glm::vec2(0.8f, 0.1f));
+                add(apex, nApex, glm::vec2(0.875f, 0.9f));
+                add(p1, n1, glm::vec2(0.95f, 0.1f));
+
+                // underneath, seen on the slopes
+                add(center, glm::vec3(0.0f, -1.0f, 0.0f), glm::vec2(0.875f, 0.5f));
+                add(p0, glm::vec3(0.0f, -1.0f, 0.0f), glm::vec2(0.8f, 0.3f));
+                add(p1, glm::vec3(0.0f, -1.0f, 0.0f), glm::vec2(0.95f, 0.3f));
+            }
+        }
+    }
+
+    void ScatterSystem::buildMeshes() {
+
+        std::vector<Vertex> vertices;
+        std::vector<GLuint> indices;
+        const int rockSubdivisions[SCATTER_LOD_COUNT] = { 2, 1, 0 };
+        const int treeSegments[SCATTER_LOD_COUNT] = { 10, 6, 4 };
+        const int treeCones[SCATTER_LOD_COUNT] = { 3, 2, 1 };
+
+        for (int s = 0; s < 2; s++) {
+            Shape& shape = shapes[s];
+            size_t shapeVertices = vertices.size();
+            for (int lod = 0; lod < SCATTER_LOD_COUNT; lod++) {
+                std::vector<Vertex> lodVertices;
+                std::vector<GLuint> lodIndices;
+                if (s == SCATTER_ROCK) {
+                    buildRock(lodVertices, lodIndices, rockSubdivisions[lod]);
+                }
+                else {
+                    buildTree(lodVertices, lodIndices, treeSegments[lod], treeCones[lod]);
+                }
+                shape.lods[lod].firstIndex = (GLuint)indices.size();
+                shape.lods[lod].indexCount = (GLuint)lodIndices.size();
+                shape.lods[lod].baseVertex = (GLint)vertices.size();
+                vertices.insert(vertices.end(), lodVertices.begin(), lodVertices.end());
+                indices.insert(indices.end(), lodIndices.begin(), lodIndices.end());
+            }
+
+            // ===== BOUNDS, of every LOD =====
+            glm::vec3 low = vertices[shapeVertices].Position;
+            glm::vec3 high = low;
+            for (size_t v = shapeVertices; v < vertices.size(); v++) {
+                low = glm::min(low, vertices[v].Position);
+                high = glm::max(high, vertices[v].Position);
+            }
+            shape.boundsCenter = 0.5f * (low + high);
+            shape.boundsRadius = 0.0f;
+            for (size_t v = shapeVertices; v < vertices.size(); v++) {
+                shape.boundsRadius = std::max(shape.boundsRadius, glm::length(vertices[v].Position - shape.boundsCenter));
+            }
+        }
+
+        glGenVertexArrays(1, &VAO);
+        glGenBuffers(1, &VBO);
+        glGenBuffers(1, &EBO);
+
+        glBindVertexArray(VAO);
+        glBindBuffer(GL_ARRAY_BUFFER, VBO);
+        glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(Vertex), vertices.data(), GL_STATIC_DRAW);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(GLuint), indices.data(), GL_STATIC_DRAW);
+
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (GLvoid*)offsetof(Vertex, Position));
+        glEnableVertexAttribArray(1);
+        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (GLvoid*)offsetof(Vertex, Normal));
+        glEnableVertexAttribArray(2);
+        glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (GLvoid*)offsetof(Vertex, TexCoords));
+        // the instance matrix, its buffer is the cull's output, set in Draw
+        for (int column = 0; column < 4; column++) {
+            glEnableVertexAttribArray(3 + column);
+            glVertexAttribDivisor(3 + column, 1);
+        }
+
+        glBindVertexArray(0);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+        meshSize = vertices.size() * sizeof(Vertex) + indices.size() * sizeof(GLuint);
+    }
+
+    void ScatterSystem::buildTexture() {
+
+        // three bands across: rock (u < 0.5), bark, needles (u >= 0.75), grain hashed in
+        std::vector<unsigned char> pixels(TEXTURE_SIZE * TEXTURE_SIZE * 4);
+        for (int y = 0; y < TEXTURE_SIZE; y++) {
+            for (int x = 0; x < TEXTURE_SIZE; x++) {
+                float grain = hashToUnit(hash((uint32_t)(y * TEXTURE_SIZE + x) + 0x2545f491u)) - 0.5f;
+                glm::vec3 colour;
+                if (x < TEXTURE_SIZE / 2) {
+                    colour = glm::vec3(118.0f, 116.0f, 112.0f) * (1.0f + 0.3f * grain);
+                }
+                else if (x < 3 * TEXTURE_SIZE / 4) {
+                    colour = glm::vec3(86.0f, 62.0f, 44.0f) * (1.0f + 0.25f * grain);
+                }
+                else {
+                    colour = glm::vec3(38.0f, 72.0f, 44.0f) * (1.0f + 0.35f * grain);
+                }
+                colour = glm::clamp(colour, glm::vec3(0.0f), glm::vec3(255.0f));
+                unsigned char* pixel = &pixels[(y * TEXTURE_SIZE + x) * 4];
+                pixel[0] = (unsigned char)colour.r;
+                pixel[1] = (unsigned char)colour.g;
+                pixel[2] = (unsigned char)colour.b;
+                pixel[3] = 255;
+            }
+        }
+
+        glGenTextures(1, &texture);
+        glBindTexture(GL_TEXTURE_2D, texture);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_SRGB, TEXTURE_SIZE, TEXTURE_SIZE, 0, GL_RGBA, GL_UNSIGNED_BYTE, pixels.data());
+        glGenerateMipmap(GL_TEXTURE_2D);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        // the bands are 16 texels or more: 3 levels down they still do not mix
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 3);
+        glBindTexture(GL_TEXTURE_2D, 0);
+    }
+
+    // ===== STATS =====
+    int ScatterSystem::getLayerCount() {
+        return (int)layers.size();
+    }
+
+    int ScatterSystem::getTilePointCount(int layer) {
+        return (int)layers[layer].tile.size();
+    }
+
+    int ScatterSystem::getLoadedCellCount(int layer) {
+        return (int)std::count_if(layers[layer].cellSlots.begin(), layers[layer].cellSlots.end(), [](int slot) { return slot >= 0; });
+    }
+
+    int ScatterSystem::getLoadedInstanceCount(int layer) {
+        return layers[layer].loadedInstances;
+    }
+
+    int ScatterSystem::getVisibleCount(int layer, int lod) {
+        return layers[layer].cullers[lod].getVisibleCount();
+    }
+
+    size_t ScatterSystem::getMemorySize() {
+
+        // the texture's mips: a third more
+        size_t size = meshSize + TEXTURE_SIZE * TEXTURE_SIZE * 4 * 4 / 3;
+        for (const Layer& layer : layers) {
+            size_t texel = GpuInstanceCuller::TEXELS_PER_INSTANCE * sizeof(glm::vec4);
+            size += layer.slotCells.size() * layer.slotCapacity * texel;
+            for (int lod = 0; lod < SCATTER_LOD_COUNT; lod++) {
+                size += 2 * (size_t)layer.keptCapacity[lod] * texel;
+            }
+        }
+        return size;
+    }
+}
@@ -0,0 +1,159 @@
+#ifndef ScatterSystem_hpp
+#define ScatterSystem_hpp
+
+#if defined (__APPLE__)
+    #define GL_SILENCE_DEPRECATION
+    #include <OpenGL/gl3.h>
+#else
+    #define GLEW_STATIC
+    #include <GL/glew.h>
+#endif
+
+#include <glm/glm.hpp>
+
+#include "GpuInstanceCuller.hpp"
+#include "Heightfield.hpp"
+#include "Shader.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace gps {
+
+    enum ScatterShape { SCATTER_ROCK, SCATTER_TREE };
+
+    static const int SCATTER_LOD_COUNT = 3;
+
+    // One kind of thing scattered over the terrain
+    struct ScatterLayer {
+        ScatterShape shape;
+        float spacing;          // the least distance between two instances
+        float density;          // the share of the points kept where every window is 1
+        glm::vec2 altitude;     // the band kept: 0 the lowest height of the terrain, 1 the highest
+        float minNormalY;       // steeper ground is left bare
+        glm::vec2 scale;        // size range, the meshes are about 1 across
+        float sink;             // into the ground, relative to the size
+        float alignToSlope;     // 0 upright .. 1 along the ground's normal
+        float lodDistances[SCATTER_LOD_COUNT]; // where every LOD ends, the last one is how far cells are loaded
+        glm::vec3 material;     // light multiplier, shininess, specular strength
+        uint32_t seed;
+    };
+
+    // Rocks and trees placed over the heightfield at run time, the same
+    // ones for the same terrain and layers every time.
+    //
+    // Every layer has a blue noise tile, CELL_SIZE across: Bridson's Poisson
+    // disk sampling from the layer's seed, wrapping around so that tiles side
+    // by side keep the spacing across their edges. A terrain cell takes the
+    // tile's points and keeps those whose hash (of the cell and the point)
+    // falls under the layer's density times three windows: the altitude band,
+    // the slope and a density map (value noise baked over the terrain every
+    // DENSITY_MAP_SPACING), all faded at their edges so the layers thin out
+    // instead of stopping on a line. Clearings keep the places the scene
+    // already uses (the camp, the penguins) bare.
+    //
+    // The instances are stored per cell, in a slot of the layer's buffer as
+    // large as the tile (GpuInstanceCuller's layout; the points not kept are
+    // zeros, holes the culler never keeps). update streams the cells by distance:
+    // the nearest missing ones within the last LOD distance are generated,
+    // at most MAX_CELLS_PER_UPDATE a call, the ones a cell past it freed.
+    //
+    // Draw culls every layer once per LOD on the GPU, against the frustum
+    // and the LOD's ring of distances, then draws the LOD's mesh once per
+    // instance kept (the matrix from attributes 3-6, the light shader's
+    // instanced path). The meshes are made here too: a displaced, flattened
+    // icosphere for the rocks, a trunk and stacked cones for the trees,
+    // fewer triangles at every LOD.
+    class ScatterSystem {
+
+    public:
+        static constexpr float CELL_SIZE = 4096.0f;
+        static constexpr float DENSITY_MAP_SPACING = 2048.0f;
+        static const int MAX_CELLS_PER_UPDATE = 2;
+        static const int TEXTURE_SIZE = 64;
+
+        // the heightfield is read by update, it must outlive the scatter
+        void init(gps::Heightfield& heightfield, const std::vector<ScatterLayer>& layers);
+        void Delete();
+
+        // nothing in the disk (center.x, center.z, radius), in the terrain's space: the loaded cells
+        // it touches are freed, the next updates generate them again
+        void addClearing(const glm::vec3& center, float radius);
+
+        // camera: in the terrain's space
+        void update(const glm::vec3& camera);
+
+        // the light shader is used for the draw, the cull shader before it;
+        // model: the terrain's space -> world, camera in the terrain's space
+        void Draw(gps::Shader& cullShader, gps::Shader& shader, const glm::mat4& viewProjection, const glm::mat4& model, const glm::vec3& camera);
+
+        int getLayerCount();
+        int getTilePointCount(int layer);
+        int getLoadedCellCount(int layer);
+        // instances in the loaded cells
+        int getLoadedInstanceCount(int layer);
+        // kept by the last cull whose count has arrived, per LOD
+        int getVisibleCount(int layer, int lod);
+        // bytes of video memory: instances, cull outputs, meshes and texture
+        size_t getMemorySize();
+
+    private:
+        struct MeshRange {
+            GLuint firstIndex = 0;
+            GLuint indexCount = 0;
+            GLint baseVertex = 0;
+        };
+
+        struct Shape {
+            MeshRange lods[SCATTER_LOD_COUNT];
+            glm::vec3 boundsCenter = glm::vec3(0.0f);
+            float boundsRadius = 0.0f;
+        };
+
+        struct Layer {
+            ScatterLayer settings;
+            std::vector<glm::vec2> tile;        // the blue noise points, in [0, CELL_SIZE)
+            std::vector<float> densityMap;      // densityWidth x densityDepth
+            std::vector<int> cellSlots;         // per terrain cell, -1 when not loaded
+            std::vector<int> cellCounts;        // the instances of every loaded cell
+            std::vector<int> slotCells;         // per slot, -1 when free
+            int slotCapacity = 0;               // instances a slot holds
+            int loadedInstances = 0;
+            GLuint instanceBuffer = 0;
+            gps::GpuInstanceCuller cullers[SCATTER_LOD_COUNT];
+            int keptCapacity[SCATTER_LOD_COUNT];
+        };
+
+        gps::Heightfield* heightfield = nullptr;
+        std::vector<Layer> layers;
+        std::vector<glm::vec3> clearings; // x, z, radius
+        Shape shapes[2];
+        int cellsX = 0;
+        int cellsZ = 0;
+        int densityWidth = 0;
+        int densityDepth = 0;
+        float lowest = 0.0f;
+        float highest = 1.0f;
+
+        GLuint VAO = 0;
+        GLuint VBO = 0;
+        GLuint EBO = 0;
+        GLuint texture = 0;
+        size_t meshSize = 0;
+
+        void buildTile(Layer& layer);
+        void buildDensityMap(Layer& layer);
+        void buildMeshes();
+        void buildTexture();
+
+        float densityAt(const Layer& layer, float x, float z);
+        // distance from the camera to the cell, on the ground plane
+        float cellDistance(int cell, const glm::vec3& camera);
+        void loadCell(Layer& layer, int cell);
+        void unloadCell(Layer& layer, int cell);
+        void writeSlot(Layer& layer, int slot, const std::vector<glm::vec4>& texels);
+    };
+}
+
+#endif /* ScatterSystem_hpp */
@@ -91,6 +91,119 @@ namespace gps {
         shaderLinkLog(this->shaderProgram);
     }
     
+    void Shader::loadShader(std::string vertexShaderFileName, std::string geometryShaderFileName, std::string fragmentShaderFileName) {
+
+        //read, parse and compile the vertex shader
+        std::string v = readShaderFile(vertexShaderFileName);
+        const GLchar* vertexShaderString = v.c_str();
+        GLuint vertexShader;
+        vertexShader = glCreateShader(GL_VERTEX_SHADER);
+        glShaderSource(vertexShader, 1, &vertexShaderString, NULL);
+        glCompileShader(vertexShader);
+        //check compilation status
+        shaderCompileLog(vertexShader);
+
+        //read, parse and compile the geometry shader
+        std::string g = readShaderFile(geometryShaderFileName);
+        const GLchar* geometryShaderString = g.c_str();
+        GLuint geometryShader;
+        geometryShader = glCreateShader(GL_GEOMETRY_SHADER);
+        glShaderSource(geometryShader, 1, &geometryShaderString, NULL);
+        glCompileShader(geometryShader);
+        //check compilation status
+        shaderCompileLog(geometryShader);
+
+        //read, parse and compile the fragment shader
+        std::string f = readShaderFile(fragmentShaderFileName);
+        const GLchar* fragmentShaderString = f.c_str();
+        GLuint fragmentShader;
+        fragmentShader = glCreateShader(GL_FRAGMENT_SHADER);
+        glShaderSource(fragmentShader, 1, &fragmentShaderString, NULL);
+        glCompileShader(fragmentShader);
+        //check compilation status
+        shaderCompileLog(fragmentShader);
+
+        //attach and link the shader programs
+        this->shaderProgram = glCreateProgram();
+        glAttachShader(this->shaderProgram, vertexShader);
+        glAttachShader(this->shaderProgram, geometryShader);
+        glAttachShader(this->shaderProgram, fragmentShader);
+        glLinkProgram(this->shaderProgram);
+        glDeleteShader(vertexShader);
+        glDeleteShader(geometryShader);
+        glDeleteShader(fragmentShader);
+        //check linking info
+        shaderLinkLog(this->shaderProgram);
+    }
+
+    void Shader::loadTransformFeedbackShader(std::string vertexShaderFileName, const std::vector<std::string>& varyings) {
+
+        //read, parse and compile the vertex shader
+        std::string v = readShaderFile(vertexShaderFileName);
+        const GLchar* vertexShaderString = v.c_str();
+        GLuint vertexShader;
+        vertexShader = glCreateShader(GL_VERTEX_SHADER);
+        glShaderSource(vertexShader, 1, &vertexShaderString, NULL);
+        glCompileShader(vertexShader);
+        //check compilation status
+        shaderCompileLog(vertexShader);
+
+        this->shaderProgram = glCreateProgram();
+        glAttachShader(this->shaderProgram, vertexShader);
+
+        //the captured outputs have to be declared before linking
+        std::vector<const GLchar*> varyingNames;
+        for (size_t i = 0; i < varyings.size(); i++) {
+            varyingNames.push_back(varyings[i].c_str());
+        }
+        glTransformFeedbackVaryings(this->shaderProgram, (GLsizei)varyingNames.size(), varyingNames.data(), GL_INTERLEAVED_ATTRIBS);
+
+        glLinkProgram(this->shaderProgram);
+        glDeleteShader(vertexShader);
+        //check linking info
+        shaderLinkLog(this->shaderProgram);
+    }
+
+    void Shader::loadTransformFeedbackShader(std::string vertexShaderFileName, std::string geometryShaderFileName, const std::vector<std::string>& varyings) {
+
+        //read, parse and compile the vertex shader
+        std::string v = readShaderFile(vertexShaderFileName);
+        const GLchar* vertexShaderString = v.c_str();
+        GLuint vertexShader;
+        vertexShader = glCreateShader(GL_VERTEX_SHADER);
+        glShaderSource(vertexShader, 1, &vertexShaderString, NULL);
+        glCompileShader(vertexShader);
+        //check compilation status
+        shaderCompileLog(vertexShader);
+
+        //read, parse and compile the geometry shader
+        std::string g = readShaderFile(geometryShaderFileName);
+        const GLchar* geometryShaderString = g.c_str();
+        GLuint geometryShader;
+        geometryShader = glCreateShader(GL_GEOMETRY_SHADER);
+        glShaderSource(geometryShader, 1, &geometryShaderString, NULL);
+        glCompileShader(geometryShader);
+        //check compilation status
+        shaderCompileLog(geometryShader);
+
+        this->shaderProgram = glCreateProgram();
+        glAttachShader(this->shaderProgram, vertexShader);
+        glAttachShader(this->shaderProgram, geometryShader);
+
+        //the captured outputs have to be declared before linking
+        std::vector<const GLchar*> varyingNames;
+        for (size_t i = 0; i < varyings.size(); i++) {
+            varyingNames.push_back(varyings[i].c_str());
+        }
+        glTransformFeedbackVaryings(this->shaderProgram, (GLsizei)varyingNames.size(), varyingNames.data(), GL_INTERLEAVED_ATTRIBS);
+
+        glLinkProgram(this->shaderProgram);
+        glDeleteShader(vertexShader);
+        glDeleteShader(geometryShader);
+        //check linking info
+        shaderLinkLog(this->shaderProgram);
+    }
+
     void Shader::useShaderProgram() {
 
         glUseProgram(this->shaderProgram);
@@ -20,6 +20,8 @@
 #include <fstream>
 #include <sstream>
 #include <iostream>
+#include <string>
+#include <vector>
 
 
 namespace gps {
@@ -29,6 +31,11 @@ namespace gps {
     public:
         GLuint shaderProgram;
         void loadShader(std::string vertexShaderFileName, std::string fragmentShaderFileName);
+        void loadShader(std::string vertexShaderFileName, std::string geometryShaderFileName, std::string fragmentShaderFileName);
+        // vertex shader only program whose outputs are captured (interleaved) with transform feedback
+        void loadTransformFeedbackShader(std::string vertexShaderFileName, const std::vector<std::string>& varyings);
+        // the same with a geometry shader, whose outputs are the ones captured
+        void loadTransformFeedbackShader(std::string vertexShaderFileName, std::string geometryShaderFileName, const std::vector<std::string>& varyings);
         void useShaderProgram();
     
     private:
@@ -0,0 +1,386 @@
+#include "ShadowAtlas.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+namespace gps {
+
+    // ===== QUADTREE ALLOCATOR =====
+
+    void ShadowAtlasAllocator::init(int width, int height, int minTileSize) {
+
+        this->width = width;
+        this->height = height;
+        this->minTileSize = minTileSize;
+        nodes.clear();
+        freeNodeBlocks.clear();
+        addRoots(0, 0, width, height);
+        rootCount = (int)nodes.size();
+    }
+
+    void ShadowAtlasAllocator::addRoots(int x, int y, int width, int height) {
+
+        int shorter = std::min(width, height);
+        if (shorter < minTileSize) {
+            return;
+        }
+        int size = minTileSize;
+        while (size * 2 <= shorter) {
+            size *= 2;
+        }
+
+        // a row (or column) of squares along the longer side, then the strip left over
+        if (width >= height) {
+            int count = width / size;
+            for (int i = 0; i < count; i++) {
+                nodes.push_back({ { x + i * size, y, size }, -1, -1, false });
+            }
+            addRoots(x + count * size, y, width - count * size, height);
+            addRoots(x, y + size, count * size, height - size);
+        }
+        else {
+            int count = height / size;
+            for (int i = 0; i < count; i++) {
+                nodes.push_back({ { x, y + i * size, size }, -1, -1, false });
+            }
+            addRoots(x, y + count * size, width, height - count * size);
+            addRoots(x + size, y, width - size, count * size);
+        }
+    }
+
+    void ShadowAtlasAllocator::clear() {
+
+        init(width, height, minTileSize);
+    }
+
+    ShadowTile ShadowAtlasAllocator::getTile(int node) {
+        return nodes[node].tile;
+    }
+
+    bool ShadowAtlasAllocator::isFreeLeaf(int node) {
+        return nodes[node].firstChild == -1 && !nodes[node].used;
+    }
+
+    void ShadowAtlasAllocator::split(int node) {
+
+        int first;
+        if (!freeNodeBlocks.empty()) {
+            first = freeNodeBlocks.back();
+            freeNodeBlocks.pop_back();
+        }
+        else {
+            first = (int)nodes.size();
+            nodes.resize(nodes.size() + 4);
+        }
+
+        ShadowTile t = nodes[node].tile;
+        int half = t.size / 2;
+        nodes[first + 0] = { { t.x,        t.y,        half }, node, -1, false };
+        nodes[first + 1] = { { t.x + half, t.y,        half }, node, -1, false };
+        nodes[first + 2] = { { t.x,        t.y + half, half }, node, -1, false };
+        nodes[first + 3] = { { t.x + half, t.y + half, half }, node, -1, false };
+        nodes[node].firstChild = first;
+    }
+
+    int ShadowAtlasAllocator::allocateIn(int node, int size) {
+
+        if (nodes[node].tile.size < size) {
+            return -1;
+        }
+
+        if (nodes[node].firstChild == -1) {
+
+            if (nodes[node].used) {
+                return -1;
+            }
+            if (nodes[node].tile.size == size) {
+                nodes[node].used = true;
+                return node;
+            }
+            split(node);
+        }
+
+        for (int i = 0; i < 4; i++) {
+
+            int result = allocateIn(nodes[node].firstChild + i, size);
+            if (result != -1) {
+                return result;
+            }
+        }
+        return -1;
+    }
+
+    int ShadowAtlasAllocator::allocate(int size) {
+
+        if (size < minTileSize) {
+            size = minTileSize;
+        }
+        for (int root = 0; root < rootCount; root++) {
+            int node = allocateIn(root, size);
+            if (node != -1) {
+                return node;
+            }
+        }
+        return -1;
+    }
+
+    void ShadowAtlasAllocator::release(int node) {
+
+        nodes[node].used = false;
+
+        // merge the parents whose 4 children are all free again
+        int parent = nodes[node].parent;
+        while (parent != -1) {
+
+            int first = nodes[parent].firstChild;
+            if (!(isFreeLeaf(first) && isFreeLeaf(first + 1) && isFreeLeaf(first + 2) && isFreeLeaf(first + 3))) {
+                break;
+            }
+            freeNodeBlocks.push_back(first);
+            nodes[parent].firstChild = -1;
+            parent = nodes[parent].parent;
+        }
+    }
+
+    // ===== SHADOW ATLAS =====
+
+    void ShadowAtlas::init(int width, int height, int minTileSize, int maxTileSize) {
+
+        this->width = width;
+        this->height = height;
+        this->minTileSize = minTileSize;
+        this->maxTileSize = std::min(maxTileSize, std::min(width, height));
+        allocator.init(width, height, minTileSize);
+
+        glGenTextures(1, &texture);
+        glBindTexture(GL_TEXTURE_2D, texture);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT,
+            width, height, 0, GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
+        float borderColor[] = { 1.0f, 1.0f, 1.0f, 1.0f };
+        glTexParameterfv(GL_TEXTURE_2D, GL_TEXTURE_BORDER_COLOR, borderColor);
+
+        glGenFramebuffers(1, &fbo);
+        glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, texture, 0);
+        glDrawBuffer(GL_NONE);
+        glReadBuffer(GL_NONE);
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    }
+
+    void ShadowAtlas::Delete() {
+
+        glDeleteFramebuffers(1, &fbo);
+        glDeleteTextures(1, &texture);
+    }
+
+    int ShadowAtlas::addLight(float importance) {
+
+        Light light;
+        light.viewProjection = glm::mat4(1.0f);
+        light.renderedViewProjection = glm::mat4(1.0f);
+        light.importance = importance;
+        light.coverage = 0.0f;
+        light.node = -1;
+        light.tileSize = 0;
+        light.requestedSize = 0;
+        light.dirty = true;
+        light.rendered = false;
+        light.lastUpdateFrame = -1;
+        lights.push_back(light);
+
+        return (int)lights.size() - 1;
+    }
+
+    void ShadowAtlas::setLight(int light, glm::mat4 lightViewProjection, float coverage, bool changed) {
+
+        Light& l = lights[light];
+        if (changed || l.viewProjection != lightViewProjection) {
+            l.dirty = true;
+        }
+        l.viewProjection = lightViewProjection;
+        l.coverage = coverage;
+    }
+
+    int ShadowAtlas::desiredTileSize(const Light& light) {
+
+        // tile side follows the projected size of the lit area
+        float side = std::sqrt(glm::clamp(light.coverage, 0.0f, 1.0f)) * light.importance * (float)maxTileSize;
+        if (side <= 0.0f) {
+            return 0;
+        }
+
+        int size = minTileSize;
+        while (size < maxTileSize && (float)size < side) {
+            size *= 2;
+        }
+        return size;
+    }
+
+    void ShadowAtlas::reallocateTiles() {
+
+        // most important lights are placed first and smaller lights get downgraded when full
+        std::vector<int> order(lights.size());
+        for (size_t i = 0; i < lights.size(); i++) {
+            order[i] = (int)i;
+        }
+        std::sort(order.begin(), order.end(), [this](int a, int b) {
+            return lights[a].coverage * lights[a].importance > lights[b].coverage * lights[b].importance;
+        });
+
+        allocator.clear();
+
+        for (int index : order) {
+
+            Light& l = lights[index];
+            l.node = -1;
+            l.requestedSize = desiredTileSize(l);
+            int size = l.requestedSize;
+            while (size >= minTileSize && l.node == -1) {
+                l.node = allocator.allocate(size);
+                if (l.node == -1) {
+                    size /= 2;
+                }
+            }
+
+            l.tileSize = l.node != -1 ? size : 0;
+            // content moved or was resized, it has to be redrawn
+            l.dirty = true;
+            l.rendered = false;
+        }
+    }
+
+    void ShadowAtlas::beginFrame(int updateBudget) {
+
+        frame++;
+
+        // sizes are quantized to powers of two so this only triggers on real changes
+        // (compared with the request, a downgraded tile does not retrigger it)
+        bool sizesChanged = false;
+        for (const Light& l : lights) {
+            if (desiredTileSize(l) != l.requestedSize) {
+                sizesChanged = true;
+                break;
+            }
+        }
+        if (sizesChanged) {
+            reallocateTiles();
+        }
+
+        // least recently refreshed stale tiles first
+        lightsToUpdate.clear();
+        for (size_t i = 0; i < lights.size(); i++) {
+            if (lights[i].node != -1 && lights[i].dirty) {
+                lightsToUpdate.push_back((int)i);
+            }
+        }
+        std::sort(lightsToUpdate.begin(), lightsToUpdate.end(), [this](int a, int b) {
+            if (lights[a].lastUpdateFrame != lights[b].lastUpdateFrame) {
+                return lights[a].lastUpdateFrame < lights[b].lastUpdateFrame;
+            }
+            return lights[a].importance > lights[b].importance;
+        });
+        if ((int)lightsToUpdate.size() > updateBudget) {
+            lightsToUpdate.resize(updateBudget);
+        }
+
+        // drawn this frame, with the matrix they have now
+        for (int light : lightsToUpdate) {
+            lights[light].dirty = false;
+            lights[light].rendered = true;
+            lights[light].renderedViewProjection = lights[light].viewProjection;
+            lights[light].lastUpdateFrame = frame;
+        }
+    }
+
+    const std::vector<int>& ShadowAtlas::getLightsToUpdate() {
+        return lightsToUpdate;
+    }
+
+    void ShadowAtlas::beginTileRender(int light) {
+
+        ShadowTile tile = allocator.getTile(lights[light].node);
+
+        glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+        glViewport(tile.x, tile.y, tile.size, tile.size);
+        // the clear is limited to the tile by the scissor box
+        glEnable(GL_SCISSOR_TEST);
+        glScissor(tile.x, tile.y, tile.size, tile.size);
+        glClear(GL_DEPTH_BUFFER_BIT);
+    }
+
+    void ShadowAtlas::endTileRender() {
+
+        glDisable(GL_SCISSOR_TEST);
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    }
+
+    bool ShadowAtlas::hasTile(int light) {
+        return lights[light].node != -1 && lights[light].rendered;
+    }
+
+    glm::mat4 ShadowAtlas::getSamplingMatrix(int light) {
+
+        if (!hasTile(light)) {
+            return glm::mat4(1.0f);
+        }
+
+        ShadowTile tile = allocator.getTile(lights[light].node);
+        float centerX = ((float)tile.x + 0.5f * tile.size) / (float)width * 2.0f - 1.0f;
+        float centerY = ((float)tile.y + 0.5f * tile.size) / (float)height * 2.0f - 1.0f;
+
+        // clip space xy of the light -> clip space xy of the tile inside the atlas
+        glm::mat4 tileMatrix = glm::mat4(1.0f);
+        tileMatrix[0][0] = (float)tile.size / (float)width;
+        tileMatrix[1][1] = (float)tile.size / (float)height;
+        tileMatrix[3][0] = centerX;
+        tileMatrix[3][1] = centerY;
+
+        return tileMatrix * lights[light].renderedViewProjection;
+    }
+
+    glm::vec4 ShadowAtlas::getTileRect(int light) {
+
+        // min above max: every fragment is outside, unshadowed
+        if (!hasTile(light)) {
+            return glm::vec4(1.0f, 1.0f, 0.0f, 0.0f);
+        }
+
+        ShadowTile tile = allocator.getTile(lights[light].node);
+        float invWidth = 1.0f / (float)width;
+        float invHeight = 1.0f / (float)height;
+        return glm::vec4(tile.x * invWidth, tile.y * invHeight,
+            (tile.x + tile.size) * invWidth, (tile.y + tile.size) * invHeight);
+    }
+
+    GLuint ShadowAtlas::getTexture() {
+        return texture;
+    }
+
+    int ShadowAtlas::getWidth() {
+        return width;
+    }
+
+    int ShadowAtlas::getHeight() {
+        return height;
+    }
+
+    float ShadowAtlas::screenCoverage(glm::vec3 center, float radius, glm::mat4 view, glm::mat4 projection) {
+
+        glm::vec4 viewPos = view * glm::vec4(center, 1.0f);
+        float distance = -viewPos.z;
+
+        // camera inside the light volume
+        if (distance <= radius) {
+            return 1.0f;
+        }
+
+        // projected radius in NDC, the screen is 2x2 in NDC
+        float ndcRadius = radius * projection[1][1] / distance;
+        float coverage = 3.14159265f * ndcRadius * ndcRadius / 4.0f;
+        return glm::min(coverage, 1.0f);
+    }
+}
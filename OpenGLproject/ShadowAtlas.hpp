@@ -0,0 +1,130 @@
+#ifndef ShadowAtlas_hpp
+#define ShadowAtlas_hpp
+
+#if defined (__APPLE__)
+    #define GL_SILENCE_DEPRECATION
+    #include <OpenGL/gl3.h>
+#else
+    #define GLEW_STATIC
+    #include <GL/glew.h>
+#endif
+
+#include <glm/glm.hpp>
+
+#include <vector>
+
+namespace gps {
+
+    // Square region of the atlas, in texels
+    struct ShadowTile {
+        int x;
+        int y;
+        int size;
+    };
+
+    // Quadtree allocator for power of two square tiles. A rectangular atlas
+    // is covered by the largest power of two squares that fit, each one the
+    // root of its own quadtree.
+    class ShadowAtlasAllocator {
+
+    public:
+        void init(int width, int height, int minTileSize);
+        // returns the node index of the tile, -1 if there is no room
+        int allocate(int size);
+        void release(int node);
+        void clear();
+        ShadowTile getTile(int node);
+
+    private:
+        struct Node {
+            ShadowTile tile;
+            int parent;
+            int firstChild; // -1 for leaves, the 4 children are consecutive
+            bool used;
+        };
+        std::vector<Node> nodes;
+        std::vector<int> freeNodeBlocks; // recycled groups of 4 children
+        int rootCount;
+        int width;
+        int height;
+        int minTileSize;
+
+        void addRoots(int x, int y, int width, int height);
+
+        int allocateIn(int node, int size);
+        void split(int node);
+        bool isFreeLeaf(int node);
+    };
+
+    // One large depth texture shared by all the shadow casting lights.
+    // Tile sizes follow screen coverage * importance and only a fixed number
+    // of tiles (the least recently refreshed ones) are redrawn each frame.
+    // A tile is sampled with the matrix it was drawn with, not the light's
+    // latest one, until it is redrawn.
+    class ShadowAtlas {
+
+    public:
+        void init(int width, int height, int minTileSize, int maxTileSize);
+        void Delete();
+
+        int addLight(float importance);
+        // lightViewProjection is the matrix the caster pass renders with;
+        // coverage is the fraction of the screen lit by the light (1 for the sun);
+        // changed marks the tile content as stale
+        void setLight(int light, glm::mat4 lightViewProjection, float coverage, bool changed);
+
+        // Reassigns tile sizes and picks the tiles to refresh this frame
+        void beginFrame(int updateBudget);
+        const std::vector<int>& getLightsToUpdate();
+
+        // Binds the atlas and restricts rendering to the light's tile
+        void beginTileRender(int light);
+        void endTileRender();
+
+        // the light has a tile with something drawn in it; without one the
+        // two below return the identity and an empty rectangle (nothing shadowed)
+        bool hasTile(int light);
+        // matrix for sampling: maps the world to the light's tile, as last drawn
+        glm::mat4 getSamplingMatrix(int light);
+        // uv rectangle of the tile (min.xy, max.xy) used to clamp the PCF taps
+        glm::vec4 getTileRect(int light);
+
+        GLuint getTexture();
+        int getWidth();
+        int getHeight();
+
+        // Fraction of the screen covered by a sphere, for lights with a limited range
+        static float screenCoverage(glm::vec3 center, float radius, glm::mat4 view, glm::mat4 projection);
+
+    private:
+        struct Light {
+            glm::mat4 viewProjection;
+            glm::mat4 renderedViewProjection; // what the tile's content was drawn with
+            float importance;
+            float coverage;
+            int node;      // allocator node, -1 when there is no tile
+            int tileSize;
+            int requestedSize; // can be larger than tileSize when the atlas is full
+            bool dirty;
+            bool rendered; // the tile has content, cleared when it moves
+            long long lastUpdateFrame;
+        };
+
+        GLuint fbo = 0;
+        GLuint texture = 0;
+        int width = 0;
+        int height = 0;
+        int minTileSize = 0;
+        int maxTileSize = 0;
+        long long frame = 0;
+
+        ShadowAtlasAllocator allocator;
+        std::vector<Light> lights;
+        std::vector<int> lightsToUpdate;
+
+        int desiredTileSize(const Light& light);
+        void reallocateTiles();
+    };
+}
+
+#endif /* ShadowAtlas_hpp */
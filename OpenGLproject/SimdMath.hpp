@@ -0,0 +1,151 @@
+#ifndef SimdMath_hpp
+#define SimdMath_hpp
+
+#include <cstdint>
+#include <cstring>
+
+// ===== SIMD WRAPPERS =====
+// The kernels are written once against these helpers:
+// AVX2 = 8 lanes, SSE2 = 4 lanes (always present on x64), otherwise scalar.
+// vload / vstore need W * 4 byte alignment, vloadu does not.
+
+#if defined(__AVX2__)
+    #include <immintrin.h>
+
+    namespace gps {
+    namespace simd {
+        const int W = 8;
+        typedef __m256 vf;
+        typedef __m256 vm;
+        typedef __m256i vi;
+
+        inline vf vset(float x) { return _mm256_set1_ps(x); }
+        inline vf vload(const float* p) { return _mm256_load_ps(p); }
+        inline vf vloadu(const float* p) { return _mm256_loadu_ps(p); }
+        inline void vstore(float* p, vf x) { _mm256_store_ps(p, x); }
+        inline vf vadd(vf a, vf b) { return _mm256_add_ps(a, b); }
+        inline vf vsub(vf a, vf b) { return _mm256_sub_ps(a, b); }
+        inline vf vmul(vf a, vf b) { return _mm256_mul_ps(a, b); }
+        inline vf vdiv(vf a, vf b) { return _mm256_div_ps(a, b); }
+        inline vf vmin(vf a, vf b) { return _mm256_min_ps(a, b); }
+        inline vf vmax(vf a, vf b) { return _mm256_max_ps(a, b); }
+        inline vm vgt(vf a, vf b) { return _mm256_cmp_ps(a, b, _CMP_GT_OQ); }
+        inline vm vlt(vf a, vf b) { return _mm256_cmp_ps(a, b, _CMP_LT_OQ); }
+        inline vm vand(vm a, vm b) { return _mm256_and_ps(a, b); }
+        // m ? a : b
+        inline vf vselect(vm m, vf a, vf b) { return _mm256_blendv_ps(b, a, m); }
+        // 0, 1, ..., W - 1
+        inline vf vramp() { return _mm256_setr_ps(0.0f, 1.0f, 2.0f, 3.0f, 4.0f, 5.0f, 6.0f, 7.0f); }
+        inline float vsum(vf a) {
+            __m128 x = _mm_add_ps(_mm256_castps256_ps128(a), _mm256_extractf128_ps(a, 1));
+            x = _mm_add_ps(x, _mm_movehl_ps(x, x));
+            x = _mm_add_ss(x, _mm_shuffle_ps(x, x, 1));
+            return _mm_cvtss_f32(x);
+        }
+
+        inline vi viload(const uint32_t* p) { return _mm256_load_si256((const __m256i*)p); }
+        inline void vistore(uint32_t* p, vi x) { _mm256_store_si256((__m256i*)p, x); }
+        inline vi viadd(vi a, vi b) { return _mm256_add_epi32(a, b); }
+        inline vi vixor(vi a, vi b) { return _mm256_xor_si256(a, b); }
+        inline vi vior(vi a, vi b) { return _mm256_or_si256(a, b); }
+        template<int K> inline vi vishl(vi a) { return _mm256_slli_epi32(a, K); }
+        template<int K> inline vi vishr(vi a) { return _mm256_srli_epi32(a, K); }
+        // top 23 bits as the mantissa of a float in [1, 2), minus 1
+        inline vf vunit(vi x) {
+            return _mm256_sub_ps(_mm256_castsi256_ps(_mm256_or_si256(_mm256_srli_epi32(x, 9), _mm256_set1_epi32(0x3F800000))), _mm256_set1_ps(1.0f));
+        }
+    }
+    }
+
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+    #include <emmintrin.h>
+
+    namespace gps {
+    namespace simd {
+        const int W = 4;
+        typedef __m128 vf;
+        typedef __m128 vm;
+        typedef __m128i vi;
+
+        inline vf vset(float x) { return _mm_set1_ps(x); }
+        inline vf vload(const float* p) { return _mm_load_ps(p); }
+        inline vf vloadu(const float* p) { return _mm_loadu_ps(p); }
+        inline void vstore(float* p, vf x) { _mm_store_ps(p, x); }
+        inline vf vadd(vf a, vf b) { return _mm_add_ps(a, b); }
+        inline vf vsub(vf a, vf b) { return _mm_sub_ps(a, b); }
+        inline vf vmul(vf a, vf b) { return _mm_mul_ps(a, b); }
+        inline vf vdiv(vf a, vf b) { return _mm_div_ps(a, b); }
+        inline vf vmin(vf a, vf b) { return _mm_min_ps(a, b); }
+        inline vf vmax(vf a, vf b) { return _mm_max_ps(a, b); }
+        inline vm vgt(vf a, vf b) { return _mm_cmpgt_ps(a, b); }
+        inline vm vlt(vf a, vf b) { return _mm_cmplt_ps(a, b); }
+        inline vm vand(vm a, vm b) { return _mm_and_ps(a, b); }
+        // m ? a : b
+        inline vf vselect(vm m, vf a, vf b) { return _mm_or_ps(_mm_and_ps(m, a), _mm_andnot_ps(m, b)); }
+        // 0, 1, ..., W - 1
+        inline vf vramp() { return _mm_setr_ps(0.0f, 1.0f, 2.0f, 3.0f); }
+        inline float vsum(vf a) {
+            __m128 x = _mm_add_ps(a, _mm_movehl_ps(a, a));
+            x = _mm_add_ss(x, _mm_shuffle_ps(x, x, 1));
+            return _mm_cvtss_f32(x);
+        }
+
+        inline vi viload(const uint32_t* p) { return _mm_load_si128((const __m128i*)p); }
+        inline void vistore(uint32_t* p, vi x) { _mm_store_si128((__m128i*)p, x); }
+        inline vi viadd(vi a, vi b) { return _mm_add_epi32(a, b); }
+        inline vi vixor(vi a, vi b) { return _mm_xor_si128(a, b); }
+        inline vi vior(vi a, vi b) { return _mm_or_si128(a, b); }
+        template<int K> inline vi vishl(vi a) { return _mm_slli_epi32(a, K); }
+        template<int K> inline vi vishr(vi a) { return _mm_srli_epi32(a, K); }
+        // top 23 bits as the mantissa of a float in [1, 2), minus 1
+        inline vf vunit(vi x) {
+            return _mm_sub_ps(_mm_castsi128_ps(_mm_or_si128(_mm_srli_epi32(x, 9), _mm_set1_epi32(0x3F800000))), _mm_set1_ps(1.0f));
+        }
+    }
+    }
+
+#else
+
+    namespace gps {
+    namespace simd {
+        const int W = 1;
+        typedef float vf;
+        typedef bool vm;
+        typedef uint32_t vi;
+
+        inline vf vset(float x) { return x; }
+        inline vf vload(const float* p) { return *p; }
+        inline vf vloadu(const float* p) { return *p; }
+        inline void vstore(float* p, vf x) { *p = x; }
+        inline vf vadd(vf a, vf b) { return a + b; }
+        inline vf vsub(vf a, vf b) { return a - b; }
+        inline vf vmul(vf a, vf b) { return a * b; }
+        inline vf vdiv(vf a, vf b) { return a / b; }
+        inline vf vmin(vf a, vf b) { return a < b ? a : b; }
+        inline vf vmax(vf a, vf b) { return a > b ? a : b; }
+        inline vm vgt(vf a, vf b) { return a > b; }
+        inline vm vlt(vf a, vf b) { return a < b; }
+        inline vm vand(vm a, vm b) { return a && b; }
+        inline vf vselect(vm m, vf a, vf b) { return m ? a : b; }
+        inline vf vramp() { return 0.0f; }
+        inline float vsum(vf a) { return a; }
+
+        inline vi viload(const uint32_t* p) { return *p; }
+        inline void vistore(uint32_t* p, vi x) { *p = x; }
+        inline vi viadd(vi a, vi b) { return a + b; }
+        inline vi vixor(vi a, vi b) { return a ^ b; }
+        inline vi vior(vi a, vi b) { return a | b; }
+        template<int K> inline vi vishl(vi a) { return a << K; }
+        template<int K> inline vi vishr(vi a) { return a >> K; }
+        inline vf vunit(vi x) {
+            uint32_t bits = (x >> 9) | 0x3F800000u;
+            float f;
+            std::memcpy(&f, &bits, sizeof(f));
+            return f - 1.0f;
+        }
+    }
+    }
+
+#endif
+
+#endif /* SimdMath_hpp */
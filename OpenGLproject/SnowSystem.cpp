@@ -0,0 +1,73 @@
+#include "SnowSystem.hpp"
+
+#include <glm/gtc/type_ptr.hpp>
+
+namespace gps {
+
+    void SnowSystem::init() {
+
+        glGenVertexArrays(1, &emptyVAO);
+        time = 0.0;
+    }
+
+    void SnowSystem::Delete() {
+
+        glDeleteVertexArrays(1, &emptyVAO);
+        emptyVAO = 0;
+    }
+
+    void SnowSystem::update(float deltaTime) {
+
+        time += deltaTime;
+    }
+
+    void SnowSystem::setDensity(float density) {
+        this->density = glm::clamp(density, 1.0f / 1024.0f, 1.0f);
+    }
+
+    float SnowSystem::getDensity() {
+        return density;
+    }
+
+    int SnowSystem::getNearFlakeCount() {
+
+        // the near box is ~1/125 of the far one, it gets its own share
+        // of the budget so the close flakes stay dense enough to read as snow
+        return (int)(MAX_NEAR_FLAKES * density);
+    }
+
+    int SnowSystem::getFarFlakeCount() {
+        return (int)(MAX_FLAKES * density) - getNearFlakeCount();
+    }
+
+    void SnowSystem::draw(gps::Shader& snowShader, glm::vec3 cameraPos, float viewportHeight) {
+
+        GLuint program = snowShader.shaderProgram;
+        glUniform3fv(glGetUniformLocation(program, "cameraPos"), 1, glm::value_ptr(cameraPos));
+        glUniform1f(glGetUniformLocation(program, "time"), (float)time);
+        glUniform1f(glGetUniformLocation(program, "flakeSize"), flakeSize);
+        glUniform1f(glGetUniformLocation(program, "fallSpeed"), fallSpeed);
+        glUniform3fv(glGetUniformLocation(program, "wind"), 1, glm::value_ptr(wind));
+        glUniform1f(glGetUniformLocation(program, "nearVolumeSize"), nearVolumeSize);
+        glUniform1f(glGetUniformLocation(program, "viewportHeight"), viewportHeight);
+
+        GLint pointLayerLoc = glGetUniformLocation(program, "pointLayer");
+        GLint volumeSizeLoc = glGetUniformLocation(program, "volumeSize");
+
+        glBindVertexArray(emptyVAO);
+
+        // ===== NEAR - quads =====
+        glUniform1i(pointLayerLoc, 0);
+        glUniform1f(volumeSizeLoc, nearVolumeSize);
+        glDrawArraysInstanced(GL_TRIANGLES, 0, 6, getNearFlakeCount());
+
+        // ===== FAR - points =====
+        glEnable(GL_PROGRAM_POINT_SIZE);
+        glUniform1i(pointLayerLoc, 1);
+        glUniform1f(volumeSizeLoc, volumeSize);
+        glDrawArrays(GL_POINTS, 0, getFarFlakeCount());
+        glDisable(GL_PROGRAM_POINT_SIZE);
+
+        glBindVertexArray(0);
+    }
+}
@@ -0,0 +1,61 @@
+#ifndef SnowSystem_hpp
+#define SnowSystem_hpp
+
+#if defined (__APPLE__)
+    #define GL_SILENCE_DEPRECATION
+    #include <OpenGL/gl3.h>
+#else
+    #define GLEW_STATIC
+    #include <GL/glew.h>
+#endif
+
+#include <glm/glm.hpp>
+
+#include "Shader.hpp"
+
+namespace gps {
+
+    // Scene-wide snowfall, entirely on the GPU and without any buffer.
+    // A flake's position is a closed form function of its id and the time
+    // (hashed start, fall speed, wind and wobble), wrapped into a box that
+    // follows the camera, so the density stays constant everywhere without
+    // simulating the whole mountain and nothing has to be stored or updated.
+    // Two layers by distance:
+    //  - near: camera facing quads in a small box, instanced
+    //  - far: single points in the large box, the near box is skipped
+    class SnowSystem {
+
+    public:
+        static const int MAX_FLAKES = 1 << 20;
+        static const int MAX_NEAR_FLAKES = 1 << 16;
+
+        void init();
+        void Delete();
+
+        void update(float deltaTime);
+
+        // density in (0, 1], MAX_FLAKES flakes at 1
+        void setDensity(float density);
+        float getDensity();
+        int getNearFlakeCount();
+        int getFarFlakeCount();
+
+        // draws both layers with snowShader (already in use, view / projection set);
+        // viewportHeight is the height in pixels of the target, for the point sizes
+        void draw(gps::Shader& snowShader, glm::vec3 cameraPos, float viewportHeight);
+
+        // ===== PARAMETERS =====
+        float volumeSize = 6000.0f;     // side of the far box around the camera
+        float nearVolumeSize = 1200.0f; // side of the near box, drawn as quads
+        float flakeSize = 3.0f;         // world units
+        float fallSpeed = 90.0f;        // world units / second
+        glm::vec3 wind = glm::vec3(25.0f, 0.0f, 10.0f);
+
+    private:
+        GLuint emptyVAO = 0; // every attribute comes from gl_VertexID / gl_InstanceID
+        double time = 0.0; // accumulated in double, the frame deltas are tiny next to it
+        float density = 0.25f;
+    };
+}
+
+#endif /* SnowSystem_hpp */
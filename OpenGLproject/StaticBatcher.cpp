@@ -0,0 +1,457 @@
+#include "StaticBatcher.hpp"
+
+#include "MipChain.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+
+namespace gps {
+
+    struct BatchTriangle {
+        GLuint v[3];
+        glm::vec3 centroid;
+    };
+
+    static int roundUp(int size, int multiple) {
+        return (size + multiple - 1) / multiple * multiple;
+    }
+
+    static int nextPowerOfTwo(int size) {
+        int power = 1;
+        while (power < size) {
+            power *= 2;
+        }
+        return power;
+    }
+
+    // halves the triangles along the longest side of their centroids until they fit a cluster
+    static void splitClusters(std::vector<BatchTriangle>& triangles, int first, int count, int maxTriangles, std::vector<int>& ends) {
+
+        if (count <= maxTriangles) {
+            ends.push_back(first + count);
+            return;
+        }
+
+        glm::vec3 low = triangles[first].centroid;
+        glm::vec3 high = low;
+        for (int i = first; i < first + count; i++) {
+            low = glm::min(low, triangles[i].centroid);
+            high = glm::max(high, triangles[i].centroid);
+        }
+        glm::vec3 extent = high - low;
+        int axis = extent.x >= extent.y && extent.x >= extent.z ? 0 : (extent.y >= extent.z ? 1 : 2);
+
+        int half = count / 2;
+        std::nth_element(triangles.begin() + first, triangles.begin() + first + half, triangles.begin() + first + count,
+            [axis](const BatchTriangle& a, const BatchTriangle& b) { return a.centroid[axis] < b.centroid[axis]; });
+
+        splitClusters(triangles, first, half, maxTriangles, ends);
+        splitClusters(triangles, first + half, count - half, maxTriangles, ends);
+    }
+
+    void StaticBatcher::add(gps::Model3D& model, const glm::mat4& transform, const glm::vec3& material, const std::string& texturePath,
+        bool pointShadowCaster) {
+        sources.push_back({ &model, transform, material, texturePath, pointShadowCaster });
+    }
+
+    // ===== BAKE =====
+    void StaticBatcher::bake(gps::TextureStreamer& textures, const std::string& atlasPath) {
+
+        this->textures = &textures;
+
+        // the point light's face masks, one sphere per caster
+        for (Source& source : sources) {
+            if (!source.pointShadowCaster) {
+                continue;
+            }
+            glm::vec3 boundsMin = source.model->getBoundsMin();
+            glm::vec3 boundsMax = source.model->getBoundsMax();
+            glm::vec3 center = glm::vec3(source.transform * glm::vec4(0.5f * (boundsMin + boundsMax), 1.0f));
+            float scale = glm::max(glm::length(glm::vec3(source.transform[0])),
+                glm::max(glm::length(glm::vec3(source.transform[1])), glm::length(glm::vec3(source.transform[2]))));
+            pointShadowSpheres.push_back(glm::vec4(center, 0.5f * glm::length(boundsMax - boundsMin) * scale));
+        }
+
+        struct Part {
+            Source* source;
+            gps::Mesh* mesh;
+            std::string path;
+        };
+        struct Group {
+            glm::vec3 material;
+            std::string wrapPath; // empty when atlased
+            std::vector<Part> parts;
+            std::vector<std::string> paths;
+        };
+        std::vector<Group> groups;
+
+        for (Source& source : sources) {
+            for (gps::Mesh& mesh : source.model->getMeshes()) {
+                Part part = { &source, &mesh, source.texturePath };
+                for (const gps::Texture& texture : mesh.textures) {
+                    if (texture.type == "diffuseTexture") {
+                        part.path = texture.path;
+                    }
+                }
+
+                bool wraps = false;
+                for (const gps::Vertex& vertex : mesh.vertices) {
+                    if (std::min(vertex.TexCoords.x, vertex.TexCoords.y) < -0.001f || std::max(vertex.TexCoords.x, vertex.TexCoords.y) > 1.001f) {
+                        wraps = true;
+                        break;
+                    }
+                }
+                std::string wrapPath = wraps ? part.path : "";
+
+                auto group = std::find_if(groups.begin(), groups.end(), [&](const Group& g) {
+                    return g.material == source.material && g.wrapPath == wrapPath;
+                });
+                if (group == groups.end()) {
+                    groups.push_back({ source.material, wrapPath, {}, {} });
+                    group = groups.end() - 1;
+                }
+                group->parts.push_back(part);
+                if (std::find(group->paths.begin(), group->paths.end(), part.path) == group->paths.end()) {
+                    group->paths.push_back(part.path);
+                }
+            }
+        }
+
+        for (Group& group : groups) {
+            Batch batch;
+            batch.material = group.material;
+            std::vector<glm::vec4> rects;
+            std::vector<float> shares;
+            batch.atlas = buildAtlas(group.paths, !group.wrapPath.empty(), atlasPath + std::to_string(batches.size()), rects, shares);
+
+            std::vector<gps::Vertex> vertices;
+            std::vector<GLuint> indices;
+            for (Part& part : group.parts) {
+                size_t image = std::find(group.paths.begin(), group.paths.end(), part.path) - group.paths.begin();
+                glm::vec4 rect = rects[image];
+                glm::mat4 transform = part.source->transform;
+                glm::mat3 normalMatrix = glm::transpose(glm::inverse(glm::mat3(transform)));
+
+                GLuint base = (GLuint)vertices.size();
+                for (const gps::Vertex& vertex : part.mesh->vertices) {
+                    gps::Vertex baked;
+                    baked.Position = glm::vec3(transform * glm::vec4(vertex.Position, 1.0f));
+                    baked.Normal = glm::normalize(normalMatrix * vertex.Normal);
+                    baked.TexCoords = glm::vec2(rect.x, rect.y) + vertex.TexCoords * glm::vec2(rect.z, rect.w);
+                    vertices.push_back(baked);
+                }
+
+                // the clusters of one mesh never hold another's triangles
+                std::vector<BatchTriangle> triangles;
+                const std::vector<GLuint>& meshIndices = part.mesh->indices;
+                for (size_t t = 0; t + 2 < meshIndices.size(); t += 3) {
+                    BatchTriangle triangle;
+                    for (int k = 0; k < 3; k++) {
+                        triangle.v[k] = base + meshIndices[t + k];
+                    }
+                    triangle.centroid = (vertices[triangle.v[0]].Position + vertices[triangle.v[1]].Position + vertices[triangle.v[2]].Position) / 3.0f;
+                    triangles.push_back(triangle);
+                }
+
+                std::vector<int> ends;
+                splitClusters(triangles, 0, (int)triangles.size(), CLUSTER_TRIANGLES, ends);
+                int first = 0;
+                for (int end : ends) {
+                    Cluster cluster;
+                    cluster.firstIndex = (GLuint)indices.size();
+                    cluster.indexCount = (GLuint)(end - first) * 3;
+                    cluster.atlasScale = 1.0f / shares[image];
+                    cluster.pointShadowCaster = part.source->pointShadowCaster;
+                    cluster.boundsMin = cluster.boundsMax = vertices[triangles[first].v[0]].Position;
+                    for (int t = first; t < end; t++) {
+                        for (int k = 0; k < 3; k++) {
+                            indices.push_back(triangles[t].v[k]);
+                            cluster.boundsMin = glm::min(cluster.boundsMin, vertices[triangles[t].v[k]].Position);
+                            cluster.boundsMax = glm::max(cluster.boundsMax, vertices[triangles[t].v[k]].Position);
+                        }
+                    }
+                    batch.clusters.push_back(cluster);
+                    first = end;
+                }
+            }
+
+            if (indices.empty()) {
+                continue;
+            }
+            batch.range = gps::Mesh::getArena().allocate(vertices.data(), (GLuint)vertices.size(), indices.data(), (GLuint)indices.size());
+            batches.push_back(batch);
+        }
+        sources.clear();
+    }
+
+    GLuint StaticBatcher::buildAtlas(const std::vector<std::string>& paths, bool wrap, const std::string& path,
+        std::vector<glm::vec4>& rects, std::vector<float>& shares) {
+
+        // the image as it is, its own chain streamed like any prop texture
+        if (wrap) {
+            rects.assign(1, glm::vec4(0.0f, 0.0f, 1.0f, 1.0f));
+            shares.assign(1, 1.0f);
+            return textures->load(paths[0]);
+        }
+
+        struct Image {
+            int width = 1;
+            int height = 1;
+            std::vector<unsigned char> pixels = std::vector<unsigned char>(4, 255);
+            int x = 0;
+            int y = 0;
+        };
+        std::vector<Image> images(paths.size());
+        std::vector<gps::MipChain> chains(paths.size());
+        for (size_t i = 0; i < paths.size(); i++) {
+            if (!chains[i].open(paths[i])) {
+                fprintf(stderr, "WARNING: no image %s for the static batch\n", paths[i].c_str());
+            }
+        }
+
+        // the largest level of every image within cap, and the cells they take;
+        // the cap starts at the largest texture, where every image is whole
+        GLint maxTextureSize = 0;
+        glGetIntegerv(GL_MAX_TEXTURE_SIZE, &maxTextureSize);
+        const int align = 1 << ATLAS_MAX_LEVEL;
+        int atlasWidth = 0;
+        int atlasHeight = 0;
+        for (int cap = maxTextureSize; atlasWidth == 0; cap /= 2) {
+            for (size_t i = 0; i < paths.size(); i++) {
+                if (chains[i].getLevelCount() == 0) {
+                    continue;
+                }
+                int level = 0;
+                while (level + 1 < chains[i].getLevelCount() && std::max(chains[i].getLevelWidth(level), chains[i].getLevelHeight(level)) > cap) {
+                    level++;
+                }
+                images[i].width = chains[i].getLevelWidth(level);
+                images[i].height = chains[i].getLevelHeight(level);
+                images[i].pixels.resize(chains[i].getLevelSize(level));
+                std::ifstream file(chains[i].getPath(), std::ios::binary);
+                file.seekg((std::streamoff)chains[i].getLevelOffset(level));
+                file.read((char*)images[i].pixels.data(), (std::streamsize)images[i].pixels.size());
+            }
+
+            // shelves, tallest first, in the smallest power of two rectangle
+            std::vector<int> order(images.size());
+            for (size_t i = 0; i < order.size(); i++) {
+                order[i] = (int)i;
+            }
+            std::sort(order.begin(), order.end(), [&](int a, int b) { return images[a].height > images[b].height; });
+
+            size_t bestArea = 0;
+            for (int width = align; width <= maxTextureSize; width *= 2) {
+                int x = 0, y = 0, shelf = 0;
+                bool fits = true;
+                for (int i : order) {
+                    int cellWidth = roundUp(images[i].width + 2 * ATLAS_BORDER, align);
+                    int cellHeight = roundUp(images[i].height + 2 * ATLAS_BORDER, align);
+                    if (cellWidth > width) {
+                        fits = false;
+                        break;
+                    }
+                    if (x + cellWidth > width) {
+                        x = 0;
+                        y += shelf;
+                        shelf = 0;
+                    }
+                    x += cellWidth;
+                    shelf = std::max(shelf, cellHeight);
+                }
+                int height = nextPowerOfTwo(y + shelf);
+                if (!fits || height > maxTextureSize || (bestArea != 0 && (size_t)width * height >= bestArea)) {
+                    continue;
+                }
+                bestArea = (size_t)width * height;
+                atlasWidth = width;
+                atlasHeight = height;
+            }
+
+            // place them for real in the best one
+            if (atlasWidth != 0) {
+                int x = 0, y = 0, shelf = 0;
+                for (int i : order) {
+                    int cellWidth = roundUp(images[i].width + 2 * ATLAS_BORDER, align);
+                    int cellHeight = roundUp(images[i].height + 2 * ATLAS_BORDER, align);
+                    if (x + cellWidth > atlasWidth) {
+                        x = 0;
+                        y += shelf;
+                        shelf = 0;
+                    }
+                    images[i].x = x;
+                    images[i].y = y;
+                    x += cellWidth;
+                    shelf = std::max(shelf, cellHeight);
+                }
+            }
+        }
+
+        std::vector<unsigned char> atlas((size_t)atlasWidth * atlasHeight * 4, 0);
+        rects.clear();
+        shares.clear();
+        for (Image& image : images) {
+            // the cell, the texels past the image repeat its edge
+            int cellWidth = roundUp(image.width + 2 * ATLAS_BORDER, align);
+            int cellHeight = roundUp(image.height + 2 * ATLAS_BORDER, align);
+            for (int cy = 0; cy < cellHeight; cy++) {
+                int sy = std::min(std::max(cy - ATLAS_BORDER, 0), image.height - 1);
+                for (int cx = 0; cx < cellWidth; cx++) {
+                    int sx = std::min(std::max(cx - ATLAS_BORDER, 0), image.width - 1);
+                    const unsigned char* from = &image.pixels[((size_t)sy * image.width + sx) * 4];
+                    unsigned char* to = &atlas[((size_t)(image.y + cy) * atlasWidth + image.x + cx) * 4];
+                    std::copy(from, from + 4, to);
+                }
+            }
+            rects.push_back(glm::vec4((float)(image.x + ATLAS_BORDER) / atlasWidth, (float)(image.y + ATLAS_BORDER) / atlasHeight,
+                (float)image.width / atlasWidth, (float)image.height / atlasHeight));
+            shares.push_back((float)std::max(image.width, image.height) / (float)std::max(atlasWidth, atlasHeight));
+        }
+
+        // its levels from the file, as many as the streamer's budget and the screen call for
+        gps::MipChain::write(path, atlasWidth, atlasHeight, atlas);
+        size_t levelSize = (size_t)atlasWidth * atlasHeight * 4;
+        for (int l = 0; levelSize > 0 && l <= ATLAS_MAX_LEVEL; l++, levelSize /= 4) {
+            atlasMemory += levelSize;
+        }
+        return textures->load(path, ATLAS_MAX_LEVEL);
+    }
+
+    void StaticBatcher::Delete() {
+
+        // the atlases are the streamer's
+        for (Batch& batch : batches) {
+            gps::Mesh::getArena().free(batch.range);
+        }
+        batches.clear();
+        sources.clear();
+        pointShadowSpheres.clear();
+        textures = nullptr;
+        atlasMemory = 0;
+    }
+
+    void StaticBatcher::requireTextures(const glm::mat4& viewProjection, const glm::vec3& camera, float screenScale) {
+
+        gps::Frustum frustum(viewProjection);
+        for (Batch& batch : batches) {
+            float screenSize = 0.0f;
+            for (const Cluster& cluster : batch.clusters) {
+                if (!frustum.intersectsBox(cluster.boundsMin, cluster.boundsMax)) {
+                    continue;
+                }
+                glm::vec3 center = 0.5f * (cluster.boundsMin + cluster.boundsMax);
+                float radius = 0.5f * glm::length(cluster.boundsMax - cluster.boundsMin);
+                float distance = glm::length(center - camera);
+                float size = distance > radius ? radius / distance * screenScale : screenScale;
+                screenSize = std::max(screenSize, size * cluster.atlasScale);
+            }
+            if (screenSize > 0.0f) {
+                textures->require(batch.atlas, screenSize);
+            }
+        }
+    }
+
+    // ===== DRAW =====
+    int StaticBatcher::drawClusters(Batch& batch, const gps::Frustum* frustum, bool pointShadowOnly) {
+
+        counts.clear();
+        offsets.clear();
+        int drawn = 0;
+        GLuint rangeEnd = 0;
+        for (const Cluster& cluster : batch.clusters) {
+            if ((pointShadowOnly && !cluster.pointShadowCaster) || (frustum && !frustum->intersectsBox(cluster.boundsMin, cluster.boundsMax))) {
+                continue;
+            }
+            drawn++;
+            // right after the last one: the same range grows
+            if (!counts.empty() && cluster.firstIndex == rangeEnd) {
+                counts.back() += (GLsizei)cluster.indexCount;
+            }
+            else {
+                counts.push_back((GLsizei)cluster.indexCount);
+                offsets.push_back((const GLvoid*)((size_t)(batch.range.firstIndex + cluster.firstIndex) * sizeof(GLuint)));
+            }
+            rangeEnd = cluster.firstIndex + cluster.indexCount;
+        }
+        if (counts.empty()) {
+            return 0;
+        }
+        baseVertices.assign(counts.size(), batch.range.baseVertex);
+
+        glBindVertexArray(gps::Mesh::getArena().getVertexArray(batch.range.block));
+        glMultiDrawElementsBaseVertex(GL_TRIANGLES, counts.data(), GL_UNSIGNED_INT, offsets.data(), (GLsizei)counts.size(), baseVertices.data());
+        glBindVertexArray(0);
+        return drawn;
+    }
+
+    void StaticBatcher::Draw(gps::Shader& shader, const glm::mat4& viewProjection) {
+
+        gps::Frustum frustum(viewProjection);
+        GLuint program = shader.shaderProgram;
+        GLint objLightLoc = glGetUniformLocation(program, "objectLightMultiplier");
+        GLint shininessLoc = glGetUniformLocation(program, "shininess");
+        GLint specStrengthLoc = glGetUniformLocation(program, "specularStrength");
+
+        glActiveTexture(GL_TEXTURE0);
+        glUniform1i(glGetUniformLocation(program, "diffuseTexture"), 0);
+
+        lastVisibleClusters = 0;
+        lastRanges = 0;
+        for (Batch& batch : batches) {
+            glUniform1f(objLightLoc, batch.material.x);
+            glUniform1f(shininessLoc, batch.material.y);
+            glUniform1f(specStrengthLoc, batch.material.z);
+            glBindTexture(GL_TEXTURE_2D, batch.atlas);
+
+            lastVisibleClusters += drawClusters(batch, &frustum, false);
+            lastRanges += (int)counts.size();
+        }
+
+        glBindTexture(GL_TEXTURE_2D, 0);
+    }
+
+    void StaticBatcher::DrawDepth(const glm::mat4& viewProjection) {
+
+        gps::Frustum frustum(viewProjection);
+        for (Batch& batch : batches) {
+            drawClusters(batch, &frustum, false);
+        }
+    }
+
+    void StaticBatcher::DrawPointShadow() {
+
+        for (Batch& batch : batches) {
+            drawClusters(batch, nullptr, true);
+        }
+    }
+
+    const std::vector<glm::vec4>& StaticBatcher::getPointShadowSpheres() {
+        return pointShadowSpheres;
+    }
+
+    int StaticBatcher::getBatchCount() {
+        return (int)batches.size();
+    }
+
+    int StaticBatcher::getClusterCount() {
+
+        int count = 0;
+        for (Batch& batch : batches) {
+            count += (int)batch.clusters.size();
+        }
+        return count;
+    }
+
+    int StaticBatcher::getVisibleClusterCount() {
+        return lastVisibleClusters;
+    }
+
+    int StaticBatcher::getRangeCount() {
+        return lastRanges;
+    }
+
+    size_t StaticBatcher::getAtlasMemorySize() {
+        return atlasMemory;
+    }
+}
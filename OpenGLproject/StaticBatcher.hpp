@@ -0,0 +1,135 @@
+#ifndef StaticBatcher_hpp
+#define StaticBatcher_hpp
+
+#if defined (__APPLE__)
+    #define GL_SILENCE_DEPRECATION
+    #include <OpenGL/gl3.h>
+#else
+    #define GLEW_STATIC
+    #include <GL/glew.h>
+#endif
+
+#include <glm/glm.hpp>
+
+#include "Frustum.hpp"
+#include "GeometryArena.hpp"
+#include "Model3D.hpp"
+#include "Shader.hpp"
+#include "TextureStreamer.hpp"
+
+#include <string>
+#include <vector>
+
+namespace gps {
+
+    // Props that never move, baked at load into one mesh per material (the
+    // light shader is the only one they use), each drawn in one call. The
+    // shadow passes draw the same meshes, so the models can be released.
+    //
+    // The meshes are moved into the space of the batch by their transform,
+    // their diffuse images packed in an atlas per batch (at their source size,
+    // from the image's MipChain, all halved together only while the atlas
+    // would pass GL_MAX_TEXTURE_SIZE; ATLAS_BORDER edge texels
+    // around each, the positions aligned so the first ATLAS_MAX_LEVEL mips
+    // never mix two images) and their texture coordinates moved into it. A
+    // mesh whose coordinates repeat the image can not be atlased: it gets a
+    // batch of its own, the image whole, wrapping.
+    //
+    // The atlases are written as mip chains and streamed like the other prop
+    // textures: requireTextures asks for the level the visible clusters need,
+    // by their size on screen and the share of the atlas their image takes.
+    //
+    // The triangles of every mesh are split into clusters of at most
+    // CLUSTER_TRIANGLES (halving along the longest side), each a range of the
+    // batch's indices with its bounds; the clusters outside the frustum are
+    // left out of the glMultiDrawElementsBaseVertex, neighbouring visible
+    // ones merged into one range.
+    class StaticBatcher {
+
+    public:
+        static const int ATLAS_BORDER = 8;
+        static const int ATLAS_MAX_LEVEL = 3;
+        static const int CLUSTER_TRIANGLES = 1024;
+
+        // material: light multiplier, shininess, specular strength;
+        // texturePath: the diffuse image of the meshes without their own;
+        // pointShadowCaster: false for what houses the point light
+        void add(gps::Model3D& model, const glm::mat4& transform, const glm::vec3& material, const std::string& texturePath,
+            bool pointShadowCaster = true);
+        // the models added can be released after; the atlases are written to
+        // atlasPath + batch index + ".mips" and loaded through textures
+        void bake(gps::TextureStreamer& textures, const std::string& atlasPath);
+        void Delete();
+
+        // the atlas levels the clusters in the frustum of viewProjection need:
+        // screenScale is the pixels across of a unit radius at unit distance
+        void requireTextures(const glm::mat4& viewProjection, const glm::vec3& camera, float screenScale);
+
+        // the shader (already in use) draws the clusters in the frustum of
+        // viewProjection (which maps the batches' space, model included)
+        void Draw(gps::Shader& shader, const glm::mat4& viewProjection);
+        // positions only, the shader's model must map the batches' space
+        void DrawDepth(const glm::mat4& viewProjection);
+        // every point shadow caster, the geometry shader picks the faces
+        void DrawPointShadow();
+        // a bounding sphere (center, radius) per point shadow caster added
+        const std::vector<glm::vec4>& getPointShadowSpheres();
+
+        int getBatchCount();
+        int getClusterCount();
+        // of the last Draw
+        int getVisibleClusterCount();
+        int getRangeCount();
+        // bytes of the atlases' levels the streamer can load, mips included
+        size_t getAtlasMemorySize();
+
+    private:
+        struct Source {
+            gps::Model3D* model;
+            glm::mat4 transform;
+            glm::vec3 material;
+            std::string texturePath;
+            bool pointShadowCaster;
+        };
+
+        struct Cluster {
+            GLuint firstIndex;
+            GLuint indexCount;
+            glm::vec3 boundsMin;
+            glm::vec3 boundsMax;
+            float atlasScale; // the atlas' side over its image's
+            bool pointShadowCaster;
+        };
+
+        struct Batch {
+            GeometryArena::Range range;
+            GLuint atlas = 0; // the streamer's
+            glm::vec3 material;
+            std::vector<Cluster> clusters;
+        };
+
+        gps::TextureStreamer* textures = nullptr;
+        std::vector<Source> sources;
+        std::vector<Batch> batches;
+        std::vector<glm::vec4> pointShadowSpheres;
+        size_t atlasMemory = 0;
+        int lastVisibleClusters = 0;
+        int lastRanges = 0;
+
+        // scratch of drawClusters
+        std::vector<GLsizei> counts;
+        std::vector<const GLvoid*> offsets;
+        std::vector<GLint> baseVertices;
+
+        // the images packed in one texture (path: where its mip chain goes,
+        // unused when wrap), uv rectangles (x, y, width, height) and the share
+        // of the atlas' side each image takes out
+        GLuint buildAtlas(const std::vector<std::string>& paths, bool wrap, const std::string& path,
+            std::vector<glm::vec4>& rects, std::vector<float>& shares);
+        // the clusters in the frustum (nullptr: all), neighbours merged into
+        // one range, in one call; returns the clusters drawn
+        int drawClusters(Batch& batch, const gps::Frustum* frustum, bool pointShadowOnly);
+    };
+}
+
+#endif /* StaticBatcher_hpp */
@@ -0,0 +1,133 @@
+#include "StreamBuffer.hpp"
+
+#include <iostream>
+
+namespace gps {
+
+    void StreamBuffer::init(GLenum target, GLsizeiptr regionSize) {
+
+        this->target = target;
+        this->regionSize = regionSize;
+        region = 0;
+        head = 0;
+
+        glGenBuffers(1, &buffer);
+        glBindBuffer(target, buffer);
+
+#if !defined (__APPLE__)
+        if (GLEW_ARB_buffer_storage) {
+            // immutable storage mapped for the whole lifetime of the buffer,
+            // coherent so the writes need no explicit flush
+            const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+            glBufferStorage(target, REGIONS * regionSize, nullptr, flags);
+            persistentPtr = (char*)glMapBufferRange(target, 0, REGIONS * regionSize, flags);
+            persistent = persistentPtr != nullptr;
+        }
+#endif
+
+        if (!persistent) {
+            glBufferData(target, REGIONS * regionSize, nullptr, GL_STREAM_DRAW);
+        }
+
+        glBindBuffer(target, 0);
+
+        std::cout << "Stream buffer " << REGIONS << " x " << regionSize << " bytes"
+            << (persistent ? " (persistent mapping)" : "") << std::endl;
+    }
+
+    void StreamBuffer::Delete() {
+
+        for (int i = 0; i < REGIONS; i++) {
+            if (fences[i] != 0) {
+                glDeleteSync(fences[i]);
+                fences[i] = 0;
+            }
+        }
+
+        if (persistent) {
+            glBindBuffer(target, buffer);
+            glUnmapBuffer(target);
+            glBindBuffer(target, 0);
+            persistentPtr = nullptr;
+        }
+
+        glDeleteBuffers(1, &buffer);
+        buffer = 0;
+    }
+
+    void StreamBuffer::beginFrame() {
+
+        region = (region + 1) % REGIONS;
+        head = 0;
+        frame++;
+
+        // the GPU may still read what was written REGIONS frames ago
+        if (fences[region] != 0) {
+            GLenum result = glClientWaitSync(fences[region], 0, 0);
+            while (result == GL_TIMEOUT_EXPIRED) {
+                result = glClientWaitSync(fences[region], GL_SYNC_FLUSH_COMMANDS_BIT, 1000000); // 1 ms
+            }
+            glDeleteSync(fences[region]);
+            fences[region] = 0;
+        }
+    }
+
+    void StreamBuffer::endFrame() {
+
+        if (head == 0) {
+            return; // nothing written, nothing to wait for
+        }
+
+        fences[region] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    }
+
+    void* StreamBuffer::map(GLsizeiptr bytes, GLintptr& offset, GLsizeiptr alignment) {
+
+        GLsizeiptr start = (head + alignment - 1) / alignment * alignment;
+        if (start + bytes > regionSize) {
+            return nullptr;
+        }
+
+        offset = region * regionSize + start;
+        head = start + bytes;
+
+        if (persistent) {
+            return persistentPtr + offset;
+        }
+
+        // the fence already guarantees the GPU is not reading this range
+        glBindBuffer(target, buffer);
+        void* ptr = glMapBufferRange(target, offset, bytes,
+            GL_MAP_WRITE_BIT | GL_MAP_UNSYNCHRONIZED_BIT | GL_MAP_INVALIDATE_RANGE_BIT);
+        mapped = ptr != nullptr;
+
+        return ptr;
+    }
+
+    void StreamBuffer::unmap() {
+
+        if (!mapped) {
+            return;
+        }
+
+        glBindBuffer(target, buffer);
+        glUnmapBuffer(target);
+        mapped = false;
+    }
+
+    GLuint StreamBuffer::getBuffer() {
+        return buffer;
+    }
+
+    GLsizeiptr StreamBuffer::getRegionSize() {
+        return regionSize;
+    }
+
+    long long StreamBuffer::getFrame() {
+        return frame;
+    }
+
+    bool StreamBuffer::isPersistent() {
+        return persistent;
+    }
+}
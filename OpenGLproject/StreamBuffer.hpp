@@ -0,0 +1,62 @@
+#ifndef StreamBuffer_hpp
+#define StreamBuffer_hpp
+
+#if defined (__APPLE__)
+    #define GL_SILENCE_DEPRECATION
+    #include <OpenGL/gl3.h>
+#else
+    #define GLEW_STATIC
+    #include <GL/glew.h>
+#endif
+
+namespace gps {
+
+    // Per-frame dynamic data (instances, lines...) written by the CPU and read
+    // by the GPU in the same frame. The buffer is a ring of REGIONS regions, one
+    // per frame in flight: a frame only writes into its own region, which is
+    // mapped with GL_MAP_UNSYNCHRONIZED_BIT, and a fence placed at the end of
+    // the frame tells when the GPU is done with it. With ARB_buffer_storage
+    // the whole ring is mapped once, persistently, and nothing is remapped.
+    class StreamBuffer {
+
+    public:
+        static const int REGIONS = 3;
+
+        // regionSize = bytes one frame can write, target is only used for binding
+        void init(GLenum target, GLsizeiptr regionSize);
+        void Delete();
+
+        // moves to the next region, waiting if the GPU still reads it
+        void beginFrame();
+        // fences the current region, call after the last draw using it
+        void endFrame();
+
+        // reserves bytes in the current region (offset aligned to alignment) and
+        // returns a write pointer, nullptr when the region is full;
+        // offset is where the data starts in getBuffer()
+        void* map(GLsizeiptr bytes, GLintptr& offset, GLsizeiptr alignment = 16);
+        // must follow every successful map before drawing
+        void unmap();
+
+        GLuint getBuffer();
+        GLsizeiptr getRegionSize();
+        // beginFrame calls so far: what was written in an earlier frame may be overwritten
+        long long getFrame();
+        bool isPersistent();
+
+    private:
+        GLenum target = GL_ARRAY_BUFFER;
+        GLuint buffer = 0;
+        GLsizeiptr regionSize = 0;
+        bool persistent = false;
+        char* persistentPtr = nullptr;
+
+        int region = 0;
+        long long frame = 0;
+        GLsizeiptr head = 0; // write position inside the current region
+        GLsync fences[REGIONS] = { 0, 0, 0 };
+        bool mapped = false;
+    };
+}
+
+#endif /* StreamBuffer_hpp */
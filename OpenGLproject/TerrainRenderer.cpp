@@ -0,0 +1,299 @@
+#include "TerrainRenderer.hpp"
+
+#include <glm/gtc/type_ptr.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+namespace gps {
+
+    static bool sphereBox(glm::vec3 center, float radius, glm::vec3 boundsMin, glm::vec3 boundsMax) {
+
+        glm::vec3 closest = glm::clamp(center, boundsMin, boundsMax);
+        glm::vec3 d = closest - center;
+        return glm::dot(d, d) <= radius * radius;
+    }
+
+    void TerrainRenderer::init(gps::Heightfield& heightfield) {
+
+        Delete();
+        this->heightfield = &heightfield;
+
+        int width = heightfield.getWidth();
+        int depth = heightfield.getDepth();
+        if (width == 0 || depth == 0) {
+            return;
+        }
+
+        // ===== LEVELS =====
+        // enough levels for one root over the whole grid
+        int leaves = (std::max(width, depth) - 1 + LEAF_CELLS - 1) / LEAF_CELLS;
+        levelCount = 1;
+        while ((1 << (levelCount - 1)) < leaves && levelCount < MAX_LEVELS) {
+            levelCount++;
+        }
+
+        leafSize = LEAF_CELLS * heightfield.getSpacing();
+        for (int level = 0; level < levelCount; level++) {
+            float previous = level > 0 ? ranges[level - 1] : 0.0f;
+            ranges[level] = LOD_RANGE * leafSize * (float)(1 << level);
+            float morphStart = previous + (ranges[level] - previous) * MORPH_START;
+            morphs[level] = glm::vec2(morphStart, 1.0f / (ranges[level] - morphStart));
+        }
+
+        // ===== HEIGHTS AND OWNERS =====
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+
+        glGenTextures(1, &heightsTexture);
+        glBindTexture(GL_TEXTURE_2D, heightsTexture);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_R32F, width, depth, 0, GL_RED, GL_FLOAT, heightfield.getHeights().data());
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+        // integer texture, nearest only
+        glGenTextures(1, &ownersTexture);
+        glBindTexture(GL_TEXTURE_2D, ownersTexture);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_R8UI, width, depth, 0, GL_RED_INTEGER, GL_UNSIGNED_BYTE, heightfield.getOwners().data());
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+        glBindTexture(GL_TEXTURE_2D, 0);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+
+        // ===== GRID =====
+        // (x, quadrant, z), x and z in [0, 1]: the vertex shader places it and drops
+        // the quadrants of the node the children draw, so the quadrants have their
+        // own vertices; the cells are split along (x0, z0) - (x1, z1) like the
+        // heightfield's, counter clockwise seen from above
+        std::vector<glm::vec3> vertices;
+        std::vector<GLushort> indices;
+        int half = GRID_SIZE / 2;
+        for (int quadrant = 0; quadrant < 4; quadrant++) {
+            int x0 = (quadrant & 1) * half;
+            int z0 = (quadrant >> 1) * half;
+            GLushort base = (GLushort)vertices.size();
+            for (int z = z0; z <= z0 + half; z++) {
+                for (int x = x0; x <= x0 + half; x++) {
+                    vertices.push_back(glm::vec3((float)x / GRID_SIZE, (float)quadrant, (float)z / GRID_SIZE));
+                }
+            }
+            for (int z = 0; z < half; z++) {
+                for (int x = 0; x < half; x++) {
+                    GLushort i00 = (GLushort)(base + z * (half + 1) + x);
+                    GLushort i10 = (GLushort)(i00 + 1);
+                    GLushort i01 = (GLushort)(i00 + half + 1);
+                    GLushort i11 = (GLushort)(i01 + 1);
+                    indices.insert(indices.end(), { i00, i01, i11, i00, i11, i10 });
+                }
+            }
+        }
+        indexCount = (GLsizei)indices.size();
+
+        glGenVertexArrays(1, &VAO);
+        glGenBuffers(1, &VBO);
+        glGenBuffers(1, &EBO);
+
+        glBindVertexArray(VAO);
+        glBindBuffer(GL_ARRAY_BUFFER, VBO);
+        glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(glm::vec3), vertices.data(), GL_STATIC_DRAW);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(GLushort), indices.data(), GL_STATIC_DRAW);
+
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(glm::vec3), (GLvoid*)0);
+
+        // the nodes come from the stream buffer, Draw points the attribute at them
+        glEnableVertexAttribArray(8);
+        glVertexAttribDivisor(8, 1);
+
+        glBindVertexArray(0);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+
+    void TerrainRenderer::Delete() {
+
+        glDeleteVertexArrays(1, &VAO);
+        glDeleteBuffers(1, &VBO);
+        glDeleteBuffers(1, &EBO);
+        glDeleteTextures(1, &heightsTexture);
+        glDeleteTextures(1, &ownersTexture);
+        VAO = VBO = EBO = heightsTexture = ownersTexture = 0;
+
+        textures = nullptr;
+        tileRects.clear();
+        selected.clear();
+        levelCount = 0;
+        drawCount = 0;
+    }
+
+    void TerrainRenderer::setTextures(gps::VirtualTexture& textures) {
+
+        this->textures = &textures;
+    }
+
+    void TerrainRenderer::addTile(glm::vec3 boundsMin, glm::vec3 boundsMax) {
+
+        if ((int)tileRects.size() >= MAX_TILES) {
+            return;
+        }
+        tileRects.push_back(glm::vec4(boundsMin.x, boundsMin.z, boundsMax.x, boundsMax.z));
+    }
+
+    bool TerrainRenderer::nodeBounds(int level, int x, int z, glm::vec3& boundsMin, glm::vec3& boundsMax) {
+
+        int cells = LEAF_CELLS << level;
+        int cellX = x * cells;
+        int cellZ = z * cells;
+        int width = heightfield->getWidth();
+        int depth = heightfield->getDepth();
+        if (cellX >= width - 1 || cellZ >= depth - 1) {
+            return false;
+        }
+
+        // the pyramid node of the same cells
+        int pyramidLevel = level;
+        for (int size = LEAF_CELLS; size > 1; size /= 2) {
+            pyramidLevel++;
+        }
+        glm::vec2 range;
+        if (pyramidLevel < heightfield->getLevelCount()) {
+            range = heightfield->getRange(pyramidLevel, x, z);
+        }
+        else {
+            range = heightfield->getRange(heightfield->getLevelCount() - 1, 0, 0);
+        }
+
+        float spacing = heightfield->getSpacing();
+        glm::vec2 origin = heightfield->getOrigin();
+        boundsMin = glm::vec3(origin.x + cellX * spacing, range.x, origin.y + cellZ * spacing);
+        boundsMax = glm::vec3(origin.x + std::min(cellX + cells, width - 1) * spacing, range.y,
+            origin.y + std::min(cellZ + cells, depth - 1) * spacing);
+        return true;
+    }
+
+    TerrainRenderer::Selection TerrainRenderer::selectNode(int level, int x, int z) {
+
+        glm::vec3 boundsMin, boundsMax;
+        if (!nodeBounds(level, x, z, boundsMin, boundsMax)) {
+            // past the edge of the grid, nothing to draw
+            return CULLED;
+        }
+        if (!sphereBox(camera, ranges[level], boundsMin, boundsMax)) {
+            return OUT_OF_RANGE;
+        }
+
+        if (!frustum.intersectsBox(boundsMin, boundsMax)) {
+            return CULLED;
+        }
+
+        glm::vec4 node = glm::vec4(boundsMin.x, boundsMin.z, leafSize * (float)(1 << level), (float)level);
+
+        if (level == 0 || !sphereBox(camera, ranges[level - 1], boundsMin, boundsMax)) {
+            selected.push_back(node + glm::vec4(0.0f, 0.0f, 0.0f, 16.0f * 15.0f));
+            return SELECTED;
+        }
+
+        // the children out of their range are drawn by this node, at this level
+        int quadrants = 0;
+        for (int quadrant = 0; quadrant < 4; quadrant++) {
+            if (selectNode(level - 1, 2 * x + (quadrant & 1), 2 * z + (quadrant >> 1)) == OUT_OF_RANGE) {
+                quadrants |= 1 << quadrant;
+            }
+        }
+        if (quadrants != 0) {
+            selected.push_back(node + glm::vec4(0.0f, 0.0f, 0.0f, 16.0f * quadrants));
+        }
+        return SELECTED;
+    }
+
+    void TerrainRenderer::select(const glm::mat4& viewProjection, glm::vec3 camera) {
+
+        selected.clear();
+        if (levelCount == 0) {
+            return;
+        }
+        this->camera = camera;
+
+        frustum = gps::Frustum(viewProjection);
+
+        // further than the last range the root is drawn whole
+        if (selectNode(levelCount - 1, 0, 0) == OUT_OF_RANGE) {
+            glm::vec3 boundsMin, boundsMax;
+            nodeBounds(levelCount - 1, 0, 0, boundsMin, boundsMax);
+            selected.push_back(glm::vec4(boundsMin.x, boundsMin.z, leafSize * (float)(1 << (levelCount - 1)), (float)(levelCount - 1 + 16 * 15)));
+        }
+    }
+
+    void TerrainRenderer::Draw(gps::Shader& shader, gps::StreamBuffer& stream) {
+
+        drawCount = 0;
+        if (selected.empty()) {
+            return;
+        }
+
+        GLintptr offset = 0;
+        void* data = stream.map(selected.size() * sizeof(glm::vec4), offset);
+        if (data == nullptr) {
+            return;
+        }
+        std::memcpy(data, selected.data(), selected.size() * sizeof(glm::vec4));
+        stream.unmap();
+
+        // ===== UNIFORMS =====
+        GLuint program = shader.shaderProgram;
+        glUniform1i(glGetUniformLocation(program, "terrain"), 1);
+        glUniform2fv(glGetUniformLocation(program, "terrainOrigin"), 1, glm::value_ptr(heightfield->getOrigin()));
+        glUniform1f(glGetUniformLocation(program, "terrainSpacing"), heightfield->getSpacing());
+        glUniform2f(glGetUniformLocation(program, "terrainSize"), (float)heightfield->getWidth(), (float)heightfield->getDepth());
+        glUniform1f(glGetUniformLocation(program, "terrainGridSize"), (float)GRID_SIZE);
+        glUniform2fv(glGetUniformLocation(program, "terrainMorph"), levelCount, glm::value_ptr(morphs[0]));
+        glUniform3fv(glGetUniformLocation(program, "terrainCamera"), 1, glm::value_ptr(camera));
+        if (!tileRects.empty()) {
+            glUniform4fv(glGetUniformLocation(program, "terrainTileRects"), (GLsizei)tileRects.size(), glm::value_ptr(tileRects[0]));
+        }
+
+        glActiveTexture(GL_TEXTURE0 + HEIGHTS_UNIT);
+        glBindTexture(GL_TEXTURE_2D, heightsTexture);
+        glUniform1i(glGetUniformLocation(program, "terrainHeights"), HEIGHTS_UNIT);
+
+        glActiveTexture(GL_TEXTURE0 + OWNERS_UNIT);
+        glBindTexture(GL_TEXTURE_2D, ownersTexture);
+        glUniform1i(glGetUniformLocation(program, "terrainOwners"), OWNERS_UNIT);
+
+        glActiveTexture(GL_TEXTURE0);
+
+        if (textures != nullptr) {
+            textures->bind(shader);
+        }
+
+        // ===== DRAW =====
+        // no base instance in 4.1, the attribute is pointed at this frame's nodes instead
+        glBindVertexArray(VAO);
+        glBindBuffer(GL_ARRAY_BUFFER, stream.getBuffer());
+        glVertexAttribPointer(8, 4, GL_FLOAT, GL_FALSE, sizeof(glm::vec4), (GLvoid*)offset);
+        glDrawElementsInstanced(GL_TRIANGLES, indexCount, GL_UNSIGNED_SHORT, 0, (GLsizei)selected.size());
+        drawCount++;
+
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        glBindVertexArray(0);
+
+        glUniform1i(glGetUniformLocation(program, "terrain"), 0);
+    }
+
+    int TerrainRenderer::getLevelCount() {
+        return levelCount;
+    }
+
+    int TerrainRenderer::getSelectedNodeCount() {
+        return (int)selected.size();
+    }
+
+    int TerrainRenderer::getDrawCount() {
+        return drawCount;
+    }
+}
@@ -0,0 +1,114 @@
+#ifndef TerrainRenderer_hpp
+#define TerrainRenderer_hpp
+
+#if defined (__APPLE__)
+    #define GL_SILENCE_DEPRECATION
+    #include <OpenGL/gl3.h>
+#else
+    #define GLEW_STATIC
+    #include <GL/glew.h>
+#endif
+
+#include <glm/glm.hpp>
+
+#include "Frustum.hpp"
+#include "Shader.hpp"
+#include "Heightfield.hpp"
+#include "StreamBuffer.hpp"
+#include "VirtualTexture.hpp"
+
+#include <vector>
+
+namespace gps {
+
+    // The terrain drawn from the heightfield with continuous distance-dependent
+    // level of detail (CDLOD): a quadtree over the height grid, a leaf covering
+    // LEAF_CELLS x LEAF_CELLS cells and every level above twice the size. Each
+    // frame the nodes are selected around the camera - a node is split while
+    // the camera is within the range of the level below - and the ones outside
+    // the view frustum are skipped.
+    //
+    // Every selected node is the same GRID_SIZE x GRID_SIZE grid, one shared
+    // mesh drawn instanced (attribute 8 = origin x, origin z, size,
+    // level + 16 * quadrants drawn) and lifted in the vertex shader from the
+    // height texture. Towards the far end of its range a vertex slides onto
+    // the grid of the level above, so two levels meet without cracks and
+    // nothing pops. The grid's quadrants do not share vertices, a quadrant the
+    // children draw is moved out of the view.
+    //
+    // The triangle count depends on the ranges, not on the size of the terrain.
+    //
+    // The tiles' images are the images of a virtual texture; the fragment
+    // shader reads which tile a point belongs to from the owner texture (which
+    // tile every height came from) and samples that image, so the whole
+    // terrain is a single draw.
+    class TerrainRenderer {
+
+    public:
+        // quads along a node
+        static const int GRID_SIZE = 32;
+        // height cells along a leaf
+        static const int LEAF_CELLS = 32;
+        static const int MAX_LEVELS = 12;
+        // a level is drawn up to LOD_RANGE node sizes from the camera
+        static constexpr float LOD_RANGE = 3.0f;
+        // where the morph to the level above starts, between the two ranges
+        static constexpr float MORPH_START = 0.66f;
+        // tiles a shader has room for
+        static const int MAX_TILES = 64;
+        // texture units while drawing (the virtual texture's come next)
+        static const int HEIGHTS_UNIT = 5;
+        static const int OWNERS_UNIT = 6;
+
+        // uploads the heights and the owners; the heightfield must stay baked
+        void init(gps::Heightfield& heightfield);
+        void Delete();
+
+        // the tiles in the order they were given to Heightfield::bake, tile i is
+        // image i of textures
+        void setTextures(gps::VirtualTexture& textures);
+        void addTile(glm::vec3 boundsMin, glm::vec3 boundsMax);
+
+        // viewProjection and camera in the terrain's space (projection * view * model)
+        void select(const glm::mat4& viewProjection, glm::vec3 camera);
+
+        // the shader (already in use) gets terrain = true for the draw;
+        // the instances of the frame are written to stream
+        void Draw(gps::Shader& shader, gps::StreamBuffer& stream);
+
+        int getLevelCount();
+        int getSelectedNodeCount();
+        int getDrawCount();
+
+    private:
+        enum Selection { OUT_OF_RANGE, CULLED, SELECTED };
+
+        gps::Heightfield* heightfield = nullptr;
+        gps::VirtualTexture* textures = nullptr;
+        std::vector<glm::vec4> tileRects; // min x, min z, max x, max z
+
+        int levelCount = 0;
+        float leafSize = 1.0f;  // world units along a leaf
+        float ranges[MAX_LEVELS];
+        glm::vec2 morphs[MAX_LEVELS]; // (start, 1 / (end - start))
+
+        gps::Frustum frustum = gps::Frustum(glm::mat4(1.0f));
+        glm::vec3 camera = glm::vec3(0.0f);
+        // the instances: origin x, origin z, size, level + 16 * quadrants,
+        // bit q of quadrants for quadrant q (x + 2 z) drawn, the rest is the children's
+        std::vector<glm::vec4> selected;
+        int drawCount = 0;
+
+        GLuint VAO = 0;
+        GLuint VBO = 0;
+        GLuint EBO = 0;
+        GLuint heightsTexture = 0;
+        GLuint ownersTexture = 0;
+        GLsizei indexCount = 0;
+
+        Selection selectNode(int level, int x, int z);
+        bool nodeBounds(int level, int x, int z, glm::vec3& boundsMin, glm::vec3& boundsMax);
+    };
+}
+
+#endif /* TerrainRenderer_hpp */
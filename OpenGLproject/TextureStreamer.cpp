@@ -0,0 +1,318 @@
+#include "TextureStreamer.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+
+namespace gps {
+
+    void TextureStreamer::init(size_t budget) {
+
+        Delete();
+
+        this->budget = budget;
+        stopping = false;
+        loader = std::thread(&TextureStreamer::loaderLoop, this);
+    }
+
+    void TextureStreamer::Delete() {
+
+        if (loader.joinable()) {
+            {
+                std::lock_guard<std::mutex> lock(loaderMutex);
+                stopping = true;
+            }
+            loaderWake.notify_all();
+            loader.join();
+        }
+        loadQueue.clear();
+        loadedLevels.clear();
+
+        for (Texture& texture : textures) {
+            glDeleteTextures(1, &texture.id);
+        }
+        textures.clear();
+        residentSize = 0;
+        frame = 0;
+    }
+
+    void TextureStreamer::loaderLoop() {
+
+        while (true) {
+            LevelRequest request;
+            {
+                std::unique_lock<std::mutex> lock(loaderMutex);
+                loaderWake.wait(lock, [this] { return stopping || !loadQueue.empty(); });
+                if (stopping) {
+                    return;
+                }
+                request = loadQueue.front();
+                loadQueue.pop_front();
+            }
+
+            LoadedLevel loaded;
+            loaded.texture = request.texture;
+            loaded.level = request.level;
+            loaded.pixels.resize(request.size);
+            std::ifstream file(request.path, std::ios::binary);
+            file.seekg((std::streamoff)request.offset);
+            if (!file.read((char*)loaded.pixels.data(), (std::streamsize)request.size)) {
+                loaded.pixels.clear();
+            }
+
+            std::lock_guard<std::mutex> lock(loaderMutex);
+            loadedLevels.push_back(std::move(loaded));
+        }
+    }
+
+    // ===== TEXTURES =====
+    GLuint TextureStreamer::load(const std::string& path, int maxLevel) {
+
+        for (Texture& texture : textures) {
+            if (texture.path == path) {
+                return texture.id;
+            }
+        }
+
+        Texture texture;
+        texture.path = path;
+        if (!texture.chain.open(path)) {
+            return 0;
+        }
+
+        int levels = texture.chain.getLevelCount();
+        if (maxLevel >= 0 && maxLevel + 1 < levels) {
+            levels = maxLevel + 1;
+        }
+        texture.levels = levels;
+        texture.coarseLevel = 0;
+        while (texture.coarseLevel + 1 < levels &&
+            std::max(texture.chain.getLevelWidth(texture.coarseLevel), texture.chain.getLevelHeight(texture.coarseLevel)) > RESIDENT_SIZE) {
+            texture.coarseLevel++;
+        }
+        texture.residentLevel = texture.coarseLevel;
+        texture.wantedLevel = texture.coarseLevel;
+
+        glGenTextures(1, &texture.id);
+        glBindTexture(GL_TEXTURE_2D, texture.id);
+
+        // only the levels from the base to the max need to exist; the finer ones come later
+        std::ifstream file(texture.chain.getPath(), std::ios::binary);
+        std::vector<unsigned char> pixels;
+        for (int l = texture.coarseLevel; l < levels; l++) {
+            pixels.resize(texture.chain.getLevelSize(l));
+            file.seekg((std::streamoff)texture.chain.getLevelOffset(l));
+            file.read((char*)pixels.data(), (std::streamsize)pixels.size());
+            glTexImage2D(GL_TEXTURE_2D, l, GL_SRGB, texture.chain.getLevelWidth(l), texture.chain.getLevelHeight(l), 0, GL_RGBA, GL_UNSIGNED_BYTE, pixels.data());
+        }
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, texture.coarseLevel);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, levels - 1);
+
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glBindTexture(GL_TEXTURE_2D, 0);
+
+        residentSize += levelsSize(texture, texture.coarseLevel);
+        textures.push_back(std::move(texture));
+
+        return textures.back().id;
+    }
+
+    int TextureStreamer::find(GLuint texture) {
+
+        for (int i = 0; i < (int)textures.size(); i++) {
+            if (textures[i].id == texture) {
+                return i;
+            }
+        }
+        return -1;
+    }
+
+    size_t TextureStreamer::levelsSize(Texture& texture, int firstLevel) {
+
+        size_t size = 0;
+        for (int l = firstLevel; l < texture.levels; l++) {
+            size += texture.chain.getLevelSize(l);
+        }
+        return size;
+    }
+
+    void TextureStreamer::require(GLuint texture, float screenSize) {
+
+        int i = find(texture);
+        if (i >= 0) {
+            textures[i].screenSize = std::max(textures[i].screenSize, screenSize);
+        }
+    }
+
+    // ===== STREAMING =====
+    void TextureStreamer::update() {
+
+        frame++;
+
+        // the level whose texels are about the size of a pixel
+        for (Texture& texture : textures) {
+            if (texture.screenSize > 0.0f) {
+                float size = (float)std::max(texture.chain.getWidth(), texture.chain.getHeight());
+                int level = (int)std::floor(std::log2(size / texture.screenSize));
+                texture.wantedLevel = std::min(std::max(level, 0), texture.coarseLevel);
+                texture.lastRequired = frame;
+                texture.screenSize = 0.0f;
+            }
+            else if (frame - texture.lastRequired > IDLE_FRAMES) {
+                texture.wantedLevel = texture.coarseLevel;
+            }
+        }
+
+        // ===== UPLOADS =====
+        std::vector<LoadedLevel> loaded;
+        {
+            std::lock_guard<std::mutex> lock(loaderMutex);
+            while (!loadedLevels.empty() && (int)loaded.size() < MAX_UPLOADS_PER_FRAME) {
+                loaded.push_back(std::move(loadedLevels.front()));
+                loadedLevels.pop_front();
+            }
+        }
+        for (LoadedLevel& level : loaded) {
+            Texture& texture = textures[level.texture];
+            texture.loading = false;
+            // dropped when no longer wanted, or no room; asked again if it is wanted later
+            if (level.pixels.empty() || level.level != texture.residentLevel - 1 || level.level < texture.wantedLevel) {
+                continue;
+            }
+            if (makeRoom(level.pixels.size(), level.texture)) {
+                upload(texture, level.level, level.pixels.data());
+            }
+        }
+
+        // ===== LOADS =====
+        // the textures furthest from what their objects want first
+        std::vector<int> needy;
+        for (int i = 0; i < (int)textures.size(); i++) {
+            Texture& texture = textures[i];
+            if (!texture.loading && texture.lastRequired == frame && texture.wantedLevel < texture.residentLevel) {
+                needy.push_back(i);
+            }
+        }
+        std::sort(needy.begin(), needy.end(), [this](int a, int b) {
+            return textures[a].residentLevel - textures[a].wantedLevel > textures[b].residentLevel - textures[b].wantedLevel;
+        });
+
+        std::vector<LevelRequest> requests;
+        for (int i : needy) {
+            Texture& texture = textures[i];
+            int level = texture.residentLevel - 1;
+            size_t size = texture.chain.getLevelSize(level);
+            if (residentSize + size > budget && residentSize + size - freeableSize(i) > budget) {
+                continue;
+            }
+            texture.loading = true;
+            requests.push_back({ i, level, texture.chain.getPath(), texture.chain.getLevelOffset(level), size });
+        }
+        if (!requests.empty()) {
+            {
+                std::lock_guard<std::mutex> lock(loaderMutex);
+                loadQueue.insert(loadQueue.end(), requests.begin(), requests.end());
+            }
+            loaderWake.notify_one();
+        }
+    }
+
+    // the levels finer than the others want, which can go
+    size_t TextureStreamer::freeableSize(int exceptTexture) {
+
+        size_t size = 0;
+        for (int i = 0; i < (int)textures.size(); i++) {
+            Texture& texture = textures[i];
+            for (int l = texture.residentLevel; l < texture.wantedLevel && i != exceptTexture; l++) {
+                size += texture.chain.getLevelSize(l);
+            }
+        }
+        return size;
+    }
+
+    // evicts the finest levels of the texture with the most to spare, least recently needed first
+    bool TextureStreamer::makeRoom(size_t size, int forTexture) {
+
+        if (residentSize + size > budget && residentSize + size - freeableSize(forTexture) > budget) {
+            return false;
+        }
+
+        while (residentSize + size > budget) {
+            int victim = -1;
+            for (int i = 0; i < (int)textures.size(); i++) {
+                Texture& texture = textures[i];
+                if (i == forTexture || texture.residentLevel >= texture.wantedLevel) {
+                    continue;
+                }
+                if (victim < 0) {
+                    victim = i;
+                    continue;
+                }
+                int spare = texture.wantedLevel - texture.residentLevel;
+                int victimSpare = textures[victim].wantedLevel - textures[victim].residentLevel;
+                if (spare > victimSpare || (spare == victimSpare && texture.lastRequired < textures[victim].lastRequired)) {
+                    victim = i;
+                }
+            }
+            evictLevel(textures[victim]);
+        }
+        return true;
+    }
+
+    void TextureStreamer::upload(Texture& texture, int level, const unsigned char* pixels) {
+
+        glBindTexture(GL_TEXTURE_2D, texture.id);
+        glTexImage2D(GL_TEXTURE_2D, level, GL_SRGB, texture.chain.getLevelWidth(level), texture.chain.getLevelHeight(level), 0, GL_RGBA, GL_UNSIGNED_BYTE, pixels);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, level);
+        glBindTexture(GL_TEXTURE_2D, 0);
+
+        texture.residentLevel = level;
+        residentSize += texture.chain.getLevelSize(level);
+    }
+
+    void TextureStreamer::evictLevel(Texture& texture) {
+
+        int level = texture.residentLevel;
+
+        // the base moves first so the texture stays complete, then the level is
+        // given no size, which frees it
+        glBindTexture(GL_TEXTURE_2D, texture.id);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, level + 1);
+        glTexImage2D(GL_TEXTURE_2D, level, GL_SRGB, 0, 0, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+        glBindTexture(GL_TEXTURE_2D, 0);
+
+        texture.residentLevel = level + 1;
+        residentSize -= texture.chain.getLevelSize(level);
+    }
+
+    int TextureStreamer::getTextureCount() {
+        return (int)textures.size();
+    }
+
+    TextureStreamer::Residency TextureStreamer::getResidency(int texture) {
+
+        Texture& t = textures[texture];
+        Residency residency;
+        residency.path = t.path;
+        residency.width = t.chain.getWidth();
+        residency.height = t.chain.getHeight();
+        residency.levels = t.levels;
+        residency.residentLevel = t.residentLevel;
+        residency.wantedLevel = t.wantedLevel;
+        residency.residentSize = levelsSize(t, t.residentLevel);
+        residency.loading = t.loading;
+        return residency;
+    }
+
+    size_t TextureStreamer::getResidentSize() {
+        return residentSize;
+    }
+
+    size_t TextureStreamer::getBudget() {
+        return budget;
+    }
+}
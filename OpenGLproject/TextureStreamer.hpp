@@ -0,0 +1,126 @@
+#ifndef TextureStreamer_hpp
+#define TextureStreamer_hpp
+
+#if defined (__APPLE__)
+    #define GL_SILENCE_DEPRECATION
+    #include <OpenGL/gl3.h>
+#else
+    #define GLEW_STATIC
+    #include <GL/glew.h>
+#endif
+
+#include "MipChain.hpp"
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace gps {
+
+    // Model textures of which only the mip levels their objects need are in
+    // video memory, within a budget.
+    //
+    // A texture starts with its coarse levels (RESIDENT_SIZE and smaller),
+    // which never leave; GL_TEXTURE_BASE_LEVEL is the finest level in, so it
+    // is always complete. Every frame the objects say how many pixels they
+    // cover on screen (require), which gives the level each texture wants;
+    // the finer levels are read from the mip chain file (MipChain) by a
+    // loader thread, one level at a time, and uploaded a few per frame.
+    // Over the budget, the finest levels go first from the textures that
+    // have more than they want, then from the ones no object asked for
+    // lately; a texture an object still needs is not robbed for another.
+    class TextureStreamer {
+
+    public:
+        static const int RESIDENT_SIZE = 64;
+        static const int MAX_UPLOADS_PER_FRAME = 2;
+        // updates a texture keeps its place after its object was last seen
+        static const int IDLE_FRAMES = 120;
+
+        struct Residency {
+            std::string path;
+            int width;
+            int height;
+            int levels;
+            int residentLevel;     // finest level in video memory
+            int wantedLevel;
+            size_t residentSize;   // bytes
+            bool loading;
+        };
+
+        void init(size_t budget);
+        void Delete();
+
+        // the texture of an image, its coarse levels in; the same texture for the same path.
+        // maxLevel: the coarsest level used (-1: down to 1 x 1), for atlases whose
+        // smaller levels would mix their images
+        GLuint load(const std::string& path, int maxLevel = -1);
+
+        // the texture covers about screenSize pixels across this frame; call before update
+        void require(GLuint texture, float screenSize);
+
+        // once per frame: uploads the loaded levels, queues the wanted ones
+        void update();
+
+        int getTextureCount();
+        Residency getResidency(int texture);
+        size_t getResidentSize();
+        size_t getBudget();
+
+    private:
+        struct Texture {
+            gps::MipChain chain;
+            std::string path;
+            GLuint id = 0;
+            int levels = 0;        // used from the chain
+            int residentLevel = 0;
+            int coarseLevel = 0;   // the finest of the levels that never leave
+            int wantedLevel = 0;
+            float screenSize = 0.0f; // largest asked this frame
+            uint32_t lastRequired = 0;
+            bool loading = false;
+        };
+
+        struct LevelRequest {
+            int texture;
+            int level;
+            std::string path;
+            size_t offset;
+            size_t size;
+        };
+
+        struct LoadedLevel {
+            int texture;
+            int level;
+            std::vector<unsigned char> pixels;
+        };
+
+        std::vector<Texture> textures;
+        size_t budget = 0;
+        size_t residentSize = 0;
+        uint32_t frame = 0;
+
+        // loader thread
+        std::thread loader;
+        std::mutex loaderMutex;
+        std::condition_variable loaderWake;
+        std::deque<LevelRequest> loadQueue;
+        std::deque<LoadedLevel> loadedLevels;
+        bool stopping = false;
+
+        void loaderLoop();
+
+        int find(GLuint texture);
+        size_t levelsSize(Texture& texture, int firstLevel);
+        size_t freeableSize(int exceptTexture);
+        bool makeRoom(size_t size, int forTexture);
+        void upload(Texture& texture, int level, const unsigned char* pixels);
+        void evictLevel(Texture& texture);
+    };
+}
+
+#endif /* TextureStreamer_hpp */
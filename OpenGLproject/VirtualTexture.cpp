@@ -0,0 +1,496 @@
+#include "VirtualTexture.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+
+namespace gps {
+
+    static int levelSize(int size, int level) {
+        return std::max(1, size >> level);
+    }
+
+    static int pagesAlong(int size, int level) {
+        return (levelSize(size, level) + VirtualTexture::PAGE_SIZE - 1) / VirtualTexture::PAGE_SIZE;
+    }
+
+    uint32_t VirtualTexture::pageKey(int image, int level, int x, int y) {
+        return ((uint32_t)image << 24) | ((uint32_t)level << 16) | ((uint32_t)x << 8) | (uint32_t)y;
+    }
+
+    // the page and its border, the texels past the level's edge repeat the edge
+    void VirtualTexture::readPage(uint32_t page, std::vector<unsigned char>& pixels) {
+
+        int imageIndex = (int)(page >> 24);
+        int level = (int)((page >> 16) & 0xff);
+        int pageX = (int)((page >> 8) & 0xff);
+        int pageY = (int)(page & 0xff);
+        Image& image = images[imageIndex];
+        std::ifstream& file = files[imageIndex];
+
+        const int slotSize = PAGE_SIZE + 2 * PAGE_BORDER;
+        pixels.resize((size_t)slotSize * slotSize * 4);
+
+        int w = levelSize(image.width, level);
+        int h = levelSize(image.height, level);
+        int x0 = pageX * PAGE_SIZE - PAGE_BORDER;
+        int y0 = pageY * PAGE_SIZE - PAGE_BORDER;
+        int readX0 = std::max(x0, 0);
+        int readX1 = std::min(x0 + slotSize, w);
+        std::vector<unsigned char> row((size_t)(readX1 - readX0) * 4);
+
+        for (int r = 0; r < slotSize; r++) {
+            int y = std::min(std::max(y0 + r, 0), h - 1);
+            file.clear();
+            file.seekg((std::streamoff)(image.chain.getLevelOffset(level) + ((size_t)y * w + readX0) * 4));
+            file.read((char*)row.data(), (std::streamsize)row.size());
+
+            unsigned char* out = &pixels[(size_t)r * slotSize * 4];
+            for (int c = 0; c < slotSize; c++) {
+                int x = std::min(std::max(x0 + c, readX0), readX1 - 1);
+                std::memcpy(out + c * 4, &row[(size_t)(x - readX0) * 4], 4);
+            }
+        }
+    }
+
+    void VirtualTexture::init(const std::vector<std::string>& paths, size_t budget, int screenWidth, int screenHeight) {
+
+        Delete();
+
+        // ===== IMAGES =====
+        images.resize(std::min((int)paths.size(), MAX_IMAGES));
+        for (size_t i = 0; i < images.size(); i++) {
+            Image& image = images[i];
+            if (!image.chain.open(paths[i])) {
+                continue;
+            }
+            image.width = image.chain.getWidth();
+            image.height = image.chain.getHeight();
+            if (std::max(image.width, image.height) > PAGE_TABLE_SIZE * PAGE_SIZE) {
+                fprintf(stderr, "WARNING: texture %s is larger than the page table\n", paths[i].c_str());
+                continue;
+            }
+            // the chain goes down to 1 x 1, the pages stop at the first level of one page
+            image.levels = 1;
+            while (std::max(levelSize(image.width, image.levels - 1), levelSize(image.height, image.levels - 1)) > PAGE_SIZE) {
+                image.levels++;
+            }
+        }
+        for (Image& image : images) {
+            files.emplace_back(image.chain.getPath(), std::ios::binary);
+        }
+
+        // ===== PHYSICAL CACHE =====
+        const int slotSize = PAGE_SIZE + 2 * PAGE_BORDER;
+        GLint maxTextureSize = 0;
+        glGetIntegerv(GL_MAX_TEXTURE_SIZE, &maxTextureSize);
+        slotsAlong = (int)std::sqrt((double)budget / ((size_t)slotSize * slotSize * 4));
+        slotsAlong = std::max(1, std::min(slotsAlong, std::min(255, (int)maxTextureSize / slotSize)));
+        slots.assign((size_t)slotsAlong * slotsAlong, Slot());
+
+        glGenTextures(1, &pagesTexture);
+        glBindTexture(GL_TEXTURE_2D, pagesTexture);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_SRGB8_ALPHA8, slotsAlong * slotSize, slotsAlong * slotSize, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glBindTexture(GL_TEXTURE_2D, 0);
+
+        // ===== PAGE TABLE =====
+        // integer texture, nearest only; a mip per level, down to one page
+        int tableLevels = 1;
+        while ((PAGE_TABLE_SIZE >> (tableLevels - 1)) > 1) {
+            tableLevels++;
+        }
+        int layers = std::max(1, (int)images.size());
+        std::vector<unsigned char> empty((size_t)PAGE_TABLE_SIZE * PAGE_TABLE_SIZE * 4 * layers, 0);
+
+        glGenTextures(1, &pageTableTexture);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, pageTableTexture);
+        for (int l = 0; l < tableLevels; l++) {
+            glTexImage3D(GL_TEXTURE_2D_ARRAY, l, GL_RGBA8UI, PAGE_TABLE_SIZE >> l, PAGE_TABLE_SIZE >> l, layers, 0, GL_RGBA_INTEGER, GL_UNSIGNED_BYTE, empty.data());
+        }
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_BASE_LEVEL, 0);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_LEVEL, tableLevels - 1);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+
+        // ===== COARSEST LEVELS =====
+        // always in, what every missing page falls back to
+        dirtyImages.assign(images.size(), false);
+        std::vector<unsigned char> pixels;
+        for (int i = 0; i < (int)images.size(); i++) {
+            if (images[i].levels == 0) {
+                continue;
+            }
+            uint32_t page = pageKey(i, images[i].levels - 1, 0, 0);
+            readPage(page, pixels);
+            uploadPage(page, pixels);
+            slots[residentPages[page]].locked = true;
+        }
+        for (int i = 0; i < (int)images.size(); i++) {
+            writePageTable(i);
+        }
+
+        // ===== FEEDBACK =====
+        feedbackWidth = std::max(1, screenWidth / FEEDBACK_DIVISOR);
+        feedbackHeight = std::max(1, screenHeight / FEEDBACK_DIVISOR);
+
+        glGenTextures(1, &feedbackColour);
+        glBindTexture(GL_TEXTURE_2D, feedbackColour);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, feedbackWidth, feedbackHeight, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glBindTexture(GL_TEXTURE_2D, 0);
+
+        glGenRenderbuffers(1, &feedbackDepth);
+        glBindRenderbuffer(GL_RENDERBUFFER, feedbackDepth);
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, feedbackWidth, feedbackHeight);
+        glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+        glGenFramebuffers(1, &feedbackFBO);
+        glBindFramebuffer(GL_FRAMEBUFFER, feedbackFBO);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, feedbackColour, 0);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, feedbackDepth);
+        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+            fprintf(stderr, "ERROR: virtual texture feedback framebuffer is not complete\n");
+        }
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+        // read back a frame late, the GPU is done with it by then
+        glGenBuffers(2, feedbackPBO);
+        for (GLuint pbo : feedbackPBO) {
+            glBindBuffer(GL_PIXEL_PACK_BUFFER, pbo);
+            glBufferData(GL_PIXEL_PACK_BUFFER, (GLsizeiptr)feedbackWidth * feedbackHeight * 4, nullptr, GL_STREAM_READ);
+        }
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+        // ===== LOADER =====
+        stopping = false;
+        loader = std::thread(&VirtualTexture::loaderLoop, this);
+    }
+
+    void VirtualTexture::Delete() {
+
+        if (loader.joinable()) {
+            {
+                std::lock_guard<std::mutex> lock(loaderMutex);
+                stopping = true;
+            }
+            loaderWake.notify_all();
+            loader.join();
+        }
+        loadQueue.clear();
+        loadedPages.clear();
+        pendingPages.clear();
+        files.clear();
+
+        glDeleteTextures(1, &pagesTexture);
+        glDeleteTextures(1, &pageTableTexture);
+        glDeleteTextures(1, &feedbackColour);
+        glDeleteRenderbuffers(1, &feedbackDepth);
+        glDeleteFramebuffers(1, &feedbackFBO);
+        glDeleteBuffers(2, feedbackPBO);
+        pagesTexture = pageTableTexture = feedbackColour = feedbackDepth = feedbackFBO = 0;
+        feedbackPBO[0] = feedbackPBO[1] = 0;
+
+        images.clear();
+        slots.clear();
+        residentPages.clear();
+        dirtyImages.clear();
+        requests.clear();
+        frame = 0;
+        feedbackFrame = 0;
+        lastUploads = 0;
+    }
+
+    void VirtualTexture::loaderLoop() {
+
+        while (true) {
+            uint32_t page;
+            {
+                std::unique_lock<std::mutex> lock(loaderMutex);
+                loaderWake.wait(lock, [this] { return stopping || !loadQueue.empty(); });
+                if (stopping) {
+                    return;
+                }
+                page = loadQueue.front();
+                loadQueue.pop_front();
+            }
+
+            LoadedPage loaded;
+            loaded.page = page;
+            readPage(page, loaded.pixels);
+
+            std::lock_guard<std::mutex> lock(loaderMutex);
+            loadedPages.push_back(std::move(loaded));
+        }
+    }
+
+    // ===== FEEDBACK =====
+    void VirtualTexture::beginFeedback(gps::Shader& shader) {
+
+        glBindFramebuffer(GL_FRAMEBUFFER, feedbackFBO);
+        glViewport(0, 0, feedbackWidth, feedbackHeight);
+
+        // white: no page
+        GLfloat clearColour[4];
+        glGetFloatv(GL_COLOR_CLEAR_VALUE, clearColour);
+        glClearColor(1.0f, 1.0f, 1.0f, 1.0f);
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        glClearColor(clearColour[0], clearColour[1], clearColour[2], clearColour[3]);
+
+        // the derivatives are FEEDBACK_DIVISOR times those of the screen
+        glUniform1i(glGetUniformLocation(shader.shaderProgram, "terrainFeedback"), 1);
+        glUniform1f(glGetUniformLocation(shader.shaderProgram, "terrainLodBias"), -std::log2((float)FEEDBACK_DIVISOR));
+    }
+
+    void VirtualTexture::endFeedback(gps::Shader& shader) {
+
+        glUniform1i(glGetUniformLocation(shader.shaderProgram, "terrainFeedback"), 0);
+        glUniform1f(glGetUniformLocation(shader.shaderProgram, "terrainLodBias"), 0.0f);
+
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, feedbackPBO[feedbackFrame % 2]);
+        glReadPixels(0, 0, feedbackWidth, feedbackHeight, GL_RGBA, GL_UNSIGNED_BYTE, (GLvoid*)0);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+        feedbackFrame++;
+
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    }
+
+    // ===== STREAMING =====
+    void VirtualTexture::request(uint32_t page) {
+
+        int image = (int)(page >> 24);
+        int level = (int)((page >> 16) & 0xff);
+        int x = (int)((page >> 8) & 0xff);
+        int y = (int)(page & 0xff);
+        if (image >= (int)images.size() || level >= images[image].levels) {
+            return;
+        }
+
+        // the page and every coarser one over it, the fallbacks stay in too
+        for (; level < images[image].levels; level++, x /= 2, y /= 2) {
+            uint32_t key = pageKey(image, level, x, y);
+            auto resident = residentPages.find(key);
+            if (resident != residentPages.end()) {
+                slots[resident->second].lastUsed = frame;
+            }
+            else if (pendingPages.find(key) == pendingPages.end()) {
+                requests.push_back(key);
+            }
+        }
+    }
+
+    int VirtualTexture::takeSlot() {
+
+        int oldest = -1;
+        for (int s = 0; s < (int)slots.size(); s++) {
+            if (!slots[s].used) {
+                return s;
+            }
+            if (!slots[s].locked && slots[s].lastUsed != frame && (oldest < 0 || slots[s].lastUsed < slots[oldest].lastUsed)) {
+                oldest = s;
+            }
+        }
+        if (oldest < 0) {
+            // everything in the cache is on screen
+            return -1;
+        }
+
+        uint32_t evicted = slots[oldest].page;
+        residentPages.erase(evicted);
+        dirtyImages[evicted >> 24] = true;
+        slots[oldest].used = false;
+        return oldest;
+    }
+
+    void VirtualTexture::uploadPage(uint32_t page, const std::vector<unsigned char>& pixels) {
+
+        int slot = takeSlot();
+        if (slot < 0) {
+            return;
+        }
+
+        const int slotSize = PAGE_SIZE + 2 * PAGE_BORDER;
+        glBindTexture(GL_TEXTURE_2D, pagesTexture);
+        glTexSubImage2D(GL_TEXTURE_2D, 0, (slot % slotsAlong) * slotSize, (slot / slotsAlong) * slotSize, slotSize, slotSize,
+            GL_RGBA, GL_UNSIGNED_BYTE, pixels.data());
+        glBindTexture(GL_TEXTURE_2D, 0);
+
+        slots[slot].page = page;
+        slots[slot].lastUsed = frame;
+        slots[slot].used = true;
+        residentPages[page] = slot;
+        dirtyImages[page >> 24] = true;
+    }
+
+    void VirtualTexture::writePageTable(int image) {
+
+        dirtyImages[image] = false;
+        const Image& img = images[image];
+
+        // coarsest first, a missing page takes the entry of the page over it
+        std::vector<std::vector<unsigned char>> tables(img.levels);
+        for (int l = img.levels - 1; l >= 0; l--) {
+            int along = PAGE_TABLE_SIZE >> l;
+            tables[l].assign((size_t)along * along * 4, 0);
+
+            for (int y = 0; y < pagesAlong(img.height, l); y++) {
+                for (int x = 0; x < pagesAlong(img.width, l); x++) {
+                    unsigned char* entry = &tables[l][((size_t)y * along + x) * 4];
+                    auto resident = residentPages.find(pageKey(image, l, x, y));
+                    if (resident != residentPages.end()) {
+                        entry[0] = (unsigned char)(resident->second % slotsAlong);
+                        entry[1] = (unsigned char)(resident->second / slotsAlong);
+                        entry[2] = (unsigned char)l;
+                        entry[3] = 255;
+                    }
+                    else if (l + 1 < img.levels) {
+                        int parentAlong = PAGE_TABLE_SIZE >> (l + 1);
+                        std::memcpy(entry, &tables[l + 1][((size_t)(y / 2) * parentAlong + x / 2) * 4], 4);
+                    }
+                }
+            }
+        }
+
+        glBindTexture(GL_TEXTURE_2D_ARRAY, pageTableTexture);
+        for (int l = 0; l < img.levels; l++) {
+            int along = PAGE_TABLE_SIZE >> l;
+            glTexSubImage3D(GL_TEXTURE_2D_ARRAY, l, 0, 0, image, along, along, 1, GL_RGBA_INTEGER, GL_UNSIGNED_BYTE, tables[l].data());
+        }
+        glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+    }
+
+    void VirtualTexture::update() {
+
+        if (images.empty()) {
+            return;
+        }
+        frame++;
+
+        // ===== REQUESTS =====
+        // the feedback of two frames ago, the pixel buffer the next feedback goes to
+        requests.clear();
+        if (feedbackFrame >= 2) {
+            glBindBuffer(GL_PIXEL_PACK_BUFFER, feedbackPBO[feedbackFrame % 2]);
+            const uint32_t* pixels = (const uint32_t*)glMapBuffer(GL_PIXEL_PACK_BUFFER, GL_READ_ONLY);
+            if (pixels != nullptr) {
+                // R image, G x, B y, A level
+                std::vector<uint32_t> wanted;
+                uint32_t last = 0xffffffffu;
+                for (int i = 0; i < feedbackWidth * feedbackHeight; i++) {
+                    uint32_t pixel = pixels[i];
+                    if (pixel == last || (pixel & 0xff) == 0xff) {
+                        continue;
+                    }
+                    last = pixel;
+                    const unsigned char* c = (const unsigned char*)&pixels[i];
+                    wanted.push_back(pageKey(c[0], c[3], c[1], c[2]));
+                }
+                glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+
+                std::sort(wanted.begin(), wanted.end());
+                wanted.erase(std::unique(wanted.begin(), wanted.end()), wanted.end());
+                for (uint32_t page : wanted) {
+                    request(page);
+                }
+            }
+            glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+        }
+
+        // coarse levels first, they cover the most
+        std::sort(requests.begin(), requests.end());
+        requests.erase(std::unique(requests.begin(), requests.end()), requests.end());
+        std::stable_sort(requests.begin(), requests.end(), [](uint32_t a, uint32_t b) {
+            return ((a >> 16) & 0xff) > ((b >> 16) & 0xff);
+        });
+        if (!requests.empty() && (int)pendingPages.size() < MAX_PENDING) {
+            std::lock_guard<std::mutex> lock(loaderMutex);
+            for (uint32_t page : requests) {
+                if ((int)pendingPages.size() >= MAX_PENDING) {
+                    break;
+                }
+                pendingPages[page] = true;
+                loadQueue.push_back(page);
+            }
+            loaderWake.notify_one();
+        }
+
+        // ===== UPLOADS =====
+        std::vector<LoadedPage> uploads;
+        {
+            std::lock_guard<std::mutex> lock(loaderMutex);
+            while (!loadedPages.empty() && (int)uploads.size() < MAX_UPLOADS_PER_FRAME) {
+                uploads.push_back(std::move(loadedPages.front()));
+                loadedPages.pop_front();
+            }
+        }
+        for (LoadedPage& loaded : uploads) {
+            pendingPages.erase(loaded.page);
+            uploadPage(loaded.page, loaded.pixels);
+        }
+        lastUploads = (int)uploads.size();
+
+        for (int i = 0; i < (int)images.size(); i++) {
+            if (dirtyImages[i]) {
+                writePageTable(i);
+            }
+        }
+    }
+
+    void VirtualTexture::bind(gps::Shader& shader) {
+
+        GLuint program = shader.shaderProgram;
+
+        glActiveTexture(GL_TEXTURE0 + PAGES_UNIT);
+        glBindTexture(GL_TEXTURE_2D, pagesTexture);
+        glUniform1i(glGetUniformLocation(program, "terrainPages"), PAGES_UNIT);
+
+        glActiveTexture(GL_TEXTURE0 + PAGE_TABLE_UNIT);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, pageTableTexture);
+        glUniform1i(glGetUniformLocation(program, "terrainPageTable"), PAGE_TABLE_UNIT);
+        glActiveTexture(GL_TEXTURE0);
+
+        // width, height, levels (0 without an image)
+        std::vector<glm::vec4> sizes;
+        for (const Image& image : images) {
+            sizes.push_back(glm::vec4((float)image.width, (float)image.height, (float)image.levels, 0.0f));
+        }
+        if (!sizes.empty()) {
+            glUniform4fv(glGetUniformLocation(program, "terrainImages"), (GLsizei)sizes.size(), &sizes[0].x);
+        }
+    }
+
+    int VirtualTexture::getImageCount() {
+        return (int)images.size();
+    }
+
+    int VirtualTexture::getSlotCount() {
+        return (int)slots.size();
+    }
+
+    int VirtualTexture::getResidentPageCount() {
+        return (int)residentPages.size();
+    }
+
+    int VirtualTexture::getPendingPageCount() {
+        return (int)pendingPages.size();
+    }
+
+    int VirtualTexture::getLastUploadCount() {
+        return lastUploads;
+    }
+
+    size_t VirtualTexture::getMemorySize() {
+
+        const size_t slotSize = PAGE_SIZE + 2 * PAGE_BORDER;
+        size_t cache = (size_t)slotsAlong * slotSize * slotsAlong * slotSize * 4;
+        // a full mip chain adds a third
+        size_t table = (size_t)PAGE_TABLE_SIZE * PAGE_TABLE_SIZE * 4 * std::max<size_t>(1, images.size()) * 4 / 3;
+        return cache + table;
+    }
+}
@@ -0,0 +1,151 @@
+#ifndef VirtualTexture_hpp
+#define VirtualTexture_hpp
+
+#if defined (__APPLE__)
+    #define GL_SILENCE_DEPRECATION
+    #include <OpenGL/gl3.h>
+#else
+    #define GLEW_STATIC
+    #include <GL/glew.h>
+#endif
+
+#include <glm/glm.hpp>
+
+#include "MipChain.hpp"
+#include "Shader.hpp"
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace gps {
+
+    // A set of images (the terrain tiles) of which only the pages on screen
+    // are in video memory, within a fixed budget however many images there are.
+    //
+    // Every image is cut, at every mip level, into PAGE_SIZE x PAGE_SIZE pages.
+    // A page lives in a slot of the physical cache (one texture, the slots
+    // PAGE_BORDER texels wider on every side so bilinear filtering never reads
+    // the neighbour slot); the page table (a layer per image, a mip per level,
+    // an RGBA8UI texel per page) says where: slot x, slot y, the level of the
+    // page actually there - a page not in the cache points at the closest
+    // coarser one that is. The single page of the coarsest level of every
+    // image is always in, so there is always something to show.
+    //
+    // Which pages are needed comes from the feedback pass: the terrain drawn
+    // at 1 / FEEDBACK_DIVISOR of the screen, every pixel writing the page and
+    // level it would read, read back a frame later through a pixel buffer.
+    // The missing pages are read by a loader thread, coarse levels first, and
+    // uploaded a few per frame into the least recently used slots.
+    //
+    // The pages are read from the mip chain file of every image (MipChain).
+    class VirtualTexture {
+
+    public:
+        static const int PAGE_SIZE = 128;
+        static const int PAGE_BORDER = 4;
+        // page table entries along level 0, so images up to 2048 x 2048
+        static const int PAGE_TABLE_SIZE = 16;
+        static const int MAX_IMAGES = 64;
+        static const int FEEDBACK_DIVISOR = 8;
+        static const int MAX_UPLOADS_PER_FRAME = 16;
+        // loads queued at once, the rest is asked again by the next feedback
+        static const int MAX_PENDING = 256;
+        // texture units while drawing
+        static const int PAGES_UNIT = 7;
+        static const int PAGE_TABLE_UNIT = 8;
+
+        // budget: bytes of the physical cache; screen: the size the feedback is a fraction of
+        void init(const std::vector<std::string>& paths, size_t budget, int screenWidth, int screenHeight);
+        void Delete();
+
+        // ===== FEEDBACK =====
+        // draw the terrain between the two, with the shader in use
+        void beginFeedback(gps::Shader& shader);
+        void endFeedback(gps::Shader& shader);
+
+        // ===== STREAMING =====
+        // once per frame: reads the last feedback, queues the missing pages,
+        // uploads the loaded ones and rewrites the page tables that changed
+        void update();
+
+        // the shader (already in use) gets the cache, the page table and the images
+        void bind(gps::Shader& shader);
+
+        int getImageCount();
+        int getSlotCount();
+        int getResidentPageCount();
+        int getPendingPageCount();
+        int getLastUploadCount();
+        // bytes of video memory: the cache and the page tables
+        size_t getMemorySize();
+
+    private:
+        struct Image {
+            gps::MipChain chain;
+            int width = 0;
+            int height = 0;
+            int levels = 0;       // down to one page, 0 without an image
+        };
+
+        struct Slot {
+            uint32_t page = 0;    // key of the page in it
+            uint32_t lastUsed = 0; // frame
+            bool used = false;
+            bool locked = false;  // coarsest levels
+        };
+
+        struct LoadedPage {
+            uint32_t page;
+            std::vector<unsigned char> pixels;
+        };
+
+        std::vector<Image> images;
+
+        GLuint pagesTexture = 0;
+        GLuint pageTableTexture = 0;
+        int slotsAlong = 0;
+        std::vector<Slot> slots;
+        std::unordered_map<uint32_t, int> residentPages; // page -> slot
+        std::vector<bool> dirtyImages;
+        uint32_t frame = 0;
+        int lastUploads = 0;
+
+        // feedback
+        GLuint feedbackFBO = 0;
+        GLuint feedbackColour = 0;
+        GLuint feedbackDepth = 0;
+        GLuint feedbackPBO[2] = { 0, 0 };
+        int feedbackWidth = 0;
+        int feedbackHeight = 0;
+        int feedbackFrame = 0;   // feedbacks written
+        std::vector<uint32_t> requests;
+
+        // loader thread
+        std::thread loader;
+        std::mutex loaderMutex;
+        std::condition_variable loaderWake;
+        std::deque<uint32_t> loadQueue;
+        std::deque<LoadedPage> loadedPages;
+        std::unordered_map<uint32_t, bool> pendingPages; // queued or loading, main thread only
+        bool stopping = false;
+        std::vector<std::ifstream> files; // loader thread only
+
+        static uint32_t pageKey(int image, int level, int x, int y);
+        void readPage(uint32_t page, std::vector<unsigned char>& pixels);
+        void loaderLoop();
+
+        void request(uint32_t page);
+        int takeSlot();
+        void uploadPage(uint32_t page, const std::vector<unsigned char>& pixels);
+        void writePageTable(int image);
+    };
+}
+
+#endif /* VirtualTexture_hpp */
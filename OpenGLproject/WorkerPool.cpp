@@ -0,0 +1,106 @@
+#include "WorkerPool.hpp"
+
+namespace gps {
+
+    WorkerPool::~WorkerPool() {
+        Delete();
+    }
+
+    void WorkerPool::init(int threadCount) {
+
+        Delete();
+
+        if (threadCount <= 0) {
+            threadCount = (int)std::thread::hardware_concurrency() - 1;
+        }
+
+        // a new worker starts at the current generation: reading it in the
+        // worker could see a job handed out before it ran, or one left over
+        // from the threads joined above
+        unsigned int seen;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            quit = false;
+            seen = generation;
+        }
+        for (int i = 0; i < threadCount; i++) {
+            threads.emplace_back(&WorkerPool::workerLoop, this, seen);
+        }
+    }
+
+    void WorkerPool::Delete() {
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            quit = true;
+        }
+        wake.notify_all();
+
+        for (std::thread& thread : threads) {
+            thread.join();
+        }
+        threads.clear();
+    }
+
+    int WorkerPool::getConcurrency() {
+        return (int)threads.size() + 1;
+    }
+
+    void WorkerPool::drain() {
+
+        // tasks are claimed one at a time, a slow one does not hold the others back
+        for (int i = nextTask.fetch_add(1); i < taskCount; i = nextTask.fetch_add(1)) {
+            (*task)(i);
+        }
+    }
+
+    void WorkerPool::run(int taskCount, const std::function<void(int)>& task) {
+
+        if (threads.empty() || taskCount <= 1) {
+            for (int i = 0; i < taskCount; i++) {
+                task(i);
+            }
+            return;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            this->task = &task;
+            this->taskCount = taskCount;
+            nextTask = 0;
+            busyWorkers = (int)threads.size();
+            generation++;
+        }
+        wake.notify_all();
+
+        drain();
+
+        // the job must not go out of scope while a worker still looks at it
+        std::unique_lock<std::mutex> lock(mutex);
+        done.wait(lock, [this] { return busyWorkers == 0; });
+        this->task = nullptr;
+    }
+
+    void WorkerPool::workerLoop(unsigned int seen) {
+
+        for (;;) {
+
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                wake.wait(lock, [this, seen] { return quit || generation != seen; });
+                if (quit) {
+                    return;
+                }
+                seen = generation;
+            }
+
+            drain();
+
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                busyWorkers--;
+            }
+            done.notify_one();
+        }
+    }
+}
@@ -0,0 +1,54 @@
+#ifndef WorkerPool_hpp
+#define WorkerPool_hpp
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace gps {
+
+    // A few threads kept alive for the whole run, so splitting a per frame
+    // job across cores costs a wake up instead of a thread creation.
+    // run() hands out the tasks to the workers and to the calling thread
+    // and returns once all of them are done.
+    class WorkerPool {
+
+    public:
+        WorkerPool() = default;
+        WorkerPool(const WorkerPool&) = delete;
+        WorkerPool& operator=(const WorkerPool&) = delete;
+        ~WorkerPool();
+
+        // threadCount = 0 picks the hardware concurrency minus the calling thread
+        void init(int threadCount = 0);
+        void Delete();
+
+        // calls task(0) ... task(taskCount - 1), in parallel, blocks until they are done
+        void run(int taskCount, const std::function<void(int)>& task);
+
+        // workers + the calling thread
+        int getConcurrency();
+
+    private:
+        std::vector<std::thread> threads;
+        std::mutex mutex;
+        std::condition_variable wake;
+        std::condition_variable done;
+
+        // the job in flight
+        const std::function<void(int)>* task = nullptr;
+        int taskCount = 0;
+        std::atomic<int> nextTask{ 0 };
+        int busyWorkers = 0;
+        unsigned int generation = 0;
+        bool quit = false;
+
+        void workerLoop(unsigned int seen);
+        void drain();
+    };
+}
+
+#endif /* WorkerPool_hpp */
@@ -19,9 +19,33 @@
 #include "Shader.hpp"
 #include "Camera.hpp"
 #include "Model3D.hpp"
+#include "InstancedModel.hpp"
+#include "RigidPartModel.hpp"
+#include "GpuInstanceCuller.hpp"
+#include "PenguinCrowd.hpp"
+#include "CollisionWorld.hpp"
+#include "Heightfield.hpp"
+#include "TerrainRenderer.hpp"
+#include "VirtualTexture.hpp"
+#include "TextureStreamer.hpp"
+#include "MeshletModel.hpp"
+#include "MultiDrawRenderer.hpp"
+#include "StaticBatcher.hpp"
+#include "ScatterSystem.hpp"
+#include "PointShadowMap.hpp"
+#include "ShadowAtlas.hpp"
+#include "GpuParticleSystem.hpp"
+#include "ParticlePool.hpp"
+#include "ParticleEmitterSystem.hpp"
+#include "ParticleSorter.hpp"
+#include "StreamBuffer.hpp"
+#include "OITBuffer.hpp"
+#include "SnowSystem.hpp"
 
 #include <iostream>
 #include <algorithm>
+#include <chrono>
+#include <cmath>
 #define N 35
 #define P 10
 
@@ -33,6 +57,7 @@ int retina_width;
 
 // matrices
 glm::mat4 model;
+glm::mat4 terrainFromWorld = glm::mat4(1.0f); // inverse(model), the heightfield's space
 glm::mat4 view;
 glm::mat4 projection;
 glm::mat3 normalMatrix;
@@ -79,6 +104,16 @@ GLboolean pressedKeys[1024];
 gps::Model3D matterhorn;
 gps::Model3D sky; 
 gps::Model3D m[N];
+// the tiles baked into one height grid: the ground of the camera and of the crowd,
+// and what terrainRenderer draws
+gps::Heightfield terrain;
+gps::TerrainRenderer terrainRenderer;
+// the tiles' images, only the pages on screen in video memory
+gps::VirtualTexture terrainTextures;
+const size_t TERRAIN_TEXTURE_BUDGET = 64 * 1024 * 1024; // bytes
+// rocks and trees made up from the heights, the cells around the camera loaded
+gps::ScatterSystem scatter;
+bool renderScatterOn = true;
 gps::Model3D penguin[P];
 gps::Model3D astronaut;
 gps::Model3D firePlace;
@@ -87,11 +122,57 @@ gps::Model3D skis;
 gps::Model3D snowboard;
 gps::Model3D goggles;
 gps::Model3D backpack;
+// the props' textures, only the mip levels their size on screen needs in video memory
+gps::TextureStreamer propTextures;
+const size_t PROP_TEXTURE_BUDGET = 24 * 1024 * 1024; // bytes
+// the astronaut in the sun's shadow pass (colour: astronautMeshlets)
+gps::MultiDrawRenderer propDraws;
+// the big meshes in meshlets, culled against the frustum and by their normal cones
+gps::MeshletModel matterhornMeshlets;
+gps::MeshletModel astronautMeshlets;
+// the props that never move, baked into one mesh and atlas per material (colour and shadows)
+gps::StaticBatcher staticProps;
+// light multiplier, shininess, specular strength
+const glm::vec3 PLAIN_MATERIAL = glm::vec3(1.0f, 32.0f, 0.3f);
+// skis and goggles share same material properties except specStrength
+const glm::vec3 SKIS_MATERIAL = glm::vec3(2.0f, 64.0f, 0.6f);
+const glm::vec3 GOGGLES_MATERIAL = glm::vec3(2.0f, 64.0f, 0.3f);
+
+// penguin1..9 are copies of a few meshes: one instanced draw per unique mesh
+std::vector<gps::InstanceGroup> penguinGroups;
+std::vector<gps::InstancedModel> penguinInstances;
 
 gps::Model3D penguinBody;
 gps::Model3D penguinWingL;
 gps::Model3D penguinWingR;
 
+// the hi penguin's body and wings animated on the GPU, for the whole colony:
+// instance 0 is the hi penguin, the others stand in for the static copies they align with
+gps::RigidPartModel penguinColony;
+// the colony and crowd penguins in the view, picked on the GPU for the colour pass
+gps::GpuInstanceCuller colonyCuller;
+// and the ones the fire light reaches, for its cube map
+gps::GpuInstanceCuller pointShadowCuller;
+bool cullColonyOnGpu = true;
+const int CROWD_MAX_PENGUINS = 16384;
+const int COLONY_MAX_PENGUINS = 512 + CROWD_MAX_PENGUINS; // the static copies, then the crowd
+const float COLONY_ALIGN_TOLERANCE = 0.05f; // mean distance left by the alignment, relative to the size
+const glm::vec3 WING_L_PIVOT = glm::vec3(-2068.25f, -884.082f, 5489.76f);
+const glm::vec3 WING_R_PIVOT = glm::vec3(-2008.24f, -877.652f, 5558.12f);
+int colonyBodyPart, colonyWingLPart, colonyWingRPart;
+int colonyStaticInstances; // the crowd's instances start here
+
+// boids walking around the colony, C cycles how many
+gps::PenguinCrowd penguinCrowd;
+const int CROWD_SIZES[] = { 0, 1000, 10000 };
+int crowdSizeIndex = 1;
+const glm::vec3 CROWD_HOME = glm::vec3(7400.0f, 600.0f, 7900.0f);
+glm::vec3 crowdHome = CROWD_HOME; // H moves it where the camera looks
+const glm::vec3 HI_PENGUIN_FORWARD = glm::vec3(0.74f, 0.0f, -0.67f); // where the beak points, model space
+glm::mat4 crowdModelFromMesh; // hi penguin -> feet at the origin, beak along +z
+std::vector<glm::mat4> crowdMatrices;
+std::vector<float> crowdPhases;
+
 GLfloat angle;
 
 // shaders
@@ -99,17 +180,15 @@ gps::Shader myCustomShader;
 gps::Shader lightShader;
 gps::Shader fireShader;
 gps::Shader depthMapShader;
+gps::Shader pointShadowShader;
+gps::Shader particleUpdateShader;
+gps::Shader instanceCullShader;
 
 bool renderShadows = true;
+bool renderPointShadows = true;
 
 //textures 
-GLuint matterhornTexture, skyTexture, mTexture[N], penguinTexture, astronautTexture;
-GLuint fireTexture;
-GLuint tentTexture;
-GLuint skisTexture;
-GLuint snowboardTexture;
-GLuint gogglesTexture;
-GLuint backpackTexture;
+GLuint matterhornTexture, skyTexture, penguinTexture, astronautTexture;
 
 // mouse variables
 float lastX = 400, lastY = 300; // initial pos, middle
@@ -117,17 +196,21 @@ float yaw = -90.0f;             // camera direction -z
 float pitch = 0.0f;
 bool firstMouse = true;         // avoid jumps at first move
 
-// Shadow mapping - directional light
-GLuint shadowMapFBO;
-GLuint shadowMapTexture;
-const unsigned int SHADOW_WIDTH = 8192, SHADOW_HEIGHT = 8192;
+// Shadow mapping - all the 2D shadow maps live in one atlas
+gps::ShadowAtlas shadowAtlas;
+const unsigned int SHADOW_WIDTH = 8192, SHADOW_HEIGHT = 8192; // the sun's tile
+const int SHADOW_MIN_TILE = 256;
+const int SHADOW_UPDATES_PER_FRAME = 2; // tiles redrawn per frame, whatever the number of lights
+int sunShadowLight; // directional light tile: what never moves, redrawn when the sun does
+int sunMovingShadowLight; // the same light, the animated colony and crowd, redrawn every frame
 glm::mat4 lightSpaceMatrix;
 
 // Shadow mapping - point light (cubemap for all directions)
-GLuint pointShadowMapFBO;
-GLuint pointShadowCubemap;
+gps::PointShadowMap pointShadowMap;
 const unsigned int POINT_SHADOW_WIDTH = 1024, POINT_SHADOW_HEIGHT = 1024;
-std::vector<glm::mat4> pointLightMatrices;
+unsigned int pointShadowResolution = POINT_SHADOW_WIDTH; // [ and ] halve / double it
+const float POINT_SHADOW_FAR_PLANE = 4000.0f; // the fire light is negligible further away
+const glm::vec3 POINT_LIGHT_OFFSET = glm::vec3(0.0f, 60.0f, 0.0f); // above the logs
 
 //fire
 struct Particle {
@@ -141,14 +224,50 @@ struct Particle {
 };
 
 const int MAX_PARTICLES = 1000;
-Particle particles[MAX_PARTICLES];
+Particle particles[MAX_PARTICLES]; // legacy array, only used by the B benchmark now
+
+// CPU particles: emitters (campfire, snow plumes...) sharing one SoA arena
+gps::ParticleEmitterSystem particleEmitters;
+const int PARTICLE_ARENA_CAPACITY = 8192;
+const int PARTICLE_BUDGET = 2000; // alive at once, over all the emitters
+std::vector<gps::ParticlePool*> visibleParticlePools;
+
+// the campfire split the B benchmark runs with (80% fire, 20% smoke)
+const int FIRE_POOL_CAPACITY = 800;
+const int SMOKE_POOL_CAPACITY = MAX_PARTICLES - FIRE_POOL_CAPACITY;
+const float FIRE_SPAWN_RATE = 160.0f;  // particles / second
+const float SMOKE_SPAWN_RATE = 40.0f;
+gps::ParticleSorter particleSorter; // T toggles the temporal coherence
+
+// weighted blended OIT for the particles, I switches back to sorted additive blending
+gps::OITBuffer oitBuffer;
+gps::Shader oitCompositeShader;
+gps::Shader oitDepthDownsampleShader;
+bool useOIT = true;
+int particleResolutionDivisor = 2; // off-screen particles at 1/2 resolution, R cycles 1 / 2 / 4
+const float SOFT_PARTICLE_DISTANCE = 80.0f; // fade distance where the particles cut into the scene
+const float NEAR_PLANE = 0.1f, FAR_PLANE = 1000000.0f;
+
+// snowfall around the camera, K toggles it, - / = halve / double the density
+gps::SnowSystem snowSystem;
+gps::Shader snowShader;
+bool renderSnow = true;
+
+// GPU simulated fire (transform feedback), G switches back to the CPU particles
+gps::GpuParticleSystem gpuParticles;
+const int GPU_PARTICLES = 131072;
+bool useGpuParticles = true;
 
 //object positions
 glm::vec3 firePos = glm::vec3(-2096.814209f, -980.905457f, 5921.6f);
 
-GLuint particleVAO, particleVBO;
+GLuint particleVAO;
+
+GLuint quadVBO, quadEBO;
 
-GLuint quadVBO, quadEBO, instanceVBO;
+// per-frame instance data (CPU particles...) goes through a fenced ring buffer
+gps::StreamBuffer instanceStream;
+const GLsizeiptr STREAM_REGION_SIZE = 4 * 1024 * 1024; // bytes one frame can stream
 
 GLfloat quadVertices[] = {
     // (x, y, z)
@@ -172,13 +291,10 @@ struct CameraCollider {
 
 CameraCollider cameraCollider = { myCamera.getCameraPosition(), 2.0f };
 
-struct Penguin {
-    glm::vec3 position;
-	float radius;
-	glm::vec3 velocity;
-};
-
-std::vector<Penguin> penguins;
+// the scene's triangles for the camera, the crowd as dynamic spheres
+gps::CollisionWorld collisionWorld;
+const float CROWD_COLLIDER_RADIUS = 90.0f;
+const float CROWD_COLLIDER_HEIGHT = 127.0f; // above the feet, the middle of the body
 
 GLenum glCheckError_(const char *file, int line)
 {
@@ -209,6 +325,12 @@ GLenum glCheckError_(const char *file, int line)
 #define glCheckError() glCheckError_(__FILE__, __LINE__)
 
 void loadSky();
+void benchmarkParticles();
+void spawnPenguinCrowd(int count);
+float crowdHomeRadius(int count);
+bool terrainRaycast(glm::vec3 origin, glm::vec3 direction, float maxDistance, float& t);
+void printPropTextures();
+void printScatter();
 
 void windowResizeCallback(GLFWwindow* window, int width, int height) {
 	fprintf(stdout, "Window resized! New width: %d , and height: %d\n", width, height);
@@ -258,6 +380,116 @@ void keyboardCallback(GLFWwindow* window, int key, int scancode, int action, int
         std::cout << "Shadows " << (renderShadows ? "ON" : "OFF") << std::endl;
     }
 
+    // Toggle fire light shadows
+    if (key == GLFW_KEY_P && action == GLFW_PRESS) {
+        renderPointShadows = !renderPointShadows;
+        std::cout << "Point light shadows " << (renderPointShadows ? "ON" : "OFF") << std::endl;
+    }
+
+    // Particle simulation on the GPU or on the CPU
+    if (key == GLFW_KEY_G && action == GLFW_PRESS) {
+        useGpuParticles = !useGpuParticles;
+        std::cout << "Particles on the " << (useGpuParticles ? "GPU" : "CPU") << std::endl;
+    }
+
+    // Order independent transparency
+    if (key == GLFW_KEY_I && action == GLFW_PRESS) {
+        useOIT = !useOIT;
+        std::cout << "Particle OIT " << (useOIT ? "ON" : "OFF") << std::endl;
+    }
+
+    // Snowfall
+    if (key == GLFW_KEY_K && action == GLFW_PRESS) {
+        renderSnow = !renderSnow;
+        std::cout << "Snow " << (renderSnow ? "ON" : "OFF") << std::endl;
+    }
+
+    if ((key == GLFW_KEY_MINUS || key == GLFW_KEY_EQUAL) && action == GLFW_PRESS) {
+        snowSystem.setDensity(snowSystem.getDensity() * (key == GLFW_KEY_EQUAL ? 2.0f : 0.5f));
+        std::cout << "Snow flakes " << snowSystem.getNearFlakeCount() + snowSystem.getFarFlakeCount() << std::endl;
+    }
+
+    // Off-screen particle resolution (OIT path)
+    if (key == GLFW_KEY_R && action == GLFW_PRESS) {
+        particleResolutionDivisor = particleResolutionDivisor == 4 ? 1 : particleResolutionDivisor * 2;
+        oitBuffer.resize(retina_width, retina_height, particleResolutionDivisor);
+        std::cout << "Particle resolution 1/" << particleResolutionDivisor << std::endl;
+    }
+
+    // Reuse last frame's particle order
+    if (key == GLFW_KEY_T && action == GLFW_PRESS) {
+        particleSorter.setTemporalCoherence(!particleSorter.getTemporalCoherence());
+        std::cout << "Particle sort temporal coherence " << (particleSorter.getTemporalCoherence() ? "ON" : "OFF") << std::endl;
+    }
+
+    // CPU particle update benchmark: legacy AoS vs SoA pools
+    if (key == GLFW_KEY_B && action == GLFW_PRESS) {
+        benchmarkParticles();
+    }
+
+    // Point shadow resolution
+    if (key == GLFW_KEY_LEFT_BRACKET && action == GLFW_PRESS && pointShadowResolution > 128) {
+        pointShadowResolution /= 2;
+        pointShadowMap.setResolution(pointShadowResolution);
+        std::cout << "Point shadow resolution " << pointShadowResolution << std::endl;
+    }
+
+    if (key == GLFW_KEY_RIGHT_BRACKET && action == GLFW_PRESS && pointShadowResolution < 4096) {
+        pointShadowResolution *= 2;
+        pointShadowMap.setResolution(pointShadowResolution);
+        std::cout << "Point shadow resolution " << pointShadowResolution << std::endl;
+    }
+
+    // Mip levels of the prop textures in video memory
+    if (key == GLFW_KEY_V && action == GLFW_PRESS) {
+        printPropTextures();
+    }
+
+    // GPU culling of the colony and crowd penguins
+    if (key == GLFW_KEY_U && action == GLFW_PRESS) {
+        cullColonyOnGpu = !cullColonyOnGpu;
+        std::cout << "Penguin GPU culling " << (cullColonyOnGpu ? "ON" : "OFF") << "; last kept " << colonyCuller.getVisibleCount()
+            << " of " << colonyCuller.getInstanceCount() << std::endl;
+    }
+
+    // Rocks and trees, and what is loaded and kept of them
+    if (key == GLFW_KEY_J && action == GLFW_PRESS) {
+        renderScatterOn = !renderScatterOn;
+        std::cout << "Scatter " << (renderScatterOn ? "ON" : "OFF") << std::endl;
+        printScatter();
+    }
+
+    // Meshlet culling, and what it left out last frame
+    if (key == GLFW_KEY_L && action == GLFW_PRESS) {
+        astronautMeshlets.setCulling(!astronautMeshlets.getCulling());
+        matterhornMeshlets.setCulling(astronautMeshlets.getCulling());
+        std::cout << "Meshlet culling " << (astronautMeshlets.getCulling() ? "ON" : "OFF") << "; astronaut: " << astronautMeshlets.getVisibleCount()
+            << " drawn in " << astronautMeshlets.getRangeCount() << " ranges, " << astronautMeshlets.getFrustumCulledCount() << " off screen, "
+            << astronautMeshlets.getBackfaceCulledCount() << " facing away" << std::endl;
+    }
+
+    if (key == GLFW_KEY_C && action == GLFW_PRESS) {
+        crowdSizeIndex = (crowdSizeIndex + 1) % 3;
+        spawnPenguinCrowd(CROWD_SIZES[crowdSizeIndex]);
+    }
+
+    // the crowd walks over to the ground point under the screen center
+    if (key == GLFW_KEY_H && action == GLFW_PRESS) {
+        glm::mat4 cameraView = myCamera.getViewMatrix();
+        glm::vec3 forward = -glm::vec3(cameraView[0][2], cameraView[1][2], cameraView[2][2]);
+        float distance;
+        if (terrainRaycast(myCamera.getCameraPosition(), glm::normalize(forward), FAR_PLANE, distance)) {
+            crowdHome = myCamera.getCameraPosition() + glm::normalize(forward) * distance;
+            penguinCrowd.setHome(crowdHome, crowdHomeRadius(penguinCrowd.getCount()));
+            // bare ground for the largest crowd there too (the scatter is in the terrain's space)
+            scatter.addClearing(glm::vec3(terrainFromWorld * glm::vec4(crowdHome, 1.0f)), crowdHomeRadius(CROWD_SIZES[2]));
+            std::cout << "Penguin crowd home " << crowdHome.x << " " << crowdHome.y << " " << crowdHome.z << std::endl;
+        }
+        else {
+            std::cout << "Penguin crowd home: no ground in sight" << std::endl;
+        }
+    }
+
     //sun position
     if (glfwGetKey(window, GLFW_KEY_UP) == GLFW_PRESS)    lightDir.y += 0.01f;
     if (glfwGetKey(window, GLFW_KEY_DOWN) == GLFW_PRESS)  lightDir.y -= 0.01f;
@@ -366,74 +598,318 @@ void loadSky() {
     
 }
 
-void initPenguinsVector() {
-	penguins.clear();
-
-	float radius = 90.0f;
-	glm::vec3 velocity = glm::vec3(0.0f);
-
-    // hi penguin 
-    penguins.push_back({
-        glm::vec3(-2050.9f, -877.6f, 5533.9f),  // world pos (X, Y, Z)
-        radius,                                   
-        velocity                          
-        });
-
-	// second penguin
-    penguins.push_back({
-        glm::vec3(7169.0f, 562.46f, 7153.5f),  // world pos (X, Y, Z)
-        radius,
-        velocity
-        });
-
-	// third penguin
-    penguins.push_back({
-        glm::vec3(7826.27f, 587.341f, 7525.59f),  
-        radius,
-        velocity
-        });
-
-    penguins.push_back({
-        glm::vec3(7776.78f, 604.0f, 7703.01f),  
-        radius,
-        velocity
-        });
-
-    penguins.push_back({
-        glm::vec3(7299.77f, 601.69f, 7888.11f),  
-        radius,
-        velocity
-        });
-
-    penguins.push_back({
-        glm::vec3(7603.5f, 634.356f, 8321.27f),  
-        radius,
-        velocity
-        });
-
-    penguins.push_back({
-        glm::vec3(7540.21f, 640.78f, 8546.02f),  
-        radius,
-        velocity
-        });
-
-    penguins.push_back({
-        glm::vec3(7011.57f, 577.706f, 8123.4f),  
-        radius,
-        velocity
-        });
-
-    penguins.push_back({
-        glm::vec3(-1827.53f, -872.173f, 5726.33f),  
-        radius,
-        velocity
-        });
+// Layout: pos(3) + color(4) + size(1) + life(1) = 9 floats, starting at offset
+// in the buffer bound to GL_ARRAY_BUFFER (the particle VAO must be bound)
+void setParticleInstanceAttributes(GLintptr offset) {
+
+    const GLsizei stride = 9 * sizeof(float);
+
+    // Particle position
+    glEnableVertexAttribArray(1);
+    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, stride, (void*)offset);
+    glVertexAttribDivisor(1, 1);  // o instance per particula
+
+    // Particle color
+    glEnableVertexAttribArray(2);
+    glVertexAttribPointer(2, 4, GL_FLOAT, GL_FALSE, stride, (void*)(offset + 3 * sizeof(float)));
+    glVertexAttribDivisor(2, 1);
+
+    // Particle size
+    glEnableVertexAttribArray(3);
+    glVertexAttribPointer(3, 1, GL_FLOAT, GL_FALSE, stride, (void*)(offset + 7 * sizeof(float)));
+    glVertexAttribDivisor(3, 1);
+
+    // Particle life
+    glEnableVertexAttribArray(4);
+    glVertexAttribPointer(4, 1, GL_FLOAT, GL_FALSE, stride, (void*)(offset + 8 * sizeof(float)));
+    glVertexAttribDivisor(4, 1);
+}
+
+// keeps one copy of every distinct penguin mesh, the copies become instances of it
+void initPenguinInstances() {
+    std::vector<gps::Model3D*> models;
+    for (int i = 1; i < P; i++) {
+        models.push_back(&penguin[i]);
+    }
+
+    gps::InstancedModel::findInstanceGroups(models, penguinGroups);
+
+    penguinInstances.resize(penguinGroups.size());
+    for (size_t g = 0; g < penguinGroups.size(); g++) {
+        gps::InstanceGroup& group = penguinGroups[g];
+        // model indices from now on, not indices in models
+        group.reference += 1;
+        for (int& member : group.members) {
+            member += 1;
+        }
+
+        penguinInstances[g].init(penguin[group.reference], group.transforms);
+
+        for (int member : group.members) {
+            if (member != group.reference) {
+                penguin[member].releaseMeshes();
+            }
+        }
+    }
+
+    std::cout << "penguins: " << P - 1 << " models, " << penguinGroups.size() << " unique meshes" << std::endl;
+}
+
+// the hi penguin parts, then one animated instance per static penguin they can replace
+void initPenguinColony() {
+    colonyBodyPart = penguinColony.addPart(penguinBody, { glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f), 0.0f, 0.0f });
+    colonyWingLPart = penguinColony.addPart(penguinWingL, { WING_L_PIVOT, glm::vec3(0.0f, 0.0f, 1.0f), glm::radians(30.0f), 4.0f });
+    colonyWingRPart = penguinColony.addPart(penguinWingR, { WING_R_PIVOT, glm::vec3(0.0f, 0.0f, 1.0f), -glm::radians(30.0f), 4.0f });
+    penguinColony.build(COLONY_MAX_PENGUINS, &instanceStream); // the crowd moves every frame
+    colonyCuller.init(COLONY_MAX_PENGUINS);
+    pointShadowCuller.init(COLONY_MAX_PENGUINS);
+
+    penguinColony.addInstance(glm::mat4(1.0f), 0.0f);
+
+    std::vector<gps::Vertex> hiPenguin;
+    gps::Model3D* parts[3] = { &penguinBody, &penguinWingL, &penguinWingR };
+    for (gps::Model3D* part : parts) {
+        for (gps::Mesh& mesh : part->getMeshes()) {
+            hiPenguin.insert(hiPenguin.end(), mesh.vertices.begin(), mesh.vertices.end());
+        }
+    }
+
+    // a group the parts align with is drawn by the colony from now on
+    for (size_t g = 0; g < penguinGroups.size();) {
+        gps::InstanceGroup& group = penguinGroups[g];
+
+        std::vector<gps::Vertex> reference;
+        for (gps::Mesh& mesh : penguin[group.reference].getMeshes()) {
+            reference.insert(reference.end(), mesh.vertices.begin(), mesh.vertices.end());
+        }
+
+        glm::mat4 alignment;
+        float error = gps::InstancedModel::alignShapes(hiPenguin, reference, alignment);
+        if (error > COLONY_ALIGN_TOLERANCE) {
+            g++;
+            continue;
+        }
+
+        for (const glm::mat4& transform : group.transforms) {
+            // golden angle steps, no two neighbours flap together
+            float phase = penguinColony.getInstanceCount() * 2.39996f;
+            penguinColony.addInstance(transform * alignment, phase);
+        }
+
+        penguinInstances[g].Delete();
+        penguin[group.reference].releaseMeshes();
+        penguinInstances.erase(penguinInstances.begin() + g);
+        penguinGroups.erase(penguinGroups.begin() + g);
+    }
+
+    colonyStaticInstances = penguinColony.getInstanceCount();
+    std::cout << "penguin colony: " << penguinColony.getInstanceCount() << " animated penguins" << std::endl;
+}
+
+void initTerrain() {
+    std::vector<gps::Model3D*> tiles;
+    for (int i = 1; i < N; i++) {
+        tiles.push_back(&m[i]);
+    }
+
+    auto start = std::chrono::high_resolution_clock::now();
+    terrain.bake(tiles);
+    auto end = std::chrono::high_resolution_clock::now();
+    std::cout << "terrain: " << terrain.getWidth() << " x " << terrain.getDepth() << " heights, spacing " << terrain.getSpacing()
+        << ", " << terrain.getLevelCount() << " levels, baked in " << std::chrono::duration<float, std::milli>(end - start).count() << " ms" << std::endl;
+
+    // drawn from the heights from now on, the tiles keep their bounds
+    std::vector<std::string> texturePaths;
+    for (int i = 1; i < N; i++) {
+        texturePaths.push_back("models/Matterhorn_parts/m" + std::to_string(i) + ".png");
+    }
+    start = std::chrono::high_resolution_clock::now();
+    terrainTextures.init(texturePaths, TERRAIN_TEXTURE_BUDGET, retina_width, retina_height);
+    end = std::chrono::high_resolution_clock::now();
+
+    terrainRenderer.init(terrain);
+    terrainRenderer.setTextures(terrainTextures);
+    for (int i = 1; i < N; i++) {
+        terrainRenderer.addTile(m[i].getBoundsMin(), m[i].getBoundsMax());
+        m[i].releaseMeshes();
+    }
+    std::cout << "terrain: " << terrainRenderer.getLevelCount() << " LOD levels of " << gps::TerrainRenderer::GRID_SIZE << " x "
+        << gps::TerrainRenderer::GRID_SIZE << " quads" << std::endl;
+    std::cout << "terrain textures: " << terrainTextures.getImageCount() << " images, " << terrainTextures.getSlotCount() << " pages cached ("
+        << terrainTextures.getMemorySize() / (1024 * 1024) << " MB), ready in " << std::chrono::duration<float, std::milli>(end - start).count() << " ms" << std::endl;
+}
+
+// the terrain is drawn under model (Q / E turn it about y), the heightfield is in
+// its space: world positions go through terrainFromWorld before a query
+float terrainHeightAt(float x, float z) {
+    glm::vec3 p = glm::vec3(terrainFromWorld * glm::vec4(x, 0.0f, z, 1.0f));
+    return terrain.heightAt(p.x, p.z);
+}
+
+bool terrainRaycast(glm::vec3 origin, glm::vec3 direction, float maxDistance, float& t) {
+    // rigid, the distance along the ray is the same in both spaces
+    return terrain.raycast(glm::vec3(terrainFromWorld * glm::vec4(origin, 1.0f)),
+        glm::vec3(terrainFromWorld * glm::vec4(direction, 0.0f)), maxDistance, t);
+}
+
+glm::vec3 terrainMoveSphere(glm::vec3 from, glm::vec3 to, float radius) {
+    glm::vec3 moved = terrain.moveSphere(glm::vec3(terrainFromWorld * glm::vec4(from, 1.0f)),
+        glm::vec3(terrainFromWorld * glm::vec4(to, 1.0f)), radius);
+    return glm::vec3(model * glm::vec4(moved, 1.0f));
+}
+
+// more penguins need more room
+float crowdHomeRadius(int count) {
+    return std::max(2500.0f, 55.0f * std::sqrt((float)count));
+}
+
+void initScatter() {
+    std::vector<gps::ScatterLayer> layers;
+    // rocks: stones to boulders, everywhere but the lowest ground, leaning with the slope
+    layers.push_back({ gps::SCATTER_ROCK, 60.0f, 0.9f, glm::vec2(0.25f, 1.0f), 0.6f, glm::vec2(30.0f, 140.0f), 0.25f, 0.7f,
+        { 2000.0f, 6000.0f, 16000.0f }, glm::vec3(1.0f, 16.0f, 0.1f), 17u });
+    // firs: on the lower, gentler ground, upright
+    layers.push_back({ gps::SCATTER_TREE, 200.0f, 0.85f, glm::vec2(0.0f, 0.6f), 0.85f, glm::vec2(500.0f, 950.0f), 0.05f, 0.0f,
+        { 5000.0f, 15000.0f, 40000.0f }, glm::vec3(1.0f, 8.0f, 0.05f), 29u });
+
+    auto start = std::chrono::high_resolution_clock::now();
+    scatter.init(terrain, layers);
+    auto end = std::chrono::high_resolution_clock::now();
+    // the camp and the colony, and wherever the largest crowd may wander from home;
+    // the scatter is in the terrain's space
+    scatter.addClearing(glm::vec3(terrainFromWorld * glm::vec4(firePos, 1.0f)), 2500.0f);
+    scatter.addClearing(glm::vec3(terrainFromWorld * glm::vec4(CROWD_HOME, 1.0f)), crowdHomeRadius(CROWD_SIZES[2]));
+    std::cout << "scatter: " << scatter.getLayerCount() << " layers, tiles of " << scatter.getTilePointCount(0) << " and " << scatter.getTilePointCount(1)
+        << " points, " << scatter.getMemorySize() / (1024 * 1024) << " MB, ready in " << std::chrono::duration<float, std::milli>(end - start).count() << " ms" << std::endl;
+}
+
+void printScatter() {
+    const char* names[] = { "rocks", "trees" };
+    for (int layer = 0; layer < scatter.getLayerCount(); layer++) {
+        std::cout << "  " << names[layer] << ": " << scatter.getLoadedInstanceCount(layer) << " in " << scatter.getLoadedCellCount(layer) << " cells, kept per LOD";
+        for (int lod = 0; lod < gps::SCATTER_LOD_COUNT; lod++) {
+            std::cout << " " << scatter.getVisibleCount(layer, lod);
+        }
+        std::cout << std::endl;
+    }
+}
+
+void spawnPenguinCrowd(int count) {
+    penguinCrowd.clear();
+    penguinCrowd.setHome(crowdHome, crowdHomeRadius(count));
+    penguinCrowd.spawn(count, 1234u);
+    penguinColony.setInstances(colonyStaticInstances, 0, nullptr, nullptr);
+    std::cout << "Penguin crowd " << count << std::endl;
+}
+
+void initPenguinCrowd() {
+    // the hi penguin stands at its feet, looking down +z
+    glm::vec3 boundsMin = penguinBody.getBoundsMin();
+    glm::vec3 boundsMax = penguinBody.getBoundsMax();
+    glm::vec3 feet = glm::vec3(0.5f * (boundsMin.x + boundsMax.x), boundsMin.y, 0.5f * (boundsMin.z + boundsMax.z));
+    float facing = std::atan2(HI_PENGUIN_FORWARD.x, HI_PENGUIN_FORWARD.z);
+    crowdModelFromMesh = glm::rotate(glm::mat4(1.0f), -facing, glm::vec3(0.0f, 1.0f, 0.0f)) * glm::translate(glm::mat4(1.0f), -feet);
+
+    int maxAgents = std::min(CROWD_MAX_PENGUINS, COLONY_MAX_PENGUINS - colonyStaticInstances);
+    penguinCrowd.init(maxAgents);
+    penguinCrowd.setTerrain(terrainHeightAt);
+    crowdMatrices.resize(maxAgents);
+    crowdPhases.resize(maxAgents);
+
+    spawnPenguinCrowd(CROWD_SIZES[crowdSizeIndex]);
+}
+
+void updatePenguinCrowd(float deltaTime) {
+    // a long frame (the loading one) would throw them across the map
+    penguinCrowd.update(std::min(deltaTime, 0.1f));
+    penguinCrowd.writeInstances(crowdModelFromMesh, crowdMatrices.data(), crowdPhases.data());
+    penguinColony.setInstances(colonyStaticInstances, penguinCrowd.getCount(), crowdMatrices.data(), crowdPhases.data());
+}
+
+// how many pixels across every prop in front of the camera covers, what its
+// texture's mip levels are chosen by
+void requirePropTextures() {
+    struct Prop {
+        gps::Model3D* model;
+        GLuint texture;
+    };
+    // the others are drawn from staticProps' atlases, below
+    const Prop props[] = { { &astronaut, astronautTexture } };
+
+    glm::vec3 cameraPos = myCamera.getCameraPosition();
+    glm::mat4 cameraView = myCamera.getViewMatrix();
+    glm::vec3 forward = -glm::vec3(cameraView[0][2], cameraView[1][2], cameraView[2][2]);
+
+    for (const Prop& prop : props) {
+        glm::vec3 boundsMin = prop.model->getBoundsMin();
+        glm::vec3 boundsMax = prop.model->getBoundsMax();
+        glm::vec3 center = glm::vec3(model * glm::vec4(0.5f * (boundsMin + boundsMax), 1.0f));
+        float radius = 0.5f * glm::length(boundsMax - boundsMin);
+        float distance = glm::length(center - cameraPos);
+        if (glm::dot(center - cameraPos, forward) < -radius) {
+            continue;
+        }
+        float screenSize = distance > radius ? radius / distance * projection[1][1] * retina_height : (float)retina_height;
+        propTextures.require(prop.texture, screenSize);
+    }
+
+    // the baked props' atlases, by their clusters on screen (in the props' space, under model)
+    glm::vec3 propCamera = glm::vec3(terrainFromWorld * glm::vec4(cameraPos, 1.0f));
+    staticProps.requireTextures(projection * cameraView * model, propCamera, projection[1][1] * retina_height);
+}
+
+void printPropTextures() {
+    std::cout << "prop textures: " << propTextures.getResidentSize() / 1024 << " KB of " << propTextures.getBudget() / 1024 << " KB" << std::endl;
+    for (int i = 0; i < propTextures.getTextureCount(); i++) {
+        gps::TextureStreamer::Residency residency = propTextures.getResidency(i);
+        std::cout << "  " << residency.path << " " << residency.width << " x " << residency.height << ": from level " << residency.residentLevel
+            << " of " << residency.levels << " (wants " << residency.wantedLevel << (residency.loading ? ", loading" : "") << "), "
+            << residency.residentSize / 1024 << " KB" << std::endl;
+    }
+}
+
+// everything drawn that stays in place but the terrain (the heightfield's job):
+// static penguins (the colony in its rest pose) and props
+void initCollisionWorld() {
+    glm::mat4 identity = glm::mat4(1.0f);
+
+    for (gps::InstanceGroup& group : penguinGroups) {
+        for (const glm::mat4& transform : group.transforms) {
+            collisionWorld.addModel(penguin[group.reference], transform);
+        }
+    }
+    for (int i = 0; i < colonyStaticInstances; i++) {
+        glm::mat4 transform = penguinColony.getPartMatrix(i, colonyBodyPart, 0.0f);
+        collisionWorld.addModel(penguinBody, transform);
+        collisionWorld.addModel(penguinWingL, transform);
+        collisionWorld.addModel(penguinWingR, transform);
+    }
+    gps::Model3D* props[] = { &astronaut, &tent, &firePlace, &skis, &snowboard, &goggles, &backpack };
+    for (gps::Model3D* prop : props) {
+        collisionWorld.addModel(*prop, identity);
+    }
+
+    auto start = std::chrono::high_resolution_clock::now();
+    collisionWorld.build();
+    auto end = std::chrono::high_resolution_clock::now();
+    std::cout << "collision: " << collisionWorld.getTriangleCount() << " triangles, " << collisionWorld.getNodeCount()
+        << " nodes, built in " << std::chrono::duration<float, std::milli>(end - start).count() << " ms" << std::endl;
 
+    cameraCollider.position = myCamera.getCameraPosition();
+}
+
+void updateCrowdColliders() {
+    collisionWorld.clearDynamic();
+    for (int i = 0; i < penguinCrowd.getCount(); i++) {
+        collisionWorld.addDynamic(penguinCrowd.getPosition(i) + glm::vec3(0.0f, CROWD_COLLIDER_HEIGHT, 0.0f), CROWD_COLLIDER_RADIUS);
+    }
+    collisionWorld.buildDynamic();
 }
 
 void initModels() {
 	matterhorn.LoadModel("models/Matterhorn/Matterhornbig.obj");
 	matterhornTexture = matterhorn.ReadTextureFromFile("models/Matterhorn/Matterhorn.jpg");
+    matterhornMeshlets.build(matterhorn);
 
     loadSky();
 
@@ -442,6 +918,7 @@ void initModels() {
         penguin[i].LoadModel(pathpeng);
         penguinTexture = penguin[1].ReadTextureFromFile("models/penguin/Penguin Diffuse Color.png");
     }
+    initPenguinInstances();
 
     penguinBody.LoadModel("models/penguin/penguinBody.obj");
     penguinTexture = penguinBody.ReadTextureFromFile("models/penguin/Penguin Diffuse Color.png");
@@ -451,36 +928,70 @@ void initModels() {
 
     penguinWingR.LoadModel("models/penguin/penguinWingR.obj");
     penguinTexture = penguinWingR.ReadTextureFromFile("models/penguin/Penguin Diffuse Color.png");
+    initPenguinColony();
 
+    // the props' materials name the same images, which the streamer loads once
+    propTextures.init(PROP_TEXTURE_BUDGET);
+
+	astronaut.setTextureStreamer(&propTextures);
 	astronaut.LoadModel("models/astronaut/astronaut.obj");
-	astronautTexture = astronaut.ReadTextureFromFile("models/astronaut/texture_diffuse.png");
+	astronautTexture = propTextures.load("models/astronaut/texture_diffuse.png");
+    astronautMeshlets.build(astronaut);
+    std::cout << "meshlets: " << matterhornMeshlets.getMeshletCount() << " in the Matterhorn, " << astronautMeshlets.getMeshletCount()
+        << " in the astronaut" << std::endl;
 
 	for (int i = 1; i < N; i++) {
 		std::string path = "models/Matterhorn_parts/m" + std::to_string(i) + ".obj";
 		m[i].LoadModel(path);
-		std::string texturePath = "models/Matterhorn_parts/m" + std::to_string(i) + ".png";
-		mTexture[i] = m[i].ReadTextureFromFile(texturePath.c_str());
 	}
+    initTerrain();
+    initScatter();
+    initPenguinCrowd();
 
+    tent.setTextureStreamer(&propTextures);
     tent.LoadModel("models/Tent/tent.obj");
-    tentTexture = tent.ReadTextureFromFile("models/Tent/tentTexture.jpg");
 
+	firePlace.setTextureStreamer(&propTextures);
 	firePlace.LoadModel("models/Fireplace/fire_place.obj");
-	fireTexture = firePlace.ReadTextureFromFile("models/Fireplace/texture/fireTex.png");
 
+	skis.setTextureStreamer(&propTextures);
 	skis.LoadModel("models/skis/skis.obj");
-	skisTexture = skis.ReadTextureFromFile("models/skis/skisTexture.jpg");
 
+	snowboard.setTextureStreamer(&propTextures);
 	snowboard.LoadModel("models/Snowboard/snowboard.obj");
-	snowboardTexture = snowboard.ReadTextureFromFile("models/Snowboard/zebraPrint.png");
 
+	goggles.setTextureStreamer(&propTextures);
 	goggles.LoadModel("models/Goggles/goggles.obj");
-	gogglesTexture = goggles.ReadTextureFromFile("models/Goggles/gogglesTexture.jpg");
 
+	backpack.setTextureStreamer(&propTextures);
 	backpack.LoadModel("models/Backpack/backpack.obj");
-	backpackTexture = backpack.ReadTextureFromFile("models/Backpack/backpackTexture.jpg");
 
-    initPenguinsVector();
+    // the fireplace houses the point light, it casts no shadow from it
+    glm::mat4 propModel = glm::mat4(1.0f);
+    staticProps.add(tent, propModel, PLAIN_MATERIAL, "models/Tent/tentTexture.jpg");
+    staticProps.add(snowboard, propModel, PLAIN_MATERIAL, "models/Snowboard/zebraPrint.png");
+    staticProps.add(firePlace, propModel, PLAIN_MATERIAL, "models/Fireplace/texture/fireTex.png", false);
+    staticProps.add(backpack, propModel, PLAIN_MATERIAL, "models/Backpack/backpackTexture.jpg");
+    staticProps.add(skis, propModel, SKIS_MATERIAL, "models/skis/skisTexture.jpg");
+    staticProps.add(goggles, propModel, GOGGLES_MATERIAL, "models/Goggles/gogglesTexture.jpg");
+    staticProps.bake(propTextures, "models/staticProps");
+    std::cout << "static props: " << staticProps.getBatchCount() << " batches, " << staticProps.getClusterCount() << " clusters, "
+        << staticProps.getAtlasMemorySize() / 1024 << " KB of atlas levels to stream" << std::endl;
+    std::cout << "prop textures: " << propTextures.getTextureCount() << " images, " << propTextures.getResidentSize() / 1024
+        << " KB of coarse mip levels in" << std::endl;
+
+    propDraws.init();
+
+    initCollisionWorld();
+
+    // drawn from staticProps from now on, in every pass; the models keep their bounds
+    gps::Model3D* bakedProps[] = { &tent, &firePlace, &skis, &snowboard, &goggles, &backpack };
+    for (gps::Model3D* prop : bakedProps) {
+        prop->releaseMeshes();
+    }
+    gps::GeometryArena& geometry = gps::Mesh::getArena();
+    std::cout << "geometry: " << geometry.getUsedVertexCount() << " vertices, " << geometry.getUsedIndexCount() << " indices in "
+        << geometry.getBlockCount() << " blocks (" << geometry.getMemorySize() / (1024 * 1024) << " MB)" << std::endl;
 
 
     for (int i = 0; i < MAX_PARTICLES; i++)
@@ -488,10 +999,16 @@ void initModels() {
         particles[i].life = 0.0f;
     }
 
+    particleEmitters.init(PARTICLE_ARENA_CAPACITY, PARTICLE_BUDGET);
+    particleEmitters.addEmitter(gps::EMITTER_CAMPFIRE, firePos, MAX_PARTICLES);
+    // powder blown off the slopes around the penguin colony
+    particleEmitters.addEmitter(gps::EMITTER_SNOW_PLUME, glm::vec3(6900.0f, 620.0f, 7600.0f), 512);
+    particleEmitters.addEmitter(gps::EMITTER_SNOW_PLUME, glm::vec3(7900.0f, 700.0f, 8700.0f), 512);
+
     glGenVertexArrays(1, &particleVAO);
     glGenBuffers(1, &quadVBO);
     glGenBuffers(1, &quadEBO);
-    glGenBuffers(1, &instanceVBO);
+    instanceStream.init(GL_ARRAY_BUFFER, STREAM_REGION_SIZE);
 
     glBindVertexArray(particleVAO);
 
@@ -507,35 +1024,18 @@ void initModels() {
     glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(quadIndices), quadIndices, GL_STATIC_DRAW);
 
     // ===== INSTANCE DATA (diferit pentru fiecare particula) =====
-    particleVBO = instanceVBO;  // salvam pentru update-uri
-    glBindBuffer(GL_ARRAY_BUFFER, instanceVBO);
-    glBufferData(GL_ARRAY_BUFFER, MAX_PARTICLES * 9 * sizeof(float), nullptr, GL_DYNAMIC_DRAW);
-
-    // Layout: pos(3) + color(4) + size(1) + life(1) = 9 floats
-
-    // Particle position
-    glEnableVertexAttribArray(1);
-    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 9 * sizeof(float), (void*)0);
-    glVertexAttribDivisor(1, 1);  // o instance per particula
-
-    // Particle color
-    glEnableVertexAttribArray(2);
-    glVertexAttribPointer(2, 4, GL_FLOAT, GL_FALSE, 9 * sizeof(float), (void*)(3 * sizeof(float)));
-    glVertexAttribDivisor(2, 1);
-
-    // Particle size
-    glEnableVertexAttribArray(3);
-    glVertexAttribPointer(3, 1, GL_FLOAT, GL_FALSE, 9 * sizeof(float), (void*)(7 * sizeof(float)));
-    glVertexAttribDivisor(3, 1);
-
-    // Particle life
-    glEnableVertexAttribArray(4);
-    glVertexAttribPointer(4, 1, GL_FLOAT, GL_FALSE, 9 * sizeof(float), (void*)(8 * sizeof(float)));
-    glVertexAttribDivisor(4, 1);
+    // the offset changes every frame, renderParticles points the attributes again
+    glBindBuffer(GL_ARRAY_BUFFER, instanceStream.getBuffer());
+    setParticleInstanceAttributes(0);
 
     glBindBuffer(GL_ARRAY_BUFFER, 0);
     glBindVertexArray(0);
 
+    // ===== GPU PARTICLES (share the quad) =====
+    gpuParticles.init(GPU_PARTICLES, quadVBO, quadEBO);
+
+    snowSystem.init();
+
 }
 
 void initShaders() {
@@ -575,6 +1075,54 @@ void initShaders() {
         std::cerr << "Failed to load depthMapShader: " << e.what() << std::endl;
         exit(EXIT_FAILURE);
     }
+    try {
+        particleUpdateShader.loadTransformFeedbackShader("shaders/particleUpdate.vert", gps::GpuParticleSystem::feedbackVaryings());
+        std::cout << "particleUpdateShader loaded successfully" << std::endl;
+    }
+    catch (const std::exception& e) {
+        std::cerr << "Failed to load particleUpdateShader: " << e.what() << std::endl;
+        exit(EXIT_FAILURE);
+    }
+    try {
+        instanceCullShader.loadTransformFeedbackShader("shaders/instanceCull.vert", "shaders/instanceCull.geom", gps::GpuInstanceCuller::feedbackVaryings());
+        std::cout << "instanceCullShader loaded successfully" << std::endl;
+    }
+    catch (const std::exception& e) {
+        std::cerr << "Failed to load instanceCullShader: " << e.what() << std::endl;
+        exit(EXIT_FAILURE);
+    }
+    try {
+        pointShadowShader.loadShader("shaders/pointShadowDepth.vert", "shaders/pointShadowDepth.geom", "shaders/pointShadowDepth.frag");
+        std::cout << "pointShadowShader loaded successfully" << std::endl;
+    }
+    catch (const std::exception& e) {
+        std::cerr << "Failed to load pointShadowShader: " << e.what() << std::endl;
+        exit(EXIT_FAILURE);
+    }
+    try {
+        oitCompositeShader.loadShader("shaders/oitComposite.vert", "shaders/oitComposite.frag");
+        std::cout << "oitCompositeShader loaded successfully" << std::endl;
+    }
+    catch (const std::exception& e) {
+        std::cerr << "Failed to load oitCompositeShader: " << e.what() << std::endl;
+        exit(EXIT_FAILURE);
+    }
+    try {
+        oitDepthDownsampleShader.loadShader("shaders/oitComposite.vert", "shaders/oitDepthDownsample.frag");
+        std::cout << "oitDepthDownsampleShader loaded successfully" << std::endl;
+    }
+    catch (const std::exception& e) {
+        std::cerr << "Failed to load oitDepthDownsampleShader: " << e.what() << std::endl;
+        exit(EXIT_FAILURE);
+    }
+    try {
+        snowShader.loadShader("shaders/snow.vert", "shaders/snow.frag");
+        std::cout << "snowShader loaded successfully" << std::endl;
+    }
+    catch (const std::exception& e) {
+        std::cerr << "Failed to load snowShader: " << e.what() << std::endl;
+        exit(EXIT_FAILURE);
+    }
 
 	/*myCustomShader.loadShader(
         "shaders/shaderStart.vert", 
@@ -599,7 +1147,7 @@ void initUniforms() {
 	glUniformMatrix4fv(viewLoc, 1, GL_FALSE, glm::value_ptr(view));
 
     //initialize the projection matrix
-    projection = glm::perspective(glm::radians(55.0f), (float)retina_width / (float)retina_height, 0.1f, 1000000.0f);
+    projection = glm::perspective(glm::radians(55.0f), (float)retina_width / (float)retina_height, NEAR_PLANE, FAR_PLANE);
     GLint projLoc = glGetUniformLocation(myCustomShader.shaderProgram, "projection");
     glUniformMatrix4fv(projLoc, 1, GL_FALSE, glm::value_ptr(projection));
 
@@ -650,6 +1198,18 @@ void initUniforms() {
     GLint shadowMapLoc = glGetUniformLocation(lightShader.shaderProgram, "shadowMap");
     glUniform1i(shadowMapLoc, 1); // texture unit 1
 
+    // point light shadow cubemap
+    glUniform1i(glGetUniformLocation(lightShader.shaderProgram, "pointShadowMap"), 2); // texture unit 2
+    glUniform1f(glGetUniformLocation(lightShader.shaderProgram, "pointFarPlane"), POINT_SHADOW_FAR_PLANE);
+
+    // terrain heights, owners and virtual texture, their own units (each sampler type needs its own)
+    glUniform1i(glGetUniformLocation(lightShader.shaderProgram, "terrainHeights"), gps::TerrainRenderer::HEIGHTS_UNIT);
+    glUniform1i(glGetUniformLocation(lightShader.shaderProgram, "terrainOwners"), gps::TerrainRenderer::OWNERS_UNIT);
+    glUniform1i(glGetUniformLocation(lightShader.shaderProgram, "terrainPages"), gps::VirtualTexture::PAGES_UNIT);
+    glUniform1i(glGetUniformLocation(lightShader.shaderProgram, "terrainPageTable"), gps::VirtualTexture::PAGE_TABLE_UNIT);
+    glUniform1i(glGetUniformLocation(lightShader.shaderProgram, "drawData"), gps::MultiDrawRenderer::DRAW_DATA_UNIT);
+    glUniformMatrix4fv(glGetUniformLocation(lightShader.shaderProgram, "instanceSpace"), 1, GL_FALSE, glm::value_ptr(glm::mat4(1.0f)));
+
 	//fire shader uniforms
     fireShader.useShaderProgram();
 
@@ -662,48 +1222,37 @@ void initUniforms() {
 }
 
 void initShadowMap() {
-    // ===== DIRECTIONAL LIGHT SHADOW MAP =====
-    glGenFramebuffers(1, &shadowMapFBO);
-
-    glGenTextures(1, &shadowMapTexture);
-    glBindTexture(GL_TEXTURE_2D, shadowMapTexture);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT,
-        SHADOW_WIDTH, SHADOW_HEIGHT, 0, GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
-    float borderColor[] = { 1.0f, 1.0f, 1.0f, 1.0f };
-    glTexParameterfv(GL_TEXTURE_2D, GL_TEXTURE_BORDER_COLOR, borderColor);
-
-	// attach depth texture as FBO's depth buffer
-    glBindFramebuffer(GL_FRAMEBUFFER, shadowMapFBO);
-    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, shadowMapTexture, 0);
-    glDrawBuffer(GL_NONE);
-    glReadBuffer(GL_NONE);
-    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    // ===== SHADOW ATLAS (directional light and future spot lights) =====
+    // the sun keeps the full SHADOW_WIDTH tile it had as a single shadow map; the
+    // half width column next to it holds the moving tile and future spot lights
+    shadowAtlas.init(SHADOW_WIDTH + SHADOW_WIDTH / 2, SHADOW_HEIGHT, SHADOW_MIN_TILE, SHADOW_WIDTH);
+
+    // the sun lights the whole screen, it gets the largest tiles; the penguins
+    // that move get a smaller one of their own so the rest is not redrawn for them
+    sunShadowLight = shadowAtlas.addLight(1.0f);
+    sunMovingShadowLight = shadowAtlas.addLight(0.5f);
 
 
     // ===== POINT LIGHT SHADOW MAP (CUBEMAP) =====
-    /*glGenFramebuffers(1, &pointShadowMapFBO);
-
-    glGenTextures(1, &pointShadowCubemap);
-    glBindTexture(GL_TEXTURE_CUBE_MAP, pointShadowCubemap);
-    for (unsigned int i = 0; i < 6; ++i) {
-        glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, 0, GL_DEPTH_COMPONENT,
-            POINT_SHADOW_WIDTH, POINT_SHADOW_HEIGHT, 0, GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
-    }
-    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
-
-    glBindFramebuffer(GL_FRAMEBUFFER, pointShadowMapFBO);
-    glFramebufferTexture(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, pointShadowCubemap, 0);
-    glDrawBuffer(GL_NONE);
-    glReadBuffer(GL_NONE);
-    glBindFramebuffer(GL_FRAMEBUFFER, 0);*/
+    pointShadowMap.init(pointShadowResolution);
+    pointShadowMap.setLight(firePos + POINT_LIGHT_OFFSET, POINT_SHADOW_FAR_PLANE);
+}
+
+// objects that cast fire light shadows - the order must stay the same between frames
+// (the terrain only receives; the colony and the crowd are drawn instanced and the
+// baked props from staticProps, see renderScene)
+void collectPointShadowCasters(std::vector<gps::ShadowCaster>& casters) {
+    casters.clear();
+
+    glm::mat4 identity = glm::mat4(1.0f);
+
+    // the copies share the geometry of their reference
+    for (gps::InstanceGroup& group : penguinGroups) {
+        for (size_t k = 0; k < group.members.size(); k++) {
+            casters.push_back({ &penguin[group.reference], group.transforms[k] });
+        }
+    }
+    casters.push_back({ &astronaut, identity });
 }
 
 void calculateLightSpaceMatrix() {
@@ -717,7 +1266,8 @@ void calculateLightSpaceMatrix() {
     lightSpaceMatrix = lightProjection * lightView;
 }
 
-void renderDepthMap(gps::Shader& shader, bool isPointLight = false) {
+// movingCasters: the animated colony and crowd instead of everything else
+void renderDepthMap(gps::Shader& shader, bool isPointLight = false, bool movingCasters = false) {
 
     if (!isPointLight) {
         shader.useShaderProgram();
@@ -725,64 +1275,31 @@ void renderDepthMap(gps::Shader& shader, bool isPointLight = false) {
         glUniformMatrix4fv(lightSpaceMatrixLoc, 1, GL_FALSE, glm::value_ptr(lightSpaceMatrix));
     }
 
-    GLint modelLoc = glGetUniformLocation(shader.shaderProgram, "model");
+    if (movingCasters) {
+        // Penguin colony, wings included
+        penguinColony.Draw(shader, (float)glfwGetTime());
+        return;
+    }
 
 	// render scene objects to depth map
     glm::mat4 objectModel = glm::mat4(1.0f);
 
     // Penguin
-    glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(objectModel));
-    for (int i = 1; i < P; i++) {
-        penguin[i].Draw(shader);
+    GLint instancedLoc = glGetUniformLocation(shader.shaderProgram, "instanced");
+    glUniform1i(instancedLoc, 1);
+    for (gps::InstancedModel& instances : penguinInstances) {
+        instances.Draw(shader);
     }
+    glUniform1i(instancedLoc, 0);
 
     // Astronaut
-    glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(objectModel));
-    astronaut.Draw(shader);
-
-    // Tent
-    glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(objectModel));
-    tent.Draw(shader);
-
-    // FirePlace
-    glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(objectModel));
-    firePlace.Draw(shader);
-
-	// Skis
-	glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(objectModel));
-	skis.Draw(shader);
-
-	// Snowboard
-	glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(objectModel));
-	snowboard.Draw(shader);
-
-    // HiPenguin parts
-    glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(objectModel));
-    penguinBody.Draw(shader);
-    penguinWingL.Draw(shader);
-    penguinWingR.Draw(shader);
-
-    float t = glfwGetTime();
-    float wingAngle = sin(t * 4.0f) * glm::radians(30.0f);
-
-    glm::vec3 wingLPivot = glm::vec3(-2068.25f, -884.082f, 5489.76f);
-    glm::mat4 wingLModel = objectModel *
-        glm::translate(glm::mat4(1.0f), wingLPivot) *
-        glm::rotate(glm::mat4(1.0f), wingAngle, glm::vec3(0, 0, 1)) *
-        glm::translate(glm::mat4(1.0f), -wingLPivot);
-
-    glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(wingLModel));
-    penguinWingL.Draw(shader);
-
-    glm::vec3 wingRPivot = glm::vec3(-2008.24f, -877.652f, 5558.12f);
-    glm::mat4 wingRModel = objectModel *
-        glm::translate(glm::mat4(1.0f), wingRPivot) *
-        glm::rotate(glm::mat4(1.0f), -wingAngle, glm::vec3(0, 0, 1)) *
-        glm::translate(glm::mat4(1.0f), -wingRPivot);
-
-    glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(wingRModel));
-    penguinWingR.Draw(shader);
+    propDraws.begin();
+    propDraws.add(astronaut, objectModel, glm::vec3(0.0f));
+    propDraws.submit(shader, false);
 
+    // the baked props, the clusters the light sees
+    glUniformMatrix4fv(glGetUniformLocation(shader.shaderProgram, "model"), 1, GL_FALSE, glm::value_ptr(objectModel));
+    staticProps.DrawDepth(lightSpaceMatrix * objectModel);
 }
 
 void renderMatterhorn(gps::Shader shader) {
@@ -792,11 +1309,12 @@ void renderMatterhorn(gps::Shader shader) {
     glUniform1i(glGetUniformLocation(shader.shaderProgram, "diffuseTexture"), 0);
     glBindTexture(GL_TEXTURE_2D, matterhornTexture);
 
-	// draw matterhorn
-	matterhorn.Draw(shader);
+	// draw matterhorn, the camera taken into its space
+    glm::vec3 camera = glm::vec3(glm::inverse(model) * glm::vec4(myCamera.getCameraPosition(), 1.0f));
+    matterhornMeshlets.Draw(shader, projection * view * model, camera, PLAIN_MATERIAL, matterhornTexture);
 }
 
-void renderMatterhornParts(gps::Shader shader) {
+void renderTerrain(gps::Shader shader) {
 	// select active shader program
 	shader.useShaderProgram();
 
@@ -812,14 +1330,23 @@ void renderMatterhornParts(gps::Shader shader) {
     glUniform1f(shininessLoc, 32.0f);          
     glUniform1f(specStrengthLoc, 0.3f);     
 
-	for (int i = 1; i < N; i++) {
-		glActiveTexture(GL_TEXTURE0);
-		glUniform1i(glGetUniformLocation(shader.shaderProgram, "diffuseTexture"), 0);
-		glBindTexture(GL_TEXTURE_2D, mTexture[i]);
+    // the nodes are picked in the terrain's own space (the scene may be rotated)
+    glm::vec3 terrainCamera = glm::vec3(glm::inverse(model) * glm::vec4(myCamera.getCameraPosition(), 1.0f));
+    terrainRenderer.select(projection * view * model, terrainCamera);
 
-		// draw matterhorn part
-		m[i].Draw(shader);
-	}
+    // the pages the terrain reads, small, for the next frames
+    terrainTextures.beginFeedback(shader);
+    terrainRenderer.Draw(shader, instanceStream);
+    terrainTextures.endFeedback(shader);
+    glViewport(0, 0, retina_width, retina_height);
+
+    terrainRenderer.Draw(shader, instanceStream);
+}
+
+void renderScatter(gps::Shader shader) {
+    // culled in the terrain's space, the camera taken there
+    glm::vec3 terrainCamera = glm::vec3(glm::inverse(model) * glm::vec4(myCamera.getCameraPosition(), 1.0f));
+    scatter.Draw(instanceCullShader, shader, projection * view, model, terrainCamera);
 }
 
 void renderSkyDome(gps::Shader shader) {
@@ -857,16 +1384,25 @@ void renderPenguins(gps::Shader shader) {
     glUniform1f(shininessLoc, 8.0f);          // smooth
     glUniform1f(specStrengthLoc, 0.15f);      // subtil
 
-    for (int i = 1; i < P; i++) {
-        glActiveTexture(GL_TEXTURE0);
-        glUniform1i(glGetUniformLocation(shader.shaderProgram, "diffuseTexture"), 0);
-        glBindTexture(GL_TEXTURE_2D, penguinTexture);
-        penguin[i].Draw(shader);
+    glActiveTexture(GL_TEXTURE0);
+    glUniform1i(glGetUniformLocation(shader.shaderProgram, "diffuseTexture"), 0);
+    glBindTexture(GL_TEXTURE_2D, penguinTexture);
+
+    // the model matrices come from the instance buffer
+    GLint instancedLoc = glGetUniformLocation(shader.shaderProgram, "instanced");
+    glUniform1i(instancedLoc, 1);
+    for (gps::InstancedModel& instances : penguinInstances) {
+        instances.Draw(shader);
     }
+    glUniform1i(instancedLoc, 0);
 	
 }
 
-void renderHiPenguin(gps::Shader shader) {
+void renderPenguinColony(gps::Shader shader) {
+    // the penguins in the view, before the light shader takes over
+    if (cullColonyOnGpu) {
+        penguinColony.cull(colonyCuller, instanceCullShader, projection * view);
+    }
     shader.useShaderProgram();
 
     // lighting 
@@ -887,45 +1423,8 @@ void renderHiPenguin(gps::Shader shader) {
     glUniform1i(glGetUniformLocation(shader.shaderProgram, "diffuseTexture"), 0);
     glBindTexture(GL_TEXTURE_2D, penguinTexture);
 
-	// time for animation
-    float t = glfwGetTime();
-    float wingAngle = sin(t * 4.0f) * glm::radians(30.0f);
-
-    
-    glm::vec3 penguinPos = glm::vec3(0.0f, 0.0f, 0.0f);
-
-    // ===== BODY =====
-    glm::mat4 bodyModel = glm::translate(glm::mat4(1.0f), penguinPos);
-
-    glUniformMatrix4fv(modelLocL, 1, GL_FALSE, glm::value_ptr(bodyModel));
-    normalMatrix = glm::mat3(glm::transpose(glm::inverse(view * bodyModel)));
-    glUniformMatrix3fv(normalMatrixLocL, 1, GL_FALSE, glm::value_ptr(normalMatrix));
-    penguinBody.Draw(shader);
-
-    // ===== WING LEFT =====
-    glm::vec3 wingLPivot = glm::vec3(-2068.25f, -884.082f, 5489.76f);
-    glm::mat4 wingLModel = bodyModel *
-		glm::translate(glm::mat4(1.0f), wingLPivot) *   // move pivot to origin
-        glm::rotate(glm::mat4(1.0f), wingAngle, glm::vec3(0, 0, 1)) *  // rotate
-		glm::translate(glm::mat4(1.0f), -wingLPivot);  // move back
-
-    glUniformMatrix4fv(modelLocL, 1, GL_FALSE, glm::value_ptr(wingLModel));
-    normalMatrix = glm::mat3(glm::transpose(glm::inverse(view * wingLModel)));
-    glUniformMatrix3fv(normalMatrixLocL, 1, GL_FALSE, glm::value_ptr(normalMatrix));
-    penguinWingL.Draw(shader);
-
-    // ===== WING RIGHT =====
-    glm::vec3 wingRPivot = glm::vec3(-2008.24f, -877.652f, 5558.12f);
-
-    glm::mat4 wingRModel = bodyModel *
-        glm::translate(glm::mat4(1.0f), wingRPivot) *
-        glm::rotate(glm::mat4(1.0f), -wingAngle, glm::vec3(0, 0, 1)) *
-        glm::translate(glm::mat4(1.0f), -wingRPivot);
-
-    glUniformMatrix4fv(modelLocL, 1, GL_FALSE, glm::value_ptr(wingRModel));
-    normalMatrix = glm::mat3(glm::transpose(glm::inverse(view * wingRModel)));
-    glUniformMatrix3fv(normalMatrixLocL, 1, GL_FALSE, glm::value_ptr(normalMatrix));
-    penguinWingR.Draw(shader);
+    // bodies and flapping wings of every penguin, animated in the vertex shader
+    penguinColony.Draw(shader, (float)glfwGetTime(), cullColonyOnGpu ? &colonyCuller : nullptr);
 }
 
 //void renderTent(gps::Shader shader) {
@@ -1037,57 +1536,43 @@ void renderHiPenguin(gps::Shader shader) {
 
 void renderObjects(gps::Shader shader) {
     shader.useShaderProgram();
-    glActiveTexture(GL_TEXTURE0);
-
-    GLint objLightLoc = glGetUniformLocation(shader.shaderProgram, "objectLightMultiplier");
-    GLint shininessLoc = glGetUniformLocation(shader.shaderProgram, "shininess");
-    GLint specStrengthLoc = glGetUniformLocation(shader.shaderProgram, "specularStrength");
 
-    glUniform1f(objLightLoc, 1.0f);
-    glUniform1f(shininessLoc, 32.0f);
-    glUniform1f(specStrengthLoc, 0.3f);
-
-    // Tent
-    glBindTexture(GL_TEXTURE_2D, tentTexture);
-    tent.Draw(shader);
-
-    // Snowboard
-    glBindTexture(GL_TEXTURE_2D, snowboardTexture);
-    snowboard.Draw(shader);
-
-    // Astronaut
-    glBindTexture(GL_TEXTURE_2D, astronautTexture);
-    astronaut.Draw(shader);
+    // the camera taken into the props' space
+    glm::vec3 camera = glm::vec3(glm::inverse(model) * glm::vec4(myCamera.getCameraPosition(), 1.0f));
+    astronautMeshlets.Draw(shader, projection * view * model, camera, PLAIN_MATERIAL, astronautTexture);
 
-    // FirePlace 
-    glBindTexture(GL_TEXTURE_2D, fireTexture);
-    firePlace.Draw(shader);
-
-    // Backpack
-    glBindTexture(GL_TEXTURE_2D, backpackTexture);
-    backpack.Draw(shader);
+    // the rest baked, in the props' space: model still places them
+    staticProps.Draw(shader, projection * view * model);
+}
 
-	// Skis and Goggles share same material properties except specStrength
-    glUniform1f(objLightLoc, 2.0f);
-    glUniform1f(shininessLoc, 64.0f);
-    glUniform1f(specStrengthLoc, 0.6f);
+// draws into the current particle target, after the fire
+void renderSnowfall(glm::vec3 cameraPos) {
 
-    // Skis
-    glBindTexture(GL_TEXTURE_2D, skisTexture);
-    skis.Draw(shader);
+    snowShader.useShaderProgram();
+    glUniformMatrix4fv(glGetUniformLocation(snowShader.shaderProgram, "view"), 1, GL_FALSE, glm::value_ptr(view));
+    glUniformMatrix4fv(glGetUniformLocation(snowShader.shaderProgram, "projection"), 1, GL_FALSE, glm::value_ptr(projection));
+    glUniform1i(glGetUniformLocation(snowShader.shaderProgram, "oitOn"), useOIT);
 
-    // Goggles
-    glUniform1f(specStrengthLoc, 0.3f);
-    glBindTexture(GL_TEXTURE_2D, gogglesTexture);
-    goggles.Draw(shader);
+    if (!useOIT) {
+        // white flakes must not add up like the fire
+        glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+    }
 
+    float viewportHeight = useOIT ? (float)retina_height / oitBuffer.getDivisor() : (float)retina_height;
+    snowSystem.draw(snowShader, cameraPos, viewportHeight);
 }
 
 void renderParticles(gps::Shader& shader, glm::vec3 firePos, GLuint particleVAO) {
-    glEnable(GL_BLEND);
-    glBlendFunc(GL_SRC_ALPHA, GL_ONE);  // Additive blending pentru foc
-    glDepthMask(GL_FALSE);  // Nu scrie er
-    glDisable(GL_CULL_FACE);
+    if (useOIT) {
+        // order independent: into the (low resolution) accumulation / revealage targets
+        oitBuffer.begin(oitDepthDownsampleShader);
+    }
+    else {
+        glEnable(GL_BLEND);
+        glBlendFunc(GL_SRC_ALPHA, GL_ONE);  // Additive blending pentru foc
+        glDepthMask(GL_FALSE);  // Nu scrie er
+        glDisable(GL_CULL_FACE);
+    }
 
     shader.useShaderProgram();
 
@@ -1101,65 +1586,70 @@ void renderParticles(gps::Shader& shader, glm::vec3 firePos, GLuint particleVAO)
     glUniformMatrix4fv(viewLoc, 1, GL_FALSE, glm::value_ptr(view));
     glUniformMatrix4fv(projLoc, 1, GL_FALSE, glm::value_ptr(projection));
     glUniform3fv(camPosLoc, 1, glm::value_ptr(cameraPos));
+    glUniform1i(glGetUniformLocation(shader.shaderProgram, "oitOn"), useOIT);
+    glUniform1i(glGetUniformLocation(shader.shaderProgram, "softParticlesOn"), useOIT);
 
-    struct ParticleDistance {
-        int index;
-        float distance;
-    };
-
-    std::vector<ParticleDistance> distances;
-    distances.reserve(MAX_PARTICLES);
-
-    for (int i = 0; i < MAX_PARTICLES; i++) {
-        if (particles[i].life > 0.0f) {
-            float dist = glm::length(cameraPos - particles[i].pos);
-            distances.push_back({ i, dist });
-        }
+    if (useOIT) {
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_2D, oitBuffer.getLinearDepthTexture());
+        glUniform1i(glGetUniformLocation(shader.shaderProgram, "sceneLinearDepth"), 0);
+        glUniform1f(glGetUniformLocation(shader.shaderProgram, "softDistance"), SOFT_PARTICLE_DISTANCE);
     }
 
-    // Sortare: cel mai departe primul
-    std::sort(distances.begin(), distances.end(),
-        [](const ParticleDistance& a, const ParticleDistance& b) {
-            return a.distance > b.distance;
-        });
+    if (useGpuParticles) {
+        // the simulated buffer is drawn as it is, no readback and no sort
+        gpuParticles.draw();
+    }
+    else {
+        // only the emitters in the frustum
+        particleEmitters.getVisiblePools(visibleParticlePools);
+        gps::ParticlePool** pools = visibleParticlePools.data();
+        int poolCount = (int)visibleParticlePools.size();
+
+        int numParticles = 0;
+        for (int p = 0; p < poolCount; p++) {
+            numParticles += pools[p]->getCount();
+        }
 
-    std::vector<float> instanceData;
-    instanceData.reserve(distances.size() * 9);
+        // back to front only without OIT, sorted into persistent scratch buffers
+        if (!useOIT) {
+            particleSorter.sort(pools, poolCount, cameraPos);
+        }
 
-    for (const auto& pd : distances) {
-        int i = pd.index;
-        const Particle& p = particles[i];
+        if (numParticles > 0) {
+            // the instances are packed straight into this frame's region of the ring,
+            // no implicit sync with the draws of the previous frames
+            GLsizeiptr bytes = numParticles * gps::ParticleSorter::FLOATS_PER_INSTANCE * sizeof(float);
+            GLintptr offset = 0;
+            float* instanceData = (float*)instanceStream.map(bytes, offset);
 
-        // Position (3 floats)
-        instanceData.push_back(p.pos.x);
-        instanceData.push_back(p.pos.y);
-        instanceData.push_back(p.pos.z);
+            if (instanceData != nullptr) {
+                if (useOIT) {
+                    gps::ParticleSorter::packUnsorted(pools, poolCount, instanceData);
+                }
+                else {
+                    particleSorter.pack(instanceData);
+                }
+                instanceStream.unmap();
 
-        // Color (4 floats)
-        instanceData.push_back(p.color.r);
-        instanceData.push_back(p.color.g);
-        instanceData.push_back(p.color.b);
-        instanceData.push_back(p.color.a);
+                glBindVertexArray(particleVAO);
+                glBindBuffer(GL_ARRAY_BUFFER, instanceStream.getBuffer());
+                setParticleInstanceAttributes(offset);
 
-        // Size (1 float)
-        instanceData.push_back(p.size);
+                // Instanced rendering
+                glDrawElementsInstanced(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0, numParticles);
 
-        // Life (1 float)
-        instanceData.push_back(p.life / p.maxLife);
+                glBindVertexArray(0);
+            }
+        }
     }
 
-    if (!instanceData.empty()) {
-        glBindVertexArray(particleVAO);
-        glBindBuffer(GL_ARRAY_BUFFER, particleVBO);
-        glBufferSubData(GL_ARRAY_BUFFER, 0,
-            instanceData.size() * sizeof(float),
-            instanceData.data());
-
-        // Instanced rendering
-        int numParticles = instanceData.size() / 9;
-        glDrawElementsInstanced(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0, numParticles);
+    if (renderSnow) {
+        renderSnowfall(cameraPos);
+    }
 
-        glBindVertexArray(0);
+    if (useOIT) {
+        oitBuffer.composite(oitCompositeShader);
     }
 
     // Cleanup
@@ -1314,33 +1804,134 @@ void updateParticles(float deltaTime, glm::vec3 firePos) {
     }
 }
 
-bool checkCameraCollision(const CameraCollider& cam, const Penguin& penguin) {
-	float distance = glm::length(cam.position - penguin.position);
-	return distance < (cam.radius + penguin.radius);
-}
+void benchmarkParticles() {
 
-void resolveCameraCollision(CameraCollider& cam, const Penguin& penguin) {
-	//vect from penguin to camera
-    glm::vec3 direction = cam.position - penguin.position;
-    float distance = glm::length(direction);
+    const int FRAMES = 2000;
+    const float dt = 1.0f / 60.0f;
 
-	// overlap of spheres
-    float overlap = (cam.radius + penguin.radius) - distance;
+    // ===== LEGACY AoS =====
+    for (int i = 0; i < MAX_PARTICLES; i++) {
+        particles[i].life = 0.0f;
+    }
 
-	if (overlap > 0.0f) {  // if there's a collision
-		if (distance > 0.0f) {  // camera not exactly at penguin position
-			// normalize direction
-            glm::vec3 pushDirection = glm::normalize(direction);
+    // warm up to the steady state before timing
+    for (int i = 0; i < 600; i++) {
+        updateParticles(dt, firePos);
+    }
+
+    auto start = std::chrono::high_resolution_clock::now();
+    for (int i = 0; i < FRAMES; i++) {
+        updateParticles(dt, firePos);
+    }
+    auto end = std::chrono::high_resolution_clock::now();
+    double legacyUs = std::chrono::duration<double, std::micro>(end - start).count() / FRAMES;
 
-			// push camera out of collision
-            glm::vec3 correction = pushDirection * overlap;
-            cam.position += correction;
+    int legacyAlive = 0;
+    for (int i = 0; i < MAX_PARTICLES; i++) {
+        if (particles[i].life > 0.0f) {
+            legacyAlive++;
         }
-        else {
-			// camera exactly at penguin position
-			// push camera along x axis
-            cam.position += glm::vec3(cam.radius + penguin.radius, 0.0f, 0.0f);
+    }
+
+    // ===== SoA POOLS =====
+    gps::ParticlePool benchFire;
+    gps::ParticlePool benchSmoke;
+    benchFire.init(gps::PARTICLE_FIRE, FIRE_POOL_CAPACITY, 7u);
+    benchSmoke.init(gps::PARTICLE_SMOKE, SMOKE_POOL_CAPACITY, 8u);
+
+    float fireAccumulator = 0.0f;
+    float smokeAccumulator = 0.0f;
+    auto poolFrame = [&]() {
+        fireAccumulator += dt * FIRE_SPAWN_RATE;
+        smokeAccumulator += dt * SMOKE_SPAWN_RATE;
+        int fireSpawn = (int)fireAccumulator;
+        int smokeSpawn = (int)smokeAccumulator;
+        fireAccumulator -= fireSpawn;
+        smokeAccumulator -= smokeSpawn;
+
+        benchFire.update(dt);
+        benchSmoke.update(dt);
+        benchFire.spawn(fireSpawn, firePos);
+        benchSmoke.spawn(smokeSpawn, firePos);
+    };
+
+    for (int i = 0; i < 600; i++) {
+        poolFrame();
+    }
+
+    start = std::chrono::high_resolution_clock::now();
+    for (int i = 0; i < FRAMES; i++) {
+        poolFrame();
+    }
+    end = std::chrono::high_resolution_clock::now();
+    double poolUs = std::chrono::duration<double, std::micro>(end - start).count() / FRAMES;
+
+    // ===== KERNEL ONLY, LARGE POOL =====
+    // a full pool of long lived smoke, no deaths: measures the update throughput alone
+    const int LARGE = 1 << 18;
+    gps::ParticlePool benchLarge;
+    benchLarge.init(gps::PARTICLE_SMOKE, LARGE, 9u);
+    benchLarge.spawn(LARGE, firePos);
+
+    start = std::chrono::high_resolution_clock::now();
+    for (int i = 0; i < 60; i++) {
+        benchLarge.update(0.001f);
+    }
+    end = std::chrono::high_resolution_clock::now();
+    double largeNs = std::chrono::duration<double, std::nano>(end - start).count() / (60.0 * LARGE);
+
+    std::cout << "Particle update benchmark (" << FRAMES << " frames)" << std::endl;
+    std::cout << "  legacy AoS: " << legacyUs << " us / frame, " << legacyAlive << " alive" << std::endl;
+    std::cout << "  SoA pools:  " << poolUs << " us / frame, "
+        << benchFire.getCount() + benchSmoke.getCount() << " alive" << std::endl;
+    std::cout << "  SoA kernel: " << largeNs << " ns / particle (" << LARGE << " particles)" << std::endl;
+
+    // ===== SORT + PACK, 100k PARTICLES =====
+    // spread over a 4000 unit box so the keys use the whole depth range
+    const int SORTED = 100000;
+    gps::ParticlePool benchSort;
+    benchSort.init(gps::PARTICLE_SMOKE, SORTED, 10u);
+    benchSort.spawn(SORTED, firePos);
+    gps::ParticleRandom offsets;
+    offsets.seed(11u);
+    // fill() stores whole registers, 32 byte aligned like the pool's streams
+    std::vector<float> offsetStorage(3 * SORTED + gps::ParticleRandom::LANES + 8);
+    float* offset = (float*)(((uintptr_t)offsetStorage.data() + 31) & ~(uintptr_t)31);
+    offsets.fill(offset, 3 * SORTED);
+    for (int i = 0; i < SORTED; i++) {
+        benchSort.posX[i] += (offset[3 * i] - 0.5f) * 4000.0f;
+        benchSort.posY[i] += (offset[3 * i + 1] - 0.5f) * 4000.0f;
+        benchSort.posZ[i] += (offset[3 * i + 2] - 0.5f) * 4000.0f;
+    }
+
+    gps::ParticlePool* sortPools[1] = { &benchSort };
+    std::vector<float> packed(SORTED * gps::ParticleSorter::FLOATS_PER_INSTANCE);
+    glm::vec3 eye = myCamera.getCameraPosition();
+
+    for (int coherent = 0; coherent < 2; coherent++) {
+
+        gps::ParticleSorter sorter;
+        sorter.setTemporalCoherence(coherent == 1);
+        sorter.sort(sortPools, 1, eye); // first call sizes the scratch buffers
+
+        const int SORTS = 100;
+        start = std::chrono::high_resolution_clock::now();
+        for (int i = 0; i < SORTS; i++) {
+            // slow camera motion, like a walking player
+            sorter.sort(sortPools, 1, eye + glm::vec3((float)i, 0.0f, 0.0f));
+            sorter.pack(packed.data());
         }
+        end = std::chrono::high_resolution_clock::now();
+        double sortMs = std::chrono::duration<double, std::milli>(end - start).count() / SORTS;
+
+        std::cout << "  sort + pack (" << (coherent ? "coherent" : "radix") << "): " << sortMs
+            << " ms / frame (" << SORTED << " particles"
+            << (coherent && !sorter.lastSortWasIncremental() ? ", fell back to radix" : "") << ")" << std::endl;
+    }
+
+    // the benchmark consumed the legacy array, leave it empty again
+    for (int i = 0; i < MAX_PARTICLES; i++) {
+        particles[i].life = 0.0f;
     }
 }
 
@@ -1348,23 +1939,51 @@ void renderScene() {
 	
 
     if (renderShadows) {
-        // ===== SHADOW PASS - render depth map =====
+        // ===== SHADOW PASS - render the stale atlas tiles, within the budget =====
         calculateLightSpaceMatrix();
 
-        glViewport(0, 0, SHADOW_WIDTH, SHADOW_HEIGHT);
-        glBindFramebuffer(GL_FRAMEBUFFER, shadowMapFBO);
-        glClear(GL_DEPTH_BUFFER_BIT);
+        // the static casters are redrawn when the sun moves; the hi penguin
+        // wings move every frame, so their tile is always stale
+        shadowAtlas.setLight(sunShadowLight, lightSpaceMatrix, 1.0f, false);
+        shadowAtlas.setLight(sunMovingShadowLight, lightSpaceMatrix, 1.0f, true);
+        shadowAtlas.beginFrame(SHADOW_UPDATES_PER_FRAME);
 
-		// render scene from light's point of view
-        depthMapShader.useShaderProgram();
-        renderDepthMap(depthMapShader, false);
+        for (int light : shadowAtlas.getLightsToUpdate()) {
+            shadowAtlas.beginTileRender(light);
 
-        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+            // render scene from light's point of view
+            if (light == sunShadowLight || light == sunMovingShadowLight) {
+                depthMapShader.useShaderProgram();
+                renderDepthMap(depthMapShader, false, light == sunMovingShadowLight);
+            }
+
+            shadowAtlas.endTileRender();
+        }
 
 		// reset viewport
         glViewport(0, 0, retina_width, retina_height);
     }
 
+    if (renderPointShadows) {
+        // ===== POINT SHADOW PASS - only the faces whose casters moved =====
+        static std::vector<gps::ShadowCaster> pointCasters;
+        collectPointShadowCasters(pointCasters);
+
+        // the colony and the crowd in one instanced draw, only the penguins the
+        // light reaches: a box around its sphere, then the distance to it
+        glm::vec3 pointLightPos = pointShadowMap.getLightPosition();
+        float reach = pointShadowMap.getFarPlane();
+        glm::mat4 reachBox = glm::ortho(-reach, reach, -reach, reach, -reach, reach) * glm::translate(glm::mat4(1.0f), -pointLightPos);
+        pointShadowCuller.setDistanceRange(pointLightPos, 0.0f, reach);
+        penguinColony.cull(pointShadowCuller, instanceCullShader, reachBox);
+        static std::vector<gps::AnimatedShadowCaster> animatedCasters;
+        animatedCasters.assign(1, { &penguinColony, &pointShadowCuller, (float)glfwGetTime() });
+
+        if (pointShadowMap.update(pointShadowShader, pointCasters, animatedCasters, &staticProps) > 0) {
+            glViewport(0, 0, retina_width, retina_height);
+        }
+    }
+
 
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
@@ -1386,14 +2005,33 @@ void renderScene() {
 
     // Bind shadow map la texture unit 1
     glActiveTexture(GL_TEXTURE1);
-    glBindTexture(GL_TEXTURE_2D, shadowMapTexture);
+    glBindTexture(GL_TEXTURE_2D, shadowAtlas.getTexture());
+
+    // Bind point shadow cubemap la texture unit 2
+    glActiveTexture(GL_TEXTURE2);
+    glBindTexture(GL_TEXTURE_CUBE_MAP, pointShadowMap.getCubemap());
+    glUniform1i(glGetUniformLocation(lightShader.shaderProgram, "pointShadowsOn"), renderPointShadows);
+    glUniform3fv(glGetUniformLocation(lightShader.shaderProgram, "pointLightPosWorld"), 1, glm::value_ptr(pointShadowMap.getLightPosition()));
+    glActiveTexture(GL_TEXTURE0);
 
-    // Trimite lightSpaceMatrix la shader
-    GLint lightSpaceMatrixLoc = glGetUniformLocation(lightShader.shaderProgram, "lightSpaceMatrix");
-    glUniformMatrix4fv(lightSpaceMatrixLoc, 1, GL_FALSE, glm::value_ptr(lightSpaceMatrix));
+    // Trimite lightSpaceMatrix la shader (remapped to the sun's atlas tiles);
+    // a tile not drawn yet gets an empty rectangle, nothing in it is shadowed
+    const char* shadowMatrixNames[2] = { "lightSpaceMatrix", "movingLightSpaceMatrix" };
+    const char* shadowRectNames[2] = { "shadowTileRect", "movingShadowTileRect" };
+    int sunLights[2] = { sunShadowLight, sunMovingShadowLight };
+    for (int i = 0; i < 2; i++) {
+        glm::mat4 sunShadowMatrix = glm::mat4(1.0f);
+        glm::vec4 sunShadowTileRect = glm::vec4(1.0f, 1.0f, 0.0f, 0.0f);
+        if (shadowAtlas.hasTile(sunLights[i])) {
+            sunShadowMatrix = shadowAtlas.getSamplingMatrix(sunLights[i]);
+            sunShadowTileRect = shadowAtlas.getTileRect(sunLights[i]);
+        }
+        glUniformMatrix4fv(glGetUniformLocation(lightShader.shaderProgram, shadowMatrixNames[i]), 1, GL_FALSE, glm::value_ptr(sunShadowMatrix));
+        glUniform4fv(glGetUniformLocation(lightShader.shaderProgram, shadowRectNames[i]), 1, glm::value_ptr(sunShadowTileRect));
+    }
 
     // transfrom light position from world space to view space
-    glm::vec4 lightPosEye = view * glm::vec4(firePos, 1.0f);
+    glm::vec4 lightPosEye = view * glm::vec4(firePos + POINT_LIGHT_OFFSET, 1.0f);
     glUniform3fv(lightPosLoc, 1, glm::value_ptr(glm::vec3(lightPosEye)));
 
     // time for light shader
@@ -1403,6 +2041,7 @@ void renderScene() {
 
     // update model rotation (Matterhorn)
     model = glm::rotate(glm::mat4(1.0f), glm::radians(angle), glm::vec3(0, 1, 0));
+    terrainFromWorld = glm::inverse(model);
     glUniformMatrix4fv(modelLocL, 1, GL_FALSE, glm::value_ptr(model));
 	//renderMatterhorn(myCustomShader);
 
@@ -1415,15 +2054,37 @@ void renderScene() {
     glUniform3fv(lightColorLoc, 1, glm::value_ptr(currentLightColor));
 
 	// render objects
-	renderMatterhornParts(lightShader);
+	renderTerrain(lightShader);
+    if (renderScatterOn) {
+        renderScatter(lightShader);
+    }
 	renderPenguins(lightShader);
     renderObjects(lightShader);
 
-    renderHiPenguin(lightShader);
+    renderPenguinColony(lightShader);
 
 }
 
 void cleanup() {
+    terrainRenderer.Delete();
+    terrainTextures.Delete();
+    scatter.Delete();
+    propTextures.Delete();
+    propDraws.Delete();
+    staticProps.Delete();
+    astronautMeshlets.Delete();
+    matterhornMeshlets.Delete();
+    penguinCrowd.Delete();
+    penguinColony.Delete();
+    colonyCuller.Delete();
+    pointShadowCuller.Delete();
+    for (gps::InstancedModel& instances : penguinInstances) {
+        instances.Delete();
+    }
+    instanceStream.Delete();
+    oitBuffer.Delete();
+    particleEmitters.Delete();
+    snowSystem.Delete();
     myWindow.Delete();
     //cleanup code for your own data
 }
@@ -1442,6 +2103,8 @@ int main(int argc, const char * argv[]) {
 	initModels();
 	initShaders();
 	initShadowMap();
+    oitBuffer.init(retina_width, retina_height, particleResolutionDivisor);
+    oitBuffer.setDepthRange(NEAR_PLANE, FAR_PLANE);
 	initUniforms();
 
 	glCheckError();
@@ -1456,26 +2119,36 @@ int main(int argc, const char * argv[]) {
 		lastFrame = currentFrame;
 
         processMovement();
+        updateCrowdColliders();
 
+        // the camera slides along whatever it runs into on the way, the props then the ground
+        glm::vec3 moved = collisionWorld.moveSphere(cameraCollider.position, myCamera.getCameraPosition(), cameraCollider.radius);
+        cameraCollider.position = terrainMoveSphere(cameraCollider.position, moved, cameraCollider.radius);
+        myCamera.setCameraPosition(cameraCollider.position);
 
-		// update camera collider position
-        cameraCollider.position = myCamera.getCameraPosition(); 
-
-		// check collision with penguins
-        for (auto& penguin : penguins) {
-            if (checkCameraCollision(cameraCollider, penguin)) {
-                // detected collision
-                resolveCameraCollision(cameraCollider, penguin);
-				// update camera position based on collider
-                myCamera.setCameraPosition(cameraCollider.position);
-            }
+        if (useGpuParticles) {
+            gpuParticles.update(particleUpdateShader, deltaTime, firePos);
+        }
+        else {
+            // the LOD and the budgets depend on what the camera sees
+            glm::mat4 viewProjection = projection * myCamera.getViewMatrix();
+            particleEmitters.update(deltaTime, myCamera.getCameraPosition(), viewProjection);
         }
 
-		updateParticles(deltaTime, firePos);
+        snowSystem.update(deltaTime);
+        updatePenguinCrowd(deltaTime);
+        terrainTextures.update();
+        requirePropTextures();
+        propTextures.update();
+        scatter.update(glm::vec3(glm::inverse(model) * glm::vec4(myCamera.getCameraPosition(), 1.0f)));
+
+        instanceStream.beginFrame();
 
 	    renderScene();
 		renderParticles(fireShader, firePos, particleVAO); // render fire particles
 
+        instanceStream.endFrame();
+
         printf("Camerapos = %f %f %f \n", myCamera.getCameraPosition().x, myCamera.getCameraPosition().y, myCamera.getCameraPosition().z);
 
 		glfwPollEvents();
@@ -1,11 +1,78 @@
 #version 410 core
 
 layout(location = 0) in vec3 vertexPosition;
+layout(location = 3) in mat4 instanceModel; // per instance, replaces model in instanced draws
+layout(location = 7) in float vertexPart; // animated parts only
+layout(location = 9) in float drawIndex; // multi-draw only: the draw, through the base instance
 
 uniform mat4 model;
 uniform mat4 lightSpaceMatrix;
+uniform bool instanced;
+uniform bool animatedParts;
+uniform float partTime;
+uniform samplerBuffer partData;
+uniform samplerBuffer instanceData;
+uniform int instanceFirst; // texels before the instances in instanceData
+
+// multi-draw (see MultiDrawRenderer): the transform and material of every draw in a texture buffer
+uniform bool multiDraw;
+uniform bool drawIndirect; // drawIndex is set, else the draw is found from gl_VertexID
+uniform samplerBuffer drawData;
+uniform int drawFirst; // the draws of this call, sorted by first vertex
+uniform int drawCount;
+
+// the last draw of the call starting at or before the vertex
+int multiDrawIndex()
+{
+    if (drawIndirect)
+        return int(drawIndex + 0.5);
+
+    int low = drawFirst;
+    int high = drawFirst + drawCount - 1;
+    while (low < high) {
+        int middle = (low + high + 1) / 2;
+        if (texelFetch(drawData, 5 * middle + 4).w <= float(gl_VertexID))
+            low = middle;
+        else
+            high = middle - 1;
+    }
+    return low;
+}
+
+mat4 drawModelMatrix(int draw)
+{
+    int base = 5 * draw;
+    return mat4(texelFetch(drawData, base), texelFetch(drawData, base + 1),
+        texelFetch(drawData, base + 2), texelFetch(drawData, base + 3));
+}
+
+// animated rigid parts: the instance matrix times the swing of the part around its pivot
+// (see RigidPartModel for the layout of the buffers)
+mat4 partModelMatrix()
+{
+    int part = int(vertexPart + 0.5);
+    vec4 pivot = texelFetch(partData, 2 * part);     // xyz pivot, w amplitude
+    vec4 axis = texelFetch(partData, 2 * part + 1);  // xyz axis, w frequency
+
+    int base = instanceFirst + 5 * gl_InstanceID;
+    mat4 instance = mat4(texelFetch(instanceData, base), texelFetch(instanceData, base + 1),
+        texelFetch(instanceData, base + 2), texelFetch(instanceData, base + 3));
+    float phase = texelFetch(instanceData, base + 4).x;
+
+    // Rodrigues
+    float angle = pivot.w * sin(axis.w * partTime + phase);
+    float c = cos(angle);
+    float s = sin(angle);
+    vec3 a = axis.xyz;
+    mat3 rotation = mat3(c) + s * mat3(0.0, a.z, -a.y, -a.z, 0.0, a.x, a.y, -a.x, 0.0) + (1.0 - c) * outerProduct(a, a);
+
+    mat4 swing = mat4(vec4(rotation[0], 0.0), vec4(rotation[1], 0.0), vec4(rotation[2], 0.0),
+        vec4(pivot.xyz - rotation * pivot.xyz, 1.0));
+    return instance * swing;
+}
 
 void main()
 {
-    gl_Position = lightSpaceMatrix * model * vec4(vertexPosition, 1.0);
+    mat4 modelMatrix = multiDraw ? drawModelMatrix(multiDrawIndex()) : (animatedParts ? partModelMatrix() : (instanced ? instanceModel : model));
+    gl_Position = lightSpaceMatrix * modelMatrix * vec4(vertexPosition, 1.0);
 }
@@ -3,8 +3,25 @@
 in vec4 color;
 in float life;
 in vec2 uv;
+in float viewDepth;
 
-out vec4 fragmentColour;
+layout(location = 0) out vec4 fragmentColour;
+layout(location = 1) out vec4 oitRevealage; // only written to by the OIT targets
+
+uniform bool oitOn;
+
+// soft particles: faded where they cut into the scene (OIT path only, it has the depth)
+uniform bool softParticlesOn;
+uniform sampler2D sceneLinearDepth; // same resolution as the particle target
+uniform float softDistance;
+
+// weighted blended OIT: closer and more opaque layers weigh more
+// (McGuire & Bavoil, eq. 8, with the depth in units of 100 world units)
+float oitWeight(float alpha)
+{
+    float z = viewDepth / 100.0;
+    return alpha * clamp(10.0 / (1e-5 + pow(z / 5.0, 2.0) + pow(z / 200.0, 6.0)), 1e-2, 3e3);
+}
 
 void main()
 {
@@ -28,6 +45,21 @@ void main()
     // Multiplicăm cu alpha-ul din culoare pentru control suplimentar
     alpha *= color.a;
     
+    if (softParticlesOn)
+    {
+        float sceneDepth = texelFetch(sceneLinearDepth, ivec2(gl_FragCoord.xy), 0).r;
+        alpha *= clamp((sceneDepth - viewDepth) / softDistance, 0.0, 1.0);
+    }
+
+    if (oitOn)
+    {
+        // premultiplied color and coverage, weighted; the revealage is multiplied by (1 - alpha)
+        float w = oitWeight(alpha);
+        fragmentColour = vec4(color.rgb * alpha, alpha) * w;
+        oitRevealage = vec4(alpha);
+        return;
+    }
+
     // Output final cu culoarea originală și alpha calculat
     fragmentColour = vec4(color.rgb, alpha);
 }
\ No newline at end of file
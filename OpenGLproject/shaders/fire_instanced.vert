@@ -12,6 +12,7 @@ layout(location = 4) in float particleLife;
 out vec4 color;
 out float life;
 out vec2 uv;
+out float viewDepth; // distance along the view direction, for the OIT weight
 
 uniform mat4 view;
 uniform mat4 projection;
@@ -28,7 +29,9 @@ void main()
                   + cameraRight * vertexPosition.x * particleSize
                   + cameraUp    * vertexPosition.y * particleSize;
     
-    gl_Position = projection * view * vec4(worldPos, 1.0);
+    vec4 viewPos = view * vec4(worldPos, 1.0);
+    viewDepth = -viewPos.z;
+    gl_Position = projection * viewPos;
     
     // Pass data to fragment shader
     color = particleColor;
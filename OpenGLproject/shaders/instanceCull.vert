@@ -0,0 +1,50 @@
+#version 410 core
+
+// Instance culling (see GpuInstanceCuller) - one vertex per instance, tested
+// against the frustum; the geometry shader keeps the visible ones
+
+layout(location = 0) in vec4 inColumn0; // model matrix
+layout(location = 1) in vec4 inColumn1;
+layout(location = 2) in vec4 inColumn2;
+layout(location = 3) in vec4 inColumn3;
+layout(location = 4) in vec4 inExtra;   // whatever the drawing shader reads after the matrix
+
+out vec4 column0;
+out vec4 column1;
+out vec4 column2;
+out vec4 column3;
+out vec4 extra;
+out float visible;
+
+uniform vec4 frustumPlanes[6]; // world space, inside when dot(plane.xyz, p) + plane.w >= 0
+uniform vec4 bounds;           // bounding sphere in the model's space: center, radius
+uniform vec3 cullCamera;
+uniform vec2 distanceRange;    // kept from x to y away from cullCamera, y = 0: any distance
+
+void main()
+{
+    column0 = inColumn0;
+    column1 = inColumn1;
+    column2 = inColumn2;
+    column3 = inColumn3;
+    extra = inExtra;
+
+    mat4 modelMatrix = mat4(inColumn0, inColumn1, inColumn2, inColumn3);
+    vec3 center = (modelMatrix * vec4(bounds.xyz, 1.0)).xyz;
+    float scale = max(length(inColumn0.xyz), max(length(inColumn1.xyz), length(inColumn2.xyz)));
+    float radius = bounds.w * scale;
+
+    // an all zero matrix is a hole in the set
+    visible = inColumn3.w == 0.0 ? 0.0 : 1.0;
+
+    float distanceToCamera = distance(center, cullCamera);
+    if (distanceRange.y > 0.0 && (distanceToCamera < distanceRange.x || distanceToCamera >= distanceRange.y))
+        visible = 0.0;
+
+    for (int i = 0; i < 6; ++i)
+    {
+        vec4 plane = frustumPlanes[i];
+        if (dot(plane.xyz, center) + plane.w < -radius * length(plane.xyz))
+            visible = 0.0;
+    }
+}
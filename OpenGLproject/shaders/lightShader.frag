@@ -4,6 +4,10 @@ in vec2 passTexture;
 in vec3 normalEye;
 in vec3 fragPosEye;
 in vec4 fragPosLightSpace;
+in vec4 fragPosMovingLightSpace;
+in vec3 fragPosWorld;
+in vec2 passTerrainPosition;
+flat in vec3 passMaterial;
 
 out vec4 fragmentColour;
 
@@ -16,6 +20,23 @@ uniform sampler2D diffuseTexture;
 uniform float objectLightMultiplier;
 uniform float shininess;
 uniform float specularStrength;
+uniform bool multiDraw; // the material comes with the draw (passMaterial)
+
+// terrain: the tiles' images through the virtual texture (see VirtualTexture)
+uniform bool terrain;
+uniform usampler2D terrainOwners; // tile of every height sample
+uniform vec2 terrainOrigin;
+uniform float terrainSpacing;
+uniform vec2 terrainSize;
+uniform vec4 terrainTileRects[64]; // min x, min z, max x, max z
+uniform sampler2D terrainPages; // the physical cache
+uniform usampler2DArray terrainPageTable; // layer = image, mip = level: slot x, slot y, level there, 255 if any
+uniform vec4 terrainImages[64]; // width, height, levels (0 without an image)
+uniform bool terrainFeedback; // write the page wanted instead of a colour
+uniform float terrainLodBias;
+
+const float PAGE_SIZE = 128.0; // VirtualTexture::PAGE_SIZE
+const float PAGE_BORDER = 4.0; // VirtualTexture::PAGE_BORDER
 
 // point light 
 uniform vec3 lightPosEye;
@@ -23,8 +44,17 @@ uniform vec3 pointLightColor;
 
 uniform float time;
 
-// shadow map
+// shadow map (atlas) and the uv rectangles of the sun's tiles: what never
+// moves and the animated penguins (min above max when the tile is empty)
 uniform sampler2D shadowMap;
+uniform vec4 shadowTileRect;
+uniform vec4 movingShadowTileRect;
+
+// point light shadow cubemap (distance to light / far plane, hardware compare)
+uniform samplerCubeShadow pointShadowMap;
+uniform vec3 pointLightPosWorld;
+uniform float pointFarPlane;
+uniform bool pointShadowsOn;
 
 // attenuation for point light
 float constant = 1.0f;
@@ -32,7 +62,7 @@ float linear = 0.0001f;
 float quadratic = 0.0000025f;
 
 // ===== SHADOW CALCULATION =====
-float ShadowCalculation(vec4 fragPosLightSpace, vec3 normal, vec3 lightDir)
+float ShadowCalculation(vec4 fragPosLightSpace, vec4 shadowTileRect, vec3 normal, vec3 lightDir)
 {
     // Perspective divide
     vec3 projCoords = fragPosLightSpace.xyz / fragPosLightSpace.w;
@@ -44,6 +74,10 @@ float ShadowCalculation(vec4 fragPosLightSpace, vec3 normal, vec3 lightDir)
     if(projCoords.z > 1.0)
         return 0.0;
 
+    // Outside the light's atlas tile → no shadow
+    if(any(lessThan(projCoords.xy, shadowTileRect.xy)) || any(greaterThan(projCoords.xy, shadowTileRect.zw)))
+        return 0.0;
+
     // Depth of current fragment from light's perspective
     float currentDepth = projCoords.z;
 
@@ -58,12 +92,16 @@ float ShadowCalculation(vec4 fragPosLightSpace, vec3 normal, vec3 lightDir)
     //Size of a texel in shadow map
     vec2 texelSize = 1.0 / textureSize(shadowMap, 0);
 
+    //PCF taps must not read the neighbouring tiles
+    vec2 tapMin = shadowTileRect.xy + 0.5 * texelSize;
+    vec2 tapMax = shadowTileRect.zw - 0.5 * texelSize;
+
     //PCF 5x5 kernel for soft shadows
     for(int x = -2; x <= 2; ++x)
     {
        for(int y = -2; y <= 2; ++y)
        {
-           float pcfDepth = texture(shadowMap, projCoords.xy + vec2(x, y) * texelSize).r;
+           float pcfDepth = texture(shadowMap, clamp(projCoords.xy + vec2(x, y) * texelSize, tapMin, tapMax)).r;
            shadow += currentDepth - bias > pcfDepth ? 1.0 : 0.0;
        }
    }
@@ -73,9 +111,109 @@ float ShadowCalculation(vec4 fragPosLightSpace, vec3 normal, vec3 lightDir)
     return shadow;
 }
 
+float PointShadowCalculation(vec3 normal, vec3 lightDir)
+{
+    if (!pointShadowsOn)
+        return 0.0;
+
+    vec3 fragToLight = fragPosWorld - pointLightPosWorld;
+    float currentDepth = length(fragToLight) / pointFarPlane;
+
+    if (currentDepth > 1.0)
+        return 0.0;
+
+    // slope scaled bias, in [0,1] distance units
+    float bias = max(0.004 * (1.0 - dot(normal, lightDir)), 0.001);
+
+    // single tap, the LINEAR compare filter does a 2x2 PCF
+    return 1.0 - texture(pointShadowMap, vec4(fragToLight, currentDepth - bias));
+}
+
+// ===== TERRAIN TEXTURE =====
+// the tile under the fragment, where in its image and which level; false without an image
+bool TerrainTexel(out int tile, out vec2 uv, out float lod)
+{
+    vec2 position = passTerrainPosition;
+    tile = int(texture(terrainOwners, ((position - terrainOrigin) / terrainSpacing + 0.5) / terrainSize).r);
+    vec4 rect = terrainTileRects[tile];
+    vec4 image = terrainImages[tile];
+
+    // the image spans the tile's bounds, v from max z down
+    vec2 scale = vec2(1.0, -1.0) / (rect.zw - rect.xy);
+    uv = clamp(vec2(0.0, 1.0) + (position - rect.xy) * scale, 0.0, 1.0);
+
+    // texels per pixel from the tile's own mapping, the owner changing between two pixels does not count
+    vec2 dx = dFdx(position) * scale * image.xy;
+    vec2 dy = dFdy(position) * scale * image.xy;
+    lod = 0.5 * log2(max(max(dot(dx, dx), dot(dy, dy)), 1e-8)) + terrainLodBias;
+    lod = clamp(lod, 0.0, max(image.z - 1.0, 0.0));
+    return image.z > 0.0;
+}
+
+vec2 VirtualLevelSize(int image, int level)
+{
+    return max(floor(terrainImages[image].xy / exp2(float(level))), 1.0);
+}
+
+ivec2 VirtualPage(int image, vec2 uv, int level)
+{
+    vec2 size = VirtualLevelSize(image, level);
+    return ivec2(min(uv * size, size - 0.5) / PAGE_SIZE);
+}
+
+vec3 VirtualSample(int image, vec2 uv, int level)
+{
+    ivec2 page = VirtualPage(image, uv, level);
+    uvec4 entry = texelFetch(terrainPageTable, ivec3(page, image), level);
+    if (entry.a == 0u)
+        return vec3(0.0);
+
+    // the page there may be a coarser one, the one over this page
+    int resident = int(entry.z);
+    vec2 texel = uv * VirtualLevelSize(image, resident) - vec2(page >> (resident - level)) * PAGE_SIZE;
+    texel = clamp(texel, 1.0 - PAGE_BORDER, PAGE_SIZE + PAGE_BORDER - 1.0);
+    vec2 coord = (vec2(entry.xy) * (PAGE_SIZE + 2.0 * PAGE_BORDER) + PAGE_BORDER + texel) / vec2(textureSize(terrainPages, 0));
+    return textureLod(terrainPages, coord, 0.0).rgb;
+}
+
+vec3 TerrainColour()
+{
+    int tile;
+    vec2 uv;
+    float lod;
+    if (!TerrainTexel(tile, uv, lod))
+        return vec3(0.0);
+
+    // trilinear between the two levels
+    int level = int(lod);
+    int next = min(level + 1, int(terrainImages[tile].z) - 1);
+    return mix(VirtualSample(tile, uv, level), VirtualSample(tile, uv, next), fract(lod));
+}
+
+// R image, G page x, B page y, A level
+vec4 TerrainFeedback()
+{
+    int tile;
+    vec2 uv;
+    float lod;
+    if (!TerrainTexel(tile, uv, lod))
+        return vec4(1.0);
+
+    int level = int(lod);
+    ivec2 page = VirtualPage(tile, uv, level);
+    return vec4(float(tile), float(page.x), float(page.y), float(level)) / 255.0;
+}
 
 void main()
 {
+    if (terrainFeedback) {
+        fragmentColour = TerrainFeedback();
+        return;
+    }
+
+    float lightMultiplier = multiDraw ? passMaterial.x : objectLightMultiplier;
+    float materialShininess = multiDraw ? passMaterial.y : shininess;
+    float materialSpecular = multiDraw ? passMaterial.z : specularStrength;
 
     vec3 ambient = 0.2 * lightColor; // minimal light everywhere
     
@@ -87,13 +225,14 @@ void main()
     float diff = max(dot(N, L), 0.0);
     vec3 diffuse = diff * lightColor;
     
-    float spec = pow(max(dot(V, R), 0.0), shininess); 
-    vec3 specular = specularStrength * spec * lightColor;
+    float spec = pow(max(dot(V, R), 0.0), materialShininess); 
+    vec3 specular = materialSpecular * spec * lightColor;
     
-    vec3 textColor = texture(diffuseTexture, passTexture).rgb;
+    vec3 textColor = terrain ? TerrainColour() : texture(diffuseTexture, passTexture).rgb;
 
     // shadow calculation
-    float shadow = ShadowCalculation(fragPosLightSpace, N, L);
+    float shadow = max(ShadowCalculation(fragPosLightSpace, shadowTileRect, N, L),
+                       ShadowCalculation(fragPosMovingLightSpace, movingShadowTileRect, N, L));
 
     //point light
 
@@ -126,19 +265,21 @@ void main()
     vec3 diffuse_point = diff_point * pointLightColor_dynamic;
     
     vec3 R_point = reflect(-lightDirN, N);
-    float spec_point = pow(max(dot(V, R_point), 0.0), shininess);
-    vec3 specular_point = specularStrength * spec_point * pointLightColor_dynamic;
+    float spec_point = pow(max(dot(V, R_point), 0.0), materialShininess);
+    vec3 specular_point = materialSpecular * spec_point * pointLightColor_dynamic;
 
     vec3 ambient_point = 0.2 * pointLightColor_dynamic;
 
+    float pointShadow = PointShadowCalculation(N, lightDirN);
+
     diffuse_point *= att;
     specular_point *= att;
     ambient_point *= att;
 
     vec3 result = ambient * textColor + ambient_point * textColor; 
     result += (1.0 - shadow) * (diffuse + specular) * textColor; // directional light WITH SHADOWS
-    result += (diffuse_point + specular_point) * textColor; // point light
-    result *= objectLightMultiplier;
+    result += (1.0 - pointShadow) * (diffuse_point + specular_point) * textColor; // point light WITH SHADOWS
+    result *= lightMultiplier;
 
     fragmentColour = vec4(result, 1.0);
 }
@@ -3,32 +3,189 @@
 layout(location = 0) in vec3 vertexPosition;
 layout(location = 1) in vec3 vertexNormal;   
 layout(location = 2) in vec2 textcoord;
+layout(location = 3) in mat4 instanceModel; // per instance, replaces model in instanced draws
+layout(location = 7) in float vertexPart; // animated parts only
+layout(location = 8) in vec4 terrainNode; // terrain only: origin x, origin z, size, level + 16 * quadrants
+layout(location = 9) in float drawIndex; // multi-draw only: the draw, through the base instance
 
 out vec3 fragPosEye; // fragment position in eye space
 out vec3 normalEye; // normal in eye space
 out vec2 passTexture;
 out vec4 fragPosLightSpace; // for shadow mapping
+out vec4 fragPosMovingLightSpace; // the sun's tile of the moving casters
+out vec3 fragPosWorld; // for point light shadows
+out vec2 passTerrainPosition; // terrain only: x, z in the terrain's space
+flat out vec3 passMaterial; // multi-draw only: light multiplier, shininess, specular strength
 
 uniform mat4 model;
 uniform mat4 view;
 uniform mat4 projection;
 //uniform mat3 normalMatrix;
 uniform mat4 lightSpaceMatrix;
+uniform mat4 movingLightSpaceMatrix;
+uniform bool instanced;
+uniform mat4 instanceSpace; // what instanceModel is relative to: identity, the terrain's model for the scatter
+uniform bool animatedParts;
+uniform float partTime;
+uniform samplerBuffer partData;
+uniform samplerBuffer instanceData;
+uniform int instanceFirst; // texels before the instances in instanceData
+
+// multi-draw (see MultiDrawRenderer): the transform and material of every draw in a texture buffer
+uniform bool multiDraw;
+uniform bool drawIndirect; // drawIndex is set, else the draw is found from gl_VertexID
+uniform samplerBuffer drawData;
+uniform int drawFirst; // the draws of this call, sorted by first vertex
+uniform int drawCount;
+
+// terrain (see TerrainRenderer): the grid of a node lifted from the height texture
+uniform bool terrain;
+uniform sampler2D terrainHeights;
+uniform vec2 terrainOrigin;
+uniform float terrainSpacing;
+uniform vec2 terrainSize; // samples along x and z
+uniform float terrainGridSize;
+uniform vec2 terrainMorph[12]; // per level: morph start, 1 / (end - start)
+uniform vec3 terrainCamera;
+
+// the last draw of the call starting at or before the vertex
+int multiDrawIndex()
+{
+    if (drawIndirect)
+        return int(drawIndex + 0.5);
+
+    int low = drawFirst;
+    int high = drawFirst + drawCount - 1;
+    while (low < high) {
+        int middle = (low + high + 1) / 2;
+        if (texelFetch(drawData, 5 * middle + 4).w <= float(gl_VertexID))
+            low = middle;
+        else
+            high = middle - 1;
+    }
+    return low;
+}
+
+mat4 drawModelMatrix(int draw)
+{
+    int base = 5 * draw;
+    return mat4(texelFetch(drawData, base), texelFetch(drawData, base + 1),
+        texelFetch(drawData, base + 2), texelFetch(drawData, base + 3));
+}
+
+// animated rigid parts: the instance matrix times the swing of the part around its pivot
+// (see RigidPartModel for the layout of the buffers)
+mat4 partModelMatrix()
+{
+    int part = int(vertexPart + 0.5);
+    vec4 pivot = texelFetch(partData, 2 * part);     // xyz pivot, w amplitude
+    vec4 axis = texelFetch(partData, 2 * part + 1);  // xyz axis, w frequency
+
+    int base = instanceFirst + 5 * gl_InstanceID;
+    mat4 instance = mat4(texelFetch(instanceData, base), texelFetch(instanceData, base + 1),
+        texelFetch(instanceData, base + 2), texelFetch(instanceData, base + 3));
+    float phase = texelFetch(instanceData, base + 4).x;
+
+    // Rodrigues
+    float angle = pivot.w * sin(axis.w * partTime + phase);
+    float c = cos(angle);
+    float s = sin(angle);
+    vec3 a = axis.xyz;
+    mat3 rotation = mat3(c) + s * mat3(0.0, a.z, -a.y, -a.z, 0.0, a.x, a.y, -a.x, 0.0) + (1.0 - c) * outerProduct(a, a);
+
+    mat4 swing = mat4(vec4(rotation[0], 0.0), vec4(rotation[1], 0.0), vec4(rotation[2], 0.0),
+        vec4(pivot.xyz - rotation * pivot.xyz, 1.0));
+    return instance * swing;
+}
+
+// the inverse transpose of the upper 3x3, up to a positive scale: its cofactors,
+// three cross products instead of an inverse, right for any scale or mirror
+mat3 normalMatrixOf(mat4 m)
+{
+    mat3 cofactors = mat3(cross(m[1].xyz, m[2].xyz), cross(m[2].xyz, m[0].xyz), cross(m[0].xyz, m[1].xyz));
+    return dot(m[0].xyz, cofactors[0]) < 0.0 ? -cofactors : cofactors;
+}
+
+vec2 terrainCoord(vec2 position)
+{
+    return ((position - terrainOrigin) / terrainSpacing + 0.5) / terrainSize;
+}
+
+float terrainHeight(vec2 position)
+{
+    return texture(terrainHeights, terrainCoord(position)).r;
+}
+
+void terrainVertex()
+{
+    int level = int(terrainNode.w + 0.5) & 15;
+    int quadrants = int(terrainNode.w + 0.5) >> 4;
+
+    // a quadrant the children draw goes outside the view, its triangles are clipped
+    if ((quadrants & (1 << int(vertexPosition.y + 0.5))) == 0) {
+        gl_Position = vec4(2.0, 2.0, 2.0, 1.0);
+        return;
+    }
+
+    vec2 grid = vertexPosition.xz;
+    vec2 position = terrainNode.xy + grid * terrainNode.z;
+    float dist = distance(vec3(position.x, terrainHeight(position), position.y), terrainCamera);
+
+    // towards the end of its range the vertex slides onto the grid of the level above
+    vec2 morph = terrainMorph[level];
+    float k = clamp((dist - morph.x) * morph.y, 0.0, 1.0);
+    grid -= fract(grid * terrainGridSize * 0.5) * 2.0 / terrainGridSize * k;
+
+    // the nodes on the edge stop at the last sample
+    position = clamp(terrainNode.xy + grid * terrainNode.z, terrainOrigin, terrainOrigin + (terrainSize - 1.0) * terrainSpacing);
+    vec4 worldPos = model * vec4(position.x, terrainHeight(position), position.y, 1.0);
+    fragPosWorld = worldPos.xyz;
+
+    vec4 posEye = view * worldPos;
+    fragPosEye = posEye.xyz;
+    fragPosLightSpace = lightSpaceMatrix * worldPos;
+    fragPosMovingLightSpace = movingLightSpaceMatrix * worldPos;
+
+    // central differences, one quad of the node apart
+    float quad = terrainNode.z / terrainGridSize;
+    float dx = terrainHeight(position + vec2(quad, 0.0)) - terrainHeight(position - vec2(quad, 0.0));
+    float dz = terrainHeight(position + vec2(0.0, quad)) - terrainHeight(position - vec2(0.0, quad));
+    vec3 normal = normalize(vec3(-dx, 2.0 * quad, -dz));
+    normalEye = mat3(view) * normalize(normalMatrixOf(model) * normal); // the view is rigid
+
+    // the fragment shader finds the tile and its texture coordinates
+    passTexture = vec2(0.0);
+    passTerrainPosition = position;
+    passMaterial = vec3(0.0);
+    gl_Position = projection * posEye;
+}
 
 void main()
 {
+    if (terrain) {
+        terrainVertex();
+        return;
+    }
+
+    int draw = multiDraw ? multiDrawIndex() : 0;
+    mat4 modelMatrix = multiDraw ? drawModelMatrix(draw) : (animatedParts ? partModelMatrix() : (instanced ? instanceSpace * instanceModel : model));
+    passMaterial = multiDraw ? texelFetch(drawData, 5 * draw + 4).xyz : vec3(0.0);
+
     // world space position
-    vec4 worldPos = model * vec4(vertexPosition, 1.0);
+    vec4 worldPos = modelMatrix * vec4(vertexPosition, 1.0);
+    fragPosWorld = worldPos.xyz;
 
     // view space position
     vec4 posEye = view * worldPos;
     fragPosEye = posEye.xyz;
     
     fragPosLightSpace = lightSpaceMatrix * worldPos;
+    fragPosMovingLightSpace = movingLightSpaceMatrix * worldPos;
 
-    normalEye = mat3(transpose(inverse(view * model))) * vertexNormal;
+    normalEye = mat3(view) * normalize(normalMatrixOf(modelMatrix) * vertexNormal); // the view is rigid
 
     passTexture = textcoord;
+    passTerrainPosition = vec2(0.0);
     gl_Position = projection * posEye;
     
 }
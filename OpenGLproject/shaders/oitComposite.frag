@@ -0,0 +1,89 @@
+#version 410 core
+
+// Resolves the weighted blended transparency over the opaque scene
+// (blended with GL_ONE_MINUS_SRC_ALPHA, GL_SRC_ALPHA).
+// The transparent targets can be smaller than the screen: nearest-depth
+// upsampling, bilinear where the surrounding low resolution depths match
+// this pixel, otherwise the low resolution texel closest to it in depth.
+
+in vec2 uv;
+
+out vec4 fragmentColour;
+
+uniform sampler2D accumTexture;
+uniform sampler2D revealageTexture;
+uniform sampler2D lowResDepth;  // linear
+uniform sampler2D sceneDepth;   // full resolution, non linear
+uniform int divisor;
+uniform float nearPlane;
+uniform float farPlane;
+
+// relative depth difference still considered the same surface
+const float DEPTH_THRESHOLD = 0.1;
+
+float linearizeDepth(float depth)
+{
+    float z = depth * 2.0 - 1.0;
+    return 2.0 * nearPlane * farPlane / (farPlane + nearPlane - z * (farPlane - nearPlane));
+}
+
+void main()
+{
+    vec4 accum;
+    float revealage;
+
+    if (divisor == 1)
+    {
+        accum = texture(accumTexture, uv);
+        revealage = texture(revealageTexture, uv).r;
+    }
+    else
+    {
+        float depth = linearizeDepth(texelFetch(sceneDepth, ivec2(gl_FragCoord.xy), 0).r);
+
+        // the 4 low resolution texels the bilinear filter would use
+        vec2 lowSize = vec2(textureSize(lowResDepth, 0));
+        ivec2 maxCoord = textureSize(lowResDepth, 0) - 1;
+        ivec2 base = ivec2(floor(uv * lowSize - 0.5));
+
+        ivec2 nearestCoord = clamp(base, ivec2(0), maxCoord);
+        float nearestDifference = 1e30;
+        float maxDifference = 0.0;
+
+        for (int i = 0; i < 4; i++)
+        {
+            ivec2 coord = clamp(base + ivec2(i & 1, i >> 1), ivec2(0), maxCoord);
+            float difference = abs(texelFetch(lowResDepth, coord, 0).r - depth);
+            maxDifference = max(maxDifference, difference);
+            if (difference < nearestDifference)
+            {
+                nearestDifference = difference;
+                nearestCoord = coord;
+            }
+        }
+
+        if (maxDifference < DEPTH_THRESHOLD * depth)
+        {
+            accum = texture(accumTexture, uv);
+            revealage = texture(revealageTexture, uv).r;
+        }
+        else
+        {
+            // silhouette edge: no blur across it
+            accum = texelFetch(accumTexture, nearestCoord, 0);
+            revealage = texelFetch(revealageTexture, nearestCoord, 0).r;
+        }
+    }
+
+    // nothing transparent here, keep the background as it is
+    if (revealage >= 1.0)
+        discard;
+
+    // the half float sums can overflow with many layers
+    if (isinf(max(max(accum.r, accum.g), accum.b)))
+        accum.rgb = vec3(accum.a);
+
+    vec3 averageColor = accum.rgb / max(accum.a, 1e-5);
+
+    fragmentColour = vec4(averageColor, revealage);
+}
@@ -0,0 +1,12 @@
+#version 410 core
+
+// Full screen triangle, no vertex buffer: the corners come from gl_VertexID
+
+out vec2 uv;
+
+void main()
+{
+    vec2 corner = vec2((gl_VertexID << 1) & 2, gl_VertexID & 2);
+    uv = corner;
+    gl_Position = vec4(corner * 2.0 - 1.0, 0.0, 1.0);
+}
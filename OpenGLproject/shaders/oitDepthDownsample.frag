@@ -0,0 +1,33 @@
+#version 410 core
+
+// Reduces the scene depth to the particle target resolution: the farthest
+// depth of each divisor x divisor block goes to the depth buffer, and its
+// linear view depth to the color target (sampled by the soft particles and
+// by the upsample)
+
+out vec4 linearDepth;
+
+uniform sampler2D sceneDepth;
+uniform int divisor;
+uniform float nearPlane;
+uniform float farPlane;
+
+float linearizeDepth(float depth)
+{
+    float z = depth * 2.0 - 1.0;
+    return 2.0 * nearPlane * farPlane / (farPlane + nearPlane - z * (farPlane - nearPlane));
+}
+
+void main()
+{
+    ivec2 base = ivec2(gl_FragCoord.xy) * divisor;
+    ivec2 maxCoord = textureSize(sceneDepth, 0) - 1;
+
+    float farthest = 0.0;
+    for (int y = 0; y < divisor; y++)
+        for (int x = 0; x < divisor; x++)
+            farthest = max(farthest, texelFetch(sceneDepth, min(base + ivec2(x, y), maxCoord), 0).r);
+
+    gl_FragDepth = farthest;
+    linearDepth = vec4(linearizeDepth(farthest));
+}
@@ -0,0 +1,168 @@
+#version 410 core
+
+// Particle simulation - one vertex per particle, the outputs are captured
+// with transform feedback into the other buffer of the ping-pong pair
+
+layout(location = 0) in vec3 inPosition;
+layout(location = 1) in vec4 inColor;
+layout(location = 2) in float inSize;
+layout(location = 3) in float inLifeRatio;
+layout(location = 4) in vec3 inVelocity;
+layout(location = 5) in float inLife;    // < 0 while waiting for the first spawn
+layout(location = 6) in float inMaxLife;
+layout(location = 7) in float inType;    // 1 = fire, 0 = smoke
+
+out vec3 outPosition;
+out vec4 outColor;
+out float outSize;
+out float outLifeRatio;
+out vec3 outVelocity;
+out float outLife;
+out float outMaxLife;
+out float outType;
+
+uniform float deltaTime;
+uniform float time;
+uniform uint frameIndex;
+uniform vec3 emitterPos;
+uniform float densityScale; // alpha scale, keeps the brightness with many particles
+
+// ===== HASH RNG (PCG) =====
+uint pcgHash(uint v)
+{
+    uint state = v * 747796405u + 2891336453u;
+    uint word = ((state >> ((state >> 28u) + 4u)) ^ state) * 277803737u;
+    return (word >> 22u) ^ word;
+}
+
+uint rngState;
+
+// uniform float in [0, 1)
+float random()
+{
+    rngState = pcgHash(rngState);
+    return float(rngState) * (1.0 / 4294967296.0);
+}
+
+void respawn()
+{
+    // 80% fire, 20% smoke
+    bool isFire = random() < 0.8;
+    float angle = random() * 20.0 * 3.14159;
+
+    if (isFire)
+    {
+        float radius = sqrt(random()) * 85.0;
+        float yOffset = random() * 150.0;
+        outPosition = emitterPos + vec3(radius * cos(angle), yOffset, radius * sin(angle));
+
+        outVelocity = vec3((random() - 0.5) * 4.0,
+                           15.0 + random() * 10.0,
+                           (random() - 0.5) * 4.0);
+
+        // color based on the distance from the center
+        float distanceRatio = radius / 150.0;
+        if (distanceRatio < 0.1)
+            outColor = vec4(1.0, 1.0, 0.4, 1.0);   // center - yellow
+        else if (distanceRatio < 0.65)
+            outColor = vec4(1.0, 0.5, 0.1, 0.9);   // middle - orange
+        else
+            outColor = vec4(0.95, 0.2, 0.05, 0.8); // edge - red
+
+        outSize = 20.0 + random() * 30.0;
+        outMaxLife = 0.5 + random() * 0.4;
+        outType = 1.0;
+    }
+    else
+    {
+        float radius = sqrt(random()) * 150.0;
+        float yOffset = 200.0 + random() * 1000.0;
+        outPosition = emitterPos + vec3(radius * cos(angle), yOffset, radius * sin(angle));
+
+        outVelocity = vec3((random() - 0.5) * 10.0,
+                           8.0 + random() * 25.0,
+                           (random() - 0.5) * 12.0);
+
+        float darkness = 0.1 + random() * 0.2;
+        outColor = vec4(darkness, darkness, darkness, 0.3);
+
+        outSize = 70.0 + random() * 70.0;
+        outMaxLife = 2.5 + random() * 1.5;
+        outType = 0.0;
+    }
+
+    outLife = outMaxLife;
+}
+
+void simulate()
+{
+    outPosition = inPosition + inVelocity * deltaTime;
+    outVelocity = inVelocity;
+    outSize = inSize;
+    outColor = inColor;
+    outMaxLife = inMaxLife;
+    outType = inType;
+
+    float lifeRatio = outLife / outMaxLife;
+
+    if (inType > 0.5)
+    {
+        // fire - small turbulence and gravity
+        outVelocity.x += (random() - 0.5) * 10.0 * deltaTime;
+        outVelocity.z += (random() - 0.5) * 10.0 * deltaTime;
+        outVelocity.y -= 3.0 * deltaTime;
+
+        if (lifeRatio > 0.7)
+            outColor = vec4(1.0, 1.0, 0.4, 1.0);
+        else if (lifeRatio > 0.4)
+            outColor = vec4(1.0, 0.5 + (lifeRatio - 0.4) * 1.67, 0.1, 0.9);
+        else
+            outColor = vec4(1.0, 0.2 * (lifeRatio / 0.4), 0.0, lifeRatio * 2.0);
+    }
+    else
+    {
+        // smoke - expands and rises, friction tuned for 60 fps
+        float friction = pow(0.97, deltaTime * 60.0);
+        outVelocity.x *= friction;
+        outVelocity.z *= friction;
+        outVelocity.y += 2.0 * deltaTime;
+
+        outSize += 60.0 * deltaTime;
+
+        float brightness = 0.4 + (1.0 - lifeRatio) * 0.3;
+        outColor = vec4(vec3(brightness), lifeRatio * 0.3);
+    }
+}
+
+void main()
+{
+    rngState = pcgHash(uint(gl_VertexID) ^ pcgHash(frameIndex));
+
+    if (inLife < 0.0)
+    {
+        // waiting for the first spawn
+        outLife = inLife + deltaTime;
+        if (outLife >= 0.0)
+            respawn();
+        else
+        {
+            outPosition = inPosition;
+            outVelocity = inVelocity;
+            outColor = vec4(0.0);
+            outSize = 0.0;
+            outMaxLife = inMaxLife;
+            outType = inType;
+        }
+    }
+    else
+    {
+        outLife = inLife - deltaTime;
+        if (outLife <= 0.0)
+            respawn(); // a dead particle is replaced right away, the count stays constant
+        else
+            simulate();
+    }
+
+    outLifeRatio = max(outLife, 0.0) / outMaxLife;
+    outColor.a *= densityScale;
+}
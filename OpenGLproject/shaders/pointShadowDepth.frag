@@ -0,0 +1,12 @@
+#version 410 core
+
+in vec4 fragPos;
+
+uniform vec3 lightPos;
+uniform float farPlane;
+
+void main()
+{
+    // linear distance to the light, mapped to [0,1]
+    gl_FragDepth = length(fragPos.xyz - lightPos) / farPlane;
+}
@@ -0,0 +1,43 @@
+#version 410 core
+
+layout(location = 0) in vec3 vertexPosition;
+layout(location = 7) in float vertexPart; // animated parts only
+
+uniform mat4 model;
+uniform bool animatedParts;
+uniform float partTime;
+uniform samplerBuffer partData;
+uniform samplerBuffer instanceData;
+uniform int instanceFirst; // texels before the instances in instanceData
+
+// animated rigid parts: the instance matrix times the swing of the part around its pivot
+// (see RigidPartModel for the layout of the buffers)
+mat4 partModelMatrix()
+{
+    int part = int(vertexPart + 0.5);
+    vec4 pivot = texelFetch(partData, 2 * part);     // xyz pivot, w amplitude
+    vec4 axis = texelFetch(partData, 2 * part + 1);  // xyz axis, w frequency
+
+    int base = instanceFirst + 5 * gl_InstanceID;
+    mat4 instance = mat4(texelFetch(instanceData, base), texelFetch(instanceData, base + 1),
+        texelFetch(instanceData, base + 2), texelFetch(instanceData, base + 3));
+    float phase = texelFetch(instanceData, base + 4).x;
+
+    // Rodrigues
+    float angle = pivot.w * sin(axis.w * partTime + phase);
+    float c = cos(angle);
+    float s = sin(angle);
+    vec3 a = axis.xyz;
+    mat3 rotation = mat3(c) + s * mat3(0.0, a.z, -a.y, -a.z, 0.0, a.x, a.y, -a.x, 0.0) + (1.0 - c) * outerProduct(a, a);
+
+    mat4 swing = mat4(vec4(rotation[0], 0.0), vec4(rotation[1], 0.0), vec4(rotation[2], 0.0),
+        vec4(pivot.xyz - rotation * pivot.xyz, 1.0));
+    return instance * swing;
+}
+
+void main()
+{
+    // world space, the geometry shader projects it for every cube face
+    mat4 modelMatrix = animatedParts ? partModelMatrix() : model;
+    gl_Position = modelMatrix * vec4(vertexPosition, 1.0);
+}
@@ -0,0 +1,44 @@
+#version 410 core
+
+in vec2 uv;
+in float fade;
+in float viewDepth;
+
+layout(location = 0) out vec4 fragmentColour;
+layout(location = 1) out vec4 oitRevealage; // only written to by the OIT targets
+
+uniform bool pointLayer;
+uniform bool oitOn;
+
+const vec3 SNOW_COLOR = vec3(0.95, 0.97, 1.0);
+
+// same weight as the fire particles, they share the OIT targets
+float oitWeight(float alpha)
+{
+    float z = viewDepth / 100.0;
+    return alpha * clamp(10.0 / (1e-5 + pow(z / 5.0, 2.0) + pow(z / 200.0, 6.0)), 1e-2, 3e3);
+}
+
+void main()
+{
+    vec2 coord = (pointLayer ? gl_PointCoord : uv) - vec2(0.5);
+    float dist = length(coord);
+
+    if (dist > 0.5)
+        discard;
+
+    // soft round flake
+    float alpha = (1.0 - dist * 2.0) * 0.9 * fade;
+
+    if (alpha < 0.01)
+        discard;
+
+    if (oitOn)
+    {
+        fragmentColour = vec4(SNOW_COLOR * alpha, alpha) * oitWeight(alpha);
+        oitRevealage = vec4(alpha);
+        return;
+    }
+
+    fragmentColour = vec4(SNOW_COLOR, alpha);
+}
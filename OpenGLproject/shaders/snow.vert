@@ -0,0 +1,101 @@
+#version 410 core
+
+// Snow flakes without any vertex buffer: the position of a flake is a
+// function of its id and the time, wrapped into a box around the camera
+
+out vec2 uv;
+out float fade;
+out float viewDepth; // for the OIT weight
+
+uniform mat4 view;
+uniform mat4 projection;
+uniform vec3 cameraPos;
+uniform float time;
+
+uniform bool pointLayer;      // far layer: one point per flake, otherwise a quad per instance
+uniform float volumeSize;     // side of the box of this layer
+uniform float nearVolumeSize; // the far layer leaves this box to the quads
+uniform float flakeSize;
+uniform float fallSpeed;
+uniform vec3 wind;
+uniform float viewportHeight;
+
+// ===== HASH (PCG) =====
+uint pcgHash(uint v)
+{
+    uint state = v * 747796405u + 2891336453u;
+    uint word = ((state >> ((state >> 28u) + 4u)) ^ state) * 277803737u;
+    return (word >> 22u) ^ word;
+}
+
+float hashFloat(inout uint state)
+{
+    state = pcgHash(state);
+    return float(state) * (1.0 / 4294967296.0);
+}
+
+const vec2 corners[6] = vec2[6](
+    vec2(-1.0, -1.0), vec2(1.0, -1.0), vec2(1.0, 1.0),
+    vec2(-1.0, -1.0), vec2(1.0, 1.0), vec2(-1.0, 1.0)
+);
+
+void main()
+{
+    int id = pointLayer ? gl_VertexID : gl_InstanceID;
+    // the two layers must not share flakes
+    uint state = uint(id) ^ (pointLayer ? 0x9E3779B9u : 0u);
+
+    vec3 start = vec3(hashFloat(state), hashFloat(state), hashFloat(state)) * volumeSize;
+    float speed = fallSpeed * (0.6 + 0.8 * hashFloat(state));
+    float phase = hashFloat(state) * 6.2831853;
+    float sizeScale = 0.6 + 0.8 * hashFloat(state);
+
+    // falling with the wind and a slow sideways wobble
+    vec3 pos = start + (wind - vec3(0.0, speed, 0.0)) * time;
+    pos.x += sin(time * 1.3 + phase) * 15.0;
+    pos.z += cos(time * 1.1 + phase) * 15.0;
+
+    // wrapped into the box centered on the camera
+    vec3 offset = mod(pos - cameraPos, volumeSize) - volumeSize * 0.5;
+    vec3 worldPos = cameraPos + offset;
+
+    // fades out near the faces of the box so the wrapping never pops
+    float boxDistance = max(abs(offset.x), max(abs(offset.y), abs(offset.z))) / (volumeSize * 0.5);
+    fade = 1.0 - smoothstep(0.8, 1.0, boxDistance);
+
+    float size = flakeSize * sizeScale;
+
+    if (pointLayer)
+    {
+        // the near box belongs to the quads
+        if (all(lessThan(abs(offset), vec3(nearVolumeSize * 0.5))))
+        {
+            gl_Position = vec4(2.0, 2.0, 2.0, 1.0); // outside the clip volume
+            gl_PointSize = 1.0;
+            uv = vec2(0.5);
+            viewDepth = 0.0;
+            return;
+        }
+
+        vec4 viewPos = view * vec4(worldPos, 1.0);
+        viewDepth = -viewPos.z;
+        gl_Position = projection * viewPos;
+        // projected diameter in pixels; below one pixel the flake gets fainter instead of smaller
+        float pixels = size * 2.0 * projection[1][1] * viewportHeight * 0.5 / max(gl_Position.w, 1.0);
+        gl_PointSize = clamp(pixels, 1.0, 4.0);
+        fade *= clamp(pixels, 0.1, 1.0);
+        uv = vec2(0.5);
+    }
+    else
+    {
+        vec2 corner = corners[gl_VertexID];
+        vec3 cameraRight = vec3(view[0][0], view[1][0], view[2][0]);
+        vec3 cameraUp    = vec3(view[0][1], view[1][1], view[2][1]);
+        worldPos += (cameraRight * corner.x + cameraUp * corner.y) * size;
+
+        vec4 viewPos = view * vec4(worldPos, 1.0);
+        viewDepth = -viewPos.z;
+        gl_Position = projection * viewPos;
+        uv = corner * 0.5 + 0.5;
+    }
+}